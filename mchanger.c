@@ -19,7 +19,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #define VENDOR_KEY CFSTR("Vendor Identification")
 #define PRODUCT_KEY CFSTR("Product Identification")
@@ -29,6 +40,22 @@ typedef enum {
     BACKEND_SBP2 = 1
 } BackendType;
 
+#define TRANSPORT_LOCKS 8       // robots with their own lock; addresses beyond share by modulo
+#define ANY_TRANSPORT 0xFFFF    // batches choose a robot per move (pick_transport())
+
+// Locks for a device shared by several threads; the CLI runs on one thread
+// and leaves them out, except while a batch runs robots in parallel
+typedef struct {
+    pthread_mutex_t transport[TRANSPORT_LOCKS]; // one MOVE MEDIUM in flight per robot
+    int busy[TRANSPORT_LOCKS];  // moves holding or waiting for each robot (atomic)
+    int in_flight;              // moves executing on any robot (atomic)
+    bool serial_moves;          // device refused a move while another robot's was in flight
+    pthread_mutex_t serial;     // held by every move once serial_moves is set
+    pthread_mutex_t motion;     // the motion log, which moves on any robot append to
+    pthread_mutex_t sbp2;       // an SBP2 login reports one command's status at a time
+    pthread_mutex_t door;       // door_locks and the PREVENT/ALLOW it sends
+} DeviceLocks;
+
 typedef struct {
     BackendType backend;
     io_service_t service;
@@ -36,12 +63,49 @@ typedef struct {
     bool has_exclusive;
     IOFireWireSBP2LibLUNInterface **sbp2_lun;
     IOFireWireSBP2LibLoginInterface **sbp2_login;
+    bool curdata_unsupported;   // device rejected READ ELEMENT STATUS with CURDATA set (atomic)
+    bool dvcid_unsupported;     // device rejected READ ELEMENT STATUS with DVCID set (atomic)
+    CFRunLoopRef sbp2_runloop;  // run loop SBP2 completions are delivered on
+    struct MotionLog *motion;   // optional; successful moves are timed into it
+    struct StatusBoard *board;  // optional; successful moves are published to it
+    DeviceLocks *locks;         // NULL when only one thread uses the device
+    uint64_t generation;        // bumped (atomically) by every move made through this handle
+    uint64_t *moved_at[256];    // generation of each address's last move, 256 addresses a page (see element_moved_at())
+    bool moves_untracked;       // a page could not be allocated; only generation tells moves apart
+    bool quiet;                 // no per-command chatter; set before the handle is shared (else CDB_QUIET)
+    int door_locks;             // batches holding PREVENT MEDIUM REMOVAL (see door_lock())
+    int api_door_locks;         // of those, held through mchanger_set_door_lock()
+    bool prevent_unsupported;   // device rejected PREVENT ALLOW MEDIUM REMOVAL
 } ChangerHandle;
 
+// How one command ended, for the caller that sent it. Threads sharing a
+// handle each get their own, so one's sense never shows up in another's.
 typedef struct {
-    uint16_t *addrs;
-    size_t count;
-    size_t cap;
+    uint8_t status;             // SCSI status byte; CDB_NO_STATUS if the command never completed
+    uint8_t sense_key;          // sense when status is CHECK CONDITION; otherwise zero
+    uint8_t asc;
+    uint8_t ascq;
+} CdbStatus;
+
+#define CDB_NO_STATUS 0xFF
+#define CDB_QUIET 0x01          // execute_cdb_ex() option: no per-command chatter
+
+// A run of consecutive element addresses, starting at list index `index`
+typedef struct {
+    uint32_t index;
+    uint16_t first;
+    uint16_t count;
+} ElementRun;
+
+// The addresses of one element type, as runs: changers number each type
+// contiguously, so a list is one run however large the library, and a gap
+// only starts another run. See element_addr() and element_list_index().
+typedef struct {
+    ElementRun *runs;
+    size_t run_count;
+    size_t run_cap;
+    size_t count;               // elements across all runs
+    bool unordered;             // some run starts below the one before it
 } ElementList;
 
 typedef struct {
@@ -49,8 +113,114 @@ typedef struct {
     ElementList slots;
     ElementList drives;
     ElementList ie;
+    bool short_of_memory;       // an address could not be stored; the map is incomplete
 } ElementMap;
 
+// Where the drives sit among the slots (see Slot Placement)
+typedef struct {
+    int near_slot;              // slot closest to the drives; 0 for slot 1
+    bool ring;                  // slots form a carousel, so distance wraps around
+} SlotLayout;
+
+// Drives whose use is tracked per handle (residency, idle return); further
+// drives are left alone
+#define MAX_TRACKED_DRIVES 16
+
+// Slot numbers, least recently used first
+typedef struct {
+    int slots[2 * MAX_TRACKED_DRIVES];
+    size_t count;
+} SlotList;
+
+typedef struct {
+    uint64_t last_use;          // residency clock tick of the last auto load or hit
+    uint32_t uses;
+} SlotHistory;
+
+// Access history behind mchanger_load_slot_auto(). ARC keeps discs seen once
+// (t1) apart from discs seen again (t2); b1/b2 remember recently evicted ones
+// and steer arc_target, the share of the drives t1 may hold.
+typedef struct {
+    MChangerResidencyPolicy policy;
+    uint64_t clock;
+    SlotHistory *history;       // indexed by slot - 1
+    size_t history_len;
+    SlotList t1, t2, b1, b2;
+    size_t arc_target;
+    MChangerResidencyStats stats;
+} Residency;
+
+// Background return of idle discs. Media operations stamp last_activity when
+// they claim elements; lock guards the fields below while the thread runs.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool running;
+    bool stopping;
+    int idle_secs;
+    double last_activity;                       // monotonic seconds
+    int returned_slot[MAX_TRACKED_DRIVES];      // slot last sent home from each drive, 0 if none
+    MChangerIdleStats stats;
+} IdleReturn;
+
+// Inventory read in the background from mchanger_open_ex() (see Inventory
+// Prefetch). lock guards the fields below while the thread runs.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool running;               // started and not yet joined
+    bool stopping;
+    MChangerPrefetchState state;
+    struct Inventory *inv;      // set once state is READY
+    uint64_t generation;        // moves made through the handle before the status read
+    uint64_t updated_ms;
+} Prefetch;
+
+// An element claimed by a thread; claims nest within that thread
+typedef struct {
+    uint16_t addr;
+    pthread_t owner;
+    unsigned depth;
+} ElementClaim;
+
+// Elements held by operations in flight (see Element reservations). Calls on
+// disjoint elements proceed together; a whole-changer call waits for, and
+// then excludes, every other claim.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ElementClaim *claims;
+    size_t count;
+    size_t cap;
+    pthread_t exclusive_owner;
+    unsigned exclusive_depth;
+    size_t exclusive_waiting;   // new claims wait behind these
+    bool ready;                 // initialised only by mchanger_open_ex()
+} Reservations;
+
+/* Internal handle is compatible with public handle */
+struct MChangerHandle {
+    ChangerHandle internal;
+    MChangerCatalog *catalog;   // optional; updated as discs are identified and moved
+    Residency residency;
+    IdleReturn idle;            // lock/cond are initialised only by mchanger_open_ex()
+    Prefetch prefetch;          // likewise
+    Reservations reservations;
+    DeviceLocks locks;          // internal.locks points here once opened
+    SlotLayout layout;
+    ElementMap map;             // cached by handle_map(); fixed while the device is open
+    bool have_map;
+};
+
+// READ ELEMENT STATUS byte 6 flags (SMC-3)
+#define RES_DVCID   0x01 // report device identifiers for data transfer elements
+#define RES_CURDATA 0x02 // report from changer memory; never move the robot to verify
+#define RES_QUIET   0x40 // not a CDB bit: no per-command chatter (see execute_read_element_status())
+#define RES_FALLBACK 0x80 // not a CDB bit: a verifying read will do if CURDATA is unsupported
+#define RES_MEMORY  (RES_CURDATA | RES_FALLBACK) // from changer memory when the device can
+
 typedef struct {
     uint16_t first_transport;
     uint16_t num_transport;
@@ -73,6 +243,12 @@ static void parse_element_status(const uint8_t *buf, uint32_t len);
 static int cmd_inquiry_vpd(ChangerHandle *handle, uint8_t page);
 static int cmd_report_luns(ChangerHandle *handle);
 static int cmd_log_sense(ChangerHandle *handle, uint8_t page);
+static int cmd_prevent_removal(ChangerHandle *handle, bool prevent, CdbStatus *status);
+static void motion_record(struct MotionLog *log, uint16_t transport, uint16_t source, uint16_t dest, double ms);
+static void motion_close(struct MotionLog *log);
+static void board_record_move(struct StatusBoard *board, uint16_t source, uint16_t dest);
+static const ElementMap *handle_map(MChangerHandle *changer);
+static const ElementMap *handle_map_read(MChangerHandle *changer);
 
 static void print_usage(const char *argv0) {
     fprintf(stderr,
@@ -92,14 +268,34 @@ static void print_usage(const char *argv0) {
         "  %s init-status\n"
         "  %s read-element-status --element-type <all|transport|storage|ie|drive>\n"
         "                           --start <addr> --count <n> --alloc <bytes> [--raw]\n"
+        "                           [--curdata] [--dvcid]\n"
         "  %s list-map\n"
         "  %s sanity-check\n"
-        "  %s insert --slot <n> [--transport <addr>]     (IE port -> slot)\n"
+        "  %s insert --slot <n|auto> [--hot] [--transport <addr>]  (IE port -> slot)\n"
         "  %s retrieve --slot <n> [--transport <addr>]   (slot -> IE port)\n"
+        "  %s ingest [--count <n>] [--idle <secs>] [--hot] [--identify [--drive <n>]]\n"
+        "                                     (store each disc fed into the IE port in a free slot)\n"
+        "  %s export --slots <list> [--transport <addr>]  (e.g. 10-50,77; each disc out through the IE port)\n"
         "  %s load --slot <n> [--drive <n>] [--transport <addr>]   (slot -> drive)\n"
         "  %s unload --slot <n> [--drive <n>] [--transport <addr>] (drive -> slot)\n"
         "  %s eject --slot <n> [--drive <n>] [--transport <addr>]  (load, eject, unload)\n"
         "  %s move --transport <addr> --source <addr> --dest <addr> (low-level)\n"
+        "  %s scan-library [--restart] [--timeout <secs>] (fingerprint every slot into the catalog)\n"
+        "  %s rebalance [--moves <n>]                      (move often-loaded discs toward the drives)\n"
+        "  %s calibrate [--moves <n>]                      (time probing moves; print the motion model)\n"
+        "  %s door lock|unlock                              (PREVENT/ALLOW MEDIUM REMOVAL; batches do this)\n"
+        "  %s snapshot [--out <file>]                      (save the inventory for offline planning)\n"
+        "  %s plan [--inventory <file>] [--ops <file>] [--save <file>]\n"
+        "                                     (simulate operations against a snapshot; no device access)\n"
+        "  %s board [--name <shm name>]                    (inventory published by a running service)\n"
+        "  %s watch [--interval <secs>] [--board [<shm name>]]\n"
+        "                                     (report I/E, drive, slot and door changes as they happen)\n"
+        "  %s fetch --slot <n> [--drive <n>]               (path to a cached image; loads and images on a miss)\n"
+        "  %s cache [list | evict --fingerprint <hex>]    (no device access)\n"
+        "  %s identify [--drive <n>] [--timeout <secs>]    (disc fingerprint, no mount)\n"
+        "  %s catalog [list | show --slot <n> | find --volume <name> | find --fingerprint <hex>\n"
+        "              | find --file <name> | index --slot <n> [--path <mount>]\n"
+        "              | forget --slot <n>]                  (no device access)\n"
         "\n"
         "Notes:\n"
         "- Addresses are element addresses from READ ELEMENT STATUS.\n"
@@ -108,13 +304,48 @@ static void print_usage(const char *argv0) {
         "- Use --dry-run to show resolved element addresses without moving media.\n"
         "- Use --confirm to require interactive confirmation before moving media.\n"
         "- Use --debug to print IORegistry details for troubleshooting.\n"
-        "- Use --verbose or -v to show mounted disc info during load/unload.\n",
-        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0
+        "- Use --verbose or -v to show mounted disc info during load/unload.\n"
+        "  Loaded discs are fingerprinted and recorded in the catalog; a load is\n"
+        "  also checked against the slot's recorded fingerprint when there is one.\n"
+        "- Use --catalog <path> to use a catalog other than ~/.mchanger/catalog.tsv.\n"
+        "- Use --cache-dir <dir> and --cache-max-gb <n> to place and bound the image cache\n"
+        "  (default ~/.mchanger/images, 20 GB).\n"
+        "- Use --near-slot <n> to name the slot closest to the drives (default 1) and --ring\n"
+        "  for carousel changers; insert --slot auto and rebalance place discs by this distance.\n"
+        "- read-element-status --curdata answers from changer memory without robot motion;\n"
+        "  --dvcid adds drive device identifiers.\n"
+        "- plan reads operations written as commands without the program name, one per\n"
+        "  line (e.g. load --slot 12 --drive 2), from --ops or standard input; rebalance\n"
+        "  uses the load counts in --catalog.\n",
+        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0,
+        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0
     );
 }
 
 static bool g_debug = false;
 static bool g_verbose = false;
+static volatile sig_atomic_t g_stop = 0;    // set by Ctrl-C during long-running commands
+static ChangerHandle *volatile g_door_holder = NULL;    // handle whose PREVENT MEDIUM REMOVAL is in force
+
+// The first Ctrl-C lets a batch finish its current move and clean up (put
+// discs back, unlock the door); a second one ends the process at once. The
+// changer may keep a PREVENT MEDIUM REMOVAL after the process is gone, so the
+// door is allowed open first. The handler is reset beforehand: if the device
+// doesn't answer, a third Ctrl-C still ends the process.
+static void stop_signal(int sig) {
+    if (g_stop) {
+        signal(sig, SIG_DFL);
+        ChangerHandle *held = g_door_holder;
+        if (held) cmd_prevent_removal(held, false, NULL);
+        raise(sig);
+    }
+    g_stop = 1;
+}
+
+static void catch_stop_signals(bool on) {
+    signal(SIGINT, on ? stop_signal : SIG_DFL);
+    signal(SIGTERM, on ? stop_signal : SIG_DFL);
+}
 
 static bool cfstring_equals(CFTypeRef value, const char *expected) {
     if (!value || CFGetTypeID(value) != CFStringGetTypeID()) {
@@ -722,6 +953,17 @@ static bool runloop_wait(bool *done_flag, double timeout_seconds) {
     return true;
 }
 
+// SBP2 completions arrive on the run loop the LUN is bound to, and
+// runloop_wait() only runs the calling thread's loop. Another thread must
+// bind its own loop before sending commands, and bind the old one back after.
+static void sbp2_bind_runloop(ChangerHandle *handle, CFRunLoopRef runloop) {
+    if (handle->backend != BACKEND_SBP2 || !handle->sbp2_lun || !runloop) return;
+    if (handle->sbp2_runloop == runloop) return;
+    (*handle->sbp2_lun)->removeCallbackDispatcherFromRunLoop(handle->sbp2_lun);
+    (*handle->sbp2_lun)->addCallbackDispatcherToRunLoop(handle->sbp2_lun, runloop);
+    handle->sbp2_runloop = runloop;
+}
+
 static ChangerHandle open_sbp2_lun_from_service(io_service_t service) {
     ChangerHandle handle = {0};
     handle.backend = BACKEND_SBP2;
@@ -798,6 +1040,7 @@ static ChangerHandle open_sbp2_lun_from_service(io_service_t service) {
     }
 
     (*handle.sbp2_lun)->addCallbackDispatcherToRunLoop(handle.sbp2_lun, CFRunLoopGetCurrent());
+    handle.sbp2_runloop = CFRunLoopGetCurrent();
 
     IUnknownVTbl **login_unknown = (*handle.sbp2_lun)->createLogin(
         handle.sbp2_lun,
@@ -882,6 +1125,7 @@ static ChangerHandle open_changer(bool require_sony) {
 
 static void close_changer(ChangerHandle *handle) {
     if (!handle) return;
+    if (g_door_holder == handle) g_door_holder = NULL;
     if (handle->backend == BACKEND_SCSITASK && handle->scsi_device) {
         if (handle->has_exclusive) {
             (*handle->scsi_device)->ReleaseExclusiveAccess(handle->scsi_device);
@@ -902,6 +1146,12 @@ static void close_changer(ChangerHandle *handle) {
         IOObjectRelease(handle->service);
         handle->service = IO_OBJECT_NULL;
     }
+    motion_close(handle->motion);
+    handle->motion = NULL;
+    for (size_t i = 0; i < 256; i++) {
+        free(handle->moved_at[i]);
+        handle->moved_at[i] = NULL;
+    }
 }
 
 static void dump_hex(const uint8_t *buf, size_t len) {
@@ -916,10 +1166,12 @@ static void dump_hex(const uint8_t *buf, size_t len) {
 
 static void element_list_free(ElementList *list) {
     if (!list) return;
-    free(list->addrs);
-    list->addrs = NULL;
+    free(list->runs);
+    list->runs = NULL;
+    list->run_count = 0;
+    list->run_cap = 0;
     list->count = 0;
-    list->cap = 0;
+    list->unordered = false;
 }
 
 static void element_map_free(ElementMap *map) {
@@ -928,19 +1180,95 @@ static void element_map_free(ElementMap *map) {
     element_list_free(&map->slots);
     element_list_free(&map->drives);
     element_list_free(&map->ie);
+    map->short_of_memory = false;
 }
 
-static void element_list_push(ElementList *list, uint16_t addr) {
-    if (list->count == list->cap) {
-        size_t new_cap = list->cap ? list->cap * 2 : 32;
-        uint16_t *next = realloc(list->addrs, new_cap * sizeof(uint16_t));
+// Returns false, leaving the list as it was, if memory ran out
+static bool element_list_push(ElementList *list, uint16_t addr) {
+    ElementRun *last = list->run_count ? &list->runs[list->run_count - 1] : NULL;
+    if (last && last->count < UINT16_MAX && (uint32_t)last->first + last->count == addr) {
+        last->count++;
+        list->count++;
+        return true;
+    }
+    bool unordered = list->unordered || (last && addr < last->first);
+    if (list->run_count == list->run_cap) {
+        size_t new_cap = list->run_cap ? list->run_cap * 2 : 4;
+        ElementRun *next = realloc(list->runs, new_cap * sizeof(ElementRun));
         if (!next) {
-            return;
+            return false;
+        }
+        list->runs = next;
+        list->run_cap = new_cap;
+    }
+    list->unordered = unordered;
+    list->runs[list->run_count++] = (ElementRun){ (uint32_t)list->count, addr, 1 };
+    list->count++;
+    return true;
+}
+
+static bool element_list_copy(ElementList *dst, const ElementList *src) {
+    *dst = (ElementList){0};
+    if (src->run_count == 0) return true;
+    dst->runs = malloc(src->run_count * sizeof(ElementRun));
+    if (!dst->runs) return false;
+    memcpy(dst->runs, src->runs, src->run_count * sizeof(ElementRun));
+    dst->run_count = src->run_count;
+    dst->run_cap = src->run_count;
+    dst->count = src->count;
+    dst->unordered = src->unordered;
+    return true;
+}
+
+// Returns false, with dst to be freed, if memory ran out
+static bool element_map_copy(ElementMap *dst, const ElementMap *src) {
+    bool ok = element_list_copy(&dst->transports, &src->transports);
+    ok = element_list_copy(&dst->slots, &src->slots) && ok;
+    ok = element_list_copy(&dst->drives, &src->drives) && ok;
+    return element_list_copy(&dst->ie, &src->ie) && ok;
+}
+
+// Address of the element at 0-based index: an offset into the run for a
+// single-run list, else a binary search of the runs' starting indexes
+static uint16_t element_addr(const ElementList *list, size_t index) {
+    if (list->run_count == 0) return 0;
+    if (list->run_count == 1) return (uint16_t)(list->runs[0].first + index);
+    size_t lo = 0, hi = list->run_count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (list->runs[mid].index <= index) lo = mid;
+        else hi = mid;
+    }
+    return (uint16_t)(list->runs[lo].first + (index - list->runs[lo].index));
+}
+
+// 1-based index of addr in list, or 0: the run's starting index plus the
+// offset into it. Runs in address order are binary searched; a list built out
+// of order falls back to a scan.
+static int element_list_index(const ElementList *list, uint16_t addr) {
+    size_t r = 0;
+    if (list->run_count > 1 && !list->unordered) {
+        size_t lo = 0, hi = list->run_count;
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (list->runs[mid].first <= addr) lo = mid;
+            else hi = mid;
         }
-        list->addrs = next;
-        list->cap = new_cap;
+        r = lo;
+    }
+    for (; r < list->run_count; r++) {
+        const ElementRun *run = &list->runs[r];
+        if (addr >= run->first && addr - run->first < run->count) return (int)(run->index + (addr - run->first)) + 1;
+        if (!list->unordered) break;
+    }
+    return 0;
+}
+
+// Every address in index order into out, which holds list->count
+static void element_list_expand(const ElementList *list, uint16_t *out) {
+    for (size_t r = 0; r < list->run_count; r++) {
+        for (uint16_t i = 0; i < list->runs[r].count; i++) *out++ = (uint16_t)(list->runs[r].first + i);
     }
-    list->addrs[list->count++] = addr;
 }
 
 static const char *sense_key_name(uint8_t sense_key) {
@@ -982,7 +1310,9 @@ static int execute_cdb_scsitask(
     void *buffer,
     uint32_t buffer_len,
     uint8_t direction,
-    uint32_t timeout_ms
+    uint32_t timeout_ms,
+    bool quiet,
+    CdbStatus *out
 ) {
     if (!handle || !handle->scsi_device) return 1;
 
@@ -1020,13 +1350,20 @@ static int execute_cdb_scsitask(
         fprintf(stderr, "ExecuteTaskSync failed: 0x%x\n", kr);
     }
 
+    bool check = status == kSCSITaskStatus_CHECK_CONDITION;
+    out->status = kr == kIOReturnSuccess ? (uint8_t)status : CDB_NO_STATUS;
+    out->sense_key = check ? (sense.SENSE_KEY & 0x0F) : 0;
+    out->asc = check ? sense.ADDITIONAL_SENSE_CODE : 0;
+    out->ascq = check ? sense.ADDITIONAL_SENSE_CODE_QUALIFIER : 0;
     if (status != kSCSITaskStatus_GOOD) {
-        fprintf(stderr, "SCSI task status: 0x%x\n", status);
-        print_sense(&sense);
-        fprintf(stderr, "Sense data:");
-        dump_hex((uint8_t *)&sense, sizeof(sense));
+        if (!quiet) {
+            fprintf(stderr, "SCSI task status: 0x%x\n", status);
+            print_sense(&sense);
+            fprintf(stderr, "Sense data:");
+            dump_hex((uint8_t *)&sense, sizeof(sense));
+        }
     } else {
-        if (buffer && buffer_len > 0) {
+        if (buffer && buffer_len > 0 && !quiet) {
             printf("Transferred %llu bytes.\n", (unsigned long long)transferred);
         }
     }
@@ -1042,7 +1379,9 @@ static int execute_cdb_sbp2(
     void *buffer,
     uint32_t buffer_len,
     uint8_t direction,
-    uint32_t timeout_ms
+    uint32_t timeout_ms,
+    bool quiet,
+    CdbStatus *out
 ) {
     if (!handle || !handle->sbp2_login) return 1;
 
@@ -1106,7 +1445,18 @@ static int execute_cdb_sbp2(
 
     (*orb)->Release(orb);
 
+    // A status block longer than its 8-byte header carries the SCSI status and
+    // sense (SBP-2 Annex B): status in byte 8, sense key, ASC, ASCQ in 9..11
+    const uint8_t *sb_bytes = waiter.message;
+    uint8_t scsi_status = sb_bytes && waiter.length >= 12 ? (sb_bytes[8] & 0x3F) : kSCSITaskStatus_GOOD;
+    bool check = scsi_status == kSCSITaskStatus_CHECK_CONDITION;
+    out->status = scsi_status;
+    out->sense_key = check ? (sb_bytes[9] & 0x0F) : 0;
+    out->asc = check ? sb_bytes[10] : 0;
+    out->ascq = check ? sb_bytes[11] : 0;
+
     if (waiter.notificationEvent != kFWSBP2NormalCommandStatus) {
+        out->status = CDB_NO_STATUS;
         fprintf(stderr, "SBP2 notification event: %u\n", waiter.notificationEvent);
         if (waiter.message && waiter.length >= sizeof(FWSBP2StatusBlock)) {
             const FWSBP2StatusBlock *sb = (const FWSBP2StatusBlock *)waiter.message;
@@ -1114,28 +1464,145 @@ static int execute_cdb_sbp2(
         }
         return 1;
     }
+    if (scsi_status != kSCSITaskStatus_GOOD) {
+        if (!quiet) {
+            fprintf(stderr, "SBP2 status 0x%02x: key=%s(0x%02x) asc=0x%02x ascq=0x%02x\n", scsi_status,
+                    sense_key_name(out->sense_key), out->sense_key, out->asc, out->ascq);
+        }
+        return 1;
+    }
 
-    if (buffer && buffer_len > 0) {
+    if (buffer && buffer_len > 0 && !quiet) {
         printf("Transferred %u bytes (SBP2).\n", buffer_len);
     }
 
     return 0;
 }
 
-static int execute_cdb(
+// Send one command. options are CDB_* bits; status (NULL if not wanted) gets
+// this command's own status and sense.
+static int execute_cdb_ex(
     ChangerHandle *handle,
     const uint8_t *cdb,
     uint8_t cdb_len,
     void *buffer,
     uint32_t buffer_len,
     uint8_t direction,
-    uint32_t timeout_ms
+    uint32_t timeout_ms,
+    unsigned options,
+    CdbStatus *status
 ) {
+    CdbStatus ignored;
+    if (!status) status = &ignored;
+    *status = (CdbStatus){ .status = CDB_NO_STATUS };
     if (!handle) return 1;
+    bool quiet = handle->quiet || (options & CDB_QUIET);
     if (handle->backend == BACKEND_SCSITASK) {
-        return execute_cdb_scsitask(handle, cdb, cdb_len, buffer, buffer_len, direction, timeout_ms);
+        return execute_cdb_scsitask(handle, cdb, cdb_len, buffer, buffer_len, direction, timeout_ms, quiet, status);
+    }
+    if (!handle->locks) {
+        return execute_cdb_sbp2(handle, cdb, cdb_len, buffer, buffer_len, direction, timeout_ms, quiet, status);
+    }
+
+    // Status arrives on the bound run loop, so it must be the one this thread waits on
+    pthread_mutex_lock(&handle->locks->sbp2);
+    sbp2_bind_runloop(handle, CFRunLoopGetCurrent());
+    int rc = execute_cdb_sbp2(handle, cdb, cdb_len, buffer, buffer_len, direction, timeout_ms, quiet, status);
+    pthread_mutex_unlock(&handle->locks->sbp2);
+    return rc;
+}
+
+static int execute_cdb(
+    ChangerHandle *handle,
+    const uint8_t *cdb,
+    uint8_t cdb_len,
+    void *buffer,
+    uint32_t buffer_len,
+    uint8_t direction,
+    uint32_t timeout_ms
+) {
+    return execute_cdb_ex(handle, cdb, cdb_len, buffer, buffer_len, direction, timeout_ms, 0, NULL);
+}
+
+// Build a READ ELEMENT STATUS CDB. The allocation length keeps the historical
+// cdb[6..8] placement this tool has always used; CURDATA/DVCID share cdb[6], so
+// the allocation is capped at 16 bits whenever either flag is requested.
+static void build_read_element_status_cdb(uint8_t cdb[12], uint8_t element_type,
+                                          uint16_t start, uint16_t count,
+                                          uint32_t alloc, uint8_t flags) {
+    flags &= (RES_CURDATA | RES_DVCID);
+    if (flags && alloc > 0xFFFF) alloc = 0xFFFF;
+
+    memset(cdb, 0, 12);
+    cdb[0] = 0xB8; // READ ELEMENT STATUS
+    cdb[1] = (element_type & 0x0F);
+    cdb[2] = (start >> 8) & 0xFF;
+    cdb[3] = start & 0xFF;
+    cdb[4] = (count >> 8) & 0xFF;
+    cdb[5] = count & 0xFF;
+    cdb[6] = ((alloc >> 16) & 0xFF) | flags;
+    cdb[7] = (alloc >> 8) & 0xFF;
+    cdb[8] = alloc & 0xFF;
+}
+
+// A CDB bit the device rejects shows up as ILLEGAL REQUEST / INVALID FIELD IN CDB;
+// anything else (not ready, a timeout, a lost transport) says nothing about it.
+static bool invalid_cdb_field(const CdbStatus *status) {
+    return status->sense_key == kSENSE_KEY_ILLEGAL_REQUEST && status->asc == 0x24;
+}
+
+// Issue READ ELEMENT STATUS with the requested CURDATA/DVCID flags. Older
+// changers reject either bit as an invalid CDB field; only that rejection marks
+// the bit unsupported on this handle, so later reads skip the wasted round trip.
+// DVCID is simply dropped. CURDATA is only dropped for RES_FALLBACK callers: a
+// plain RES_CURDATA read is a poll, and without the bit the changer may move
+// the robot to verify, so it fails instead.
+static int execute_read_element_status(ChangerHandle *handle, uint8_t element_type,
+                                       uint16_t start, uint16_t count,
+                                       uint8_t *buf, uint32_t alloc,
+                                       uint8_t flags, uint32_t timeout_ms) {
+    if (!handle || !buf) return 1;
+    unsigned options = (flags & RES_QUIET) ? CDB_QUIET : 0;
+    bool fallback = (flags & RES_FALLBACK) != 0;
+    flags &= (RES_CURDATA | RES_DVCID);
+    if (__atomic_load_n(&handle->dvcid_unsupported, __ATOMIC_RELAXED)) flags &= (uint8_t)~RES_DVCID;
+    if ((flags & RES_CURDATA) && __atomic_load_n(&handle->curdata_unsupported, __ATOMIC_RELAXED)) {
+        if (!fallback) return 1;
+        flags &= (uint8_t)~RES_CURDATA;
+    }
+
+    uint8_t cdb[12];
+    CdbStatus status;
+    build_read_element_status_cdb(cdb, element_type, start, count, alloc, flags);
+    int rc = execute_cdb_ex(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, timeout_ms,
+                            options, &status);
+    if (rc == 0 || flags == 0 || !invalid_cdb_field(&status)) return rc;
+
+    // Drop DVCID first (rarest), then CURDATA, to find which bit the device dislikes
+    if (flags & RES_DVCID) {
+        uint8_t without = flags & (uint8_t)~RES_DVCID;
+        build_read_element_status_cdb(cdb, element_type, start, count, alloc, without);
+        memset(buf, 0, alloc);
+        rc = execute_cdb_ex(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, timeout_ms,
+                            options, &status);
+        if (rc == 0) {
+            if (g_debug) printf("Device rejected DVCID; disabling for this handle.\n");
+            __atomic_store_n(&handle->dvcid_unsupported, true, __ATOMIC_RELAXED);
+            return 0;
+        }
+        if (!without || !invalid_cdb_field(&status)) return rc;
+        flags = without;
+    }
+    if (flags & RES_CURDATA) {
+        if (g_debug) printf("Device rejected CURDATA; disabling for this handle.\n");
+        __atomic_store_n(&handle->curdata_unsupported, true, __ATOMIC_RELAXED);
+        if (!fallback) return 1;
+        build_read_element_status_cdb(cdb, element_type, start, count, alloc, 0);
+        memset(buf, 0, alloc);
+        rc = execute_cdb_ex(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, timeout_ms,
+                            options, NULL);
     }
-    return execute_cdb_sbp2(handle, cdb, cdb_len, buffer, buffer_len, direction, timeout_ms);
+    return rc;
 }
 
 static int cmd_inquiry(ChangerHandle *handle) {
@@ -1307,19 +1774,9 @@ static int cmd_probe_storage(ChangerHandle *handle) {
         uint16_t count = assign.num_storage - offset;
         if (count > step) count = step;
 
-        uint8_t cdb[12] = {0};
-        cdb[0] = 0xB8; // READ ELEMENT STATUS
-        cdb[1] = 0x02; // storage
-        cdb[2] = (start >> 8) & 0xFF;
-        cdb[3] = start & 0xFF;
-        cdb[4] = (count >> 8) & 0xFF;
-        cdb[5] = count & 0xFF;
-        cdb[6] = (alloc >> 16) & 0xFF;
-        cdb[7] = (alloc >> 8) & 0xFF;
-        cdb[8] = alloc & 0xFF;
-
+        // Probing is diagnostic: let the device verify physically (no CURDATA)
         memset(buf, 0, alloc);
-        rc = execute_cdb(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, 30000);
+        rc = execute_read_element_status(handle, 0x02, start, count, buf, alloc, 0, 30000);
         if (rc != 0) {
             printf("  start=0x%04x count=%u -> error\n", start, count);
             continue;
@@ -1344,6 +1801,40 @@ static int cmd_test_unit_ready(ChangerHandle *handle) {
     return execute_cdb(handle, cdb, sizeof(cdb), NULL, 0, kSCSIDataTransfer_NoDataTransfer, 10000);
 }
 
+static int cmd_prevent_removal(ChangerHandle *handle, bool prevent, CdbStatus *status) {
+    uint8_t cdb[6] = {0};
+    cdb[0] = 0x1E; // PREVENT ALLOW MEDIUM REMOVAL
+    cdb[4] = prevent ? 0x01 : 0x00;
+    return execute_cdb_ex(handle, cdb, sizeof(cdb), NULL, 0, kSCSIDataTransfer_NoDataTransfer, 10000, 0, status);
+}
+
+// Batches lock the door and I/E port for their duration: an operator opening
+// the door mid-batch costs a UNIT ATTENTION and a full re-inventory, and
+// invalidates every status the batch planned with. Locks nest; the door is
+// unlocked when the last one is released. Devices without the command simply
+// run unlocked.
+static void door_lock(ChangerHandle *handle) {
+    if (handle->locks) pthread_mutex_lock(&handle->locks->door);
+    CdbStatus status;
+    if (handle->door_locks++ == 0 && !handle->prevent_unsupported) {
+        if (cmd_prevent_removal(handle, true, &status) == 0) {
+            g_door_holder = handle;
+        } else if (status.sense_key == kSENSE_KEY_ILLEGAL_REQUEST) {
+            handle->prevent_unsupported = true;
+        }
+    }
+    if (handle->locks) pthread_mutex_unlock(&handle->locks->door);
+}
+
+static void door_unlock(ChangerHandle *handle) {
+    if (handle->locks) pthread_mutex_lock(&handle->locks->door);
+    if (handle->door_locks > 0 && --handle->door_locks == 0 && !handle->prevent_unsupported) {
+        if (g_door_holder == handle) g_door_holder = NULL;
+        cmd_prevent_removal(handle, false, NULL);
+    }
+    if (handle->locks) pthread_mutex_unlock(&handle->locks->door);
+}
+
 static int cmd_init_status(ChangerHandle *handle) {
     uint8_t cdb[6] = {0};
     cdb[0] = 0x07; // INITIALIZE ELEMENT STATUS
@@ -1482,15 +1973,17 @@ static bool parse_element_status_map(const uint8_t *buf, uint32_t len, ElementMa
                     continue;
                 }
             }
+            bool stored = true;
             if (type == 0x01) {
-                element_list_push(&map->transports, elem_addr);
+                stored = element_list_push(&map->transports, elem_addr);
             } else if (type == 0x02) {
-                element_list_push(&map->slots, elem_addr);
+                stored = element_list_push(&map->slots, elem_addr);
             } else if (type == 0x03) {
-                element_list_push(&map->ie, elem_addr);
+                stored = element_list_push(&map->ie, elem_addr);
             } else if (type == 0x04) {
-                element_list_push(&map->drives, elem_addr);
+                stored = element_list_push(&map->drives, elem_addr);
             }
+            if (!stored) map->short_of_memory = true;
             offset += desc_len;
         }
         if (offset < page_end) offset = page_end;
@@ -1498,41 +1991,20 @@ static bool parse_element_status_map(const uint8_t *buf, uint32_t len, ElementMa
     return (map->transports.count + map->slots.count + map->drives.count + map->ie.count) > 0;
 }
 
-static int cmd_read_element_status(ChangerHandle *handle, uint8_t element_type, uint16_t start, uint16_t count, uint32_t alloc, bool dump_raw) {
-    uint8_t cdb[12] = {0};
-    cdb[0] = 0xB8; // READ ELEMENT STATUS
-    cdb[1] = (element_type & 0x0F);
-    cdb[2] = (start >> 8) & 0xFF;
-    cdb[3] = start & 0xFF;
-    cdb[4] = (count >> 8) & 0xFF;
-    cdb[5] = count & 0xFF;
-    cdb[6] = (alloc >> 16) & 0xFF;
-    cdb[7] = (alloc >> 8) & 0xFF;
-    cdb[8] = alloc & 0xFF;
-    cdb[9] = 0;
-    cdb[10] = 0;
-    cdb[11] = 0;
-
+static int cmd_read_element_status(ChangerHandle *handle, uint8_t element_type, uint16_t start, uint16_t count,
+                                   uint32_t alloc, uint8_t flags, bool dump_raw) {
     uint8_t *buf = calloc(1, alloc);
     if (!buf) {
         fprintf(stderr, "Allocation failed.\n");
         return 1;
     }
 
-    int rc = execute_cdb(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, 30000);
+    int rc = execute_read_element_status(handle, element_type, start, count, buf, alloc, flags, 30000);
     if (rc != 0 && element_type != 0x00) {
         fprintf(stderr, "READ ELEMENT STATUS failed for type '%s'; retrying with element-type=all.\n",
                 element_type_name(element_type));
-        memset(cdb, 0, sizeof(cdb));
-        cdb[0] = 0xB8; // READ ELEMENT STATUS
-        cdb[1] = 0x00; // all element types
-        cdb[4] = 0xFF;
-        cdb[5] = 0xFF;
-        cdb[6] = (alloc >> 16) & 0xFF;
-        cdb[7] = (alloc >> 8) & 0xFF;
-        cdb[8] = alloc & 0xFF;
         memset(buf, 0, alloc);
-        rc = execute_cdb(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, 30000);
+        rc = execute_read_element_status(handle, 0x00, 0, 0xFFFF, buf, alloc, flags, 30000);
     }
 
     if (rc == 0) {
@@ -1546,6 +2018,23 @@ static int cmd_read_element_status(ChangerHandle *handle, uint8_t element_type,
     return rc;
 }
 
+// Eject one optical disk by BSD name ("disk4") so the drive releases it.
+// Returns non-zero if diskutil refused (e.g. a volume is in use); callers that
+// move the disc regardless treat that as a warning.
+static int eject_optical_disk(const char *bsd_name) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "diskutil eject %s 2>&1", bsd_name);
+    int ret = system(cmd);
+    if (ret != 0) {
+        fprintf(stderr, "Warning: diskutil eject returned %d\n", ret);
+    }
+
+    // Give the system a moment to process the eject
+    usleep(500000); // 500ms
+
+    return ret != 0;
+}
+
 // Eject any mounted optical media before unloading from drive.
 // Returns 0 on success (or no optical media found), non-zero on failure.
 static int eject_optical_media(void) {
@@ -1586,63 +2075,81 @@ static int eject_optical_media(void) {
     }
 
     printf("Ejecting optical media (%s) before unload...\n", disk_to_eject);
+    return eject_optical_disk(disk_to_eject);
+}
 
-    char cmd[128];
-    snprintf(cmd, sizeof(cmd), "diskutil eject %s 2>&1", disk_to_eject);
-    int ret = system(cmd);
-    if (ret != 0) {
-        fprintf(stderr, "Warning: diskutil eject returned %d\n", ret);
-        // Continue anyway - the physical move might still work
-    }
-
-    // Give the system a moment to process the eject
-    usleep(500000); // 500ms
-
-    return 0;
+// Details of a disc identified through diskutil or DiskArbitration
+typedef struct {
+    char name[256];
+    char size[64];          // human readable, e.g. "385.6 MB"
+    uint64_t size_bytes;
+    char media_type[32];    // "CD", "DVD", "BD", "CD-DA", ...
+    char fingerprint[33];   // TOC and volume digest, filled in by identify_disc() only
+    char mount_path[1024];  // where the volume is mounted, when known
+} DiscInfo;
+
+// Convert diskutil's "385.6 MB" style sizes into bytes (0 if unparseable)
+static uint64_t parse_size_bytes(const char *size) {
+    if (!size || !*size) return 0;
+    char *end = NULL;
+    double value = strtod(size, &end);
+    if (!end || end == size || value < 0) return 0;
+    while (*end == ' ') end++;
+    double scale = 1.0;
+    switch (*end) {
+        case 'K': case 'k': scale = 1e3; break;
+        case 'M': scale = 1e6; break;
+        case 'G': scale = 1e9; break;
+        case 'T': scale = 1e12; break;
+        default: break;
+    }
+    return (uint64_t)(value * scale);
 }
 
-// Get info about mounted optical disc. Returns disc name in out_name (caller provides buffer).
+// Get info about mounted optical disc (caller provides the DiscInfo).
 // Returns true if an optical disc is found, false otherwise.
-static bool get_mounted_disc_info(char *out_name, size_t name_len, char *out_size, size_t size_len) {
-    if (out_name && name_len > 0) out_name[0] = '\0';
-    if (out_size && size_len > 0) out_size[0] = '\0';
+static bool get_mounted_disc_info(DiscInfo *info) {
+    if (!info) return false;
+    memset(info, 0, sizeof(*info));
 
     FILE *fp = popen("diskutil list external 2>/dev/null", "r");
     if (!fp) return false;
 
     char line[512];
     bool found_optical = false;
-    bool in_optical_disk = false;
 
     while (fgets(line, sizeof(line), fp)) {
-        // Look for external disk header
-        if (strncmp(line, "/dev/disk", 9) == 0) {
-            in_optical_disk = false;
-        }
         // Check if this is an optical disc
         if (strstr(line, "CD_partition_scheme") || strstr(line, "DVD_partition_scheme") ||
             strstr(line, "BD_partition_scheme")) {
-            in_optical_disk = true;
             found_optical = true;
             // Parse line like "   0:        CD_partition_scheme You By Me: Vol. 1      *385.6 MB   disk4"
             // Find the disc name - it's between the scheme type and the size (*xxx MB/GB)
-            char *scheme_end = strstr(line, "_scheme");
+            char *scheme_end = strstr(line, "_partition_scheme");
             if (scheme_end) {
-                scheme_end += 7; // skip "_scheme"
+                // Media type is the token in front of "_partition_scheme"
+                char *type_start = scheme_end;
+                while (type_start > line && *(type_start - 1) != ' ') type_start--;
+                size_t type_len = (size_t)(scheme_end - type_start);
+                if (type_len >= sizeof(info->media_type)) type_len = sizeof(info->media_type) - 1;
+                memcpy(info->media_type, type_start, type_len);
+                info->media_type[type_len] = '\0';
+
+                scheme_end += 17; // skip "_partition_scheme"
                 while (*scheme_end == ' ') scheme_end++;
                 // Find the size marker (starts with *)
                 char *size_start = strstr(scheme_end, "*");
-                if (size_start && out_name && name_len > 0) {
+                if (size_start) {
                     // Name is between scheme_end and size_start
                     char *name_end = size_start;
                     while (name_end > scheme_end && *(name_end-1) == ' ') name_end--;
                     size_t copy_len = name_end - scheme_end;
-                    if (copy_len >= name_len) copy_len = name_len - 1;
-                    strncpy(out_name, scheme_end, copy_len);
-                    out_name[copy_len] = '\0';
+                    if (copy_len >= sizeof(info->name)) copy_len = sizeof(info->name) - 1;
+                    strncpy(info->name, scheme_end, copy_len);
+                    info->name[copy_len] = '\0';
                 }
                 // Get size
-                if (size_start && out_size && size_len > 0) {
+                if (size_start) {
                     size_start++; // skip *
                     char *size_end = size_start;
                     while (*size_end && *size_end != ' ' && *size_end != '\t') size_end++;
@@ -1650,9 +2157,10 @@ static bool get_mounted_disc_info(char *out_name, size_t name_len, char *out_siz
                     while (*size_end == ' ') size_end++;
                     while (*size_end && *size_end != ' ' && *size_end != '\t') size_end++;
                     size_t copy_len = size_end - size_start;
-                    if (copy_len >= size_len) copy_len = size_len - 1;
-                    strncpy(out_size, size_start, copy_len);
-                    out_size[copy_len] = '\0';
+                    if (copy_len >= sizeof(info->size)) copy_len = sizeof(info->size) - 1;
+                    strncpy(info->size, size_start, copy_len);
+                    info->size[copy_len] = '\0';
+                    info->size_bytes = parse_size_bytes(info->size);
                 }
             }
             break;
@@ -1665,8 +2173,7 @@ static bool get_mounted_disc_info(char *out_name, size_t name_len, char *out_siz
 // DiskArbitration callback context
 typedef struct {
     bool found;
-    char name[256];
-    char size[64];
+    DiscInfo info;
 } DACallbackContext;
 
 // Callback for disk appeared event
@@ -1682,15 +2189,15 @@ static void disk_appeared_callback(DADiskRef disk, void *context) {
     CFStringRef mediaKind = CFDictionaryGetValue(desc, kDADiskDescriptionMediaKindKey);
 
     bool is_optical = false;
+    char kind[128] = {0};
+    char type[128] = {0};
     if (mediaKind) {
-        char kind[128] = {0};
         CFStringGetCString(mediaKind, kind, sizeof(kind), kCFStringEncodingUTF8);
         if (strstr(kind, "CD") || strstr(kind, "DVD") || strstr(kind, "BD")) {
             is_optical = true;
         }
     }
     if (mediaType) {
-        char type[128] = {0};
         CFStringGetCString(mediaType, type, sizeof(type), kCFStringEncodingUTF8);
         if (strstr(type, "CD") || strstr(type, "DVD") || strstr(type, "BD")) {
             is_optical = true;
@@ -1700,27 +2207,47 @@ static void disk_appeared_callback(DADiskRef disk, void *context) {
     if (is_optical) {
         ctx->found = true;
 
+        // Prefer the specific media type ("CD-ROM", "DVD-R"); fall back to the
+        // IOKit media class ("IOCDMedia" -> "CD")
+        if (type[0]) {
+            snprintf(ctx->info.media_type, sizeof(ctx->info.media_type), "%s", type);
+        } else if (strstr(kind, "BD")) {
+            snprintf(ctx->info.media_type, sizeof(ctx->info.media_type), "BD");
+        } else if (strstr(kind, "DVD")) {
+            snprintf(ctx->info.media_type, sizeof(ctx->info.media_type), "DVD");
+        } else {
+            snprintf(ctx->info.media_type, sizeof(ctx->info.media_type), "CD");
+        }
+
         // Get volume name
         CFStringRef volName = CFDictionaryGetValue(desc, kDADiskDescriptionVolumeNameKey);
         if (volName) {
-            CFStringGetCString(volName, ctx->name, sizeof(ctx->name), kCFStringEncodingUTF8);
+            CFStringGetCString(volName, ctx->info.name, sizeof(ctx->info.name), kCFStringEncodingUTF8);
         } else {
             // Try media name
             CFStringRef mediaName = CFDictionaryGetValue(desc, kDADiskDescriptionMediaNameKey);
             if (mediaName) {
-                CFStringGetCString(mediaName, ctx->name, sizeof(ctx->name), kCFStringEncodingUTF8);
+                CFStringGetCString(mediaName, ctx->info.name, sizeof(ctx->info.name), kCFStringEncodingUTF8);
             }
         }
 
+        // Mount point, if the volume is already mounted
+        CFURLRef volPath = CFDictionaryGetValue(desc, kDADiskDescriptionVolumePathKey);
+        if (volPath) {
+            CFURLGetFileSystemRepresentation(volPath, true, (UInt8 *)ctx->info.mount_path,
+                                             sizeof(ctx->info.mount_path));
+        }
+
         // Get size
         CFNumberRef sizeNum = CFDictionaryGetValue(desc, kDADiskDescriptionMediaSizeKey);
         if (sizeNum) {
             long long size = 0;
             CFNumberGetValue(sizeNum, kCFNumberLongLongType, &size);
+            if (size > 0) ctx->info.size_bytes = (uint64_t)size;
             if (size >= 1000000000) {
-                snprintf(ctx->size, sizeof(ctx->size), "%.1f GB", size / 1000000000.0);
+                snprintf(ctx->info.size, sizeof(ctx->info.size), "%.1f GB", size / 1000000000.0);
             } else {
-                snprintf(ctx->size, sizeof(ctx->size), "%.1f MB", size / 1000000.0);
+                snprintf(ctx->info.size, sizeof(ctx->info.size), "%.1f MB", size / 1000000.0);
             }
         }
 
@@ -1737,22 +2264,19 @@ static void timeout_callback(CFRunLoopTimerRef timer __attribute__((unused)), vo
     CFRunLoopStop(CFRunLoopGetCurrent());
 }
 
-// Wait for disc to be mounted using DiskArbitration and print info
-static void wait_and_print_mounted_disc(void) {
+// Wait for an optical disc to mount (or return the one already mounted).
+// Returns MCHANGER_OK with out filled, MCHANGER_ERR_BUSY on timeout.
+static int wait_for_disc(DiscInfo *out, int timeout_secs) {
+    memset(out, 0, sizeof(*out));
+
     // First check if already mounted
-    char name[256] = {0};
-    char size[64] = {0};
-    if (get_mounted_disc_info(name, sizeof(name), size, sizeof(size))) {
-        printf("  Mounted: %s (%s)\n", name[0] ? name : "Unknown", size[0] ? size : "?");
-        return;
+    if (get_mounted_disc_info(out)) {
+        return MCHANGER_OK;
     }
 
     // Set up DiskArbitration session
     DASessionRef session = DASessionCreate(kCFAllocatorDefault);
-    if (!session) {
-        printf("  Mounted: (unable to create DA session)\n");
-        return;
-    }
+    if (!session) return MCHANGER_ERR_INVALID;
 
     DACallbackContext ctx = {0};
     bool timed_out = false;
@@ -1761,10 +2285,9 @@ static void wait_and_print_mounted_disc(void) {
     DARegisterDiskAppearedCallback(session, NULL, disk_appeared_callback, &ctx);
     DASessionScheduleWithRunLoop(session, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
 
-    // Set up timeout (30 seconds)
     CFRunLoopTimerContext timerCtx = { 0, &timed_out, NULL, NULL, NULL };
     CFRunLoopTimerRef timer = CFRunLoopTimerCreate(kCFAllocatorDefault,
-        CFAbsoluteTimeGetCurrent() + 30.0, 0, 0, 0, timeout_callback, &timerCtx);
+        CFAbsoluteTimeGetCurrent() + (double)timeout_secs, 0, 0, 0, timeout_callback, &timerCtx);
     CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
 
     // Run until disc appears or timeout
@@ -1778,40 +2301,76 @@ static void wait_and_print_mounted_disc(void) {
     CFRelease(session);
 
     if (ctx.found) {
-        printf("  Mounted: %s (%s)\n", ctx.name[0] ? ctx.name : "Audio CD", ctx.size[0] ? ctx.size : "?");
-    } else if (timed_out) {
+        *out = ctx.info;
+        return MCHANGER_OK;
+    }
+    return timed_out ? MCHANGER_ERR_BUSY : MCHANGER_ERR_NOT_FOUND;
+}
+
+// Wait for disc to be mounted using DiskArbitration and print info.
+// Returns true (and fills out, when non-NULL) if a disc was identified.
+static bool wait_and_print_mounted_disc(DiscInfo *out) {
+    DiscInfo info;
+    int rc = wait_for_disc(&info, 30);
+    if (rc == MCHANGER_OK) {
+        printf("  Mounted: %s (%s)\n", info.name[0] ? info.name : "Audio CD", info.size[0] ? info.size : "?");
+        if (out) *out = info;
+        return true;
+    }
+    if (rc == MCHANGER_ERR_BUSY) {
         printf("  Mounted: (timed out waiting for disc)\n");
+    } else if (rc == MCHANGER_ERR_INVALID) {
+        printf("  Mounted: (unable to create DA session)\n");
     } else {
         printf("  Mounted: (unknown)\n");
     }
+    return false;
+}
+
+// Find where a disc's volume is mounted. DiskArbitration reports the disc as
+// soon as it appears, which can be before the mount finishes, so fall back to
+// /Volumes/<name> and give the mount a few seconds to show up.
+static bool resolve_mount_path(const DiscInfo *info, char *out, size_t out_len) {
+    out[0] = '\0';
+    if (info->mount_path[0]) {
+        snprintf(out, out_len, "%s", info->mount_path);
+    } else if (info->name[0]) {
+        snprintf(out, out_len, "/Volumes/%s", info->name);
+    } else {
+        return false;
+    }
+
+    struct stat st;
+    for (int waited_ms = 0; waited_ms <= 10000; waited_ms += 250) {
+        if (stat(out, &st) == 0 && S_ISDIR(st.st_mode)) return true;
+        usleep(250000);
+    }
+    out[0] = '\0';
+    return false;
 }
 
 // Structure to hold element status info
 typedef struct {
     uint16_t addr;
     bool full;
+    bool except;
     bool valid_src;
     uint16_t src_addr;
+    bool impexp;                // I/E port: an operator put the medium there (not the robot)
+    bool access;                // the robot can reach the element (I/E: the door is shut)
 } ElementStatus;
 
 // Read element status and find info for specific elements
-// Returns 0 on success, fills in drive_status and slot_status if non-NULL
+// Returns 0 on success, fills in drive_status and slot_status if non-NULL.
+// Pass RES_MEMORY in flags for a fast read from changer memory; pass 0 when
+// the caller is about to move media and wants the device to verify.
 static int read_element_status_info(ChangerHandle *handle, uint16_t drive_addr, ElementStatus *drive_status,
-                                    uint16_t slot_addr, ElementStatus *slot_status) {
+                                    uint16_t slot_addr, ElementStatus *slot_status, uint8_t flags) {
     uint32_t alloc = 4096;
-    uint8_t cdb[12] = {0};
-    cdb[0] = 0xB8; // READ ELEMENT STATUS
-    cdb[1] = 0x00; // all element types
-    cdb[4] = 0xFF;
-    cdb[5] = 0xFF;
-    cdb[6] = (alloc >> 16) & 0xFF;
-    cdb[7] = (alloc >> 8) & 0xFF;
-    cdb[8] = alloc & 0xFF;
-
     uint8_t *buf = calloc(1, alloc);
     if (!buf) return -1;
 
-    int rc = execute_cdb(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, 30000);
+    int rc = execute_read_element_status(handle, 0x00, 0, 0xFFFF, buf, alloc, flags, 30000);
     if (rc != 0) {
         free(buf);
         return rc;
@@ -1821,12 +2380,14 @@ static int read_element_status_info(ChangerHandle *handle, uint16_t drive_addr,
     if (drive_status) {
         drive_status->addr = drive_addr;
         drive_status->full = false;
+        drive_status->except = false;
         drive_status->valid_src = false;
         drive_status->src_addr = 0;
     }
     if (slot_status) {
         slot_status->addr = slot_addr;
         slot_status->full = false;
+        slot_status->except = false;
         slot_status->valid_src = false;
         slot_status->src_addr = 0;
     }
@@ -1853,6 +2414,7 @@ static int read_element_status_info(ChangerHandle *handle, uint16_t drive_addr,
             uint16_t elem_addr = (buf[offset] << 8) | buf[offset + 1];
             uint8_t elem_flags = buf[offset + 2];
             bool full = (elem_flags & 0x01) != 0;
+            bool except = (elem_flags & 0x04) != 0;
 
             bool svalid = false;
             uint16_t src = 0;
@@ -1863,11 +2425,13 @@ static int read_element_status_info(ChangerHandle *handle, uint16_t drive_addr,
 
             if (drive_status && elem_addr == drive_addr) {
                 drive_status->full = full;
+                drive_status->except = except;
                 drive_status->valid_src = svalid;
                 drive_status->src_addr = src;
             }
             if (slot_status && elem_addr == slot_addr) {
                 slot_status->full = full;
+                slot_status->except = except;
                 slot_status->valid_src = svalid;
                 slot_status->src_addr = src;
             }
@@ -1884,6 +2448,210 @@ static int read_element_status_info(ChangerHandle *handle, uint16_t drive_addr,
     return 0;
 }
 
+#define PAIR_SPAN_MAX 8     // elements one ranged read may cover to reach both of a pair
+
+// Status of just two elements (b_status NULL to read only a), without the
+// all-types read above: one ranged READ ELEMENT STATUS when the addresses are
+// within PAIR_SPAN_MAX, otherwise one single-element read each. An element the
+// device leaves out of a ranged reply is read the old way.
+static int read_element_pair(ChangerHandle *handle, uint16_t a, ElementStatus *a_status,
+                             uint16_t b, ElementStatus *b_status, uint8_t flags) {
+    uint16_t addrs[2] = { a, b };
+    ElementStatus *out[2] = { a_status, b_status };
+    bool found[2] = { false, b_status == NULL };
+    for (int i = 0; i < 2; i++) {
+        if (found[i]) continue;
+        memset(out[i], 0, sizeof(ElementStatus));
+        out[i]->addr = addrs[i];
+    }
+
+    uint8_t buf[512];
+    uint16_t span = (uint16_t)((a > b ? a - b : b - a) + 1);
+    bool ranged = b_status && a != b && span <= PAIR_SPAN_MAX;
+    for (int pass = 0; pass < (!b_status || ranged ? 1 : 2); pass++) {
+        uint16_t start = ranged ? (a < b ? a : b) : addrs[pass];
+        memset(buf, 0, sizeof(buf));
+        if (execute_read_element_status(handle, 0x00, start, ranged ? span : 1, buf, sizeof(buf), flags, 30000) != 0) {
+            break;
+        }
+        uint32_t report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
+        uint32_t len = report_bytes + 8 <= sizeof(buf) ? report_bytes + 8 : sizeof(buf);
+        uint32_t offset = 8;
+        while (offset + 8 <= len) {
+            uint16_t desc_len = (buf[offset + 2] << 8) | buf[offset + 3];
+            uint32_t page_bytes = (buf[offset + 5] << 16) | (buf[offset + 6] << 8) | buf[offset + 7];
+            offset += 8;
+            if (desc_len == 0 || page_bytes == 0) break;
+            uint32_t page_end = offset + page_bytes < len ? offset + page_bytes : len;
+            while (offset + desc_len <= page_end) {
+                uint16_t elem_addr = (buf[offset] << 8) | buf[offset + 1];
+                for (int i = 0; i < 2; i++) {
+                    if (found[i] || elem_addr != addrs[i]) continue;
+                    found[i] = true;
+                    out[i]->full = (buf[offset + 2] & 0x01) != 0;
+                    out[i]->impexp = (buf[offset + 2] & 0x02) != 0;
+                    out[i]->except = (buf[offset + 2] & 0x04) != 0;
+                    out[i]->access = (buf[offset + 2] & 0x08) != 0;
+                    if (desc_len >= 12) {
+                        out[i]->valid_src = (buf[offset + 9] & 0x80) != 0;
+                        out[i]->src_addr = (buf[offset + 10] << 8) | buf[offset + 11];
+                    }
+                }
+                offset += desc_len;
+            }
+            if (offset < page_end) offset = page_end;
+        }
+    }
+
+    if (found[0] && found[1]) return 0;
+    return read_element_status_info(handle, found[0] ? 0 : a, found[0] ? NULL : a_status,
+                                    found[1] ? 0 : b, found[1] ? NULL : b_status, flags);
+}
+
+// Status of every element in list (all of one type, in address order) into
+// out, using buf for as few ranged reads from changer memory as alloc allows.
+// Elements the changer leaves out keep what out held.
+static int read_element_range(ChangerHandle *handle, uint8_t type, const ElementList *list,
+                              uint8_t *buf, uint32_t alloc, uint8_t flags, ElementStatus *out) {
+    size_t next = 0;
+    while (next < list->count) {
+        buf[5] = buf[6] = buf[7] = 0;
+        if (execute_read_element_status(handle, type, element_addr(list, next), (uint16_t)(list->count - next),
+                                        buf, alloc, flags, 30000) != 0) {
+            return next == 0 ? 1 : 0;
+        }
+        uint32_t report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
+        uint32_t len = report_bytes + 8 <= alloc ? report_bytes + 8 : alloc;
+        size_t last = next;
+        uint32_t offset = 8;
+        while (offset + 8 <= len) {
+            uint16_t desc_len = (buf[offset + 2] << 8) | buf[offset + 3];
+            uint32_t page_bytes = (buf[offset + 5] << 16) | (buf[offset + 6] << 8) | buf[offset + 7];
+            offset += 8;
+            if (desc_len == 0 || page_bytes == 0) break;
+            uint32_t page_end = offset + page_bytes < len ? offset + page_bytes : len;
+            while (offset + desc_len <= page_end) {
+                uint16_t addr = (buf[offset] << 8) | buf[offset + 1];
+                // Descriptors come in address order; search only when they don't
+                int i = last < list->count && element_addr(list, last) == addr ? (int)last
+                                                                              : element_list_index(list, addr) - 1;
+                if (i >= 0) {
+                    ElementStatus *st = &out[i];
+                    st->addr = addr;
+                    st->full = (buf[offset + 2] & 0x01) != 0;
+                    st->impexp = (buf[offset + 2] & 0x02) != 0;
+                    st->except = (buf[offset + 2] & 0x04) != 0;
+                    st->access = (buf[offset + 2] & 0x08) != 0;
+                    st->valid_src = desc_len >= 12 && (buf[offset + 9] & 0x80) != 0;
+                    st->src_addr = st->valid_src ? (buf[offset + 10] << 8) | buf[offset + 11] : 0;
+                    if ((size_t)i + 1 > last) last = (size_t)i + 1;
+                }
+                offset += desc_len;
+            }
+            if (offset < page_end) offset = page_end;
+        }
+        if (last == next) break;
+        next = last;
+    }
+    return 0;
+}
+
+// What the source and destination show once MOVE MEDIUM has reported success
+typedef enum {
+    MOVE_CONFIRMED = 0,
+    MOVE_UNVERIFIED,            // status could not be read; the move is taken as made
+    MOVE_MISSED,                // the source still holds the disc
+    MOVE_NOT_SEATED,            // the disc left the source but is not cleanly in the destination
+    MOVE_STRANDED               // after recovery, still in neither: the robot or a half-seated destination
+} MoveCheck;
+
+// cmd_move_medium() result for MOVE_STRANDED, so callers stop rather than
+// send another disc into an element that may be occupied
+#define MOVE_RC_STRANDED 2
+
+// Read just the two elements of a completed move, from changer memory
+static MoveCheck verify_move(ChangerHandle *handle, uint16_t transport, uint16_t source, uint16_t dest,
+                             ElementStatus *src, ElementStatus *dst) {
+    if (read_element_pair(handle, source, src, dest, dst, RES_MEMORY) != 0) return MOVE_UNVERIFIED;
+    if (src->full && !(dst->full && dst->valid_src && dst->src_addr == source)) return MOVE_MISSED;
+    if (dst->except) return MOVE_NOT_SEATED;
+    if (dst->full) return MOVE_CONFIRMED;
+
+    // Neither holds it: still in the robot, or gone out through a mail-slot port
+    ElementStatus robot = {0};
+    if (read_element_pair(handle, transport, &robot, 0, NULL, RES_MEMORY) != 0) return MOVE_UNVERIFIED;
+    return robot.full ? MOVE_NOT_SEATED : MOVE_CONFIRMED;
+}
+
+// Check a move the device reported made, and recover what can be: a missed
+// pick is tried once more if the destination is still empty, and a disc left
+// in the robot goes back to the source. Both elements are read again after
+// each step. Runs under the robot's lock. Returns MOVE_MISSED if the disc is
+// back in the source, and MOVE_STRANDED if it is in neither element and needs
+// an operator.
+static MoveCheck check_move(ChangerHandle *handle, const uint8_t cdb[12], uint16_t transport, uint16_t source,
+                           uint16_t dest) {
+    ElementStatus src = {0}, dst = {0};
+    MoveCheck check = verify_move(handle, transport, source, dest, &src, &dst);
+    // A destination that filled from elsewhere would only refuse the retry
+    if (check == MOVE_MISSED && src.full && !dst.full && !dst.except) {
+        execute_cdb(handle, cdb, 12, NULL, 0, kSCSIDataTransfer_NoDataTransfer, 60000);
+        check = verify_move(handle, transport, source, dest, &src, &dst);
+    }
+    if (check == MOVE_CONFIRMED || check == MOVE_UNVERIFIED) return check;
+
+    fprintf(stderr, "Move 0x%04x -> 0x%04x not confirmed: %s\n", source, dest,
+            check == MOVE_MISSED ? "the source still holds the disc" : "the disc is not seated in the destination");
+    if (check == MOVE_MISSED) return check;
+
+    // Neither element holds it, so verify_move() found it in the robot
+    if (!src.full && !dst.full) {
+        uint8_t back[12] = {0};
+        back[0] = 0xA5; // MOVE MEDIUM
+        back[2] = back[4] = (transport >> 8) & 0xFF;
+        back[3] = back[5] = transport & 0xFF;
+        back[6] = (source >> 8) & 0xFF;
+        back[7] = source & 0xFF;
+        execute_cdb(handle, back, sizeof(back), NULL, 0, kSCSIDataTransfer_NoDataTransfer, 60000);
+        if (verify_move(handle, transport, source, dest, &src, &dst) == MOVE_MISSED) {
+            fprintf(stderr, "Returned the disc from the robot to 0x%04x.\n", source);
+            return MOVE_MISSED;
+        }
+    }
+    fprintf(stderr, "The disc from 0x%04x is stranded; check the robot and 0x%04x before moving again.\n",
+            source, dest);
+    return MOVE_STRANDED;
+}
+
+// Generation of the last move into or out of addr through this handle; 0 if
+// none. Pages are allocated on a page's first move, and never freed before
+// the handle is closed, so lookups need no lock.
+static uint64_t element_moved_at(ChangerHandle *handle, uint16_t addr) {
+    uint64_t *page = __atomic_load_n(&handle->moved_at[addr >> 8], __ATOMIC_ACQUIRE);
+    return page ? __atomic_load_n(&page[addr & 0xFF], __ATOMIC_SEQ_CST) : 0;
+}
+
+static void element_note_move(ChangerHandle *handle, uint16_t addr, uint64_t generation) {
+    uint64_t **slot = &handle->moved_at[addr >> 8];
+    uint64_t *page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (!page) {
+        uint64_t *fresh = calloc(256, sizeof(uint64_t));
+        if (!fresh) {
+            __atomic_store_n(&handle->moves_untracked, true, __ATOMIC_SEQ_CST);
+            return;
+        }
+        // Another robot's thread may have allocated it first
+        if (__atomic_compare_exchange_n(slot, &page, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            page = fresh;
+        } else {
+            free(fresh);
+        }
+    }
+    __atomic_store_n(&page[addr & 0xFF], generation, __ATOMIC_SEQ_CST);
+}
+
+// Returns 0 once the move is made, MOVE_RC_STRANDED if the disc ended up in
+// neither element, else 1.
 static int cmd_move_medium(ChangerHandle *handle, uint16_t transport, uint16_t source, uint16_t dest) {
     uint8_t cdb[12] = {0};
     cdb[0] = 0xA5; // MOVE MEDIUM
@@ -1893,103 +2661,300 @@ static int cmd_move_medium(ChangerHandle *handle, uint16_t transport, uint16_t s
     cdb[5] = source & 0xFF;
     cdb[6] = (dest >> 8) & 0xFF;
     cdb[7] = dest & 0xFF;
-    return execute_cdb(handle, cdb, sizeof(cdb), NULL, 0, kSCSIDataTransfer_NoDataTransfer, 60000);
+
+    // Status reads and other threads' planning go on; each robot carries one
+    // disc at a time, and different robots move at once
+    DeviceLocks *locks = handle->locks;
+    size_t robot = transport % TRANSPORT_LOCKS;
+    bool serial = false;
+    int others = 0;
+    if (locks) {
+        __atomic_add_fetch(&locks->busy[robot], 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&locks->transport[robot]);
+        serial = __atomic_load_n(&locks->serial_moves, __ATOMIC_SEQ_CST);
+        if (serial) pthread_mutex_lock(&locks->serial);
+        others = __atomic_fetch_add(&locks->in_flight, 1, __ATOMIC_SEQ_CST);
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    CdbStatus status;
+    int rc = execute_cdb_ex(handle, cdb, sizeof(cdb), NULL, 0, kSCSIDataTransfer_NoDataTransfer, 60000, 0, &status);
+    if (locks) __atomic_sub_fetch(&locks->in_flight, 1, __ATOMIC_SEQ_CST);
+
+    // Not every multi-robot changer takes a second MOVE MEDIUM while one is
+    // running; one that answers BUSY or NOT READY gets its moves one at a time.
+    // A move that timed out or never reached the device may still be running,
+    // so it is a failure, not a refusal.
+    bool refused = status.status == kSCSITaskStatus_BUSY ||
+                   (status.status == kSCSITaskStatus_CHECK_CONDITION && status.sense_key == kSENSE_KEY_NOT_READY);
+    if (rc != 0 && locks && !serial && others > 0 && refused) {
+        __atomic_store_n(&locks->serial_moves, true, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&locks->serial);
+        serial = true;
+        while (__atomic_load_n(&locks->in_flight, __ATOMIC_SEQ_CST) > 0) usleep(20000);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        rc = execute_cdb(handle, cdb, sizeof(cdb), NULL, 0, kSCSIDataTransfer_NoDataTransfer, 60000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // Every move checks itself from its two elements, so a bad one stops here
+    // rather than surfacing as a confusing failure in the next operation
+    MoveCheck check = rc == 0 && source != dest ? check_move(handle, cdb, transport, source, dest) : MOVE_CONFIRMED;
+    if (rc == 0) {
+        uint64_t generation = __atomic_add_fetch(&handle->generation, 1, __ATOMIC_SEQ_CST);
+        element_note_move(handle, source, generation);
+        element_note_move(handle, dest, generation);
+        // A move that didn't check out leaves the board as it was: the disc
+        // stayed in, or was put back in, the source
+        if (check == MOVE_CONFIRMED || check == MOVE_UNVERIFIED) board_record_move(handle->board, source, dest);
+    }
+    if (rc == 0 && check == MOVE_CONFIRMED && handle->motion) {
+        double ms = (double)(t1.tv_sec - t0.tv_sec) * 1000.0 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+        if (locks) pthread_mutex_lock(&locks->motion);
+        motion_record(handle->motion, transport, source, dest, ms);
+        if (locks) pthread_mutex_unlock(&locks->motion);
+    }
+    if (locks) {
+        if (serial) pthread_mutex_unlock(&locks->serial);
+        pthread_mutex_unlock(&locks->transport[robot]);
+        __atomic_sub_fetch(&locks->busy[robot], 1, __ATOMIC_SEQ_CST);
+    }
+    if (rc == 0 && check == MOVE_STRANDED) return MOVE_RC_STRANDED;
+    return rc == 0 && (check == MOVE_CONFIRMED || check == MOVE_UNVERIFIED) ? 0 : 1;
 }
 
-static int fetch_element_map(ChangerHandle *handle, ElementMap *map) {
-    uint32_t alloc = 65535;
-    uint8_t *buf = calloc(1, alloc);
-    if (!buf) return 1;
+// MCHANGER code for a failed cmd_move_medium()
+static int move_error(int rc) {
+    return rc == MOVE_RC_STRANDED ? MCHANGER_ERR_STRANDED : MCHANGER_ERR_SCSI;
+}
 
-    // First query "all types" to get transport, IE, and drive elements
-    // (Some devices only respond to "all types" for these element types)
-    uint8_t cdb[12] = {0};
-    cdb[0] = 0xB8; // READ ELEMENT STATUS
-    cdb[1] = 0x00; // all element types
-    cdb[2] = 0x00; // starting element address (high)
-    cdb[3] = 0x00; // starting element address (low)
-    cdb[4] = 0xFF; // number of elements (high) - request maximum
-    cdb[5] = 0xFF; // number of elements (low)
-    cdb[6] = (alloc >> 16) & 0xFF;
-    cdb[7] = (alloc >> 8) & 0xFF;
-    cdb[8] = alloc & 0xFF;
+static void device_locks_init(DeviceLocks *locks) {
+    memset(locks, 0, sizeof(*locks));
+    for (size_t i = 0; i < TRANSPORT_LOCKS; i++) pthread_mutex_init(&locks->transport[i], NULL);
+    pthread_mutex_init(&locks->serial, NULL);
+    pthread_mutex_init(&locks->motion, NULL);
+    pthread_mutex_init(&locks->sbp2, NULL);
+    pthread_mutex_init(&locks->door, NULL);
+}
 
-    int rc = execute_cdb(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, 60000);
-    if (rc != 0) {
-        free(buf);
-        return rc;
-    }
+static void device_locks_destroy(DeviceLocks *locks) {
+    for (size_t i = 0; i < TRANSPORT_LOCKS; i++) pthread_mutex_destroy(&locks->transport[i]);
+    pthread_mutex_destroy(&locks->serial);
+    pthread_mutex_destroy(&locks->motion);
+    pthread_mutex_destroy(&locks->sbp2);
+    pthread_mutex_destroy(&locks->door);
+}
+
+#define MAP_PIPELINE_DEPTH 4    // storage pages in flight at once while mapping
 
+// Read one page of storage elements, count from start, into the map's
+// slots. Returns the slots it added; 0 on error or an empty page.
+static size_t read_storage_page(ChangerHandle *handle, ElementMap *map, uint16_t start, uint16_t count,
+                                uint8_t *buf, uint32_t alloc, uint8_t flags) {
+    memset(buf, 0, alloc);
+    if (execute_read_element_status(handle, 0x02, start, count, buf, alloc, flags, 60000) != 0) return 0;
     uint32_t report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
-    if (report_bytes == 0) {
-        free(buf);
-        return 1;
+    if (report_bytes == 0) return 0;
+    size_t before = map->slots.count;
+    (void)parse_element_status_map(buf, report_bytes + 8 <= alloc ? report_bytes + 8 : alloc, map);
+    return map->slots.count - before;
+}
+
+// Storage elements from start up to end (exclusive), one page after another,
+// each starting after the last slot reported
+static void read_storage_pages(ChangerHandle *handle, ElementMap *map, uint32_t start, uint32_t end,
+                               uint8_t *buf, uint32_t alloc, uint8_t flags) {
+    while (start < end) {
+        uint32_t want = end - start < 0xFFFF ? end - start : 0xFFFF;
+        if (read_storage_page(handle, map, (uint16_t)start, (uint16_t)want, buf, alloc, flags) == 0) break;
+        start = (uint32_t)element_addr(&map->slots, map->slots.count - 1) + 1;
     }
+}
 
-    uint32_t parse_len = (report_bytes + 8 <= alloc) ? report_bytes + 8 : alloc;
-    (void)parse_element_status_map(buf, parse_len, map);
+// Page k of the storage elements from next up to end, per_page to a page
+static void storage_page_span(uint32_t next, uint32_t end, size_t per_page, size_t k, uint16_t *start,
+                              uint16_t *count) {
+    uint32_t first = next + (uint32_t)(k * per_page);
+    *start = (uint16_t)first;
+    *count = (uint16_t)(end - first < per_page ? end - first : per_page);
+}
 
-    // Now query storage elements separately - some devices return truncated
+// Pages of storage elements read by at most MAP_PIPELINE_DEPTH worker
+// threads. Page k is read into buffer k % MAP_PIPELINE_DEPTH, once the
+// reader has parsed the page before it in that buffer.
+typedef struct {
+    ChangerHandle *handle;
+    uint32_t next, end;
+    size_t per_page;
+    size_t count;               // pages
+    uint8_t *bufs;
+    uint32_t alloc;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t claimed;             // pages handed to a worker
+    size_t parsed;              // pages the reader is finished with
+    bool ready[MAP_PIPELINE_DEPTH];
+    int rc[MAP_PIPELINE_DEPTH];
+} StoragePager;
+
+static void *storage_pager_worker(void *arg) {
+    StoragePager *pager = arg;
+    pthread_mutex_lock(&pager->lock);
+    for (;;) {
+        while (pager->claimed < pager->count && pager->claimed >= pager->parsed + MAP_PIPELINE_DEPTH) {
+            pthread_cond_wait(&pager->cond, &pager->lock);
+        }
+        if (pager->claimed >= pager->count) break;
+        size_t k = pager->claimed++;
+        pthread_mutex_unlock(&pager->lock);
+
+        uint16_t start, count;
+        storage_page_span(pager->next, pager->end, pager->per_page, k, &start, &count);
+        uint8_t *buf = pager->bufs + (k % MAP_PIPELINE_DEPTH) * pager->alloc;
+        memset(buf, 0, pager->alloc);
+        int rc = execute_read_element_status(pager->handle, 0x02, start, count, buf, pager->alloc, RES_MEMORY,
+                                             60000);
+
+        pthread_mutex_lock(&pager->lock);
+        pager->rc[k % MAP_PIPELINE_DEPTH] = rc;
+        pager->ready[k % MAP_PIPELINE_DEPTH] = true;
+        pthread_cond_broadcast(&pager->cond);
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return NULL;
+}
+
+// All num storage elements from first. The first page shows how many the
+// device reports per command; the rest are then requested up to
+// MAP_PIPELINE_DEPTH at a time, each parsed as it arrives while later ones
+// are in flight. A page that comes back short is finished one page at a time.
+// SBP2 runs one command at a time, so it reads page after page.
+static void read_storage_map(ChangerHandle *handle, ElementMap *map, uint16_t first, uint16_t num,
+                             uint8_t *buf, uint32_t alloc) {
+    uint32_t end = (uint32_t)first + num;
+    size_t per_page = read_storage_page(handle, map, first, num, buf, alloc, RES_MEMORY);
+    if (per_page == 0 || per_page >= num) return;
+    uint32_t next = (uint32_t)element_addr(&map->slots, map->slots.count - 1) + 1;
+    if (next >= end) return;
+
+    StoragePager pager = { .handle = handle, .next = next, .end = end, .per_page = per_page,
+                           .count = (end - next + per_page - 1) / per_page, .alloc = alloc };
+    pager.bufs = handle->backend == BACKEND_SCSITASK ? malloc((size_t)MAP_PIPELINE_DEPTH * alloc) : NULL;
+    pthread_t workers[MAP_PIPELINE_DEPTH];
+    size_t started = 0;
+    if (pager.bufs) {
+        pthread_mutex_init(&pager.lock, NULL);
+        pthread_cond_init(&pager.cond, NULL);
+        while (started < MAP_PIPELINE_DEPTH && started < pager.count &&
+               pthread_create(&workers[started], NULL, storage_pager_worker, &pager) == 0) {
+            started++;
+        }
+        if (started == 0) {
+            pthread_cond_destroy(&pager.cond);
+            pthread_mutex_destroy(&pager.lock);
+        }
+    }
+    if (started == 0) {
+        free(pager.bufs);
+        read_storage_pages(handle, map, next, end, buf, alloc, RES_MEMORY);
+        return;
+    }
+
+    for (size_t k = 0; k < pager.count; k++) {
+        size_t slot = k % MAP_PIPELINE_DEPTH;
+        pthread_mutex_lock(&pager.lock);
+        while (!pager.ready[slot]) pthread_cond_wait(&pager.cond, &pager.lock);
+        int rc = pager.rc[slot];
+        pthread_mutex_unlock(&pager.lock);
+
+        const uint8_t *page = pager.bufs + slot * alloc;
+        size_t added = 0;
+        uint32_t report_bytes = (page[5] << 16) | (page[6] << 8) | page[7];
+        if (rc == 0 && report_bytes > 0) {
+            size_t before = map->slots.count;
+            (void)parse_element_status_map(page, report_bytes + 8 <= alloc ? report_bytes + 8 : alloc, map);
+            added = map->slots.count - before;
+        }
+        uint16_t start, count;
+        storage_page_span(next, end, per_page, k, &start, &count);
+        uint32_t page_end = (uint32_t)start + count;
+        uint32_t resume = added ? (uint32_t)element_addr(&map->slots, map->slots.count - 1) + 1 : start;
+
+        // Hand the buffer back before finishing a short page, so the window stays full
+        pthread_mutex_lock(&pager.lock);
+        pager.ready[slot] = false;
+        pager.parsed = k + 1;
+        pthread_cond_broadcast(&pager.cond);
+        pthread_mutex_unlock(&pager.lock);
+        if (resume < page_end) read_storage_pages(handle, map, resume, page_end, buf, alloc, RES_MEMORY);
+    }
+    for (size_t i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    pthread_cond_destroy(&pager.cond);
+    pthread_mutex_destroy(&pager.lock);
+    free(pager.bufs);
+}
+
+static int fetch_element_map(ChangerHandle *handle, ElementMap *map) {
+    uint32_t alloc = 65535;
+    uint8_t *buf = calloc(1, alloc);
+    if (!buf) return 1;
+
+    // First query "all types" to get transport, IE, and drive elements
+    // (Some devices only respond to "all types" for these element types).
+    // Only addresses are needed here, so CURDATA keeps the robot still.
+    int rc = execute_read_element_status(handle, 0x00, 0x0000, 0xFFFF, buf, alloc, RES_MEMORY, 60000);
+    if (rc != 0) {
+        free(buf);
+        return rc;
+    }
+
+    uint32_t report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
+    if (report_bytes == 0) {
+        free(buf);
+        return 1;
+    }
+
+    uint32_t parse_len = (report_bytes + 8 <= alloc) ? report_bytes + 8 : alloc;
+    (void)parse_element_status_map(buf, parse_len, map);
+
+    // Now query storage elements separately - some devices return truncated
     // storage lists when using "all types" but return full lists when querying
     // storage specifically. Some devices also paginate results (max ~40 per query).
     ElementAddrAssignment assign = {0};
     if (read_mode_sense_element(handle, &assign, false) == 0 && assign.num_storage > 0) {
         // Clear existing slots - we'll rebuild from paginated queries
-        free(map->slots.addrs);
-        map->slots.addrs = NULL;
-        map->slots.count = 0;
-        map->slots.cap = 0;
+        element_list_free(&map->slots);
 
         // Paginate through storage elements - device may return max ~40 per query
-        uint16_t start_addr = assign.first_storage;
-        uint16_t remaining = assign.num_storage;
-
-        while (remaining > 0) {
-            memset(cdb, 0, sizeof(cdb));
-            cdb[0] = 0xB8; // READ ELEMENT STATUS
-            cdb[1] = 0x02; // storage elements only
-            cdb[2] = (start_addr >> 8) & 0xFF;
-            cdb[3] = start_addr & 0xFF;
-            cdb[4] = (remaining >> 8) & 0xFF;
-            cdb[5] = remaining & 0xFF;
-            cdb[6] = (alloc >> 16) & 0xFF;
-            cdb[7] = (alloc >> 8) & 0xFF;
-            cdb[8] = alloc & 0xFF;
-
-            memset(buf, 0, alloc);
-            rc = execute_cdb(handle, cdb, sizeof(cdb), buf, alloc, kSCSIDataTransfer_FromTargetToInitiator, 60000);
-            if (rc != 0) break;
-
-            report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
-            if (report_bytes == 0) break;
-
-            // Parse this page of results
-            parse_len = (report_bytes + 8 <= alloc) ? report_bytes + 8 : alloc;
-            size_t before = map->slots.count;
-            (void)parse_element_status_map(buf, parse_len, map);
-            size_t added = map->slots.count - before;
-
-            if (added == 0) break; // No new elements, stop pagination
-
-            // Move to next page
-            start_addr += (uint16_t)added;
-            if (added >= remaining) break;
-            remaining -= (uint16_t)added;
-        }
+        read_storage_map(handle, map, assign.first_storage, assign.num_storage, buf, alloc);
 
         // Fill in missing slots from MODE SENSE if device didn't return all
         // Some devices (like VGP-XL1B) have firmware quirks where READ ELEMENT STATUS
-        // doesn't return all slots even though they physically exist
+        // doesn't return all slots even though they physically exist. A page
+        // lost mid-way leaves a hole rather than a short tail, so take the
+        // whole contiguous range the assignment page gives.
         if (map->slots.count < assign.num_storage) {
-            uint16_t expected_end = assign.first_storage + assign.num_storage;
-            uint16_t actual_end = assign.first_storage + (uint16_t)map->slots.count;
-            for (uint16_t addr = actual_end; addr < expected_end; addr++) {
-                element_list_push(&map->slots, addr);
+            element_list_free(&map->slots);
+            for (uint32_t i = 0; i < assign.num_storage && !map->short_of_memory; i++) {
+                if (!element_list_push(&map->slots, (uint16_t)(assign.first_storage + i))) {
+                    map->short_of_memory = true;
+                }
             }
         }
+    } else if (map->slots.count > 0) {
+        // No assignment page to say how many slots there are, and the
+        // "all types" report may have stopped at the device's page size:
+        // keep reading after its last slot until a page comes back empty
+        read_storage_pages(handle, map, (uint32_t)element_addr(&map->slots, map->slots.count - 1) + 1, 0x10000,
+                           buf, alloc, RES_MEMORY | RES_QUIET);
     }
 
     free(buf);
+    // A map missing an address would number the elements after it wrongly
+    if (map->short_of_memory) {
+        element_map_free(map);
+        return 1;
+    }
     return (map->transports.count + map->slots.count + map->drives.count + map->ie.count) > 0 ? 0 : 1;
 }
 
@@ -1997,19 +2962,19 @@ static void print_element_map(const ElementMap *map) {
     printf("Element Map:\n");
     printf("  Transports: %zu\n", map->transports.count);
     for (size_t i = 0; i < map->transports.count; i++) {
-        printf("    transport %zu -> 0x%04x\n", i + 1, map->transports.addrs[i]);
+        printf("    transport %zu -> 0x%04x\n", i + 1, element_addr(&map->transports, i));
     }
     printf("  Slots: %zu\n", map->slots.count);
     for (size_t i = 0; i < map->slots.count; i++) {
-        printf("    slot %zu -> 0x%04x\n", i + 1, map->slots.addrs[i]);
+        printf("    slot %zu -> 0x%04x\n", i + 1, element_addr(&map->slots, i));
     }
     printf("  Drives: %zu\n", map->drives.count);
     for (size_t i = 0; i < map->drives.count; i++) {
-        printf("    drive %zu -> 0x%04x\n", i + 1, map->drives.addrs[i]);
+        printf("    drive %zu -> 0x%04x\n", i + 1, element_addr(&map->drives, i));
     }
     printf("  Import/Export: %zu\n", map->ie.count);
     for (size_t i = 0; i < map->ie.count; i++) {
-        printf("    ie %zu -> 0x%04x\n", i + 1, map->ie.addrs[i]);
+        printf("    ie %zu -> 0x%04x\n", i + 1, element_addr(&map->ie, i));
     }
 }
 
@@ -2093,1148 +3058,7184 @@ static bool confirm_move(void) {
 
 /*
  * =============================================================================
- * CLI Main (excluded when building as library with -DMCHANGER_NO_MAIN)
+ * Disc Identification
  * =============================================================================
+ *
+ * Mounting a disc can take many seconds, and never happens for audio CDs. The
+ * drive itself can describe the disc as soon as it has spun up: the TOC gives
+ * the track layout and the lead-out gives the capacity, and a data track's
+ * volume descriptors tell apart discs of the same size. Identification talks
+ * MMC to the drive through IOKit and never waits for the filesystem.
  */
 
-#ifndef MCHANGER_NO_MAIN
+// Read the device identifier the changer reports for a drive element (DVCID).
+// Returns an MCHANGER code; NOT_FOUND if the changer doesn't report one.
+static int read_drive_identifier(ChangerHandle *handle, uint16_t drive_addr, char *out_id, size_t id_len) {
+    out_id[0] = '\0';
+    if (__atomic_load_n(&handle->dvcid_unsupported, __ATOMIC_RELAXED)) return MCHANGER_ERR_NOT_FOUND;
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        print_usage(argv[0]);
-        return 1;
+    uint32_t alloc = 1024;
+    uint8_t *buf = calloc(1, alloc);
+    if (!buf) return MCHANGER_ERR_INVALID;
+
+    int rc = execute_read_element_status(handle, 0x04, drive_addr, 1, buf, alloc,
+                                         RES_MEMORY | RES_DVCID, 30000);
+    if (rc != 0 || __atomic_load_n(&handle->dvcid_unsupported, __ATOMIC_RELAXED)) {
+        free(buf);
+        return rc != 0 ? MCHANGER_ERR_SCSI : MCHANGER_ERR_NOT_FOUND;
+    }
+
+    // Header (8) + page header (8) + descriptor; identifier follows the volume tags
+    uint8_t page_flags = buf[9];
+    uint16_t desc_len = (buf[10] << 8) | buf[11];
+    uint32_t id_off = 16 + 12;
+    if (page_flags & 0x80) id_off += 36; // PVolTag
+    if (page_flags & 0x40) id_off += 36; // AVolTag
+
+    int result = MCHANGER_ERR_NOT_FOUND;
+    if (desc_len >= (id_off - 16) + 4 && id_off + 4 <= alloc) {
+        uint8_t code_set = buf[id_off] & 0x0F;
+        uint8_t ident_len = buf[id_off + 3];
+        if (ident_len > 0 && id_off + 4 + ident_len <= alloc && id_off + 4 + ident_len <= 16 + (uint32_t)desc_len) {
+            const uint8_t *ident = &buf[id_off + 4];
+            size_t n = 0;
+            for (uint8_t i = 0; i < ident_len && n + 2 < id_len; i++) {
+                if (code_set == 0x01) {
+                    // Binary identifier: render as hex
+                    n += (size_t)snprintf(out_id + n, id_len - n, "%02x", ident[i]);
+                } else if (ident[i] >= 0x20 && ident[i] < 0x7F) {
+                    out_id[n++] = (char)ident[i];
+                }
+            }
+            if (n < id_len) out_id[n] = '\0';
+            while (n > 0 && out_id[n - 1] == ' ') out_id[--n] = '\0';
+            if (n > 0) result = MCHANGER_OK;
+        }
     }
 
-    bool force = false;
-    bool skip_tur = false;
-    bool dry_run = false;
-    bool confirm = false;
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--force") == 0) force = true;
-        if (strcmp(argv[i], "--no-tur") == 0) skip_tur = true;
-        if (strcmp(argv[i], "--dry-run") == 0) dry_run = true;
-        if (strcmp(argv[i], "--confirm") == 0) confirm = true;
-        if (strcmp(argv[i], "--debug") == 0) g_debug = true;
-        if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) g_verbose = true;
+    free(buf);
+    return result;
+}
+
+// Serial number IOKit reports for an MMC device ("" if none)
+static void get_drive_serial(io_service_t service, char *out, size_t out_len) {
+    out[0] = '\0';
+    CFTypeRef chars = IORegistryEntryCreateCFProperty(service, CFSTR("Device Characteristics"),
+                                                      kCFAllocatorDefault, 0);
+    if (chars && CFGetTypeID(chars) == CFDictionaryGetTypeID()) {
+        CFTypeRef serial = CFDictionaryGetValue((CFDictionaryRef)chars, CFSTR("Serial Number"));
+        cfstring_to_c(serial, out, out_len);
+    }
+    if (chars) CFRelease(chars);
+
+    // Trim the padding drives put around serial numbers
+    size_t len = strlen(out);
+    while (len > 0 && out[len - 1] == ' ') out[--len] = '\0';
+    size_t lead = strspn(out, " ");
+    if (lead > 0) memmove(out, out + lead, len - lead + 1);
+}
+
+// Find the MMC device for a changer drive (1-based). Changers only know their
+// drives by element address, so drives are matched by serial number when the
+// changer reports a DVCID identifier, and otherwise by registry order. A lone
+// MMC device is assumed to be the changer's drive.
+static io_service_t find_optical_drive_service(int drive, const char *drive_id) {
+    CFMutableDictionaryRef match = IOServiceMatching("IOSCSIPeripheralDeviceType05");
+    if (!match) return IO_OBJECT_NULL;
+
+    io_iterator_t iter = IO_OBJECT_NULL;
+    kern_return_t kr = IOServiceGetMatchingServices(kIOMasterPortDefault, match, &iter);
+    if (kr != KERN_SUCCESS) return IO_OBJECT_NULL;
+
+    io_service_t drives[16];
+    int count = 0;
+    io_service_t service;
+    while ((service = IOIteratorNext(iter))) {
+        if (count < (int)(sizeof(drives) / sizeof(drives[0]))) {
+            drives[count++] = service;
+        } else {
+            IOObjectRelease(service);
+        }
     }
+    IOObjectRelease(iter);
 
-    if (strcmp(argv[1], "list") == 0) {
-        list_changers();
-        return 0;
+    int pick = -1;
+    if (drive_id && drive_id[0]) {
+        for (int i = 0; i < count && pick < 0; i++) {
+            char serial[128];
+            get_drive_serial(drives[i], serial, sizeof(serial));
+            if (serial[0] && strstr(drive_id, serial)) pick = i;
+        }
     }
-    if (strcmp(argv[1], "list-all") == 0) {
-        list_all_scsi_devices();
-        return 0;
+    if (pick < 0 && drive >= 1 && drive <= count) pick = drive - 1;
+    if (pick < 0 && count == 1) pick = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (i != pick) IOObjectRelease(drives[i]);
     }
-    if (strcmp(argv[1], "scan-changers") == 0) {
-        scan_changers();
-        return 0;
+    return pick >= 0 ? drives[pick] : IO_OBJECT_NULL;
+}
+
+static MMCDeviceInterface **open_mmc_device(io_service_t service) {
+    IOCFPlugInInterface **plugin = NULL;
+    SInt32 score = 0;
+    kern_return_t kr = IOCreatePlugInInterfaceForService(
+        service,
+        kIOMMCDeviceUserClientTypeID,
+        kIOCFPlugInInterfaceID,
+        &plugin,
+        &score
+    );
+    if (kr != KERN_SUCCESS || !plugin) {
+        if (g_debug) fprintf(stderr, "MMC plugin for drive failed: 0x%x\n", kr);
+        return NULL;
     }
-    if (strcmp(argv[1], "list-sbp2") == 0) {
-        list_sbp2_luns();
-        return 0;
+
+    MMCDeviceInterface **mmc = NULL;
+    HRESULT result = (*plugin)->QueryInterface(
+        plugin,
+        CFUUIDGetUUIDBytes(kIOMMCDeviceInterfaceID),
+        (LPVOID *)&mmc
+    );
+    (*plugin)->Release(plugin);
+    if (result || !mmc) return NULL;
+    return mmc;
+}
+
+// Poll TEST UNIT READY until the disc has spun up. A freshly loaded drive can
+// briefly report "medium not present" while it closes, so that answer is only
+// believed after a short grace period.
+static int mmc_wait_ready(MMCDeviceInterface **mmc, int timeout_ms) {
+    const int poll_ms = 250;
+    const int no_medium_grace_ms = 5000;
+    for (int waited = 0; ; waited += poll_ms) {
+        SCSITaskStatus status = kSCSITaskStatus_CHECK_CONDITION;
+        SCSI_Sense_Data sense;
+        memset(&sense, 0, sizeof(sense));
+        IOReturn kr = (*mmc)->TestUnitReady(mmc, &status, &sense);
+        if (kr == kIOReturnSuccess && status == kSCSITaskStatus_GOOD) return MCHANGER_OK;
+
+        uint8_t key = sense.SENSE_KEY & 0x0F;
+        if (key == kSENSE_KEY_NOT_READY && sense.ADDITIONAL_SENSE_CODE == 0x3A &&
+            waited >= no_medium_grace_ms) {
+            return MCHANGER_ERR_EMPTY;
+        }
+        if (waited >= timeout_ms) return MCHANGER_ERR_BUSY;
+        usleep(poll_ms * 1000);
     }
-    if (strcmp(argv[1], "scan-sbp2") == 0) {
-        scan_sbp2_luns();
-        return 0;
+}
+
+// Map an MMC current profile to the media names DiskArbitration uses
+static const char *mmc_profile_media(uint16_t profile) {
+    if (profile >= 0x08 && profile <= 0x0A) return "CD";
+    if ((profile >= 0x10 && profile <= 0x1B) || profile == 0x2A || profile == 0x2B) return "DVD";
+    if (profile >= 0x40 && profile <= 0x43) return "BD";
+    if (profile >= 0x50 && profile <= 0x5A) return "HD DVD";
+    return NULL;
+}
+
+// FNV-1a, 64-bit
+static uint64_t fnv1a64(uint64_t hash, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
     }
+    return hash;
+}
 
-    ChangerHandle handle = open_changer(!force);
-    if ((handle.backend == BACKEND_SCSITASK && !handle.scsi_device) ||
-        (handle.backend == BACKEND_SBP2 && !handle.sbp2_login)) {
-        return 1;
+// Locate the MMC device for a changer drive (drive is 1-based; drive_addr lets
+// the changer's DVCID identifier pick the right device and may be 0)
+static io_service_t find_changer_drive_service(ChangerHandle *handle, uint16_t drive_addr, int drive) {
+    char drive_id[128] = {0};
+    if (handle && drive_addr != 0) {
+        read_drive_identifier(handle, drive_addr, drive_id, sizeof(drive_id));
     }
+    return find_optical_drive_service(drive, drive_id);
+}
 
-    int rc = 0;
-    if (strcmp(argv[1], "sanity-check") == 0) {
-        if (handle.backend == BACKEND_SCSITASK) {
-            printf("Backend: SCSITask\n");
-        } else if (handle.backend == BACKEND_SBP2) {
-            printf("Backend: SBP2\n");
-        } else {
-            printf("Backend: unknown\n");
+// BSD name of the media in an MMC device ("disk4"), if the OS has published one
+static bool get_drive_bsd_name(io_service_t service, char *out, size_t out_len) {
+    out[0] = '\0';
+    CFTypeRef name = IORegistryEntrySearchCFProperty(service, kIOServicePlane, CFSTR("BSD Name"),
+                                                     kCFAllocatorDefault, kIORegistryIterateRecursively);
+    cfstring_to_c(name, out, out_len);
+    if (name) CFRelease(name);
+    return out[0] != '\0';
+}
+
+// Sectors of a data track hashed into its fingerprint: ISO 9660's volume
+// descriptors start at 16, and most UDF discs put their main volume descriptor
+// sequence right after the recognition area
+#define FINGERPRINT_FIRST_SECTOR 16
+#define FINGERPRINT_SECTORS      32
+
+// Read the fingerprint sectors of the data track at track_lba into buf
+// (FINGERPRINT_SECTORS * 2048 bytes). READ(10) needs the drive to ourselves,
+// which the OS grants only while nothing is mounted; a disc that has already
+// mounted is read through its raw node instead, which usually needs sudo.
+static int mmc_read_volume_area(MMCDeviceInterface **mmc, io_service_t service, uint32_t track_lba, uint8_t *buf) {
+    const uint32_t lba = track_lba + FINGERPRINT_FIRST_SECTOR;
+    const uint32_t len = FINGERPRINT_SECTORS * 2048;
+
+    SCSITaskDeviceInterface **dev = (*mmc)->GetSCSITaskDeviceInterface(mmc);
+    if (dev && (*dev)->ObtainExclusiveAccess(dev) == kIOReturnSuccess) {
+        int rc = MCHANGER_ERR_SCSI;
+        SCSITaskInterface **task = (*dev)->CreateSCSITask(dev);
+        if (task) {
+            uint8_t cdb[10] = {0};
+            cdb[0] = 0x28; // READ(10)
+            cdb[2] = (lba >> 24) & 0xFF;
+            cdb[3] = (lba >> 16) & 0xFF;
+            cdb[4] = (lba >> 8) & 0xFF;
+            cdb[5] = lba & 0xFF;
+            cdb[7] = (FINGERPRINT_SECTORS >> 8) & 0xFF;
+            cdb[8] = FINGERPRINT_SECTORS & 0xFF;
+            SCSITaskSGElement sg;
+#if defined(__LP64__)
+            sg.address = (mach_vm_address_t)buf;
+#else
+            sg.address = (UInt32)buf;
+#endif
+            sg.length = len;
+            (*task)->SetTaskAttribute(task, kSCSITask_SIMPLE);
+            (*task)->SetCommandDescriptorBlock(task, cdb, sizeof(cdb));
+            (*task)->SetTimeoutDuration(task, 30000);
+            (*task)->SetScatterGatherEntries(task, &sg, 1, len, kSCSIDataTransfer_FromTargetToInitiator);
+
+            SCSI_Sense_Data sense;
+            memset(&sense, 0, sizeof(sense));
+            SCSITaskStatus status = kSCSITaskStatus_CHECK_CONDITION;
+            UInt64 transferred = 0;
+            IOReturn kr = (*task)->ExecuteTaskSync(task, &sense, &status, &transferred);
+            if (kr == kIOReturnSuccess && status == kSCSITaskStatus_GOOD && transferred == len) {
+                rc = MCHANGER_OK;
+            } else if (g_verbose) {
+                print_sense(&sense);
+            }
+            (*task)->Release(task);
         }
-        printf("User client open: OK\n");
-        rc = 0;
-        goto out;
+        (*dev)->ReleaseExclusiveAccess(dev);
+        (*dev)->Release(dev);
+        return rc;
     }
-    if (!skip_tur && strcmp(argv[1], "test-unit-ready") != 0) {
-        int tur = cmd_test_unit_ready(&handle);
-        if (tur != 0 && !force) {
-            fprintf(stderr, "TEST UNIT READY failed. Use --force to continue.\n");
-            rc = 1; goto out;
+    if (dev) (*dev)->Release(dev);
+
+    char bsd[64], device[80];
+    if (service == IO_OBJECT_NULL || !get_drive_bsd_name(service, bsd, sizeof(bsd))) return MCHANGER_ERR_OPEN;
+    snprintf(device, sizeof(device), "/dev/r%s", bsd);
+    int fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        if (g_verbose) fprintf(stderr, "Unable to read %s: %s\n", device, strerror(errno));
+        return MCHANGER_ERR_OPEN;
+    }
+    ssize_t got = pread(fd, buf, len, (off_t)lba * 2048);
+    close(fd);
+    return got == (ssize_t)len ? MCHANGER_OK : MCHANGER_ERR_SCSI;
+}
+
+// Identify the disc in an open MMC device, waiting up to timeout_ms for it to
+// become ready (0 polls once). service is the drive's, for reading a data disc
+// the OS has already mounted, and may be IO_OBJECT_NULL. Returns an MCHANGER
+// code; BUSY means not ready yet.
+static int identify_disc_mmc(MMCDeviceInterface **mmc, io_service_t service, int timeout_ms, DiscInfo *info,
+                             int *out_tracks) {
+    memset(info, 0, sizeof(*info));
+    if (out_tracks) *out_tracks = 0;
+
+    int rc = mmc_wait_ready(mmc, timeout_ms);
+    if (rc != MCHANGER_OK) return rc;
+
+    // Format 0 TOC in LBA form: 4-byte header, 8 bytes per track plus lead-out
+    uint8_t toc[4 + 8 * 100];
+    SCSI_Sense_Data sense;
+    memset(toc, 0, sizeof(toc));
+    memset(&sense, 0, sizeof(sense));
+    IOReturn kr = (*mmc)->ReadTableOfContents(mmc, 0, 0x00, 1, toc, sizeof(toc), &sense);
+    if (kr != kIOReturnSuccess) {
+        if (g_verbose) print_sense(&sense);
+        return MCHANGER_ERR_SCSI;
+    }
+
+    uint32_t toc_len = ((uint32_t)toc[0] << 8 | toc[1]) + 2;
+    if (toc_len > sizeof(toc)) toc_len = sizeof(toc);
+    if (toc_len < 4 + 8) {
+        return MCHANGER_ERR_SCSI;
+    }
+
+    int tracks = 0, data_tracks = 0;
+    uint32_t leadout = 0, data_lba = 0;
+    for (uint32_t off = 4; off + 8 <= toc_len; off += 8) {
+        uint8_t control = toc[off + 1] & 0x0F;
+        uint8_t track = toc[off + 2];
+        uint32_t lba = ((uint32_t)toc[off + 4] << 24) | ((uint32_t)toc[off + 5] << 16) |
+                       ((uint32_t)toc[off + 6] << 8) | toc[off + 7];
+        if (track == 0xAA) {
+            leadout = lba;
+        } else {
+            tracks++;
+            if ((control & 0x04) && data_tracks++ == 0) data_lba = lba;
         }
     }
 
-    if (strcmp(argv[1], "test-unit-ready") == 0) {
-        rc = cmd_test_unit_ready(&handle);
-    } else if (strcmp(argv[1], "inquiry") == 0) {
-        rc = cmd_inquiry(&handle);
-    } else if (strcmp(argv[1], "inquiry-vpd") == 0) {
-        uint8_t page = 0;
-        bool have_page = false;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--page") == 0 && i + 1 < argc) {
-                have_page = parse_u8(argv[++i], &page);
-            }
+    // Everything after the length field: track range, every track's type and
+    // start address, and the lead-out. A single-session DVD or BD has one
+    // track, so its TOC is only its capacity; the first data track's volume
+    // descriptors tell same-size discs apart.
+    uint64_t hash = fnv1a64(0xcbf29ce484222325ULL, toc + 2, toc_len - 2);
+    if (data_tracks > 0) {
+        uint8_t *volume = malloc(FINGERPRINT_SECTORS * 2048);
+        if (!volume) return MCHANGER_ERR_INVALID;
+        rc = mmc_read_volume_area(mmc, service, data_lba, volume);
+        if (rc == MCHANGER_OK) hash = fnv1a64(hash, volume, FINGERPRINT_SECTORS * 2048);
+        free(volume);
+        if (rc != MCHANGER_OK) return rc;
+    }
+    snprintf(info->fingerprint, sizeof(info->fingerprint), "%016llx", (unsigned long long)hash);
+
+    bool audio = tracks > 0 && data_tracks == 0;
+    info->size_bytes = (uint64_t)leadout * (audio ? 2352 : 2048);
+    if (info->size_bytes >= 1000000000ULL) {
+        snprintf(info->size, sizeof(info->size), "%.1f GB", info->size_bytes / 1000000000.0);
+    } else if (info->size_bytes > 0) {
+        snprintf(info->size, sizeof(info->size), "%.1f MB", info->size_bytes / 1000000.0);
+    }
+
+    // Current profile from the GET CONFIGURATION header
+    uint8_t config[8] = {0};
+    UInt32 got = 0;
+    const char *media = NULL;
+    memset(&sense, 0, sizeof(sense));
+    if ((*mmc)->GetConfiguration(mmc, 0x01, 0, config, sizeof(config), &got, &sense) == kIOReturnSuccess &&
+        got >= 8) {
+        media = mmc_profile_media((uint16_t)(config[6] << 8 | config[7]));
+    }
+    if (audio) media = "CD-DA";
+    if (media) snprintf(info->media_type, sizeof(info->media_type), "%s", media);
+
+    if (out_tracks) *out_tracks = tracks;
+    return MCHANGER_OK;
+}
+
+// Identify the disc in a changer drive. Returns an MCHANGER code and fills
+// info->fingerprint, size_bytes, size and media_type.
+static int identify_disc(ChangerHandle *handle, uint16_t drive_addr, int drive, int timeout_secs,
+                         DiscInfo *info, int *out_tracks) {
+    memset(info, 0, sizeof(*info));
+    if (out_tracks) *out_tracks = 0;
+
+    io_service_t service = find_changer_drive_service(handle, drive_addr, drive);
+    if (service == IO_OBJECT_NULL) return MCHANGER_ERR_NOT_FOUND;
+    MMCDeviceInterface **mmc = open_mmc_device(service);
+    if (!mmc) {
+        IOObjectRelease(service);
+        return MCHANGER_ERR_OPEN;
+    }
+
+    int rc = identify_disc_mmc(mmc, service, timeout_secs * 1000, info, out_tracks);
+    (*mmc)->Release(mmc);
+    IOObjectRelease(service);
+    return rc;
+}
+
+// Public view of an identified disc
+static void disc_id_from_info(const DiscInfo *info, int tracks, MChangerDiscId *out) {
+    memset(out, 0, sizeof(*out));
+    snprintf(out->fingerprint, sizeof(out->fingerprint), "%s", info->fingerprint);
+    snprintf(out->media_type, sizeof(out->media_type), "%s", info->media_type);
+    out->size_bytes = info->size_bytes;
+    out->track_count = tracks;
+}
+
+/*
+ * =============================================================================
+ * Disc Catalog
+ * =============================================================================
+ *
+ * The catalog remembers the last disc identified in every slot so that finding
+ * a disc is a table lookup instead of a series of robot swaps. It is a plain
+ * tab-separated text file, one slot per line, rewritten atomically on save.
+ */
+
+#define CATALOG_HEADER "# mchanger catalog v1"
+
+struct MChangerCatalog {
+    pthread_mutex_t lock;           /* entries and the file; held around catalog_get/put/record/forget/save() */
+    char path[1024];
+    MChangerCatalogEntry *entries;  /* sorted by slot */
+    size_t count;
+    size_t cap;
+    bool dirty;
+};
+
+/* Resolve the default base directory (~/.mchanger), creating it if needed */
+static bool mchanger_base_dir(char *out, size_t out_len) {
+    const char *home = getenv("HOME");
+    if (!home || !*home) return false;
+    snprintf(out, out_len, "%s/.mchanger", home);
+    if (mkdir(out, 0755) != 0 && errno != EEXIST) return false;
+    return true;
+}
+
+/* Copy a field into the catalog file, replacing separators */
+static void catalog_write_field(FILE *fp, const char *value) {
+    if (!value || !*value) {
+        fputc('-', fp);
+        return;
+    }
+    for (const char *c = value; *c; c++) {
+        fputc((*c == '\t' || *c == '\n' || *c == '\r') ? ' ' : *c, fp);
+    }
+}
+
+static void catalog_read_field(char *out, size_t out_len, const char *value) {
+    if (strcmp(value, "-") == 0) value = "";
+    snprintf(out, out_len, "%s", value);
+}
+
+static MChangerCatalogEntry *catalog_find_slot(MChangerCatalog *catalog, int slot) {
+    for (size_t i = 0; i < catalog->count; i++) {
+        if (catalog->entries[i].slot == slot) return &catalog->entries[i];
+    }
+    return NULL;
+}
+
+/* Insert or replace by slot, keeping entries sorted. Other slots are left
+ * alone even when they hold the same fingerprint: two copies of a disc look
+ * alike, and a disc that moved is reported by catalog_note_moved(). */
+static int catalog_put(MChangerCatalog *catalog, const MChangerCatalogEntry *entry) {
+    MChangerCatalogEntry *existing = catalog_find_slot(catalog, entry->slot);
+    if (existing) {
+        *existing = *entry;
+        return MCHANGER_OK;
+    }
+    if (catalog->count == catalog->cap) {
+        size_t new_cap = catalog->cap ? catalog->cap * 2 : 64;
+        MChangerCatalogEntry *next = realloc(catalog->entries, new_cap * sizeof(MChangerCatalogEntry));
+        if (!next) return MCHANGER_ERR_INVALID;
+        catalog->entries = next;
+        catalog->cap = new_cap;
+    }
+    size_t pos = catalog->count;
+    while (pos > 0 && catalog->entries[pos - 1].slot > entry->slot) {
+        catalog->entries[pos] = catalog->entries[pos - 1];
+        pos--;
+    }
+    catalog->entries[pos] = *entry;
+    catalog->count++;
+    return MCHANGER_OK;
+}
+
+/* The read-only calls take a const catalog but still lock it */
+static void catalog_lock(const MChangerCatalog *catalog) {
+    pthread_mutex_lock((pthread_mutex_t *)&catalog->lock);
+}
+
+static void catalog_unlock(const MChangerCatalog *catalog) {
+    pthread_mutex_unlock((pthread_mutex_t *)&catalog->lock);
+}
+
+MChangerCatalog *mchanger_catalog_open(const char *path) {
+    MChangerCatalog *catalog = calloc(1, sizeof(MChangerCatalog));
+    if (!catalog) return NULL;
+    pthread_mutex_init(&catalog->lock, NULL);
+
+    if (path && *path) {
+        snprintf(catalog->path, sizeof(catalog->path), "%s", path);
+    } else if (getenv("MCHANGER_CATALOG") && *getenv("MCHANGER_CATALOG")) {
+        snprintf(catalog->path, sizeof(catalog->path), "%s", getenv("MCHANGER_CATALOG"));
+    } else {
+        char base[1024];
+        if (!mchanger_base_dir(base, sizeof(base))) {
+            mchanger_catalog_close(catalog);
+            return NULL;
         }
-        if (!have_page) {
-            fprintf(stderr, "Missing or invalid --page.\n");
-            rc = 1; goto out;
+        int n = snprintf(catalog->path, sizeof(catalog->path), "%s/catalog.tsv", base);
+        if (n < 0 || (size_t)n >= sizeof(catalog->path)) {
+            mchanger_catalog_close(catalog);
+            return NULL;
         }
-        rc = cmd_inquiry_vpd(&handle, page);
-    } else if (strcmp(argv[1], "report-luns") == 0) {
-        rc = cmd_report_luns(&handle);
-    } else if (strcmp(argv[1], "log-sense") == 0) {
-        uint8_t page = 0;
-        bool have_page = false;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--page") == 0 && i + 1 < argc) {
-                have_page = parse_u8(argv[++i], &page);
-            }
+    }
+
+    FILE *fp = fopen(catalog->path, "r");
+    if (!fp) {
+        /* A missing file is an empty catalog */
+        return catalog;
+    }
+
+    char line[2048];
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        size_t len = strcspn(line, "\r\n");
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+        line[len] = '\0';
+
+        /* The loads column was added later; older files stop at volume */
+        char *fields[7] = {0};
+        char *cursor = line;
+        int n = 0;
+        while (n < 7) {
+            fields[n++] = cursor;
+            char *tab = (n < 7) ? strchr(cursor, '\t') : NULL;
+            if (!tab) break;
+            *tab = '\0';
+            cursor = tab + 1;
         }
-        if (!have_page) {
-            fprintf(stderr, "Missing or invalid --page.\n");
-            rc = 1; goto out;
+        if (n < 6) continue;
+
+        MChangerCatalogEntry entry = {0};
+        entry.slot = atoi(fields[0]);
+        if (entry.slot < 1) continue;
+        catalog_read_field(entry.fingerprint, sizeof(entry.fingerprint), fields[1]);
+        entry.last_seen = (int64_t)strtoll(fields[2], NULL, 10);
+        entry.size_bytes = (uint64_t)strtoull(fields[3], NULL, 10);
+        catalog_read_field(entry.media_type, sizeof(entry.media_type), fields[4]);
+        catalog_read_field(entry.volume, sizeof(entry.volume), fields[5]);
+        if (n > 6) entry.loads = (uint32_t)strtoul(fields[6], NULL, 10);
+        catalog_put(catalog, &entry);
+    }
+    fclose(fp);
+    return catalog;
+}
+
+static int catalog_save(MChangerCatalog *catalog) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", catalog->path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) return MCHANGER_ERR_OPEN;
+
+    fprintf(fp, "%s\n", CATALOG_HEADER);
+    fprintf(fp, "# slot\tfingerprint\tlast_seen\tsize_bytes\tmedia_type\tvolume\tloads\n");
+    for (size_t i = 0; i < catalog->count; i++) {
+        const MChangerCatalogEntry *e = &catalog->entries[i];
+        fprintf(fp, "%d\t", e->slot);
+        catalog_write_field(fp, e->fingerprint);
+        fprintf(fp, "\t%lld\t%llu\t", (long long)e->last_seen, (unsigned long long)e->size_bytes);
+        catalog_write_field(fp, e->media_type);
+        fputc('\t', fp);
+        catalog_write_field(fp, e->volume);
+        fprintf(fp, "\t%u\n", e->loads);
+    }
+
+    if (fclose(fp) != 0 || rename(tmp_path, catalog->path) != 0) {
+        unlink(tmp_path);
+        return MCHANGER_ERR_OPEN;
+    }
+    catalog->dirty = false;
+    return MCHANGER_OK;
+}
+
+int mchanger_catalog_save(MChangerCatalog *catalog) {
+    if (!catalog) return MCHANGER_ERR_INVALID;
+    catalog_lock(catalog);
+    int rc = catalog_save(catalog);
+    catalog_unlock(catalog);
+    return rc;
+}
+
+void mchanger_catalog_close(MChangerCatalog *catalog) {
+    if (!catalog) return;
+    pthread_mutex_destroy(&catalog->lock);
+    free(catalog->entries);
+    free(catalog);
+}
+
+const char *mchanger_catalog_path(const MChangerCatalog *catalog) {
+    return catalog ? catalog->path : NULL;
+}
+
+static int catalog_record(MChangerCatalog *catalog, const MChangerCatalogEntry *entry) {
+    MChangerCatalogEntry copy = *entry;
+    if (copy.last_seen == 0) copy.last_seen = (int64_t)time(NULL);
+    int rc = catalog_put(catalog, &copy);
+    if (rc == MCHANGER_OK) catalog->dirty = true;
+    return rc;
+}
+
+static int catalog_forget(MChangerCatalog *catalog, int slot) {
+    for (size_t i = 0; i < catalog->count; i++) {
+        if (catalog->entries[i].slot == slot) {
+            memmove(&catalog->entries[i], &catalog->entries[i + 1],
+                    (catalog->count - i - 1) * sizeof(MChangerCatalogEntry));
+            catalog->count--;
+            catalog->dirty = true;
+            return MCHANGER_OK;
         }
-        rc = cmd_log_sense(&handle, page);
-    } else if (strcmp(argv[1], "mode-sense-element") == 0) {
-        rc = cmd_mode_sense_element(&handle);
-    } else if (strcmp(argv[1], "probe-storage") == 0) {
-        rc = cmd_probe_storage(&handle);
-    } else if (strcmp(argv[1], "init-status") == 0) {
-        rc = cmd_init_status(&handle);
-    } else if (strcmp(argv[1], "read-element-status") == 0) {
-        uint8_t element_type = 0;
-        uint16_t start = 0;
-        uint16_t count = 0;
-        uint32_t alloc = 0;
-        bool dump_raw = false;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--element-type") == 0 && i + 1 < argc) {
-                if (!parse_element_type(argv[++i], &element_type)) {
-                    fprintf(stderr, "Invalid element type.\n");
-                    rc = 1; goto out;
-                }
-            } else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) {
-                if (!parse_u16(argv[++i], &start)) {
-                    fprintf(stderr, "Invalid --start.\n");
-                    rc = 1; goto out;
-                }
-            } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
-                if (!parse_u16(argv[++i], &count)) {
-                    fprintf(stderr, "Invalid --count.\n");
-                    rc = 1; goto out;
-                }
-            } else if (strcmp(argv[i], "--alloc") == 0 && i + 1 < argc) {
-                if (!parse_u32(argv[++i], &alloc)) {
-                    fprintf(stderr, "Invalid --alloc.\n");
-                    rc = 1; goto out;
-                }
-            } else if (strcmp(argv[i], "--raw") == 0) {
-                dump_raw = true;
-            }
+    }
+    return MCHANGER_ERR_NOT_FOUND;
+}
+
+static int catalog_get(const MChangerCatalog *catalog, int slot, MChangerCatalogEntry *out) {
+    for (size_t i = 0; i < catalog->count; i++) {
+        if (catalog->entries[i].slot == slot) {
+            *out = catalog->entries[i];
+            return MCHANGER_OK;
         }
-        if (alloc == 0) {
-            fprintf(stderr, "Missing --alloc.\n");
-            rc = 1; goto out;
+    }
+    return MCHANGER_ERR_NOT_FOUND;
+}
+
+int mchanger_catalog_record(MChangerCatalog *catalog, const MChangerCatalogEntry *entry) {
+    if (!catalog || !entry || entry->slot < 1) return MCHANGER_ERR_INVALID;
+    catalog_lock(catalog);
+    int rc = catalog_record(catalog, entry);
+    catalog_unlock(catalog);
+    return rc;
+}
+
+int mchanger_catalog_forget(MChangerCatalog *catalog, int slot) {
+    if (!catalog || slot < 1) return MCHANGER_ERR_INVALID;
+    catalog_lock(catalog);
+    int rc = catalog_forget(catalog, slot);
+    catalog_unlock(catalog);
+    return rc;
+}
+
+int mchanger_catalog_get(const MChangerCatalog *catalog, int slot, MChangerCatalogEntry *out) {
+    if (!catalog || !out || slot < 1) return MCHANGER_ERR_INVALID;
+    catalog_lock(catalog);
+    int rc = catalog_get(catalog, slot, out);
+    catalog_unlock(catalog);
+    return rc;
+}
+
+int mchanger_catalog_find_volume(const MChangerCatalog *catalog, const char *volume, MChangerCatalogEntry *out) {
+    if (!catalog || !volume || !out) return MCHANGER_ERR_INVALID;
+    int rc = MCHANGER_ERR_NOT_FOUND;
+    catalog_lock(catalog);
+    for (size_t i = 0; i < catalog->count; i++) {
+        if (strcasecmp(catalog->entries[i].volume, volume) == 0) {
+            *out = catalog->entries[i];
+            rc = MCHANGER_OK;
+            break;
         }
-        rc = cmd_read_element_status(&handle, element_type, start, count, alloc, dump_raw);
-    } else if (strcmp(argv[1], "move") == 0) {
-        uint16_t transport = 0, source = 0, dest = 0;
-        bool have_transport = false, have_source = false, have_dest = false;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
-                have_transport = parse_u16(argv[++i], &transport);
-            } else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
-                have_source = parse_u16(argv[++i], &source);
-            } else if (strcmp(argv[i], "--dest") == 0 && i + 1 < argc) {
-                have_dest = parse_u16(argv[++i], &dest);
-            }
+    }
+    catalog_unlock(catalog);
+    return rc;
+}
+
+int mchanger_catalog_find_fingerprint(const MChangerCatalog *catalog, const char *fingerprint,
+                                      MChangerCatalogEntry *out) {
+    if (!catalog || !fingerprint || !*fingerprint || !out) return MCHANGER_ERR_INVALID;
+    int rc = MCHANGER_ERR_NOT_FOUND;
+    catalog_lock(catalog);
+    for (size_t i = 0; i < catalog->count; i++) {
+        if (strcasecmp(catalog->entries[i].fingerprint, fingerprint) == 0) {
+            *out = catalog->entries[i];
+            rc = MCHANGER_OK;
+            break;
         }
-        if (!have_transport || !have_source || !have_dest) {
-            fprintf(stderr, "Missing --transport, --source, or --dest.\n");
-            rc = 1; goto out;
+    }
+    catalog_unlock(catalog);
+    return rc;
+}
+
+size_t mchanger_catalog_count(const MChangerCatalog *catalog) {
+    if (!catalog) return 0;
+    catalog_lock(catalog);
+    size_t count = catalog->count;
+    catalog_unlock(catalog);
+    return count;
+}
+
+int mchanger_catalog_entry_at(const MChangerCatalog *catalog, size_t index, MChangerCatalogEntry *out) {
+    if (!catalog || !out) return MCHANGER_ERR_INVALID;
+    catalog_lock(catalog);
+    bool have = index < catalog->count;
+    if (have) *out = catalog->entries[index];
+    catalog_unlock(catalog);
+    return have ? MCHANGER_OK : MCHANGER_ERR_INVALID;
+}
+
+void mchanger_set_catalog(MChangerHandle *changer, MChangerCatalog *catalog) {
+    if (!changer) return;
+    changer->catalog = catalog;
+}
+
+/* Record a freshly identified disc for a slot and persist the catalog */
+static void catalog_note_disc(MChangerCatalog *catalog, int slot, const DiscInfo *info) {
+    if (!catalog || slot < 1 || !info) return;
+    MChangerCatalogEntry entry = {0};
+    MChangerCatalogEntry previous;
+    catalog_lock(catalog);
+    if (catalog_get(catalog, slot, &previous) == MCHANGER_OK) {
+        // A different fingerprint means a different disc: nothing carries over
+        bool replaced = info->fingerprint[0] && previous.fingerprint[0] &&
+                        strcasecmp(info->fingerprint, previous.fingerprint) != 0;
+        if (!replaced) entry = previous;
+    }
+    entry.slot = slot;
+    if (info->name[0]) snprintf(entry.volume, sizeof(entry.volume), "%s", info->name);
+    if (info->media_type[0]) snprintf(entry.media_type, sizeof(entry.media_type), "%s", info->media_type);
+    if (info->fingerprint[0]) snprintf(entry.fingerprint, sizeof(entry.fingerprint), "%s", info->fingerprint);
+    if (info->size_bytes > 0) entry.size_bytes = info->size_bytes;
+    entry.last_seen = (int64_t)time(NULL);
+    if (catalog_record(catalog, &entry) == MCHANGER_OK) {
+        catalog_save(catalog);
+    }
+    catalog_unlock(catalog);
+}
+
+/* A slot's disc left the changer (or an unknown one arrived): drop the entry */
+static void catalog_note_slot_changed(MChangerCatalog *catalog, int slot) {
+    if (!catalog || slot < 1) return;
+    catalog_lock(catalog);
+    if (catalog_forget(catalog, slot) == MCHANGER_OK) {
+        catalog_save(catalog);
+    }
+    catalog_unlock(catalog);
+}
+
+/* Count a load of a slot's disc; rebalancing moves often-loaded discs closer */
+static void catalog_note_access(MChangerCatalog *catalog, int slot) {
+    if (!catalog || slot < 1) return;
+    MChangerCatalogEntry entry = {0};
+    catalog_lock(catalog);
+    if (catalog_get(catalog, slot, &entry) != MCHANGER_OK) entry.slot = slot;
+    entry.loads++;
+    if (catalog_record(catalog, &entry) == MCHANGER_OK) {
+        catalog_save(catalog);
+    }
+    catalog_unlock(catalog);
+}
+
+/* A disc moved between slots: its entry (and load count) goes with it */
+static void catalog_note_moved(MChangerCatalog *catalog, int from, int to) {
+    if (!catalog || from < 1 || to < 1) return;
+    MChangerCatalogEntry entry;
+    catalog_lock(catalog);
+    bool known = catalog_get(catalog, from, &entry) == MCHANGER_OK;
+    catalog_forget(catalog, from);
+    catalog_forget(catalog, to);
+    if (known) {
+        entry.slot = to;
+        catalog_record(catalog, &entry);
+    }
+    catalog_save(catalog);
+    catalog_unlock(catalog);
+}
+
+static void print_catalog_entry(const MChangerCatalogEntry *e) {
+    char when[32] = "-";
+    if (e->last_seen > 0) {
+        time_t t = (time_t)e->last_seen;
+        struct tm tm_local;
+        if (localtime_r(&t, &tm_local)) {
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm_local);
         }
-        if (dry_run) {
-            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
-                   transport, source, dest);
-        } else {
-            if (confirm && !confirm_move()) {
-                fprintf(stderr, "Aborted.\n");
-                rc = 1; goto out;
+    }
+    char size[32] = "?";
+    if (e->size_bytes >= 1000000000ULL) {
+        snprintf(size, sizeof(size), "%.1f GB", e->size_bytes / 1000000000.0);
+    } else if (e->size_bytes > 0) {
+        snprintf(size, sizeof(size), "%.1f MB", e->size_bytes / 1000000.0);
+    }
+    printf("  slot %3d  %-8s %9s  %s  %-16s  %3u loads  %s\n", e->slot,
+           e->media_type[0] ? e->media_type : "?", size, when,
+           e->fingerprint[0] ? e->fingerprint : "-", e->loads,
+           e->volume[0] ? e->volume : "(no volume name)");
+}
+
+// catalog [list] | show --slot <n> | find --volume <name> | find --fingerprint <hex> |
+//         find --file <name> | index --slot <n> [--path <mount>] | forget --slot <n>
+// Works entirely from the catalog file; the changer is never opened.
+static int cmd_catalog(int argc, char **argv, const char *catalog_path) {
+    MChangerCatalog *catalog = mchanger_catalog_open(catalog_path);
+    if (!catalog) {
+        fprintf(stderr, "Unable to open catalog.\n");
+        return 1;
+    }
+
+    const char *sub = (argc > 2 && argv[2][0] != '-') ? argv[2] : "list";
+    size_t slot_index = 0;
+    bool have_slot = false;
+    const char *volume = NULL;
+    const char *fingerprint = NULL;
+    const char *file = NULL;
+    const char *mount_path = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+            have_slot = parse_index(argv[++i], &slot_index);
+        } else if (strcmp(argv[i], "--volume") == 0 && i + 1 < argc) {
+            volume = argv[++i];
+        } else if (strcmp(argv[i], "--fingerprint") == 0 && i + 1 < argc) {
+            fingerprint = argv[++i];
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            file = argv[++i];
+        } else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) {
+            mount_path = argv[++i];
+        }
+    }
+
+    int rc = 0;
+    MChangerCatalogEntry entry;
+    if (strcmp(sub, "list") == 0) {
+        size_t count = mchanger_catalog_count(catalog);
+        printf("Catalog: %s (%zu disc%s)\n", mchanger_catalog_path(catalog), count, count == 1 ? "" : "s");
+        for (size_t i = 0; i < count; i++) {
+            if (mchanger_catalog_entry_at(catalog, i, &entry) == MCHANGER_OK) {
+                print_catalog_entry(&entry);
             }
-            rc = cmd_move_medium(&handle, transport, source, dest);
         }
-    } else if (strcmp(argv[1], "list-map") == 0) {
-        ElementMap map = {0};
-        rc = fetch_element_map(&handle, &map);
-        if (rc == 0) {
-            print_element_map(&map);
-            warn_if_slot_mismatch(&handle, &map);
+    } else if (strcmp(sub, "show") == 0) {
+        if (!have_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1;
+        } else if (mchanger_catalog_get(catalog, (int)slot_index, &entry) == MCHANGER_OK) {
+            print_catalog_entry(&entry);
         } else {
-            fprintf(stderr, "Failed to read element map.\n");
+            printf("Slot %zu: not cataloged.\n", slot_index);
+            rc = 1;
         }
-        element_map_free(&map);
-    } else if (strcmp(argv[1], "load") == 0 || strcmp(argv[1], "load-slot") == 0) {
-        size_t slot_index = 0, drive_index = 1; // default to drive 1
-        bool have_slot = false;
-        bool have_transport = false;
-        uint16_t transport = 0;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
-                have_slot = parse_index(argv[++i], &slot_index);
-            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
-                parse_index(argv[++i], &drive_index);
-            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
-                have_transport = parse_u16(argv[++i], &transport);
+    } else if (strcmp(sub, "find") == 0 && file) {
+        MChangerFileIndex *index = mchanger_file_index_open(catalog);
+        MChangerFileHit hits[50];
+        size_t total = 0;
+        if (!index || mchanger_file_index_search(index, file, hits, 50, &total) != MCHANGER_OK) {
+            fprintf(stderr, "Unable to search file listings.\n");
+            rc = 1;
+        } else {
+            size_t shown = total < 50 ? total : 50;
+            for (size_t i = 0; i < shown; i++) {
+                printf("  slot %3d  %-24s %s (%.1f MB)\n", hits[i].slot,
+                       hits[i].volume[0] ? hits[i].volume : hits[i].fingerprint, hits[i].path,
+                       hits[i].size_bytes / 1000000.0);
             }
+            if (total > shown) printf("  ... and %zu more\n", total - shown);
+            printf("%zu match%s in %zu indexed files.\n", total, total == 1 ? "" : "es",
+                   mchanger_file_index_count(index));
+            if (total == 0) rc = 1;
         }
+        mchanger_file_index_close(index);
+    } else if (strcmp(sub, "index") == 0) {
+        char root[1024] = {0};
         if (!have_slot) {
             fprintf(stderr, "Missing --slot.\n");
-            rc = 1; goto out;
-        }
-        ElementMap map = {0};
-        rc = fetch_element_map(&handle, &map);
-        if (rc != 0) {
-            fprintf(stderr, "Failed to read element map.\n");
-            element_map_free(&map);
-            goto out;
-        }
-        if (slot_index == 0 || slot_index > map.slots.count ||
-            drive_index == 0 || drive_index > map.drives.count) {
-            fprintf(stderr, "Slot/drive out of range. Slots: %zu, Drives: %zu\n",
-                    map.slots.count, map.drives.count);
             rc = 1;
-            element_map_free(&map);
-            goto out;
-        }
-        if (!have_transport) {
-            if (map.transports.count == 0) {
-                fprintf(stderr, "No transport element found.\n");
+        } else if (mchanger_catalog_get(catalog, (int)slot_index, &entry) != MCHANGER_OK ||
+                   !entry.fingerprint[0]) {
+            fprintf(stderr, "Slot %zu has no fingerprinted catalog entry; load it with -v or run identify first.\n",
+                    slot_index);
+            rc = 1;
+        } else {
+            if (mount_path) {
+                snprintf(root, sizeof(root), "%s", mount_path);
+            } else if (entry.volume[0]) {
+                snprintf(root, sizeof(root), "/Volumes/%s", entry.volume);
+            }
+            size_t files = 0;
+            if (!root[0]) {
+                fprintf(stderr, "Volume name unknown; pass --path <mount point>.\n");
+                rc = 1;
+            } else if (mchanger_catalog_index_files(catalog, (int)slot_index, root, &files) == MCHANGER_OK) {
+                printf("Indexed %zu files from %s for slot %zu.\n", files, root, slot_index);
+            } else {
+                fprintf(stderr, "Unable to index %s.\n", root);
                 rc = 1;
-                element_map_free(&map);
-                goto out;
             }
-            transport = map.transports.addrs[0];
         }
-        uint16_t slot_addr = map.slots.addrs[slot_index - 1];
-        uint16_t drive_addr = map.drives.addrs[drive_index - 1];
-
-        // Check if drive already has a disc - if so, unload it first
-        ElementStatus drive_st = {0}, target_slot_st = {0};
-        rc = read_element_status_info(&handle, drive_addr, &drive_st, slot_addr, &target_slot_st);
-        if (rc != 0) {
-            fprintf(stderr, "Failed to read element status.\n");
-            element_map_free(&map);
-            goto out;
+    } else if (strcmp(sub, "find") == 0) {
+        int found = MCHANGER_ERR_INVALID;
+        if (volume) {
+            found = mchanger_catalog_find_volume(catalog, volume, &entry);
+        } else if (fingerprint) {
+            found = mchanger_catalog_find_fingerprint(catalog, fingerprint, &entry);
+        } else {
+            fprintf(stderr, "Missing --volume, --fingerprint or --file.\n");
         }
-
-        // Check if the target slot's disc is already in the drive
-        if (target_slot_st.full) {
-            // Slot has disc, we can load it
-        } else if (drive_st.full && drive_st.valid_src && drive_st.src_addr == slot_addr) {
-            // The disc we want is already in the drive
-            printf("LOAD: Disc from slot %u is already in drive %u.\n",
-                   (unsigned)slot_index, (unsigned)drive_index);
-            element_map_free(&map);
-            goto out;
-        } else if (!target_slot_st.full) {
-            fprintf(stderr, "Slot %u is empty.\n", (unsigned)slot_index);
+        if (found == MCHANGER_OK) {
+            print_catalog_entry(&entry);
+        } else {
+            if (volume || fingerprint) printf("Not found.\n");
             rc = 1;
-            element_map_free(&map);
-            goto out;
         }
+    } else if (strcmp(sub, "forget") == 0) {
+        if (!have_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1;
+        } else if (mchanger_catalog_forget(catalog, (int)slot_index) == MCHANGER_OK) {
+            rc = mchanger_catalog_save(catalog) == MCHANGER_OK ? 0 : 1;
+            if (rc == 0) printf("Forgot slot %zu.\n", slot_index);
+        } else {
+            printf("Slot %zu: not cataloged.\n", slot_index);
+        }
+    } else {
+        fprintf(stderr, "Unknown catalog command '%s'.\n", sub);
+        rc = 1;
+    }
 
-        printf("LOAD: transport=0x%04x slot=%u(0x%04x) drive=%u(0x%04x)\n",
-               transport, (unsigned)slot_index, slot_addr,
-               (unsigned)drive_index, drive_addr);
+    mchanger_catalog_close(catalog);
+    return rc;
+}
 
-        // Show current mounted disc in verbose mode
-        if (g_verbose && drive_st.full) {
-            char name[256] = {0};
-            char size[64] = {0};
-            if (get_mounted_disc_info(name, sizeof(name), size, sizeof(size))) {
-                printf("  Currently mounted: %s (%s)\n", name[0] ? name : "Unknown", size[0] ? size : "?");
-            }
-        }
+/*
+ * =============================================================================
+ * File Index
+ * =============================================================================
+ *
+ * People look for files, not discs. Every time a fingerprinted disc is seen
+ * mounted, its file tree is written to "<catalog>.files/<fingerprint>.tsv"
+ * (size, mtime, path per line). A file index loads those listings for the
+ * discs in the catalog and keeps a trigram -> file table over lowercased file
+ * names, so a search only verifies the files sharing its rarest trigram.
+ */
 
-        // If drive has a different disc, unload it first
-        if (drive_st.full) {
-            uint16_t unload_slot_addr = 0;
-            size_t unload_slot_index = 0;
+#define FILES_HEADER "# mchanger files v1"
 
-            if (drive_st.valid_src) {
-                unload_slot_addr = drive_st.src_addr;
-                // Find the slot index for this address
-                for (size_t i = 0; i < map.slots.count; i++) {
-                    if (map.slots.addrs[i] == unload_slot_addr) {
-                        unload_slot_index = i + 1;
-                        break;
-                    }
-                }
-            }
+typedef struct {
+    uint32_t disc;              // index into discs
+    uint32_t path_off;          // offset of the relative path in paths
+    uint32_t name_off;          // offset of the last path component
+    uint64_t size_bytes;
+    int64_t mtime;
+} IndexedFile;
+
+struct MChangerFileIndex {
+    MChangerCatalogEntry *discs;
+    size_t disc_count;
+    IndexedFile *files;
+    size_t file_count;
+    size_t file_cap;
+    char *paths;                // NUL-separated relative paths
+    size_t paths_len;
+    size_t paths_cap;
+    char *names_lower;          // lowercased copy of paths, for matching
+    uint32_t *trigrams;         // sorted, unique
+    uint32_t *starts;           // postings for trigrams[i]: [starts[i], starts[i + 1])
+    size_t trigram_count;
+    uint32_t *postings;         // file numbers
+};
 
-            if (unload_slot_addr == 0 || unload_slot_index == 0) {
-                fprintf(stderr, "Drive has a disc but cannot determine source slot.\n");
-                rc = 1;
-                element_map_free(&map);
-                goto out;
-            }
+static void listing_path(const MChangerCatalog *catalog, const char *fingerprint, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s.files/%s.tsv", mchanger_catalog_path(catalog), fingerprint);
+}
 
-            printf("  Drive has disc from slot %zu(0x%04x), unloading first...\n",
-                   unload_slot_index, unload_slot_addr);
+// Listings are line-oriented: keep tabs and newlines in names from splitting fields
+static void listing_write_path(FILE *fp, const char *path) {
+    for (const char *c = path; *c; c++) {
+        fputc((*c == '\t' || *c == '\n' || *c == '\r') ? ' ' : *c, fp);
+    }
+}
 
-            if (dry_run) {
-                printf("DRY RUN: Eject from macOS\n");
-                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (unload)\n",
-                       transport, drive_addr, unload_slot_addr);
-                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (load)\n",
-                       transport, slot_addr, drive_addr);
-            } else {
-                if (confirm && !confirm_move()) {
-                    fprintf(stderr, "Aborted.\n");
-                    rc = 1;
-                    element_map_free(&map);
-                    goto out;
-                }
-                // Eject from macOS
-                eject_optical_media();
-                // Unload current disc
-                rc = cmd_move_medium(&handle, transport, drive_addr, unload_slot_addr);
-                if (rc != 0) {
-                    fprintf(stderr, "Failed to unload current disc.\n");
-                    element_map_free(&map);
-                    goto out;
-                }
-                // Load requested disc
-                printf("  Loading slot %u...\n", (unsigned)slot_index);
-                rc = cmd_move_medium(&handle, transport, slot_addr, drive_addr);
-            }
-        } else {
-            // Drive is empty, just load
-            if (dry_run) {
-                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
-                       transport, slot_addr, drive_addr);
-            } else {
-                if (confirm && !confirm_move()) {
-                    fprintf(stderr, "Aborted.\n");
-                    rc = 1;
-                    element_map_free(&map);
-                    goto out;
-                }
-                rc = cmd_move_medium(&handle, transport, slot_addr, drive_addr);
-            }
-        }
-        // Show newly mounted disc in verbose mode
-        if (g_verbose && rc == 0 && !dry_run) {
-            wait_and_print_mounted_disc();
-        }
-        element_map_free(&map);
-    } else if (strcmp(argv[1], "unload") == 0 || strcmp(argv[1], "unload-drive") == 0) {
-        size_t slot_index = 0, drive_index = 1; // default to drive 1
-        bool have_slot = false;
-        bool have_transport = false;
-        uint16_t transport = 0;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
-                have_slot = parse_index(argv[++i], &slot_index);
-            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
-                parse_index(argv[++i], &drive_index);
-            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
-                have_transport = parse_u16(argv[++i], &transport);
-            }
-        }
-        if (!have_slot) {
-            fprintf(stderr, "Missing --slot.\n");
-            rc = 1; goto out;
-        }
-        ElementMap map = {0};
-        rc = fetch_element_map(&handle, &map);
-        if (rc != 0) {
-            fprintf(stderr, "Failed to read element map.\n");
-            element_map_free(&map);
-            goto out;
+int mchanger_catalog_index_files(MChangerCatalog *catalog, int slot, const char *mount_path, size_t *out_files) {
+    if (out_files) *out_files = 0;
+    if (!catalog || slot < 1 || !mount_path || !*mount_path) return MCHANGER_ERR_INVALID;
+
+    MChangerCatalogEntry entry;
+    if (mchanger_catalog_get(catalog, slot, &entry) != MCHANGER_OK || !entry.fingerprint[0]) {
+        return MCHANGER_ERR_NOT_FOUND;
+    }
+
+    char dir[1100];
+    snprintf(dir, sizeof(dir), "%s.files", mchanger_catalog_path(catalog));
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return MCHANGER_ERR_OPEN;
+
+    char path[1200], tmp[1210];
+    listing_path(catalog, entry.fingerprint, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return MCHANGER_ERR_OPEN;
+    fprintf(fp, "%s\n", FILES_HEADER);
+
+    char *roots[] = { (char *)mount_path, NULL };
+    FTS *fts = fts_open(roots, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, NULL);
+    if (!fts) {
+        fclose(fp);
+        unlink(tmp);
+        return MCHANGER_ERR_OPEN;
+    }
+
+    size_t root_len = strlen(mount_path);
+    while (root_len > 1 && mount_path[root_len - 1] == '/') root_len--;
+    size_t files = 0;
+    FTSENT *ent;
+    while ((ent = fts_read(fts)) != NULL) {
+        if (ent->fts_info != FTS_F) continue;
+        const char *rel = ent->fts_path + root_len;
+        while (*rel == '/') rel++;
+        fprintf(fp, "%llu\t%lld\t", (unsigned long long)ent->fts_statp->st_size,
+                (long long)ent->fts_statp->st_mtime);
+        listing_write_path(fp, rel);
+        fputc('\n', fp);
+        files++;
+    }
+    fts_close(fts);
+
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return MCHANGER_ERR_OPEN;
+    }
+    if (out_files) *out_files = files;
+    return MCHANGER_OK;
+}
+
+// A disc was seen mounted: record it and, if it is fingerprinted, index its files
+static void catalog_note_mount(MChangerCatalog *catalog, int slot, const DiscInfo *mounted) {
+    if (!catalog || slot < 1 || !mounted) return;
+    catalog_note_disc(catalog, slot, mounted);
+
+    char root[1024];
+    if (resolve_mount_path(mounted, root, sizeof(root))) {
+        mchanger_catalog_index_files(catalog, slot, root, NULL);
+    }
+}
+
+static bool file_index_add(MChangerFileIndex *index, uint32_t disc, uint64_t size, int64_t mtime, const char *rel) {
+    size_t len = strlen(rel);
+    if (index->paths_len + len + 1 > UINT32_MAX) return false;
+    if (index->file_count == index->file_cap) {
+        size_t cap = index->file_cap ? index->file_cap * 2 : 1024;
+        IndexedFile *next = realloc(index->files, cap * sizeof(IndexedFile));
+        if (!next) return false;
+        index->files = next;
+        index->file_cap = cap;
+    }
+    if (index->paths_len + len + 1 > index->paths_cap) {
+        size_t cap = index->paths_cap ? index->paths_cap * 2 : 65536;
+        while (cap < index->paths_len + len + 1) cap *= 2;
+        char *next = realloc(index->paths, cap);
+        if (!next) return false;
+        index->paths = next;
+        index->paths_cap = cap;
+    }
+
+    IndexedFile *f = &index->files[index->file_count++];
+    f->disc = disc;
+    f->path_off = (uint32_t)index->paths_len;
+    const char *slash = strrchr(rel, '/');
+    f->name_off = f->path_off + (uint32_t)(slash ? (size_t)(slash - rel) + 1 : 0);
+    f->size_bytes = size;
+    f->mtime = mtime;
+    memcpy(index->paths + index->paths_len, rel, len + 1);
+    index->paths_len += len + 1;
+    return true;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static uint32_t trigram_key(const char *p) {
+    return ((uint32_t)(uint8_t)p[0] << 16) | ((uint32_t)(uint8_t)p[1] << 8) | (uint8_t)p[2];
+}
+
+// Build the trigram table from (trigram, file) pairs sorted into posting lists
+static bool file_index_build_trigrams(MChangerFileIndex *index) {
+    size_t pair_count = 0;
+    for (size_t i = 0; i < index->file_count; i++) {
+        size_t n = strlen(index->names_lower + index->files[i].name_off);
+        if (n >= 3) pair_count += n - 2;
+    }
+    if (pair_count == 0) return true;
+
+    uint64_t *pairs = malloc(pair_count * sizeof(uint64_t));
+    if (!pairs) return false;
+    size_t k = 0;
+    for (size_t i = 0; i < index->file_count; i++) {
+        const char *name = index->names_lower + index->files[i].name_off;
+        for (size_t j = 0; name[j] && name[j + 1] && name[j + 2]; j++) {
+            pairs[k++] = ((uint64_t)trigram_key(name + j) << 32) | (uint32_t)i;
         }
-        if (slot_index == 0 || slot_index > map.slots.count ||
-            drive_index == 0 || drive_index > map.drives.count) {
-            fprintf(stderr, "Slot/drive out of range. Slots: %zu, Drives: %zu\n",
-                    map.slots.count, map.drives.count);
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+    }
+    qsort(pairs, pair_count, sizeof(uint64_t), compare_u64);
+
+    // Drop repeats of a trigram within one name, and count distinct trigrams
+    size_t unique = 0, keys = 0;
+    for (size_t i = 0; i < pair_count; i++) {
+        if (unique > 0 && pairs[unique - 1] == pairs[i]) continue;
+        if (unique == 0 || (pairs[unique - 1] >> 32) != (pairs[i] >> 32)) keys++;
+        pairs[unique++] = pairs[i];
+    }
+
+    index->trigrams = malloc(keys * sizeof(uint32_t));
+    index->starts = malloc((keys + 1) * sizeof(uint32_t));
+    index->postings = malloc(unique * sizeof(uint32_t));
+    if (!index->trigrams || !index->starts || !index->postings) {
+        free(pairs);
+        return false;
+    }
+    size_t key = 0;
+    for (size_t i = 0; i < unique; i++) {
+        uint32_t tri = (uint32_t)(pairs[i] >> 32);
+        if (i == 0 || tri != index->trigrams[key - 1]) {
+            index->trigrams[key] = tri;
+            index->starts[key] = (uint32_t)i;
+            key++;
         }
-        if (!have_transport) {
-            if (map.transports.count == 0) {
-                fprintf(stderr, "No transport element found.\n");
-                rc = 1;
-                element_map_free(&map);
-                goto out;
+        index->postings[i] = (uint32_t)pairs[i];
+    }
+    index->starts[keys] = (uint32_t)unique;
+    index->trigram_count = keys;
+    free(pairs);
+    return true;
+}
+
+MChangerFileIndex *mchanger_file_index_open(const MChangerCatalog *catalog) {
+    if (!catalog) return NULL;
+    MChangerFileIndex *index = calloc(1, sizeof(MChangerFileIndex));
+    if (!index) return NULL;
+
+    size_t count = mchanger_catalog_count(catalog);
+    index->discs = calloc(count ? count : 1, sizeof(MChangerCatalogEntry));
+    if (!index->discs) {
+        mchanger_file_index_close(index);
+        return NULL;
+    }
+
+    char line[2048];
+    for (size_t i = 0; i < count; i++) {
+        MChangerCatalogEntry entry;
+        if (mchanger_catalog_entry_at(catalog, i, &entry) != MCHANGER_OK || !entry.fingerprint[0]) continue;
+
+        char path[1200];
+        listing_path(catalog, entry.fingerprint, path, sizeof(path));
+        FILE *fp = fopen(path, "r");
+        if (!fp) continue;
+
+        uint32_t disc = (uint32_t)index->disc_count;
+        index->discs[index->disc_count++] = entry;
+        while (fgets(line, sizeof(line), fp)) {
+            if (line[0] == '#') continue;
+            size_t len = strcspn(line, "\r\n");
+            while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+            line[len] = '\0';
+            char *size_end = NULL, *mtime_end = NULL;
+            unsigned long long size = strtoull(line, &size_end, 10);
+            if (!size_end || *size_end != '\t') continue;
+            long long mtime = strtoll(size_end + 1, &mtime_end, 10);
+            if (!mtime_end || *mtime_end != '\t') continue;
+            if (!file_index_add(index, disc, size, mtime, mtime_end + 1)) {
+                fclose(fp);
+                mchanger_file_index_close(index);
+                return NULL;
             }
-            transport = map.transports.addrs[0];
         }
-        uint16_t slot_addr = map.slots.addrs[slot_index - 1];
-        uint16_t drive_addr = map.drives.addrs[drive_index - 1];
-        printf("UNLOAD: transport=0x%04x drive=%u(0x%04x) slot=%u(0x%04x)\n",
-               transport, (unsigned)drive_index, drive_addr,
-               (unsigned)slot_index, slot_addr);
-        if (dry_run) {
-            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
-                   transport, drive_addr, slot_addr);
-        } else {
-            if (confirm && !confirm_move()) {
-                fprintf(stderr, "Aborted.\n");
-                rc = 1; goto out;
+        fclose(fp);
+    }
+
+    index->names_lower = malloc(index->paths_len ? index->paths_len : 1);
+    if (!index->names_lower) {
+        mchanger_file_index_close(index);
+        return NULL;
+    }
+    for (size_t i = 0; i < index->paths_len; i++) {
+        index->names_lower[i] = (char)tolower((unsigned char)index->paths[i]);
+    }
+    if (!file_index_build_trigrams(index)) {
+        mchanger_file_index_close(index);
+        return NULL;
+    }
+    return index;
+}
+
+void mchanger_file_index_close(MChangerFileIndex *index) {
+    if (!index) return;
+    free(index->discs);
+    free(index->files);
+    free(index->paths);
+    free(index->names_lower);
+    free(index->trigrams);
+    free(index->starts);
+    free(index->postings);
+    free(index);
+}
+
+size_t mchanger_file_index_count(const MChangerFileIndex *index) {
+    return index ? index->file_count : 0;
+}
+
+static void file_index_hit(const MChangerFileIndex *index, uint32_t file, MChangerFileHit *out) {
+    const IndexedFile *f = &index->files[file];
+    const MChangerCatalogEntry *disc = &index->discs[f->disc];
+    out->slot = disc->slot;
+    snprintf(out->volume, sizeof(out->volume), "%s", disc->volume);
+    snprintf(out->fingerprint, sizeof(out->fingerprint), "%s", disc->fingerprint);
+    snprintf(out->path, sizeof(out->path), "%s", index->paths + f->path_off);
+    out->size_bytes = f->size_bytes;
+    out->mtime = f->mtime;
+}
+
+int mchanger_file_index_search(const MChangerFileIndex *index, const char *text,
+                               MChangerFileHit *out, size_t max, size_t *out_total) {
+    if (out_total) *out_total = 0;
+    if (!index || !text || !*text || (max > 0 && !out)) return MCHANGER_ERR_INVALID;
+
+    char query[256];
+    size_t qlen = 0;
+    for (; text[qlen] && qlen + 1 < sizeof(query); qlen++) {
+        query[qlen] = (char)tolower((unsigned char)text[qlen]);
+    }
+    query[qlen] = '\0';
+
+    // Candidates: files sharing the query's rarest trigram, or every file for
+    // queries too short to have one
+    const uint32_t *candidates = NULL;
+    size_t candidate_count = index->file_count;
+    if (qlen >= 3) {
+        candidate_count = 0;
+        bool first = true;
+        for (size_t j = 0; j + 2 < qlen; j++) {
+            uint32_t tri = trigram_key(query + j);
+            size_t lo = 0, hi = index->trigram_count;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (index->trigrams[mid] < tri) lo = mid + 1; else hi = mid;
             }
-            // Eject optical media from macOS before physical unload
-            eject_optical_media();
-            rc = cmd_move_medium(&handle, transport, drive_addr, slot_addr);
-        }
-        element_map_free(&map);
-    } else if (strcmp(argv[1], "eject") == 0) {
-        // Eject a disc from the machine via the I/E slot
-        // If the disc is currently in the drive, unload it first
-        size_t slot_index = 0, drive_index = 1; // default drive 1
-        bool have_slot = false, have_drive = false;
-        bool have_transport = false;
-        uint16_t transport = 0;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
-                have_slot = parse_index(argv[++i], &slot_index);
-            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
-                have_drive = parse_index(argv[++i], &drive_index);
-            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
-                have_transport = parse_u16(argv[++i], &transport);
+            if (lo == index->trigram_count || index->trigrams[lo] != tri) return MCHANGER_OK;
+            size_t n = index->starts[lo + 1] - index->starts[lo];
+            if (first || n < candidate_count) {
+                candidates = index->postings + index->starts[lo];
+                candidate_count = n;
+                first = false;
             }
         }
-        if (!have_slot) {
-            fprintf(stderr, "Missing --slot.\n");
-            rc = 1; goto out;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < candidate_count; i++) {
+        uint32_t file = candidates ? candidates[i] : (uint32_t)i;
+        if (!strstr(index->names_lower + index->files[file].name_off, query)) continue;
+        if (total < max) file_index_hit(index, file, &out[total]);
+        total++;
+    }
+    if (out_total) *out_total = total;
+    return MCHANGER_OK;
+}
+
+/*
+ * =============================================================================
+ * Image Cache
+ * =============================================================================
+ *
+ * A small number of discs get most of the requests, and each of those costs an
+ * unload, a load and a mount. Keeping full images of them on local disk turns
+ * those requests into file opens. Images are "<fingerprint>.iso" in the cache
+ * directory and "index.tsv" records size, last use and hit count for LRU
+ * eviction under a byte budget. Fetches into one cache can run at once, so
+ * the index is guarded by a lock; the long copy from the drive is not.
+ */
+
+#define CACHE_HEADER "# mchanger cache v1"
+#define CACHE_DEFAULT_MAX_BYTES (20ULL * 1000 * 1000 * 1000)
+
+struct MChangerImageCache {
+    pthread_mutex_t lock;       // entries, used_bytes and index.tsv
+    char dir[1024];
+    uint64_t max_bytes;
+    uint64_t used_bytes;
+    MChangerCacheEntry *entries;
+    size_t count;
+    size_t cap;
+};
+
+static void cache_image_path(const MChangerImageCache *cache, const char *fingerprint, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s/%s.iso", cache->dir, fingerprint);
+}
+
+static MChangerCacheEntry *cache_find(const MChangerImageCache *cache, const char *fingerprint) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (strcasecmp(cache->entries[i].fingerprint, fingerprint) == 0) return &cache->entries[i];
+    }
+    return NULL;
+}
+
+static int cache_save(const MChangerImageCache *cache) {
+    char path[1100], tmp[1110];
+    snprintf(path, sizeof(path), "%s/index.tsv", cache->dir);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return MCHANGER_ERR_OPEN;
+    fprintf(fp, "%s\n", CACHE_HEADER);
+    for (size_t i = 0; i < cache->count; i++) {
+        const MChangerCacheEntry *e = &cache->entries[i];
+        fprintf(fp, "%s\t%llu\t%lld\t%u\n", e->fingerprint, (unsigned long long)e->size_bytes,
+                (long long)e->last_used, e->hits);
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return MCHANGER_ERR_OPEN;
+    }
+    return MCHANGER_OK;
+}
+
+// Drop an index entry, and its image unless a new one has just replaced it
+static void cache_remove_at(MChangerImageCache *cache, size_t i, bool unlink_image) {
+    if (unlink_image) {
+        char path[1100];
+        cache_image_path(cache, cache->entries[i].fingerprint, path, sizeof(path));
+        unlink(path);
+    }
+    cache->used_bytes -= cache->entries[i].size_bytes;
+    cache->entries[i] = cache->entries[cache->count - 1];
+    cache->count--;
+}
+
+// Evict least recently used images until `incoming` more bytes fit
+static void cache_make_room(MChangerImageCache *cache, uint64_t incoming) {
+    while (cache->count > 0 && cache->used_bytes + incoming > cache->max_bytes) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last_used < cache->entries[oldest].last_used) oldest = i;
         }
-        ElementMap map = {0};
-        rc = fetch_element_map(&handle, &map);
-        if (rc != 0) {
-            fprintf(stderr, "Failed to read element map.\n");
-            element_map_free(&map);
-            goto out;
+        cache_remove_at(cache, oldest, true);
+    }
+}
+
+MChangerImageCache *mchanger_cache_open(const char *dir, uint64_t max_bytes) {
+    MChangerImageCache *cache = calloc(1, sizeof(MChangerImageCache));
+    if (!cache) return NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->max_bytes = max_bytes ? max_bytes : CACHE_DEFAULT_MAX_BYTES;
+
+    if (dir && *dir) {
+        snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+    } else if (getenv("MCHANGER_CACHE_DIR") && *getenv("MCHANGER_CACHE_DIR")) {
+        snprintf(cache->dir, sizeof(cache->dir), "%s", getenv("MCHANGER_CACHE_DIR"));
+    } else {
+        char base[1000];
+        if (!mchanger_base_dir(base, sizeof(base))) {
+            mchanger_cache_close(cache);
+            return NULL;
         }
-        if (slot_index == 0 || slot_index > map.slots.count) {
-            fprintf(stderr, "Slot out of range. Slots: %zu\n", map.slots.count);
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+        snprintf(cache->dir, sizeof(cache->dir), "%s/images", base);
+    }
+    if (mkdir(cache->dir, 0755) != 0 && errno != EEXIST) {
+        mchanger_cache_close(cache);
+        return NULL;
+    }
+
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/index.tsv", cache->dir);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return cache;
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#') continue;
+        MChangerCacheEntry e = {0};
+        unsigned long long size = 0;
+        long long last_used = 0;
+        unsigned hits = 0;
+        if (sscanf(line, "%32s\t%llu\t%lld\t%u", e.fingerprint, &size, &last_used, &hits) < 3) continue;
+
+        // Trust the index only for images that are still there
+        char image[1100];
+        struct stat st;
+        cache_image_path(cache, e.fingerprint, image, sizeof(image));
+        if (stat(image, &st) != 0) continue;
+
+        if (cache->count == cache->cap) {
+            size_t cap = cache->cap ? cache->cap * 2 : 16;
+            MChangerCacheEntry *next = realloc(cache->entries, cap * sizeof(MChangerCacheEntry));
+            if (!next) break;
+            cache->entries = next;
+            cache->cap = cap;
         }
-        if (!have_drive) drive_index = 1;
-        if (drive_index == 0 || drive_index > map.drives.count) {
-            fprintf(stderr, "Drive out of range. Drives: %zu\n", map.drives.count);
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+        e.size_bytes = (uint64_t)st.st_size;
+        e.last_used = last_used;
+        e.hits = hits;
+        cache->entries[cache->count++] = e;
+        cache->used_bytes += e.size_bytes;
+    }
+    fclose(fp);
+    return cache;
+}
+
+void mchanger_cache_close(MChangerImageCache *cache) {
+    if (!cache) return;
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->entries);
+    free(cache);
+}
+
+// The read-only accessors take a const cache but still lock it
+static void cache_lock(const MChangerImageCache *cache) {
+    pthread_mutex_lock((pthread_mutex_t *)&cache->lock);
+}
+
+static void cache_unlock(const MChangerImageCache *cache) {
+    pthread_mutex_unlock((pthread_mutex_t *)&cache->lock);
+}
+
+int mchanger_cache_lookup(MChangerImageCache *cache, const char *fingerprint, char *out_path, size_t path_len) {
+    if (!cache || !fingerprint || !*fingerprint) return MCHANGER_ERR_INVALID;
+    cache_lock(cache);
+    MChangerCacheEntry *e = cache_find(cache, fingerprint);
+    if (e) {
+        e->last_used = (int64_t)time(NULL);
+        e->hits++;
+        cache_save(cache);
+        if (out_path && path_len > 0) cache_image_path(cache, e->fingerprint, out_path, path_len);
+    }
+    cache_unlock(cache);
+    return e ? MCHANGER_OK : MCHANGER_ERR_NOT_FOUND;
+}
+
+int mchanger_cache_evict(MChangerImageCache *cache, const char *fingerprint) {
+    if (!cache || !fingerprint) return MCHANGER_ERR_INVALID;
+    int rc = MCHANGER_ERR_NOT_FOUND;
+    cache_lock(cache);
+    for (size_t i = 0; i < cache->count; i++) {
+        if (strcasecmp(cache->entries[i].fingerprint, fingerprint) == 0) {
+            cache_remove_at(cache, i, true);
+            rc = cache_save(cache);
+            break;
         }
-        if (map.ie.count == 0) {
-            fprintf(stderr, "No import/export element found.\n");
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+    }
+    cache_unlock(cache);
+    return rc;
+}
+
+size_t mchanger_cache_count(const MChangerImageCache *cache) {
+    if (!cache) return 0;
+    cache_lock(cache);
+    size_t count = cache->count;
+    cache_unlock(cache);
+    return count;
+}
+
+int mchanger_cache_entry_at(const MChangerImageCache *cache, size_t index, MChangerCacheEntry *out) {
+    if (!cache || !out) return MCHANGER_ERR_INVALID;
+    cache_lock(cache);
+    bool have = index < cache->count;
+    if (have) *out = cache->entries[index];
+    cache_unlock(cache);
+    return have ? MCHANGER_OK : MCHANGER_ERR_INVALID;
+}
+
+uint64_t mchanger_cache_used_bytes(const MChangerImageCache *cache) {
+    if (!cache) return 0;
+    cache_lock(cache);
+    uint64_t used = cache->used_bytes;
+    cache_unlock(cache);
+    return used;
+}
+
+// Copy the raw device of the disc in a drive into the cache. The media's BSD
+// node can lag behind the drive reporting ready, so it is given a few seconds.
+static int cache_store_from_drive(MChangerImageCache *cache, io_service_t drive_service,
+                                  const DiscInfo *disc, char *out_path, size_t path_len) {
+    if (!disc->fingerprint[0]) return MCHANGER_ERR_INVALID;
+    if (strcmp(disc->media_type, "CD-DA") == 0) return MCHANGER_ERR_INVALID;
+    if (disc->size_bytes > cache->max_bytes) return MCHANGER_ERR_INVALID;
+
+    char bsd[64] = {0};
+    for (int waited_ms = 0; !get_drive_bsd_name(drive_service, bsd, sizeof(bsd)); waited_ms += 250) {
+        if (waited_ms >= 10000) return MCHANGER_ERR_NOT_FOUND;
+        usleep(250000);
+    }
+
+    char device[80];
+    snprintf(device, sizeof(device), "/dev/r%s", bsd);
+    int in = open(device, O_RDONLY);
+    if (in < 0) {
+        fprintf(stderr, "Unable to read %s: %s\n", device, strerror(errno));
+        return MCHANGER_ERR_OPEN;
+    }
+
+    cache_lock(cache);
+    cache_make_room(cache, disc->size_bytes);
+    cache_unlock(cache);
+
+    // Another fetch may be imaging a copy of the same disc into its own file
+    char path[1100], tmp[1120];
+    cache_image_path(cache, disc->fingerprint, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.part.XXXXXX", path);
+    int out = mkstemp(tmp);
+    if (out < 0) {
+        close(in);
+        return MCHANGER_ERR_OPEN;
+    }
+    fchmod(out, 0644);
+
+    // Raw optical reads must be whole 2048-byte sectors
+    const size_t chunk = 1024 * 1024;
+    uint8_t *buf = malloc(chunk);
+    uint64_t copied = 0;
+    int rc = buf ? MCHANGER_OK : MCHANGER_ERR_INVALID;
+    while (rc == MCHANGER_OK) {
+        ssize_t n = read(in, buf, chunk);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            rc = MCHANGER_ERR_SCSI;
+            break;
         }
-        if (!have_transport) {
-            if (map.transports.count == 0) {
-                fprintf(stderr, "No transport element found.\n");
-                rc = 1;
-                element_map_free(&map);
-                goto out;
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                rc = MCHANGER_ERR_OPEN;
+                break;
             }
-            transport = map.transports.addrs[0];
+            off += w;
         }
-        uint16_t slot_addr = map.slots.addrs[slot_index - 1];
-        uint16_t drive_addr = map.drives.addrs[drive_index - 1];
-        uint16_t ie_addr = map.ie.addrs[0];
+        copied += (uint64_t)n;
+        if (copied > cache->max_bytes) rc = MCHANGER_ERR_INVALID;
+    }
+    free(buf);
+    close(in);
+    if (close(out) != 0 && rc == MCHANGER_OK) rc = MCHANGER_ERR_OPEN;
+    if (rc != MCHANGER_OK) {
+        unlink(tmp);
+        return rc;
+    }
 
-        // Check element status to see if disc is in slot or in drive
-        ElementStatus drive_st = {0}, slot_st = {0};
-        rc = read_element_status_info(&handle, drive_addr, &drive_st, slot_addr, &slot_st);
-        if (rc != 0) {
-            fprintf(stderr, "Failed to read element status.\n");
-            element_map_free(&map);
-            goto out;
+    // Rename under the lock, so an eviction can't unlink the new image. An
+    // older one under the same fingerprint has just been replaced on disk;
+    // only its index entry goes. The real size may differ from the TOC
+    // estimate, so the budget is settled again.
+    cache_lock(cache);
+    if (rename(tmp, path) != 0) {
+        cache_unlock(cache);
+        unlink(tmp);
+        return MCHANGER_ERR_OPEN;
+    }
+    MChangerCacheEntry *existing = cache_find(cache, disc->fingerprint);
+    if (existing) cache_remove_at(cache, (size_t)(existing - cache->entries), false);
+    cache_make_room(cache, copied);
+    if (cache->count == cache->cap) {
+        size_t cap = cache->cap ? cache->cap * 2 : 16;
+        MChangerCacheEntry *next = realloc(cache->entries, cap * sizeof(MChangerCacheEntry));
+        if (!next) {
+            unlink(path);
+            cache_unlock(cache);
+            return MCHANGER_ERR_INVALID;
         }
+        cache->entries = next;
+        cache->cap = cap;
+    }
+    MChangerCacheEntry *e = &cache->entries[cache->count++];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->fingerprint, sizeof(e->fingerprint), "%s", disc->fingerprint);
+    e->size_bytes = copied;
+    e->last_used = (int64_t)time(NULL);
+    cache->used_bytes += copied;
+    cache_save(cache);
+    cache_unlock(cache);
+
+    if (out_path && path_len > 0) snprintf(out_path, path_len, "%s", path);
+    return MCHANGER_OK;
+}
 
-        bool disc_in_drive = false;
-        if (!slot_st.full && drive_st.full) {
-            // Slot is empty and drive has a disc - check if it came from this slot
-            if (drive_st.valid_src && drive_st.src_addr == slot_addr) {
-                disc_in_drive = true;
-            } else if (!drive_st.valid_src) {
-                // No source info, assume disc in drive belongs to this slot if slot is empty
-                disc_in_drive = true;
+/*
+ * =============================================================================
+ * Library Scan
+ * =============================================================================
+ *
+ * Cataloging a whole library is dominated by waiting: the robot moves, then a
+ * drive spins up. With several drives those waits can overlap, so the scan is
+ * a small polling loop over per-drive state rather than a sequence of loads.
+ * Each pass returns every disc that has been identified (or timed out) and
+ * refills idle drives. The robot is only ever doing one move, but the drives
+ * spin up in parallel with it.
+ */
+
+#define SCAN_HEADER "# mchanger scan v1"
+#define SCAN_DEFAULT_TIMEOUT_SECS 45
+
+typedef struct {
+    int drive;                  // 1-based
+    uint16_t addr;              // 0 if the drive can't be used
+    io_service_t service;
+    MMCDeviceInterface **mmc;
+    bool busy;
+    int slot;                   // 1-based slot whose disc is in the drive
+    double loaded_at;
+} ScanDrive;
+
+static double monotonic_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Find the 1-based slot index for an element address (0 if not a slot)
+static int slot_index_for_addr(const ElementMap *map, uint16_t addr) {
+    return element_list_index(&map->slots, addr);
+}
+
+// Fill full[] (one entry per map slot) from changer memory. Storage is read in
+// pages like fetch_element_map(); slots a device leaves out are asked for singly.
+static int read_slot_occupancy(ChangerHandle *handle, const ElementMap *map, bool *full) {
+    uint32_t alloc = 65535;
+    uint8_t *buf = calloc(1, alloc);
+    bool *seen = calloc(map->slots.count, sizeof(bool));
+    if (!buf || !seen) {
+        free(buf);
+        free(seen);
+        return 1;
+    }
+
+    size_t next = 0;
+    while (next < map->slots.count) {
+        uint16_t start_addr = element_addr(&map->slots, next);
+        uint16_t remaining = (uint16_t)(map->slots.count - next);
+        memset(buf, 0, alloc);
+        if (execute_read_element_status(handle, 0x02, start_addr, remaining, buf, alloc, RES_MEMORY, 60000) != 0) {
+            break;
+        }
+
+        uint32_t report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
+        uint32_t len = (report_bytes + 8 <= alloc) ? report_bytes + 8 : alloc;
+        size_t added = 0;
+        uint32_t offset = 8;
+        while (offset + 8 <= len) {
+            uint16_t desc_len = (buf[offset + 2] << 8) | buf[offset + 3];
+            uint32_t page_bytes = (buf[offset + 5] << 16) | (buf[offset + 6] << 8) | buf[offset + 7];
+            offset += 8;
+            if (desc_len == 0 || page_bytes == 0) break;
+
+            uint32_t page_end = offset + page_bytes;
+            if (page_end > len) page_end = len;
+            while (offset + desc_len <= page_end) {
+                uint16_t elem_addr = (buf[offset] << 8) | buf[offset + 1];
+                int slot = slot_index_for_addr(map, elem_addr);
+                if (slot > 0 && !seen[slot - 1]) {
+                    seen[slot - 1] = true;
+                    full[slot - 1] = (buf[offset + 2] & 0x01) != 0;
+                    added++;
+                }
+                offset += desc_len;
             }
+            if (offset < page_end) offset = page_end;
         }
 
-        if (!slot_st.full && !disc_in_drive) {
-            fprintf(stderr, "Slot %zu is empty and disc is not in drive.\n", slot_index);
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+        if (added == 0) break;
+        next += added;
+    }
+
+    for (size_t i = 0; i < map->slots.count; i++) {
+        if (seen[i]) continue;
+        ElementStatus st = {0};
+        if (read_element_pair(handle, element_addr(&map->slots, i), &st, 0, NULL, RES_MEMORY) == 0) {
+            full[i] = st.full;
         }
+    }
 
-        printf("EJECT: slot=%zu(0x%04x) via ie(0x%04x)\n", slot_index, slot_addr, ie_addr);
+    free(seen);
+    free(buf);
+    return 0;
+}
 
-        if (disc_in_drive) {
-            printf("  Disc is currently in drive %zu(0x%04x), unloading first...\n",
-                   drive_index, drive_addr);
-            if (dry_run) {
-                printf("DRY RUN: Eject from macOS\n");
-                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (unload to slot)\n",
-                       transport, drive_addr, slot_addr);
-                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (eject to I/E)\n",
-                       transport, slot_addr, ie_addr);
-            } else {
-                if (confirm && !confirm_move()) {
-                    fprintf(stderr, "Aborted.\n");
-                    rc = 1;
-                    element_map_free(&map);
-                    goto out;
-                }
-                // Step 1: Eject from macOS
-                eject_optical_media();
-                // Step 2: Unload from drive to slot
-                printf("  Moving from drive to slot...\n");
-                rc = cmd_move_medium(&handle, transport, drive_addr, slot_addr);
-                if (rc != 0) {
-                    fprintf(stderr, "Failed to unload from drive.\n");
-                    element_map_free(&map);
-                    goto out;
-                }
-                // Step 3: Move from slot to I/E
-                printf("  Moving from slot to I/E...\n");
-                rc = cmd_move_medium(&handle, transport, slot_addr, ie_addr);
-                if (rc != 0) {
-                    fprintf(stderr, "Failed to move to I/E slot.\n");
-                }
+static void scan_progress_path(const MChangerCatalog *catalog, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s.scan", mchanger_catalog_path(catalog));
+}
+
+// Mark slots finished by an earlier, interrupted scan. Returns how many.
+static size_t scan_progress_load(const char *path, bool *done, size_t slot_count) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    size_t count = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#') continue;
+        long slot = strtol(line, NULL, 10);
+        if (slot >= 1 && (size_t)slot <= slot_count && !done[slot - 1]) {
+            done[slot - 1] = true;
+            count++;
+        }
+    }
+    fclose(fp);
+    return count;
+}
+
+// Log one finished slot; flushed immediately so an interrupted scan can resume
+static void scan_progress_append(const char *path, int slot, int result) {
+    struct stat st;
+    bool fresh = stat(path, &st) != 0;
+    FILE *fp = fopen(path, "a");
+    if (!fp) return;
+    if (fresh) fprintf(fp, "%s\n", SCAN_HEADER);
+    fprintf(fp, "%d\t%d\n", slot, result);
+    fclose(fp);
+}
+
+// Return a drive's disc to its slot. Returns 0 on success.
+static int scan_return_disc(ChangerHandle *handle, uint16_t transport, const ElementMap *map, ScanDrive *d) {
+    char bsd[64];
+    if (get_drive_bsd_name(d->service, bsd, sizeof(bsd))) {
+        eject_optical_disk(bsd);
+    }
+    int rc = cmd_move_medium(handle, transport, d->addr, element_addr(&map->slots, d->slot - 1));
+    if (rc == 0) d->busy = false;
+    return rc;
+}
+
+static int scan_library(ChangerHandle *handle, MChangerCatalog *catalog, bool restart, int timeout_secs,
+                        MChangerScanCallback callback, void *context) {
+    if (!catalog) return MCHANGER_ERR_INVALID;
+    if (timeout_secs <= 0) timeout_secs = SCAN_DEFAULT_TIMEOUT_SECS;
+
+    ElementMap map = {0};
+    if (fetch_element_map(handle, &map) != 0) {
+        element_map_free(&map);
+        return MCHANGER_ERR_SCSI;
+    }
+    if (map.transports.count == 0 || map.drives.count == 0 || map.slots.count == 0) {
+        element_map_free(&map);
+        return MCHANGER_ERR_INVALID;
+    }
+    uint16_t transport = element_addr(&map.transports, 0);
+
+    bool *full = calloc(map.slots.count, sizeof(bool));
+    bool *done = calloc(map.slots.count, sizeof(bool));
+    bool *claimed = calloc(map.slots.count, sizeof(bool));
+    ScanDrive *drives = calloc(map.drives.count, sizeof(ScanDrive));
+    if (!full || !done || !claimed || !drives) {
+        free(full);
+        free(done);
+        free(claimed);
+        free(drives);
+        element_map_free(&map);
+        return MCHANGER_ERR_INVALID;
+    }
+
+    int rc = MCHANGER_OK;
+    door_lock(handle);
+    if (read_slot_occupancy(handle, &map, full) != 0) {
+        rc = MCHANGER_ERR_SCSI;
+        goto cleanup;
+    }
+
+    // Set up drives. A disc already in a drive is scanned in place, as if the
+    // scan had just loaded it; one with no known home makes the drive unusable.
+    size_t usable = 0;
+    for (size_t i = 0; i < map.drives.count; i++) {
+        ScanDrive *d = &drives[i];
+        d->drive = (int)i + 1;
+        d->addr = element_addr(&map.drives, i);
+
+        ElementStatus st = {0};
+        if (read_element_pair(handle, d->addr, &st, 0, NULL, RES_MEMORY) != 0) {
+            rc = MCHANGER_ERR_SCSI;
+            goto cleanup;
+        }
+        if (st.full) {
+            int slot = st.valid_src ? slot_index_for_addr(&map, st.src_addr) : 0;
+            if (slot == 0) {
+                fprintf(stderr, "Drive %d holds a disc with no source slot; skipping it.\n", d->drive);
+                d->addr = 0;
+                continue;
             }
-        } else {
-            // Disc is in slot, just move to I/E
-            if (dry_run) {
-                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (eject to I/E)\n",
-                       transport, slot_addr, ie_addr);
-            } else {
-                if (confirm && !confirm_move()) {
-                    fprintf(stderr, "Aborted.\n");
-                    rc = 1;
-                    element_map_free(&map);
-                    goto out;
-                }
-                printf("  Moving from slot to I/E...\n");
-                rc = cmd_move_medium(&handle, transport, slot_addr, ie_addr);
-                if (rc != 0) {
-                    fprintf(stderr, "Failed to move to I/E slot.\n");
+            full[slot - 1] = true;
+            claimed[slot - 1] = true;
+            d->busy = true;
+            d->slot = slot;
+            d->loaded_at = monotonic_secs();
+        }
+
+        d->service = find_changer_drive_service(handle, d->addr, d->drive);
+        d->mmc = d->service != IO_OBJECT_NULL ? open_mmc_device(d->service) : NULL;
+        if (!d->mmc) {
+            fprintf(stderr, "Drive %d is not reachable over MMC; skipping it.\n", d->drive);
+            if (d->busy) claimed[d->slot - 1] = false;
+            d->busy = false;
+            d->addr = 0;
+            continue;
+        }
+        usable++;
+    }
+    if (usable == 0) {
+        rc = MCHANGER_ERR_NOT_FOUND;
+        goto cleanup;
+    }
+
+    char progress_path[1100];
+    scan_progress_path(catalog, progress_path, sizeof(progress_path));
+    if (restart) {
+        unlink(progress_path);
+    } else {
+        scan_progress_load(progress_path, done, map.slots.count);
+    }
+
+    size_t total = 0, done_count = 0;
+    for (size_t i = 0; i < map.slots.count; i++) {
+        if (!full[i]) continue;
+        total++;
+        if (done[i]) done_count++;
+    }
+
+    double started = monotonic_secs();
+    size_t finished_here = 0;
+    size_t next_slot = 0;
+
+    for (;;) {
+        bool active = false;
+        bool progressed = false;
+
+        // Harvest: identify whatever has spun up, then put it back
+        for (size_t i = 0; i < map.drives.count; i++) {
+            ScanDrive *d = &drives[i];
+            if (d->addr == 0 || !d->busy) continue;
+            active = true;
+
+            DiscInfo info;
+            int tracks = 0;
+            int result = identify_disc_mmc(d->mmc, d->service, 0, &info, &tracks);
+            if (result == MCHANGER_ERR_BUSY && monotonic_secs() - d->loaded_at < timeout_secs) continue;
+
+            int slot = d->slot;
+            if (result == MCHANGER_OK) catalog_note_disc(catalog, slot, &info);
+            int returned = scan_return_disc(handle, transport, &map, d);
+            if (returned != 0) {
+                fprintf(stderr, "Failed to return disc from drive %d to slot %d.\n", d->drive, slot);
+                rc = move_error(returned);
+                goto cleanup;
+            }
+            progressed = true;
+
+            if (!done[slot - 1]) {
+                done[slot - 1] = true;
+                done_count++;
+            }
+            finished_here++;
+            scan_progress_append(progress_path, slot, result);
+
+            if (callback) {
+                MChangerScanProgress p = {0};
+                p.slot = slot;
+                p.drive = d->drive;
+                p.result = result;
+                if (result == MCHANGER_OK) disc_id_from_info(&info, tracks, &p.disc);
+                p.done = done_count;
+                p.total = total;
+                // Pipelined throughput so far is the best predictor of the rest
+                p.eta_secs = (double)(total - done_count) * (monotonic_secs() - started) / (double)finished_here;
+                callback(&p, context);
+            }
+        }
+
+        // Refill idle drives with the next unscanned slot (none once stopped:
+        // the loaded discs are finished and put back, the rest resume later)
+        for (size_t i = 0; i < map.drives.count && !g_stop; i++) {
+            ScanDrive *d = &drives[i];
+            if (d->addr == 0 || d->busy) continue;
+            while (next_slot < map.slots.count &&
+                   (!full[next_slot] || done[next_slot] || claimed[next_slot])) {
+                next_slot++;
+            }
+            if (next_slot >= map.slots.count) break;
+
+            int slot = (int)next_slot + 1;
+            claimed[next_slot] = true;
+            int loaded = cmd_move_medium(handle, transport, element_addr(&map.slots, next_slot), d->addr);
+            if (loaded == MOVE_RC_STRANDED) {
+                rc = MCHANGER_ERR_STRANDED;
+                goto cleanup;
+            }
+            if (loaded != 0) {
+                // Most likely the cached occupancy was stale; note it and move on
+                done[next_slot] = true;
+                done_count++;
+                finished_here++;
+                scan_progress_append(progress_path, slot, MCHANGER_ERR_SCSI);
+                if (callback) {
+                    MChangerScanProgress p = {0};
+                    p.slot = slot;
+                    p.drive = d->drive;
+                    p.result = MCHANGER_ERR_SCSI;
+                    p.done = done_count;
+                    p.total = total;
+                    p.eta_secs = (double)(total - done_count) * (monotonic_secs() - started) / (double)finished_here;
+                    callback(&p, context);
                 }
+                progressed = true;
+                continue;
             }
+            d->busy = true;
+            d->slot = slot;
+            d->loaded_at = monotonic_secs();
+            active = true;
+            progressed = true;
         }
 
-        if (rc == 0) {
-            printf("Disc ejected to I/E slot. You can now remove it from the changer.\n");
+        if (!active) break;
+        if (!progressed) usleep(250000);
+    }
+
+    // Everything has been visited: the next scan starts from scratch
+    if (g_stop) rc = MCHANGER_ERR_BUSY;
+    else unlink(progress_path);
+
+cleanup:
+    door_unlock(handle);
+    for (size_t i = 0; i < map.drives.count; i++) {
+        if (drives[i].mmc) (*drives[i].mmc)->Release(drives[i].mmc);
+        if (drives[i].service != IO_OBJECT_NULL) IOObjectRelease(drives[i].service);
+    }
+    free(full);
+    free(done);
+    free(claimed);
+    free(drives);
+    element_map_free(&map);
+    return rc;
+}
+
+static void format_duration(double secs, char *out, size_t out_len) {
+    long total = secs > 0 ? (long)(secs + 0.5) : 0;
+    if (total >= 3600) {
+        snprintf(out, out_len, "%ldh%02ldm", total / 3600, (total % 3600) / 60);
+    } else {
+        snprintf(out, out_len, "%ldm%02lds", total / 60, total % 60);
+    }
+}
+
+static void print_scan_progress(const MChangerScanProgress *p, void *context __attribute__((unused))) {
+    char eta[32];
+    format_duration(p->eta_secs, eta, sizeof(eta));
+    if (p->result == MCHANGER_OK) {
+        printf("[%zu/%zu] slot %d (drive %d): %s %s %.1f MB, ETA %s\n", p->done, p->total, p->slot, p->drive,
+               p->disc.fingerprint, p->disc.media_type[0] ? p->disc.media_type : "?",
+               p->disc.size_bytes / 1000000.0, eta);
+    } else {
+        printf("[%zu/%zu] slot %d (drive %d): not identified (error %d), ETA %s\n", p->done, p->total,
+               p->slot, p->drive, p->result, eta);
+    }
+    fflush(stdout);
+}
+
+// cache [list] | evict --fingerprint <hex>
+// Works entirely from the cache directory; the changer is never opened.
+static int cmd_cache(int argc, char **argv, const char *dir, uint64_t max_bytes) {
+    MChangerImageCache *cache = mchanger_cache_open(dir, max_bytes);
+    if (!cache) {
+        fprintf(stderr, "Unable to open image cache.\n");
+        return 1;
+    }
+
+    const char *sub = (argc > 2 && argv[2][0] != '-') ? argv[2] : "list";
+    const char *fingerprint = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--fingerprint") == 0 && i + 1 < argc) fingerprint = argv[++i];
+    }
+
+    int rc = 0;
+    if (strcmp(sub, "list") == 0) {
+        size_t count = mchanger_cache_count(cache);
+        printf("Image cache: %s (%zu image%s, %.1f of %.1f GB)\n", cache->dir, count, count == 1 ? "" : "s",
+               mchanger_cache_used_bytes(cache) / 1e9, cache->max_bytes / 1e9);
+        for (size_t i = 0; i < count; i++) {
+            MChangerCacheEntry e;
+            if (mchanger_cache_entry_at(cache, i, &e) != MCHANGER_OK) continue;
+            char when[32] = "-";
+            time_t t = (time_t)e.last_used;
+            struct tm tm_local;
+            if (e.last_used > 0 && localtime_r(&t, &tm_local)) {
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm_local);
+            }
+            printf("  %s  %8.1f MB  used %s  %u hit%s\n", e.fingerprint, e.size_bytes / 1e6, when,
+                   e.hits, e.hits == 1 ? "" : "s");
         }
-        element_map_free(&map);
-    } else if (strcmp(argv[1], "insert") == 0) {
-        // Insert a disc from the IE port into a slot
-        size_t slot_index = 0;
-        bool have_slot = false;
-        bool have_transport = false;
-        uint16_t transport = 0;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
-                have_slot = parse_index(argv[++i], &slot_index);
-            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
-                have_transport = parse_u16(argv[++i], &transport);
+    } else if (strcmp(sub, "evict") == 0) {
+        if (!fingerprint) {
+            fprintf(stderr, "Missing --fingerprint.\n");
+            rc = 1;
+        } else if (mchanger_cache_evict(cache, fingerprint) != MCHANGER_OK) {
+            printf("%s is not cached.\n", fingerprint);
+            rc = 1;
+        } else {
+            printf("Evicted %s.\n", fingerprint);
+        }
+    } else {
+        fprintf(stderr, "Unknown cache command '%s'.\n", sub);
+        rc = 1;
+    }
+
+    mchanger_cache_close(cache);
+    return rc;
+}
+
+/*
+ * =============================================================================
+ * Slot Placement
+ * =============================================================================
+ *
+ * Robot travel grows with the distance between a slot and the drives, several
+ * fold on a large carousel. Slots are ranked by index distance from the slot
+ * nearest the drives (slot 1 unless configured), measured around the ring on
+ * carousel changers: the element map gives the slot order, and the Transport
+ * Geometry mode page only describes media rotation, not position. Often
+ * loaded discs belong near the drives and cold ones far away.
+ */
+
+typedef struct {
+    int from;
+    int to;
+} SlotMove;
+
+static size_t slot_distance(const SlotLayout *layout, size_t slot_count, int slot) {
+    size_t near = layout->near_slot > 0 ? (size_t)layout->near_slot : 1;
+    if (near > slot_count) near = slot_count;
+    size_t s = (size_t)slot;
+    size_t d = s > near ? s - near : near - s;
+    if (layout->ring && slot_count - d < d) d = slot_count - d;
+    return d;
+}
+
+// Free slot nearest the drives (hot) or farthest from them; 0 if none.
+// Ties go to the lower slot number.
+static int pick_free_slot(const SlotLayout *layout, const bool *full, size_t slot_count, bool hot) {
+    int best = 0;
+    size_t best_d = 0;
+    for (size_t i = 0; i < slot_count; i++) {
+        if (full[i]) continue;
+        size_t d = slot_distance(layout, slot_count, (int)i + 1);
+        if (best == 0 || (hot ? d < best_d : d > best_d)) {
+            best = (int)i + 1;
+            best_d = d;
+        }
+    }
+    return best;
+}
+
+// Slot an idle return sends a drive's disc back to: the slot it came from,
+// when that is known and empty. 0 leaves the disc in the drive.
+static int pick_home_slot(const ElementMap *map, bool drive_full, uint16_t source, bool home_full) {
+    int slot = drive_full ? slot_index_for_addr(map, source) : 0;
+    return slot > 0 && !home_full ? slot : 0;
+}
+
+// Occupancy for placement: a disc in a drive still owns its home slot.
+// full[] and loaded[] have one entry per map slot.
+static int read_placement_state(ChangerHandle *handle, const ElementMap *map, bool *full, bool *loaded) {
+    if (read_slot_occupancy(handle, map, full) != 0) return MCHANGER_ERR_SCSI;
+    for (size_t d = 0; d < map->drives.count; d++) {
+        ElementStatus st = {0};
+        if (read_element_pair(handle, element_addr(&map->drives, d), &st, 0, NULL, RES_MEMORY) != 0) {
+            return MCHANGER_ERR_SCSI;
+        }
+        int home = st.full && st.valid_src ? slot_index_for_addr(map, st.src_addr) : 0;
+        if (home > 0) {
+            full[home - 1] = true;
+            loaded[home - 1] = true;
+        }
+    }
+    return MCHANGER_OK;
+}
+
+typedef struct {
+    int slot;
+    uint32_t loads;
+    size_t distance;
+} HotDisc;
+
+static int compare_hot_discs(const void *a, const void *b) {
+    const HotDisc *x = a, *y = b;
+    if (x->loads != y->loads) return x->loads > y->loads ? -1 : 1;
+    if (x->distance != y->distance) return x->distance < y->distance ? -1 : 1;
+    return x->slot - y->slot;
+}
+
+// Plan at most max_moves slot-to-slot moves that put the most-loaded discs
+// in the slots nearest the drives, hottest first. A colder disc in the way is
+// moved to the farthest free slot. full[] is updated as if the moves had run.
+static size_t plan_rebalance(const SlotLayout *layout, const MChangerCatalog *catalog, bool *full,
+                             const bool *loaded, size_t slot_count, size_t max_moves, SlotMove *moves) {
+    size_t catalog_count = mchanger_catalog_count(catalog);
+    HotDisc *hot = calloc(catalog_count ? catalog_count : 1, sizeof(HotDisc));
+    int *order = calloc(slot_count ? slot_count : 1, sizeof(int));
+    bool *settled = calloc(slot_count ? slot_count : 1, sizeof(bool));
+    size_t planned = 0;
+    if (!hot || !order || !settled) goto done;
+
+    size_t hot_count = 0;
+    for (size_t i = 0; i < catalog_count; i++) {
+        MChangerCatalogEntry e;
+        if (mchanger_catalog_entry_at(catalog, i, &e) != MCHANGER_OK) continue;
+        if (e.loads == 0 || (size_t)e.slot > slot_count || !full[e.slot - 1] || loaded[e.slot - 1]) continue;
+        hot[hot_count].slot = e.slot;
+        hot[hot_count].loads = e.loads;
+        hot[hot_count].distance = slot_distance(layout, slot_count, e.slot);
+        hot_count++;
+    }
+    qsort(hot, hot_count, sizeof(HotDisc), compare_hot_discs);
+
+    // Slots nearest first; a loaded disc's home is spoken for
+    for (size_t i = 0; i < slot_count; i++) {
+        order[i] = (int)i + 1;
+        settled[i] = loaded[i];
+    }
+    for (size_t i = 1; i < slot_count; i++) {
+        int slot = order[i];
+        size_t d = slot_distance(layout, slot_count, slot);
+        size_t j = i;
+        while (j > 0 && slot_distance(layout, slot_count, order[j - 1]) > d) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = slot;
+    }
+
+    size_t next = 0;
+    for (size_t h = 0; h < hot_count; h++) {
+        while (next < slot_count && settled[order[next] - 1]) next++;
+        if (next >= slot_count) break;
+        int target = order[next];
+        int from = hot[h].slot;
+        if (slot_distance(layout, slot_count, from) <= slot_distance(layout, slot_count, target)) {
+            settled[from - 1] = true;
+            continue;
+        }
+
+        if (full[target - 1]) {
+            int away = pick_free_slot(layout, full, slot_count, false);
+            if (away == 0 || planned + 2 > max_moves) break;
+            moves[planned++] = (SlotMove){ target, away };
+            full[target - 1] = false;
+            full[away - 1] = true;
+            for (size_t k = h + 1; k < hot_count; k++) {
+                if (hot[k].slot == target) hot[k].slot = away;
             }
         }
-        if (!have_slot) {
-            fprintf(stderr, "Missing --slot.\n");
-            rc = 1; goto out;
+        if (planned + 1 > max_moves) break;
+        moves[planned++] = (SlotMove){ from, target };
+        full[from - 1] = false;
+        full[target - 1] = true;
+        settled[target - 1] = true;
+    }
+
+done:
+    free(hot);
+    free(order);
+    free(settled);
+    return planned;
+}
+
+// Planned moves being carried out by one worker per robot
+typedef struct {
+    ChangerHandle *handle;
+    MChangerCatalog *catalog;
+    const ElementMap *map;
+    const SlotMove *moves;
+    size_t count;
+    uint8_t *state;             // per move: 0 waiting, 1 moving, 2 finished
+    size_t waiting;
+    size_t done;
+    int rc;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} SlotMoveRun;
+
+typedef struct {
+    SlotMoveRun *run;
+    uint16_t transport;
+} SlotMoveWorker;
+
+// The first waiting move that no earlier unfinished move shares a slot with,
+// or count. Plans chain moves (A->B, then C->A), and this keeps each chain in
+// plan order while unrelated moves go to whichever robot is free.
+static size_t next_ready_move(const SlotMoveRun *run) {
+    for (size_t i = 0; i < run->count; i++) {
+        if (run->state[i] != 0) continue;
+        const SlotMove *m = &run->moves[i];
+        bool ready = true;
+        for (size_t j = 0; j < i && ready; j++) {
+            const SlotMove *e = &run->moves[j];
+            ready = run->state[j] == 2 || (e->from != m->from && e->from != m->to && e->to != m->from && e->to != m->to);
         }
-        ElementMap map = {0};
-        rc = fetch_element_map(&handle, &map);
-        if (rc != 0) {
-            fprintf(stderr, "Failed to read element map.\n");
-            element_map_free(&map);
-            goto out;
+        if (ready) return i;
+    }
+    return run->count;
+}
+
+static void *slot_move_worker(void *arg) {
+    SlotMoveWorker *w = arg;
+    SlotMoveRun *run = w->run;
+    pthread_mutex_lock(&run->lock);
+    while (run->rc == MCHANGER_OK && run->waiting > 0 && !g_stop) {
+        size_t i = next_ready_move(run);
+        if (i == run->count) {
+            // Another robot is moving a disc this move depends on
+            pthread_cond_wait(&run->changed, &run->lock);
+            continue;
         }
-        if (slot_index == 0 || slot_index > map.slots.count) {
-            fprintf(stderr, "Slot out of range. Slots: %zu\n", map.slots.count);
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+        run->state[i] = 1;
+        run->waiting--;
+        pthread_mutex_unlock(&run->lock);
+        int rc = cmd_move_medium(run->handle, w->transport, element_addr(&run->map->slots, run->moves[i].from - 1),
+                                 element_addr(&run->map->slots, run->moves[i].to - 1));
+        pthread_mutex_lock(&run->lock);
+        if (rc != 0) {
+            run->rc = move_error(rc);
+        } else {
+            catalog_note_moved(run->catalog, run->moves[i].from, run->moves[i].to);
+            run->done++;
         }
-        if (map.ie.count == 0) {
-            fprintf(stderr, "No import/export element found.\n");
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+        run->state[i] = 2;
+        pthread_cond_broadcast(&run->changed);
+    }
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+// Carry out planned moves, keeping the catalog in step, on every robot at once
+// when there are several. Returns an MCHANGER code.
+static int run_slot_moves(ChangerHandle *handle, MChangerCatalog *catalog, const ElementMap *map,
+                          const SlotMove *moves, size_t count, size_t *out_done) {
+    if (out_done) *out_done = 0;
+    if (map->transports.count == 0) return MCHANGER_ERR_INVALID;
+    SlotMoveRun run = { .handle = handle, .catalog = catalog, .map = map, .moves = moves, .count = count,
+                        .state = calloc(count ? count : 1, 1), .waiting = count, .rc = MCHANGER_OK };
+    if (!run.state) return MCHANGER_ERR_INVALID;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.changed, NULL);
+
+    // An SBP2 login runs one command at a time, so only SCSITask devices gain
+    size_t robots = handle->backend == BACKEND_SCSITASK && count > 1 ? map->transports.count : 1;
+    if (robots > TRANSPORT_LOCKS) robots = TRANSPORT_LOCKS;
+    SlotMoveWorker workers[TRANSPORT_LOCKS];
+    pthread_t threads[TRANSPORT_LOCKS];
+    DeviceLocks batch_locks;
+    bool own_locks = robots > 1 && !handle->locks;
+    if (own_locks) {
+        device_locks_init(&batch_locks);
+        handle->locks = &batch_locks;
+    }
+
+    door_lock(handle);
+    // This thread drives the first robot; a robot whose thread can't start is left idle
+    size_t started = 1;
+    for (size_t r = 0; r < robots; r++) {
+        workers[r] = (SlotMoveWorker){ &run, element_addr(&map->transports, r) };
+        if (r > 0 && pthread_create(&threads[started], NULL, slot_move_worker, &workers[r]) == 0) {
+            started++;
         }
-        if (!have_transport) {
-            if (map.transports.count == 0) {
+    }
+    slot_move_worker(&workers[0]);
+    for (size_t t = 1; t < started; t++) pthread_join(threads[t], NULL);
+    door_unlock(handle);
+
+    if (own_locks) {
+        handle->locks = NULL;
+        device_locks_destroy(&batch_locks);
+    }
+    pthread_cond_destroy(&run.changed);
+    pthread_mutex_destroy(&run.lock);
+    free(run.state);
+    if (out_done) *out_done = run.done;
+    return run.rc;
+}
+
+/*
+ * =============================================================================
+ * Motion Model
+ * =============================================================================
+ *
+ * Every successful MOVE MEDIUM is timed and appended to a small log
+ * (~/.mchanger/motion.tsv, or $MCHANGER_MOTION). Estimates fit a line per
+ * kind of move (load, unload, slot to slot, import, export) against the slot
+ * distance from the drives, from the most recent moves, so planners and ETAs
+ * follow the device's real mechanics as they drift.
+ */
+
+#define MOTION_HEADER "# mchanger motion v1"
+#define MOTION_MAX_SAMPLES 512
+
+typedef struct {
+    uint16_t transport;
+    uint16_t source;
+    uint16_t dest;
+    uint32_t ms;
+} MotionSample;
+
+struct MotionLog {
+    char path[1024];
+    MotionSample samples[MOTION_MAX_SAMPLES];   // ring buffer of the latest moves
+    size_t count;
+    size_t next;
+};
+typedef struct MotionLog MotionLog;
+
+typedef enum {
+    MOVE_LOAD = 0,      // slot -> drive
+    MOVE_UNLOAD,        // drive -> slot
+    MOVE_SHUFFLE,       // slot -> slot
+    MOVE_IMPORT,        // I/E -> slot
+    MOVE_EXPORT,        // slot -> I/E
+    MOVE_OTHER,
+    MOVE_KINDS
+} MoveKind;
+
+static const char *const move_kind_names[MOVE_KINDS] = {
+    "load", "unload", "slot to slot", "import", "export", "other"
+};
+
+static void motion_push(MotionLog *log, MotionSample sample) {
+    log->samples[log->next] = sample;
+    log->next = (log->next + 1) % MOTION_MAX_SAMPLES;
+    if (log->count < MOTION_MAX_SAMPLES) log->count++;
+}
+
+// Open the log at path (NULL for the default). Returns NULL if there is no
+// usable location; moves are then simply not timed.
+static MotionLog *motion_open(const char *path) {
+    MotionLog *log = calloc(1, sizeof(MotionLog));
+    if (!log) return NULL;
+    if (path && *path) {
+        snprintf(log->path, sizeof(log->path), "%s", path);
+    } else if (getenv("MCHANGER_MOTION") && *getenv("MCHANGER_MOTION")) {
+        snprintf(log->path, sizeof(log->path), "%s", getenv("MCHANGER_MOTION"));
+    } else {
+        char base[1024];
+        int n = mchanger_base_dir(base, sizeof(base)) ? snprintf(log->path, sizeof(log->path), "%s/motion.tsv", base)
+                                                       : -1;
+        if (n < 0 || (size_t)n >= sizeof(log->path)) {
+            free(log);
+            return NULL;
+        }
+    }
+
+    FILE *fp = fopen(log->path, "r");
+    if (!fp) return log;
+    size_t lines = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned transport, source, dest, ms;
+        if (line[0] == '#' || sscanf(line, "%u\t%u\t%u\t%u", &transport, &source, &dest, &ms) != 4) continue;
+        motion_push(log, (MotionSample){ (uint16_t)transport, (uint16_t)source, (uint16_t)dest, ms });
+        lines++;
+    }
+    fclose(fp);
+
+    // The file only grows; keep it to what the model uses
+    if (lines > 2 * MOTION_MAX_SAMPLES) {
+        char tmp_path[1100];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", log->path);
+        fp = fopen(tmp_path, "w");
+        if (fp) {
+            fprintf(fp, "%s\n# transport\tsource\tdest\tms\n", MOTION_HEADER);
+            for (size_t i = 0; i < log->count; i++) {
+                const MotionSample *m = &log->samples[(log->next + MOTION_MAX_SAMPLES - log->count + i) %
+                                                      MOTION_MAX_SAMPLES];
+                fprintf(fp, "%u\t%u\t%u\t%u\n", m->transport, m->source, m->dest, m->ms);
+            }
+            if (fclose(fp) != 0 || rename(tmp_path, log->path) != 0) unlink(tmp_path);
+        }
+    }
+    return log;
+}
+
+static void motion_close(MotionLog *log) {
+    free(log);
+}
+
+static void motion_record(MotionLog *log, uint16_t transport, uint16_t source, uint16_t dest, double ms) {
+    if (!log) return;
+    MotionSample sample = { transport, source, dest, ms > 0 ? (uint32_t)(ms + 0.5) : 0 };
+    motion_push(log, sample);
+
+    FILE *fp = fopen(log->path, "a");
+    if (!fp) return;
+    if (ftell(fp) == 0) fprintf(fp, "%s\n# transport\tsource\tdest\tms\n", MOTION_HEADER);
+    fprintf(fp, "%u\t%u\t%u\t%u\n", transport, source, dest, sample.ms);
+    fclose(fp);
+}
+
+// Kind of a move and its travel measure: the slot's distance from the
+// drives, or for slot-to-slot moves the distance between the two slots
+static MoveKind classify_move(const ElementMap *map, const SlotLayout *layout, uint16_t source, uint16_t dest,
+                              double *out_x) {
+    int src_slot = slot_index_for_addr(map, source);
+    int dst_slot = slot_index_for_addr(map, dest);
+    size_t n = map->slots.count;
+    *out_x = 0;
+    if (src_slot && dst_slot) {
+        SlotLayout between = { src_slot, layout->ring };
+        *out_x = (double)slot_distance(&between, n, dst_slot);
+        return MOVE_SHUFFLE;
+    }
+    int slot = src_slot ? src_slot : dst_slot;
+    if (slot) *out_x = (double)slot_distance(layout, n, slot);
+    if (src_slot && element_list_index(&map->drives, dest)) return MOVE_LOAD;
+    if (dst_slot && element_list_index(&map->drives, source)) return MOVE_UNLOAD;
+    if (dst_slot && element_list_index(&map->ie, source)) return MOVE_IMPORT;
+    if (src_slot && element_list_index(&map->ie, dest)) return MOVE_EXPORT;
+    return MOVE_OTHER;
+}
+
+// Least-squares line through the logged moves of one kind
+typedef struct {
+    double n, sx, sy, sxx, sxy;
+} MotionFit;
+
+static void motion_fit(const MotionLog *log, const ElementMap *map, const SlotLayout *layout, uint16_t transport,
+                       MotionFit fits[MOVE_KINDS]) {
+    memset(fits, 0, MOVE_KINDS * sizeof(MotionFit));
+    // Moves of this transport when there are any; a single-robot changer has one
+    bool any_for_transport = false;
+    for (size_t i = 0; i < log->count && !any_for_transport; i++) {
+        any_for_transport = log->samples[i].transport == transport;
+    }
+    for (size_t i = 0; i < log->count; i++) {
+        const MotionSample *m = &log->samples[i];
+        if (any_for_transport && m->transport != transport) continue;
+        double x;
+        MoveKind kind = classify_move(map, layout, m->source, m->dest, &x);
+        MotionFit *f = &fits[kind];
+        f->n += 1;
+        f->sx += x;
+        f->sy += m->ms;
+        f->sxx += x * x;
+        f->sxy += x * m->ms;
+    }
+}
+
+// Intercept and slope of a fit; a flat line until the distances vary
+static void motion_line(const MotionFit *f, double *out_fixed, double *out_per_slot) {
+    double mx = f->sx / f->n, my = f->sy / f->n;
+    double var = f->sxx / f->n - mx * mx;
+    *out_per_slot = var > 1e-9 ? (f->sxy / f->n - mx * my) / var : 0;
+    *out_fixed = my - *out_per_slot * mx;
+}
+
+// Estimated duration of a move. Falls back to the average of all logged moves
+// for a kind that has not been seen; false when nothing has been logged.
+static bool motion_estimate(const MotionLog *log, const ElementMap *map, const SlotLayout *layout,
+                            uint16_t transport, uint16_t source, uint16_t dest, double *out_ms) {
+    if (!log || log->count == 0) return false;
+    MotionFit fits[MOVE_KINDS];
+    motion_fit(log, map, layout, transport, fits);
+    double x;
+    MoveKind kind = classify_move(map, layout, source, dest, &x);
+    const MotionFit *f = &fits[kind];
+    if (f->n == 0) {
+        MotionFit all = {0};
+        for (int k = 0; k < MOVE_KINDS; k++) {
+            all.n += fits[k].n;
+            all.sy += fits[k].sy;
+        }
+        if (all.n == 0) return false;
+        *out_ms = all.sy / all.n;
+        return true;
+    }
+    double fixed, per_slot;
+    motion_line(f, &fixed, &per_slot);
+    double ms = fixed + per_slot * x;
+    *out_ms = ms > 0 ? ms : 0;
+    return true;
+}
+
+// Cost of a move when choosing between robots or ports: the motion model's
+// estimate, or no preference until there is one
+static double move_cost(const ChangerHandle *handle, const ElementMap *map, const SlotLayout *layout,
+                        uint16_t transport, uint16_t source, uint16_t dest) {
+    double ms;
+    return layout && motion_estimate(handle->motion, map, layout, transport, source, dest, &ms) ? ms : 0;
+}
+
+// The robot for a move: the least busy, then the one expected to finish it
+// soonest. With one robot, or nothing to tell them apart, the first.
+static uint16_t pick_transport(const ChangerHandle *handle, const ElementMap *map, const SlotLayout *layout,
+                               uint16_t source, uint16_t dest) {
+    if (map->transports.count == 0) return 0;
+    uint16_t best = element_addr(&map->transports, 0);
+    int best_busy = INT_MAX;
+    double best_cost = 0;
+    for (size_t i = 0; i < map->transports.count && map->transports.count > 1; i++) {
+        uint16_t t = element_addr(&map->transports, i);
+        int busy = handle->locks ? __atomic_load_n(&handle->locks->busy[t % TRANSPORT_LOCKS], __ATOMIC_SEQ_CST) : 0;
+        double cost = move_cost(handle, map, layout, t, source, dest);
+        if (busy < best_busy || (busy == best_busy && cost < best_cost)) {
+            best = t;
+            best_busy = busy;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+// The I/E port to move a disc through for slot_addr: the nearest one that is
+// empty and accessible, or the first when none is or they can't be read
+static uint16_t pick_ie_port(ChangerHandle *handle, const ElementMap *map, const SlotLayout *layout,
+                             uint16_t transport, uint16_t slot_addr, bool into_port) {
+    if (map->ie.count <= 1) return map->ie.count ? element_addr(&map->ie, 0) : 0;
+    uint16_t best = element_addr(&map->ie, 0);
+    ElementStatus *ports = calloc(map->ie.count, sizeof(ElementStatus));
+    uint32_t alloc = 16 + (uint32_t)map->ie.count * 64;
+    uint8_t *buf = malloc(alloc);
+    if (ports && buf && read_element_range(handle, 0x03, &map->ie, buf, alloc, RES_MEMORY, ports) == 0) {
+        double best_cost = -1;
+        for (size_t i = 0; i < map->ie.count; i++) {
+            if (ports[i].full || !ports[i].access) continue;
+            uint16_t port = element_addr(&map->ie, i);
+            double cost = into_port ? move_cost(handle, map, layout, transport, slot_addr, port)
+                                    : move_cost(handle, map, layout, transport, port, slot_addr);
+            if (best_cost < 0 || cost < best_cost) {
+                best = port;
+                best_cost = cost;
+            }
+        }
+    }
+    free(ports);
+    free(buf);
+    return best;
+}
+
+static void print_motion_model(const MotionLog *log, const ElementMap *map, const SlotLayout *layout,
+                               uint16_t transport) {
+    MotionFit fits[MOVE_KINDS];
+    motion_fit(log, map, layout, transport, fits);
+    if (map->transports.count > 1) {
+        printf("Motion model for transport 0x%04x: %s (%zu moves)\n", transport, log->path, log->count);
+    } else {
+        printf("Motion model: %s (%zu moves)\n", log->path, log->count);
+    }
+    for (int k = 0; k < MOVE_KINDS; k++) {
+        if (fits[k].n == 0) continue;
+        double fixed, per_slot;
+        motion_line(&fits[k], &fixed, &per_slot);
+        printf("  %-13s %4.0f moves  %7.0f ms + %6.1f ms per slot of distance\n", move_kind_names[k],
+               fits[k].n, fixed, per_slot);
+    }
+}
+
+// Probe moves spread over the slot distances, so the fitted lines are not
+// extrapolated from one end of the magazine. Uses an empty drive (load and
+// unload) when there is one, otherwise slot-to-slot moves into a free slot
+// and back. Every disc ends where it started. Robots take turns, so each
+// gets its own spread of probes. Returns the moves made.
+static size_t calibrate_motion(ChangerHandle *handle, const ElementMap *map, const SlotLayout *layout,
+                               size_t budget) {
+    if (map->transports.count == 0 || map->slots.count == 0 || budget < 2) return 0;
+    size_t slots = map->slots.count;
+    bool *full = calloc(slots, sizeof(bool));
+    bool *loaded = calloc(slots, sizeof(bool));
+    int *occupied = calloc(slots, sizeof(int));
+    size_t made = 0;
+    if (!full || !loaded || !occupied || read_placement_state(handle, map, full, loaded) != MCHANGER_OK) goto done;
+
+    uint16_t empty_drive = 0;
+    for (size_t d = 0; d < map->drives.count && !empty_drive; d++) {
+        ElementStatus st = {0};
+        if (read_element_pair(handle, element_addr(&map->drives, d), &st, 0, NULL, RES_MEMORY) == 0 && !st.full) {
+            empty_drive = element_addr(&map->drives, d);
+        }
+    }
+    int spare = empty_drive ? 0 : pick_free_slot(layout, full, slots, true);
+    if (!empty_drive && !spare) goto done;
+
+    // Occupied slots, nearest first
+    size_t count = 0;
+    for (size_t i = 0; i < slots; i++) {
+        if (!full[i] || loaded[i]) continue;
+        int slot = (int)i + 1;
+        size_t d = slot_distance(layout, slots, slot);
+        size_t j = count++;
+        while (j > 0 && slot_distance(layout, slots, occupied[j - 1]) > d) {
+            occupied[j] = occupied[j - 1];
+            j--;
+        }
+        occupied[j] = slot;
+    }
+
+    size_t probes = budget / 2 < count ? budget / 2 : count;
+    door_lock(handle);
+    for (size_t p = 0; p < probes && !g_stop; p++) {
+        size_t pick = probes > 1 ? p * (count - 1) / (probes - 1) : 0;
+        uint16_t slot_addr = element_addr(&map->slots, occupied[pick] - 1);
+        uint16_t there = empty_drive ? empty_drive : element_addr(&map->slots, spare - 1);
+        uint16_t transport = element_addr(&map->transports, p % map->transports.count);
+        if (cmd_move_medium(handle, transport, slot_addr, there) != 0) break;
+        made++;
+        if (empty_drive) eject_optical_media();
+        if (cmd_move_medium(handle, transport, there, slot_addr) != 0) break;
+        made++;
+    }
+    door_unlock(handle);
+
+done:
+    free(full);
+    free(loaded);
+    free(occupied);
+    return made;
+}
+
+/*
+ * =============================================================================
+ * Inventory Snapshots
+ * =============================================================================
+ *
+ * A snapshot is the element map plus what every element holds, saved as TSV
+ * (~/.mchanger/inventory.tsv unless a path is given). Batches of operations
+ * are planned against it with no device: each operation expands to the
+ * MOVE MEDIUM commands the CLI would issue, each move is checked the way the
+ * changer checks it (source full, destination empty), and robot time comes
+ * from the motion model. The I/E port is taken to be tended: a disc waits
+ * there for every insert, and every disc sent there is taken away.
+ */
+
+#define INVENTORY_HEADER "# mchanger inventory v1"
+#define INVENTORY_KINDS 4
+
+typedef struct {
+    bool full;
+    uint16_t source;            // element the medium was last moved from; 0 if not reported
+} InventoryState;
+
+typedef struct Inventory {
+    ElementMap map;
+    InventoryState *states[INVENTORY_KINDS];    // parallel to the lists below
+} Inventory;
+
+static const char *const inventory_kind_names[INVENTORY_KINDS] = { "transport", "slot", "drive", "ie" };
+
+static ElementList *inventory_list(Inventory *inv, int kind) {
+    switch (kind) {
+        case 0: return &inv->map.transports;
+        case 1: return &inv->map.slots;
+        case 2: return &inv->map.drives;
+        default: return &inv->map.ie;
+    }
+}
+
+static void inventory_free(Inventory *inv) {
+    element_map_free(&inv->map);
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        free(inv->states[k]);
+        inv->states[k] = NULL;
+    }
+}
+
+static bool inventory_alloc_states(Inventory *inv) {
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        size_t count = inventory_list(inv, k)->count;
+        inv->states[k] = calloc(count ? count : 1, sizeof(InventoryState));
+        if (!inv->states[k]) return false;
+    }
+    return true;
+}
+
+static InventoryState *inventory_state(Inventory *inv, uint16_t addr) {
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        int i = element_list_index(inventory_list(inv, k), addr);
+        if (i > 0) return &inv->states[k][i - 1];
+    }
+    return NULL;
+}
+
+static bool inventory_default_path(char *out, size_t out_len) {
+    char base[1024];
+    if (!mchanger_base_dir(base, sizeof(base))) return false;
+    int n = snprintf(out, out_len, "%s/inventory.tsv", base);
+    return n > 0 && (size_t)n < out_len;
+}
+
+// What every element of inv->map holds, from changer memory
+static int inventory_read_states(ChangerHandle *handle, Inventory *inv) {
+    if (!inventory_alloc_states(inv)) return MCHANGER_ERR_INVALID;
+
+    bool *full = calloc(inv->map.slots.count ? inv->map.slots.count : 1, sizeof(bool));
+    if (!full) return MCHANGER_ERR_INVALID;
+    int rc = read_slot_occupancy(handle, &inv->map, full) == 0 ? MCHANGER_OK : MCHANGER_ERR_SCSI;
+    for (size_t i = 0; i < inv->map.slots.count; i++) {
+        inv->states[1][i].full = full[i];
+    }
+    free(full);
+
+    // Transports, drives and I/E ports are few; read them singly
+    for (int k = 0; k < INVENTORY_KINDS && rc == MCHANGER_OK; k++) {
+        if (k == 1) continue;
+        const ElementList *list = inventory_list(inv, k);
+        for (size_t i = 0; i < list->count; i++) {
+            ElementStatus st = {0};
+            if (read_element_pair(handle, element_addr(list, i), &st, 0, NULL, RES_MEMORY) != 0) {
+                rc = MCHANGER_ERR_SCSI;
+                break;
+            }
+            inv->states[k][i].full = st.full;
+            inv->states[k][i].source = st.valid_src ? st.src_addr : 0;
+        }
+    }
+    return rc;
+}
+
+// Snapshot the changer from its memory (no robot motion). Returns an MCHANGER
+// code; the caller frees inv either way.
+static int inventory_read(ChangerHandle *handle, Inventory *inv) {
+    memset(inv, 0, sizeof(*inv));
+    if (fetch_element_map(handle, &inv->map) != 0) return MCHANGER_ERR_SCSI;
+    return inventory_read_states(handle, inv);
+}
+
+static int inventory_save(Inventory *inv, const char *path) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) return MCHANGER_ERR_OPEN;
+    fprintf(fp, "%s\n# kind\taddress\tfull\tsource\n", INVENTORY_HEADER);
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        const ElementList *list = inventory_list(inv, k);
+        for (size_t i = 0; i < list->count; i++) {
+            fprintf(fp, "%s\t%u\t%d\t%u\n", inventory_kind_names[k], element_addr(list, i),
+                    inv->states[k][i].full ? 1 : 0, inv->states[k][i].source);
+        }
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return MCHANGER_ERR_OPEN;
+    }
+    return MCHANGER_OK;
+}
+
+// Elements are listed in index order within each kind, so the file is read
+// twice: once for the map, once for the states.
+static int inventory_load(const char *path, Inventory *inv) {
+    memset(inv, 0, sizeof(*inv));
+    FILE *fp = fopen(path, "r");
+    if (!fp) return MCHANGER_ERR_NOT_FOUND;
+
+    char line[256];
+    if (!fgets(line, sizeof(line), fp) || strncmp(line, INVENTORY_HEADER, strlen(INVENTORY_HEADER)) != 0) {
+        fclose(fp);
+        return MCHANGER_ERR_INVALID;
+    }
+    int rc = MCHANGER_OK;
+    for (int pass = 0; pass < 2 && rc == MCHANGER_OK; pass++) {
+        size_t seen[INVENTORY_KINDS] = {0};
+        rewind(fp);
+        while (fgets(line, sizeof(line), fp)) {
+            char kind_name[16];
+            unsigned addr, full, source;
+            if (line[0] == '#' || line[0] == '\n') continue;
+            if (sscanf(line, "%15s %u %u %u", kind_name, &addr, &full, &source) != 4 || addr > 0xFFFF) {
+                rc = MCHANGER_ERR_INVALID;
+                break;
+            }
+            int k = 0;
+            while (k < INVENTORY_KINDS && strcmp(kind_name, inventory_kind_names[k]) != 0) k++;
+            if (k == INVENTORY_KINDS) {
+                rc = MCHANGER_ERR_INVALID;
+                break;
+            }
+            if (pass == 0) {
+                if (!element_list_push(inventory_list(inv, k), (uint16_t)addr)) {
+                    rc = MCHANGER_ERR_INVALID;
+                    break;
+                }
+            } else if (seen[k] < inventory_list(inv, k)->count) {
+                inv->states[k][seen[k]].full = full != 0;
+                inv->states[k][seen[k]].source = (uint16_t)source;
+                seen[k]++;
+            }
+        }
+        if (pass == 0 && rc == MCHANGER_OK) {
+            if (inv->map.slots.count == 0) rc = MCHANGER_ERR_INVALID;
+            else if (!inventory_alloc_states(inv)) rc = MCHANGER_ERR_INVALID;
+        }
+    }
+    fclose(fp);
+    if (rc != MCHANGER_OK) inventory_free(inv);
+    return rc;
+}
+
+static void inventory_element_name(const ElementMap *map, uint16_t addr, char *out, size_t out_len) {
+    int i;
+    if ((i = element_list_index(&map->slots, addr)) > 0) {
+        snprintf(out, out_len, "slot %d", i);
+    } else if ((i = element_list_index(&map->drives, addr)) > 0) {
+        snprintf(out, out_len, "drive %d", i);
+    } else if ((i = element_list_index(&map->ie, addr)) > 0) {
+        snprintf(out, out_len, "I/E %d", i);
+    } else if ((i = element_list_index(&map->transports, addr)) > 0) {
+        snprintf(out, out_len, "transport %d", i);
+    } else {
+        snprintf(out, out_len, "0x%04x", addr);
+    }
+}
+
+// Running totals of a simulated plan
+typedef struct {
+    const MotionLog *motion;
+    const SlotLayout *layout;
+    const MChangerCatalog *catalog;     // load counts for rebalance; NULL if there is none
+    uint16_t transport;
+    size_t moves;
+    double robot_ms;
+    bool estimated;             // every move so far had an estimate
+    bool verbose;               // print each operation and its moves
+} PlanRun;
+
+// Simulate one MOVE MEDIUM. Returns false, with the reason in why, when the
+// changer would refuse it; the inventory is then left as it was.
+static bool plan_move(Inventory *inv, PlanRun *run, uint16_t source, uint16_t dest, char *why, size_t why_len) {
+    char src_name[32], dst_name[32];
+    inventory_element_name(&inv->map, source, src_name, sizeof(src_name));
+    inventory_element_name(&inv->map, dest, dst_name, sizeof(dst_name));
+    InventoryState *src = inventory_state(inv, source);
+    InventoryState *dst = inventory_state(inv, dest);
+    bool src_ie = element_list_index(&inv->map.ie, source) > 0;
+    bool dst_ie = element_list_index(&inv->map.ie, dest) > 0;
+    if (!src || !dst) {
+        snprintf(why, why_len, "no element at 0x%04x", src ? dest : source);
+        return false;
+    }
+    if (source == dest) {
+        snprintf(why, why_len, "%s is both source and destination", src_name);
+        return false;
+    }
+    if (!src->full && !src_ie) {
+        snprintf(why, why_len, "%s is empty", src_name);
+        return false;
+    }
+    if (dst->full && !dst_ie) {
+        snprintf(why, why_len, "%s is full", dst_name);
+        return false;
+    }
+
+    if (!src_ie) src->full = false;
+    if (!dst_ie) {
+        dst->full = true;
+        dst->source = source;
+    }
+    run->moves++;
+    double ms = 0;
+    if (motion_estimate(run->motion, &inv->map, run->layout, run->transport, source, dest, &ms)) {
+        run->robot_ms += ms;
+        if (run->verbose) {
+            printf("   MOVE %s -> %s  (0x%04x -> 0x%04x, %.1f s)\n", src_name, dst_name, source, dest, ms / 1000.0);
+        }
+    } else {
+        run->estimated = false;
+        if (run->verbose) printf("   MOVE %s -> %s  (0x%04x -> 0x%04x)\n", src_name, dst_name, source, dest);
+    }
+    return true;
+}
+
+// Occupancy for placement, as read_placement_state() sees it on a device
+static void inventory_placement(Inventory *inv, bool *full, bool *loaded) {
+    for (size_t i = 0; i < inv->map.slots.count; i++) {
+        full[i] = inv->states[1][i].full;
+        loaded[i] = false;
+    }
+    for (size_t d = 0; d < inv->map.drives.count; d++) {
+        const InventoryState *st = &inv->states[2][d];
+        int home = st->full ? slot_index_for_addr(&inv->map, st->source) : 0;
+        if (home > 0) {
+            full[home - 1] = true;
+            loaded[home - 1] = true;
+        }
+    }
+}
+
+// The moves rebalance would make, at most max_moves of them
+static bool plan_rebalance_moves(Inventory *inv, PlanRun *run, size_t max_moves, char *why, size_t why_len) {
+    if (!run->catalog) {
+        snprintf(why, why_len, "rebalance needs a catalog");
+        return false;
+    }
+    const ElementMap *map = &inv->map;
+    size_t slots = map->slots.count;
+    bool *full = calloc(slots, sizeof(bool));
+    bool *loaded = calloc(slots, sizeof(bool));
+    SlotMove *moves = calloc(max_moves, sizeof(SlotMove));
+    bool ok = full && loaded && moves;
+    if (!ok) snprintf(why, why_len, "out of memory");
+    size_t planned = 0;
+    if (ok) {
+        inventory_placement(inv, full, loaded);
+        planned = plan_rebalance(run->layout, run->catalog, full, loaded, slots, max_moves, moves);
+    }
+    for (size_t i = 0; ok && i < planned; i++) {
+        ok = plan_move(inv, run, element_addr(&map->slots, moves[i].from - 1),
+                       element_addr(&map->slots, moves[i].to - 1), why, why_len);
+    }
+    free(full);
+    free(loaded);
+    free(moves);
+    return ok;
+}
+
+// Expand one operation, written as the CLI command without the program name
+// (e.g. "load --slot 12 --drive 2"), into the moves the CLI would make.
+// Returns false, with the reason in why, if a move would be refused.
+static bool plan_operation(Inventory *inv, PlanRun *run, int argc, char **argv, char *why, size_t why_len) {
+    const ElementMap *map = &inv->map;
+    size_t slot_index = 0, drive_index = 1, max_moves = 20;
+    bool have_slot = false, auto_slot = false, hot = false;
+    uint16_t source = 0, dest = 0;
+    bool have_source = false, have_dest = false;
+    run->transport = map->transports.count ? element_addr(&map->transports, 0) : 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+            auto_slot = strcmp(argv[++i], "auto") == 0;
+            have_slot = auto_slot || parse_index(argv[i], &slot_index);
+        } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
+            parse_index(argv[++i], &drive_index);
+        } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            parse_u16(argv[++i], &run->transport);
+        } else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+            have_source = parse_u16(argv[++i], &source);
+        } else if (strcmp(argv[i], "--dest") == 0 && i + 1 < argc) {
+            have_dest = parse_u16(argv[++i], &dest);
+        } else if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc) {
+            parse_index(argv[++i], &max_moves);
+        } else if (strcmp(argv[i], "--hot") == 0) {
+            hot = true;
+        }
+    }
+    const char *op = argv[0];
+
+    if (strcmp(op, "move") == 0) {
+        if (!have_source || !have_dest) {
+            snprintf(why, why_len, "missing --source or --dest");
+            return false;
+        }
+        return plan_move(inv, run, source, dest, why, why_len);
+    }
+    if (strcmp(op, "rebalance") == 0) {
+        return plan_rebalance_moves(inv, run, max_moves, why, why_len);
+    }
+    if (strcmp(op, "return") == 0) {
+        // An idle return: every disc that can go home does; the rest stay put
+        for (size_t d = 0; d < map->drives.count; d++) {
+            const InventoryState *st = &inv->states[2][d];
+            const InventoryState *home = st->full ? inventory_state(inv, st->source) : NULL;
+            int slot = pick_home_slot(map, st->full, st->source, home && home->full);
+            if (slot > 0 && !plan_move(inv, run, element_addr(&map->drives, d), element_addr(&map->slots, slot - 1),
+                                       why, why_len)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (strcmp(op, "load") != 0 && strcmp(op, "unload") != 0 && strcmp(op, "insert") != 0 &&
+        strcmp(op, "retrieve") != 0 && strcmp(op, "eject") != 0) {
+        snprintf(why, why_len, "unknown operation '%s'", op);
+        return false;
+    }
+    if (auto_slot && strcmp(op, "insert") == 0) {
+        bool *full = calloc(map->slots.count, sizeof(bool));
+        bool *loaded = calloc(map->slots.count, sizeof(bool));
+        int slot = 0;
+        if (full && loaded) {
+            inventory_placement(inv, full, loaded);
+            slot = pick_free_slot(run->layout, full, map->slots.count, hot);
+        }
+        free(full);
+        free(loaded);
+        if (slot == 0) {
+            snprintf(why, why_len, "no free slot");
+            return false;
+        }
+        slot_index = (size_t)slot;
+    } else if (!have_slot || auto_slot) {
+        snprintf(why, why_len, "missing or invalid --slot");
+        return false;
+    }
+    if (slot_index == 0 || slot_index > map->slots.count) {
+        snprintf(why, why_len, "slot %zu out of range (%zu slots)", slot_index, map->slots.count);
+        return false;
+    }
+    uint16_t slot_addr = element_addr(&map->slots, slot_index - 1);
+
+    if (strcmp(op, "insert") == 0 || strcmp(op, "retrieve") == 0) {
+        if (map->ie.count == 0) {
+            snprintf(why, why_len, "no import/export element");
+            return false;
+        }
+        return strcmp(op, "insert") == 0 ? plan_move(inv, run, element_addr(&map->ie, 0), slot_addr, why, why_len)
+                                         : plan_move(inv, run, slot_addr, element_addr(&map->ie, 0), why, why_len);
+    }
+
+    if (drive_index == 0 || drive_index > map->drives.count) {
+        snprintf(why, why_len, "drive %zu out of range (%zu drives)", drive_index, map->drives.count);
+        return false;
+    }
+    uint16_t drive_addr = element_addr(&map->drives, drive_index - 1);
+    const InventoryState *drive = &inv->states[2][drive_index - 1];
+    const InventoryState *slot = &inv->states[1][slot_index - 1];
+
+    if (strcmp(op, "unload") == 0) {
+        return plan_move(inv, run, drive_addr, slot_addr, why, why_len);
+    }
+    if (strcmp(op, "eject") == 0) {
+        if (map->ie.count == 0) {
+            snprintf(why, why_len, "no import/export element");
+            return false;
+        }
+        bool in_drive = !slot->full && drive->full && (drive->source == slot_addr || drive->source == 0);
+        if (in_drive && !plan_move(inv, run, drive_addr, slot_addr, why, why_len)) return false;
+        return plan_move(inv, run, slot_addr, element_addr(&map->ie, 0), why, why_len);
+    }
+
+    // load: a different disc in the drive goes home first
+    if (!slot->full && drive->full && drive->source == slot_addr) {
+        if (run->verbose) printf("   disc from slot %zu is already in drive %zu\n", slot_index, drive_index);
+        return true;
+    }
+    if (!slot->full) {
+        snprintf(why, why_len, "slot %zu is empty", slot_index);
+        return false;
+    }
+    if (drive->full) {
+        uint16_t home = drive->source;
+        if (slot_index_for_addr(map, home) == 0) {
+            snprintf(why, why_len, "drive %zu has a disc but its source slot is unknown", drive_index);
+            return false;
+        }
+        if (!plan_move(inv, run, drive_addr, home, why, why_len)) return false;
+    }
+    return plan_move(inv, run, slot_addr, drive_addr, why, why_len);
+}
+
+// Simulate every operation in ops, one per line; '#' starts a comment
+static void plan_ops(Inventory *inv, PlanRun *run, FILE *ops, size_t *out_operations, size_t *out_illegal) {
+    char line[512];
+    while (fgets(line, sizeof(line), ops)) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        size_t len = strcspn(line, "\r\n");
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+        line[len] = '\0';
+        char text[512];
+        snprintf(text, sizeof(text), "%s", line);
+
+        char *args[16], *save = NULL;
+        int nargs = 0;
+        for (char *tok = strtok_r(line, " \t", &save); tok && nargs < 16; tok = strtok_r(NULL, " \t", &save)) {
+            args[nargs++] = tok;
+        }
+        if (nargs == 0) continue;
+
+        (*out_operations)++;
+        if (run->verbose) printf("%zu: %s\n", *out_operations, text + strspn(text, " \t"));
+        char why[128];
+        if (!plan_operation(inv, run, nargs, args, why, sizeof(why))) {
+            if (run->verbose) printf("   ILLEGAL: %s\n", why);
+            (*out_illegal)++;
+        }
+    }
+}
+
+static void describe_contents(const ElementMap *map, int kind, const InventoryState *st, char *out, size_t out_len) {
+    if (!st->full) {
+        snprintf(out, out_len, "empty");
+    } else if (kind == 2 && slot_index_for_addr(map, st->source) > 0) {
+        snprintf(out, out_len, "disc from slot %d", slot_index_for_addr(map, st->source));
+    } else {
+        snprintf(out, out_len, "full");
+    }
+}
+
+static int cmd_plan(int argc, char **argv, const SlotLayout *layout, const char *catalog_path) {
+    const char *inventory_path = NULL;
+    const char *ops_path = "-";
+    const char *save_path = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--inventory") == 0 && i + 1 < argc) {
+            inventory_path = argv[++i];
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            ops_path = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        }
+    }
+    char default_path[1024];
+    if (!inventory_path) {
+        if (!inventory_default_path(default_path, sizeof(default_path))) {
+            fprintf(stderr, "No inventory location; use --inventory <path>.\n");
+            return 1;
+        }
+        inventory_path = default_path;
+    }
+
+    Inventory start, inv;
+    int load_rc = inventory_load(inventory_path, &start);
+    if (load_rc == MCHANGER_OK) load_rc = inventory_load(inventory_path, &inv);
+    if (load_rc != MCHANGER_OK) {
+        fprintf(stderr, "Cannot read inventory %s; save one with 'snapshot'.\n", inventory_path);
+        inventory_free(&start);
+        return 1;
+    }
+    FILE *ops = strcmp(ops_path, "-") == 0 ? stdin : fopen(ops_path, "r");
+    if (!ops) {
+        fprintf(stderr, "Cannot open %s: %s\n", ops_path, strerror(errno));
+        inventory_free(&start);
+        inventory_free(&inv);
+        return 1;
+    }
+
+    MotionLog *motion = motion_open(NULL);
+    MChangerCatalog *catalog = mchanger_catalog_open(catalog_path);
+    PlanRun run = { motion, layout, catalog, 0, 0, 0, true, true };
+    size_t operations = 0, illegal = 0;
+    plan_ops(&inv, &run, ops, &operations, &illegal);
+    if (ops != stdin) fclose(ops);
+
+    printf("\n%zu operation%s, %zu move%s, %zu illegal\n", operations, operations == 1 ? "" : "s",
+           run.moves, run.moves == 1 ? "" : "s", illegal);
+    if (run.moves > 0 && run.estimated) {
+        char took[32];
+        format_duration(run.robot_ms / 1000.0, took, sizeof(took));
+        printf("Estimated robot time: %s\n", took);
+    } else if (run.moves > 0) {
+        printf("Estimated robot time: unknown (no motion data yet; see calibrate)\n");
+    }
+
+    printf("Resulting inventory:\n");
+    size_t changed = 0;
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        const ElementList *list = inventory_list(&inv, k);
+        for (size_t i = 0; i < list->count; i++) {
+            const InventoryState *was = &start.states[k][i], *now = &inv.states[k][i];
+            if (was->full == now->full && (!now->full || was->source == now->source || k != 2)) continue;
+            char name[32], before[48], after[48];
+            inventory_element_name(&inv.map, element_addr(list, i), name, sizeof(name));
+            describe_contents(&inv.map, k, was, before, sizeof(before));
+            describe_contents(&inv.map, k, now, after, sizeof(after));
+            printf("  %-10s %s -> %s\n", name, before, after);
+            changed++;
+        }
+    }
+    size_t slots_full = 0, drives_full = 0;
+    for (size_t i = 0; i < inv.map.slots.count; i++) slots_full += inv.states[1][i].full;
+    for (size_t i = 0; i < inv.map.drives.count; i++) drives_full += inv.states[2][i].full;
+    if (changed == 0) printf("  (unchanged)\n");
+    printf("  %zu of %zu slots full, %zu of %zu drives loaded\n", slots_full, inv.map.slots.count,
+           drives_full, inv.map.drives.count);
+
+    int rc = illegal ? 1 : 0;
+    if (save_path) {
+        if (inventory_save(&inv, save_path) == MCHANGER_OK) {
+            printf("Saved resulting inventory to %s\n", save_path);
+        } else {
+            fprintf(stderr, "Failed to save %s\n", save_path);
+            rc = 1;
+        }
+    }
+    mchanger_catalog_close(catalog);
+    motion_close(motion);
+    inventory_free(&start);
+    inventory_free(&inv);
+    return rc;
+}
+
+/*
+ * =============================================================================
+ * Status Board
+ * =============================================================================
+ *
+ * The process that owns the changer can publish its inventory to a POSIX
+ * shared-memory segment (default "/mchanger.board"). Dashboards, the catalog
+ * and schedulers map it read-only and copy consistent snapshots without a
+ * syscall, a SCSI command or a lock: the owner bumps seq to an odd value
+ * before writing and back to even after, and readers retry any copy that
+ * overlapped a write.
+ */
+
+#define BOARD_MAGIC 0x4d434244u    // "MCBD"
+#define BOARD_VERSION 1
+#define BOARD_DEFAULT_NAME "/mchanger.board"
+#define BOARD_READ_RETRIES 10000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;               // odd while the owner is writing
+    uint32_t count;
+    int32_t owner_pid;
+    uint32_t total;             // elements in the inventory; more than count if they didn't all fit
+    uint64_t generation;        // moves published since the board was created
+    uint64_t updated_ms;        // wall clock of the last write
+    MChangerBoardElement elements[MCHANGER_BOARD_MAX_ELEMENTS];
+} BoardSegment;
+
+struct StatusBoard {
+    char name[32];              // shm names are limited to 31 characters on macOS
+    BoardSegment *seg;
+    pthread_mutex_t lock;       // one writer at a time; readers never take it
+};
+typedef struct StatusBoard StatusBoard;
+
+struct MChangerBoard {
+    const BoardSegment *seg;
+};
+
+static const char *board_name(const char *name) {
+    return name && *name ? name : BOARD_DEFAULT_NAME;
+}
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void board_write_begin(BoardSegment *seg) {
+    __atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void board_write_end(BoardSegment *seg) {
+    seg->updated_ms = wall_ms();
+    __atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELEASE);
+}
+
+static StatusBoard *board_create(const char *name) {
+    StatusBoard *board = calloc(1, sizeof(StatusBoard));
+    if (!board) return NULL;
+    snprintf(board->name, sizeof(board->name), "%s", board_name(name));
+
+    int fd = shm_open(board->name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        free(board);
+        return NULL;
+    }
+    // A segment left by an earlier owner keeps its size (macOS can't resize one)
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size != (off_t)sizeof(BoardSegment) &&
+                                (st.st_size != 0 || ftruncate(fd, sizeof(BoardSegment)) != 0))) {
+        close(fd);
+        free(board);
+        return NULL;
+    }
+    void *mem = mmap(NULL, sizeof(BoardSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        free(board);
+        return NULL;
+    }
+    board->seg = mem;
+    pthread_mutex_init(&board->lock, NULL);
+
+    BoardSegment *seg = board->seg;
+    board_write_begin(seg);
+    seg->magic = BOARD_MAGIC;
+    seg->version = BOARD_VERSION;
+    seg->count = 0;
+    seg->total = 0;
+    seg->owner_pid = (int32_t)getpid();
+    seg->generation = 0;
+    board_write_end(seg);
+    return board;
+}
+
+static void board_close(StatusBoard *board) {
+    if (!board) return;
+    shm_unlink(board->name);
+    munmap(board->seg, sizeof(BoardSegment));
+    pthread_mutex_destroy(&board->lock);
+    free(board);
+}
+
+// Slots go last, so a library too large for the board loses only its
+// highest slots, never a drive or I/E port
+static const int board_kind_order[INVENTORY_KINDS] = { 0, 2, 3, 1 };
+
+// inv in board form; an element whose kind has no states reads as empty.
+// Returns how many elements fit, and sets *out_total to how many there are.
+static uint32_t board_fill(MChangerBoardElement *elements, Inventory *inv, uint32_t *out_total) {
+    uint32_t n = 0;
+    size_t total = 0;
+    for (int o = 0; o < INVENTORY_KINDS; o++) {
+        int k = board_kind_order[o];
+        const ElementList *list = inventory_list(inv, k);
+        total += list->count;
+        for (size_t i = 0; i < list->count && n < MCHANGER_BOARD_MAX_ELEMENTS; i++) {
+            const InventoryState *st = inv->states[k] ? &inv->states[k][i] : NULL;
+            MChangerBoardElement *e = &elements[n++];
+            e->address = element_addr(list, i);
+            e->kind = (uint8_t)k;
+            e->full = st && st->full;
+            e->except = false;
+            e->source_addr = st ? st->source : 0;
+        }
+    }
+    *out_total = total < UINT32_MAX ? (uint32_t)total : UINT32_MAX;
+    return n;
+}
+
+// Replace the published elements with a fresh inventory
+static void board_publish(StatusBoard *board, Inventory *inv) {
+    if (!board) return;
+    pthread_mutex_lock(&board->lock);
+    BoardSegment *seg = board->seg;
+    board_write_begin(seg);
+    seg->count = board_fill(seg->elements, inv, &seg->total);
+    board_write_end(seg);
+    pthread_mutex_unlock(&board->lock);
+}
+
+static MChangerBoardElement *board_element(BoardSegment *seg, uint16_t addr) {
+    for (uint32_t i = 0; i < seg->count; i++) {
+        if (seg->elements[i].address == addr) return &seg->elements[i];
+    }
+    return NULL;
+}
+
+// A completed MOVE MEDIUM: the medium left source and now sits in dest
+static void board_record_move(StatusBoard *board, uint16_t source, uint16_t dest) {
+    if (!board) return;
+    pthread_mutex_lock(&board->lock);
+    BoardSegment *seg = board->seg;
+    board_write_begin(seg);
+    MChangerBoardElement *from = board_element(seg, source);
+    MChangerBoardElement *to = board_element(seg, dest);
+    if (from) {
+        from->full = false;
+        from->source_addr = 0;
+    }
+    if (to) {
+        to->full = true;
+        to->source_addr = source;
+    }
+    seg->generation++;
+    board_write_end(seg);
+    pthread_mutex_unlock(&board->lock);
+}
+
+// One element as a status read found it (see Change Watch)
+static void board_set_element(StatusBoard *board, uint16_t addr, const ElementStatus *st) {
+    if (!board) return;
+    pthread_mutex_lock(&board->lock);
+    BoardSegment *seg = board->seg;
+    MChangerBoardElement *e = board_element(seg, addr);
+    if (e) {
+        board_write_begin(seg);
+        e->full = st->full;
+        e->except = st->except;
+        e->source_addr = st->valid_src ? st->src_addr : 0;
+        board_write_end(seg);
+    }
+    pthread_mutex_unlock(&board->lock);
+}
+
+// Copy the board if no write overlapped the copy. Returns false to retry.
+static bool board_try_copy(const BoardSegment *seg, MChangerBoardSnapshot *out) {
+    uint32_t before = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+    if (before & 1) return false;
+    uint32_t count = seg->count;
+    if (count > MCHANGER_BOARD_MAX_ELEMENTS) return false;
+    out->count = count;
+    out->total = seg->total > count ? seg->total : count;
+    out->generation = seg->generation;
+    out->updated_ms = seg->updated_ms;
+    out->owner_pid = seg->owner_pid;
+    memcpy(out->elements, seg->elements, count * sizeof(MChangerBoardElement));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == before;
+}
+
+static const char *const board_kind_names[INVENTORY_KINDS] = { "transport", "slot", "drive", "I/E" };
+
+static int cmd_board(int argc, char **argv) {
+    const char *name = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) name = argv[++i];
+    }
+    MChangerBoard *board = mchanger_board_attach(name);
+    if (!board) {
+        fprintf(stderr, "No status board %s is published.\n", board_name(name));
+        return 1;
+    }
+    MChangerBoardSnapshot *snap = malloc(sizeof(MChangerBoardSnapshot));
+    int rc = snap ? mchanger_board_read(board, snap) : MCHANGER_ERR_INVALID;
+    mchanger_board_detach(board);
+    if (rc != MCHANGER_OK) {
+        fprintf(stderr, "Failed to read status board (%d).\n", rc);
+        free(snap);
+        return 1;
+    }
+
+    bool alive = snap->owner_pid > 0 && (kill(snap->owner_pid, 0) == 0 || errno == EPERM);
+    time_t updated = (time_t)(snap->updated_ms / 1000);
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&updated));
+    printf("Owner pid %d%s, %llu move%s, updated %s\n", snap->owner_pid, alive ? "" : " (exited)",
+           (unsigned long long)snap->generation, snap->generation == 1 ? "" : "s", when);
+    int index[INVENTORY_KINDS] = {0};
+    for (size_t i = 0; i < snap->count; i++) {
+        const MChangerBoardElement *e = &snap->elements[i];
+        int kind = e->kind < INVENTORY_KINDS ? e->kind : 0;
+        printf("  %-9s %3d  0x%04x  %s", board_kind_names[kind], ++index[kind], e->address,
+               e->full ? "full" : "empty");
+        if (e->full && e->source_addr) printf("  (from 0x%04x)", e->source_addr);
+        if (e->except) printf("  EXCEPT");
+        printf("\n");
+    }
+    if (snap->total > snap->count)
+        printf("  (%zu more slot%s not on the board)\n", snap->total - snap->count,
+               snap->total - snap->count == 1 ? "" : "s");
+    free(snap);
+    return 0;
+}
+
+/*
+ * =============================================================================
+ * Change Watch
+ * =============================================================================
+ *
+ * Polls the changer as cheaply as it can and reports only what changed. Each
+ * poll is a TEST UNIT READY (door and I/E port activity come back as sense)
+ * and one ranged READ ELEMENT STATUS from changer memory (a plain read on a
+ * changer without CURDATA) for the drives and one for the I/E ports. The slots are re-read only after the changer reports
+ * a change, and every WATCH_SLOT_EVERY polls. One buffer, sized at the start
+ * from header-only reads, serves every poll.
+ */
+
+#define WATCH_SLOT_EVERY 30
+#define WATCH_MAX_ALLOC 0xFFFF  // CURDATA shares the top allocation byte
+
+// READ ELEMENT STATUS element type codes, by inventory kind
+static const uint8_t watch_kind_types[INVENTORY_KINDS] = { 0x01, 0x02, 0x04, 0x03 };
+
+typedef struct {
+    ElementMap map;
+    ElementStatus *states[INVENTORY_KINDS];     // last seen, parallel to the map lists
+    ElementStatus *fresh[INVENTORY_KINDS];      // this poll's reads; swapped in after diffing
+    uint8_t *buf;
+    uint32_t alloc;
+    bool primed;                // first poll done; until then nothing is reported
+    bool not_ready;
+    bool rescan_slots;
+    unsigned polls;
+    MChangerEvent *events;      // reported but not yet handed to the caller
+    size_t count;
+    size_t next;
+    size_t cap;
+} Watch;
+
+static void watch_free(Watch *w) {
+    element_map_free(&w->map);
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        free(w->states[k]);
+        free(w->fresh[k]);
+    }
+    free(w->buf);
+    free(w->events);
+    memset(w, 0, sizeof(*w));
+}
+
+static ElementList *watch_list(Watch *w, int kind) {
+    switch (kind) {
+        case 0: return &w->map.transports;
+        case 1: return &w->map.slots;
+        case 2: return &w->map.drives;
+        default: return &w->map.ie;
+    }
+}
+
+// Size of the full report for one kind, from its 8-byte header
+static uint32_t watch_probe_alloc(ChangerHandle *handle, int kind, const ElementList *list) {
+    uint8_t header[8] = {0};
+    if (execute_read_element_status(handle, watch_kind_types[kind], element_addr(list, 0), (uint16_t)list->count,
+                                    header, sizeof(header), RES_MEMORY | RES_QUIET, 30000) != 0) {
+        return 0;
+    }
+    return ((uint32_t)header[5] << 16 | (uint32_t)header[6] << 8 | header[7]) + 8;
+}
+
+static int watch_open(ChangerHandle *handle, Watch *w) {
+    memset(w, 0, sizeof(*w));
+    if (fetch_element_map(handle, &w->map) != 0) return 1;
+    uint32_t alloc = 256;
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        size_t count = watch_list(w, k)->count;
+        w->states[k] = calloc(count ? count : 1, sizeof(ElementStatus));
+        w->fresh[k] = calloc(count ? count : 1, sizeof(ElementStatus));
+        if (!w->states[k] || !w->fresh[k]) return 1;
+        if (k == 0 || count == 0) continue;
+        uint32_t need = watch_probe_alloc(handle, k, watch_list(w, k));
+        if (need == 0) need = 16 + (uint32_t)count * 64;    // no header: assume generous descriptors
+        if (need > alloc) alloc = need;
+    }
+    w->alloc = alloc < WATCH_MAX_ALLOC ? alloc : WATCH_MAX_ALLOC;
+    w->buf = malloc(w->alloc);
+    return w->buf ? 0 : 1;
+}
+
+static int watch_read_kind(ChangerHandle *handle, Watch *w, int kind, ElementStatus *out) {
+    return read_element_range(handle, watch_kind_types[kind], watch_list(w, kind), w->buf, w->alloc,
+                              RES_MEMORY | RES_QUIET, out);
+}
+
+static void watch_note(Watch *w, MChangerEvent event) {
+    if (w->count == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 16;
+        MChangerEvent *events = realloc(w->events, cap * sizeof(MChangerEvent));
+        if (!events) return;
+        w->events = events;
+        w->cap = cap;
+    }
+    w->events[w->count++] = event;
+}
+
+static void watch_diff(ChangerHandle *handle, Watch *w, int kind) {
+    const ElementList *list = watch_list(w, kind);
+    for (size_t i = 0; i < list->count; i++) {
+        const ElementStatus *was = &w->states[kind][i];
+        const ElementStatus *now = &w->fresh[kind][i];
+        MChangerEvent event = { .kind = (MChangerElementKind)kind, .index = (int)i + 1,
+                                .address = element_addr(list, i), .source_addr = now->src_addr };
+        bool changed = false;
+        if (w->primed && now->full != was->full) {
+            event.type = now->full ? MCHANGER_EVENT_FILLED : MCHANGER_EVENT_EMPTIED;
+            watch_note(w, event);
+            changed = true;
+        }
+        if (now->except != (w->primed && was->except)) {
+            event.type = now->except ? MCHANGER_EVENT_EXCEPTION : MCHANGER_EVENT_EXCEPTION_CLEARED;
+            watch_note(w, event);
+            changed = true;
+        }
+        if (changed || !w->primed) board_set_element(handle->board, element_addr(list, i), now);
+    }
+    ElementStatus *swap = w->states[kind];
+    w->states[kind] = w->fresh[kind];
+    w->fresh[kind] = swap;
+}
+
+static int watch_test_unit_ready(ChangerHandle *handle, CdbStatus *status) {
+    uint8_t cdb[6] = {0};
+    cdb[0] = 0x00; // TEST UNIT READY
+    return execute_cdb_ex(handle, cdb, sizeof(cdb), NULL, 0, kSCSIDataTransfer_NoDataTransfer, 10000, CDB_QUIET, status);
+}
+
+// One poll. Returns 0, or 1 if the changer could not be read at all.
+static int watch_poll(ChangerHandle *handle, Watch *w) {
+    w->count = w->next = 0;
+    CdbStatus status;
+    int rc = watch_test_unit_ready(handle, &status);
+    if (rc != 0 && status.sense_key == kSENSE_KEY_UNIT_ATTENTION) {
+        // Power on, door closed, I/E port accessed: anything may have moved
+        w->rescan_slots = true;
+        rc = watch_test_unit_ready(handle, &status);
+    }
+    if (rc != 0) {
+        if (status.sense_key == 0) return 1;
+        if (!w->not_ready) {
+            watch_note(w, (MChangerEvent){ .type = MCHANGER_EVENT_NOT_READY, .sense_key = status.sense_key,
+                                           .asc = status.asc, .ascq = status.ascq });
+            w->not_ready = true;
+        }
+        return 0;
+    }
+    if (w->not_ready) {
+        watch_note(w, (MChangerEvent){ .type = MCHANGER_EVENT_READY });
+        w->not_ready = false;
+        w->rescan_slots = true;
+    }
+
+    bool slots = !w->primed || w->rescan_slots || w->polls % WATCH_SLOT_EVERY == 0;
+    for (int k = 1; k < INVENTORY_KINDS; k++) {
+        if (k == 1 && !slots) continue;
+        if (watch_list(w, k)->count == 0) continue;
+        memcpy(w->fresh[k], w->states[k], watch_list(w, k)->count * sizeof(ElementStatus));
+        if (watch_read_kind(handle, w, k, w->fresh[k]) != 0) return 1;
+        watch_diff(handle, w, k);
+    }
+    if (slots) w->rescan_slots = false;
+    w->primed = true;
+    w->polls++;
+    return 0;
+}
+
+static void print_watch_event(const MChangerEvent *e) {
+    static const char *const kind_names[INVENTORY_KINDS] = { "Transport", "Slot", "Drive", "I/E port" };
+    char when[16];
+    time_t now = time(NULL);
+    strftime(when, sizeof(when), "%H:%M:%S", localtime(&now));
+    switch (e->type) {
+        case MCHANGER_EVENT_NOT_READY:
+            printf("%s  Changer not ready (door open?): %s asc=0x%02x ascq=0x%02x\n", when,
+                   sense_key_name(e->sense_key), e->asc, e->ascq);
+            return;
+        case MCHANGER_EVENT_READY:
+            printf("%s  Changer ready\n", when);
+            return;
+        default:
+            break;
+    }
+    const char *what = e->type == MCHANGER_EVENT_FILLED ? "now holds a disc"
+                     : e->type == MCHANGER_EVENT_EMPTIED ? "now empty"
+                     : e->type == MCHANGER_EVENT_EXCEPTION ? "reports an exception"
+                     : "exception cleared";
+    printf("%s  %s %d (0x%04x) %s", when, kind_names[e->kind < INVENTORY_KINDS ? e->kind : 0], e->index,
+           e->address, what);
+    if (e->type == MCHANGER_EVENT_FILLED && e->source_addr) printf(" (from 0x%04x)", e->source_addr);
+    printf("\n");
+}
+
+static int cmd_watch(ChangerHandle *handle, int argc, char **argv) {
+    double interval = 2.0;
+    bool publish = false;
+    const char *board_name_arg = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) interval = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--board") == 0) {
+            publish = true;
+            if (i + 1 < argc && argv[i + 1][0] == '/') board_name_arg = argv[++i];
+        }
+    }
+    if (interval < 0.1) interval = 0.1;
+
+    handle->quiet = true;
+    Watch w;
+    if (watch_open(handle, &w) != 0) {
+        fprintf(stderr, "Failed to read element map.\n");
+        watch_free(&w);
+        return 1;
+    }
+    if (publish) {
+        handle->board = board_create(board_name_arg);
+        if (!handle->board) fprintf(stderr, "Could not create status board %s\n", board_name(board_name_arg));
+        Inventory inv;
+        if (handle->board && inventory_read(handle, &inv) == MCHANGER_OK) board_publish(handle->board, &inv);
+        inventory_free(&inv);
+    }
+
+    catch_stop_signals(true);
+    printf("Watching %zu slots, %zu drives, %zu I/E ports every %.1fs (Ctrl-C to stop)\n",
+           w.map.slots.count, w.map.drives.count, w.map.ie.count, interval);
+    fflush(stdout);
+    int rc = 0;
+    while (!g_stop) {
+        if (watch_poll(handle, &w) != 0) {
+            fprintf(stderr, "Changer stopped answering.\n");
+            rc = 1;
+            break;
+        }
+        for (size_t i = 0; i < w.count; i++) print_watch_event(&w.events[i]);
+        fflush(stdout);
+        struct timespec pause = { (time_t)interval, (long)((interval - (double)(time_t)interval) * 1e9) };
+        while (!g_stop && nanosleep(&pause, &pause) != 0 && errno == EINTR) {}
+    }
+    catch_stop_signals(false);
+    board_close(handle->board);
+    handle->board = NULL;
+    watch_free(&w);
+    return rc;
+}
+
+/*
+ * =============================================================================
+ * I/E Port Batches
+ * =============================================================================
+ *
+ * Bulk loading and unloading through the import/export port. Only the I/E
+ * elements are polled while waiting for the operator, from changer memory, so
+ * waiting costs one small command per poll. A disc counts as fed once the
+ * port reports it full, put there by an operator (ImpExp) and reachable by
+ * the robot again (Access). The operator is told to feed the next disc as
+ * soon as the robot has taken the last one, so fingerprinting overlaps with
+ * the next feed.
+ */
+
+#define INGEST_POLL_MS 500
+
+static void sleep_ms(int ms) {
+    struct timespec pause = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    while (!g_stop && nanosleep(&pause, &pause) != 0 && errno == EINTR) {}
+}
+
+// Let macOS release the disc in a drive before the robot takes it
+static void eject_drive_disc(ChangerHandle *handle, uint16_t drive_addr, int drive) {
+    io_service_t service = find_changer_drive_service(handle, drive_addr, drive);
+    if (service == IO_OBJECT_NULL) return;
+    char bsd[64];
+    if (get_drive_bsd_name(service, bsd, sizeof(bsd))) eject_optical_disk(bsd);
+    IOObjectRelease(service);
+}
+
+static int return_from_drive(ChangerHandle *handle, uint16_t transport, uint16_t drive_addr, int drive,
+                             uint16_t slot_addr) {
+    eject_drive_disc(handle, drive_addr, drive);
+    return cmd_move_medium(handle, transport, drive_addr, slot_addr);
+}
+
+// Fingerprint the disc in slot using drive, which must be empty, and return it
+static int ingest_identify(ChangerHandle *handle, MChangerCatalog *catalog, const ElementMap *map,
+                           uint16_t transport, int slot, int drive, int timeout_secs, MChangerIngestProgress *p) {
+    uint16_t slot_addr = element_addr(&map->slots, slot - 1);
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+    int loaded = cmd_move_medium(handle, transport, slot_addr, drive_addr);
+    if (loaded != 0) return move_error(loaded);
+    DiscInfo info;
+    int tracks = 0;
+    p->result = identify_disc(handle, drive_addr, drive, timeout_secs, &info, &tracks);
+    if (p->result == MCHANGER_OK) {
+        catalog_note_disc(catalog, slot, &info);
+        disc_id_from_info(&info, tracks, &p->disc);
+    }
+    int returned = return_from_drive(handle, transport, drive_addr, drive, slot_addr);
+    return returned == 0 ? MCHANGER_OK : move_error(returned);
+}
+
+static int ingest_discs(ChangerHandle *handle, MChangerCatalog *catalog, const ElementMap *map,
+                        const SlotLayout *layout, uint16_t transport, const MChangerIngestOptions *opts,
+                        MChangerIngestCallback callback, void *context, size_t *out_count) {
+    if (out_count) *out_count = 0;
+    if (map->ie.count == 0 || map->slots.count == 0) return MCHANGER_ERR_NOT_FOUND;
+    int drive = opts->drive > 0 ? opts->drive : 1;
+    if (opts->identify) {
+        if ((size_t)drive > map->drives.count) return MCHANGER_ERR_INVALID;
+        ElementStatus st;
+        if (read_element_pair(handle, element_addr(&map->drives, drive - 1), &st, 0, NULL, RES_MEMORY) != 0) {
+            return MCHANGER_ERR_SCSI;
+        }
+        if (st.full) return MCHANGER_ERR_BUSY;
+    }
+
+    bool *full = calloc(map->slots.count, sizeof(bool));
+    bool *loaded = calloc(map->slots.count, sizeof(bool));
+    ElementStatus *ports = calloc(map->ie.count, sizeof(ElementStatus));
+    uint32_t alloc = 16 + (uint32_t)map->ie.count * 64;
+    uint8_t *buf = malloc(alloc);
+    int rc = full && loaded && ports && buf ? read_placement_state(handle, map, full, loaded) : MCHANGER_ERR_INVALID;
+
+    MChangerIngestProgress p = {0};
+    double last_activity = monotonic_secs();
+    bool warned_exported = false;
+    while (rc == MCHANGER_OK && !g_stop && (opts->max_discs == 0 || p.ingested < opts->max_discs)) {
+        if (read_element_range(handle, 0x03, &map->ie, buf, alloc, RES_MEMORY, ports) != 0) {
+            rc = MCHANGER_ERR_SCSI;
+            break;
+        }
+        int port = -1;
+        bool exported = false;
+        for (size_t i = 0; i < map->ie.count && port < 0; i++) {
+            if (!ports[i].full || !ports[i].access) continue;
+            // A disc the robot put out (an earlier export) is not a new one
+            if (ports[i].impexp) port = (int)i;
+            else exported = true;
+        }
+        if (port < 0) {
+            memset(&p.disc, 0, sizeof(p.disc));
+            p.stage = exported && !warned_exported ? MCHANGER_INGEST_PORT_BLOCKED : MCHANGER_INGEST_WAITING;
+            warned_exported = warned_exported || exported;
+            if (callback && !callback(&p, context)) break;
+            if (opts->idle_secs > 0 && monotonic_secs() - last_activity > opts->idle_secs) break;
+            sleep_ms(opts->poll_ms > 0 ? opts->poll_ms : INGEST_POLL_MS);
+            continue;
+        }
+        warned_exported = false;
+
+        // Someone else may have filled the planned slot; check before moving
+        int slot = 0;
+        while ((slot = pick_free_slot(layout, full, map->slots.count, opts->hot)) != 0) {
+            ElementStatus st;
+            if (read_element_pair(handle, element_addr(&map->slots, slot - 1), &st, 0, NULL, RES_MEMORY) != 0 ||
+                !st.full) {
+                break;
+            }
+            full[slot - 1] = true;
+        }
+        if (slot == 0) {
+            rc = MCHANGER_ERR_NOT_FOUND;
+            break;
+        }
+        uint16_t robot = transport != ANY_TRANSPORT ? transport
+                       : pick_transport(handle, map, layout, element_addr(&map->ie, port), element_addr(&map->slots, slot - 1));
+        int moved = cmd_move_medium(handle, robot, element_addr(&map->ie, port), element_addr(&map->slots, slot - 1));
+        if (moved != 0) {
+            rc = move_error(moved);
+            break;
+        }
+        full[slot - 1] = true;
+        catalog_note_slot_changed(catalog, slot);
+        p.ingested++;
+        p.slot = slot;
+        p.result = MCHANGER_OK;
+        memset(&p.disc, 0, sizeof(p.disc));
+        p.stage = MCHANGER_INGEST_STORED;
+        bool go_on = !callback || callback(&p, context);
+
+        if (opts->identify) {
+            if (transport == ANY_TRANSPORT) {
+                robot = pick_transport(handle, map, layout, element_addr(&map->slots, slot - 1), element_addr(&map->drives, drive - 1));
+            }
+            rc = ingest_identify(handle, catalog, map, robot, slot, drive,
+                                 opts->timeout_secs > 0 ? opts->timeout_secs : 60, &p);
+            if (rc != MCHANGER_OK) break;
+            p.stage = MCHANGER_INGEST_IDENTIFIED;
+            if (callback && !callback(&p, context)) go_on = false;
+        }
+        last_activity = monotonic_secs();
+        if (!go_on) break;
+    }
+
+    if (out_count) *out_count = p.ingested;
+    free(full);
+    free(loaded);
+    free(ports);
+    free(buf);
+    return rc;
+}
+
+typedef struct {
+    bool waiting_shown;         // "Waiting" is said once per wait
+} IngestConsole;
+
+static bool print_ingest_progress(const MChangerIngestProgress *p, void *context) {
+    IngestConsole *console = context;
+    switch (p->stage) {
+        case MCHANGER_INGEST_WAITING:
+            if (!console->waiting_shown) {
+                printf("Waiting for a disc in the I/E port...\n");
+                console->waiting_shown = true;
+            }
+            break;
+        case MCHANGER_INGEST_PORT_BLOCKED:
+            printf("The I/E port holds a disc the changer put out; remove it to continue.\n");
+            break;
+        case MCHANGER_INGEST_STORED:
+            // The bell calls the operator back to the port
+            printf("\a#%zu stored in slot %d. Feed the next disc.\n", p->ingested, p->slot);
+            console->waiting_shown = true;
+            break;
+        case MCHANGER_INGEST_IDENTIFIED:
+            if (p->result == MCHANGER_OK) {
+                printf("   slot %d: %s %s\n", p->slot, p->disc.media_type[0] ? p->disc.media_type : "disc",
+                       p->disc.fingerprint);
+            } else {
+                printf("   slot %d: could not identify the disc (%d)\n", p->slot, p->result);
+            }
+            break;
+    }
+    fflush(stdout);
+    return !g_stop;
+}
+
+static int cmd_ingest(ChangerHandle *handle, MChangerCatalog *catalog, const SlotLayout *layout,
+                      int argc, char **argv) {
+    MChangerIngestOptions opts = {0};
+    bool have_transport = false;
+    uint16_t transport = 0;
+    for (int i = 2; i < argc; i++) {
+        size_t n = 0;
+        if (strcmp(argv[i], "--count") == 0 && i + 1 < argc && parse_index(argv[i + 1], &n)) {
+            opts.max_discs = n;
+            i++;
+        } else if (strcmp(argv[i], "--idle") == 0 && i + 1 < argc) {
+            opts.idle_secs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--identify") == 0) {
+            opts.identify = true;
+        } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc && parse_index(argv[i + 1], &n)) {
+            opts.drive = (int)n;
+            i++;
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            opts.timeout_secs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hot") == 0) {
+            opts.hot = true;
+        } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            have_transport = parse_u16(argv[++i], &transport);
+        }
+    }
+
+    handle->quiet = true;
+    ElementMap map = {0};
+    if (fetch_element_map(handle, &map) != 0) {
+        fprintf(stderr, "Failed to read element map.\n");
+        element_map_free(&map);
+        return 1;
+    }
+    if (!have_transport) transport = ANY_TRANSPORT;
+    if (!have_transport && map.transports.count == 0) {
+        fprintf(stderr, "No transport element found.\n");
+        element_map_free(&map);
+        return 1;
+    }
+
+    catch_stop_signals(true);
+    IngestConsole console = {0};
+    size_t count = 0;
+    int rc = ingest_discs(handle, catalog, &map, layout, transport, &opts, print_ingest_progress, &console, &count);
+    catch_stop_signals(false);
+
+    switch (rc) {
+        case MCHANGER_OK: break;
+        case MCHANGER_ERR_NOT_FOUND:
+            fprintf(stderr, map.ie.count == 0 ? "No import/export element found.\n" : "No free slot left.\n");
+            break;
+        case MCHANGER_ERR_BUSY:
+            fprintf(stderr, "Drive %d holds a disc; unload it or drop --identify.\n", opts.drive > 0 ? opts.drive : 1);
+            break;
+        case MCHANGER_ERR_INVALID:
+            fprintf(stderr, "Drive %d out of range. Drives: %zu\n", opts.drive, map.drives.count);
+            break;
+        default:
+            fprintf(stderr, "Changer command failed.\n");
+            break;
+    }
+    printf("Ingested %zu disc%s.\n", count, count == 1 ? "" : "s");
+    element_map_free(&map);
+    return rc == MCHANGER_OK ? 0 : 1;
+}
+
+// Bulk export: discs leave through the I/E port in the order that brings the
+// first ones out soonest, each as soon as the operator has emptied a port.
+// A selected disc that is sitting in a drive goes straight from the drive.
+typedef struct {
+    int slot;
+    uint16_t source;            // the slot, or the drive holding its disc
+    int drive;                  // 1-based when source is a drive
+    double cost;                // estimated ms (or slot distance) to the I/E port
+} ExportItem;
+
+static int compare_export_items(const void *a, const void *b) {
+    const ExportItem *x = a, *y = b;
+    if (x->cost != y->cost) return x->cost < y->cost ? -1 : 1;
+    return x->slot - y->slot;
+}
+
+static int export_discs(ChangerHandle *handle, MChangerCatalog *catalog, const ElementMap *map,
+                        const SlotLayout *layout, uint16_t transport, const int *slots, size_t count,
+                        MChangerExportCallback callback, void *context, size_t *out_count) {
+    if (out_count) *out_count = 0;
+    if (map->ie.count == 0) return MCHANGER_ERR_NOT_FOUND;
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i] < 1 || (size_t)slots[i] > map->slots.count) return MCHANGER_ERR_INVALID;
+    }
+
+    bool *full = calloc(map->slots.count, sizeof(bool));
+    ExportItem *items = calloc(count ? count : 1, sizeof(ExportItem));
+    ElementStatus *ports = calloc(map->ie.count, sizeof(ElementStatus));
+    ElementStatus *drives = calloc(map->drives.count ? map->drives.count : 1, sizeof(ElementStatus));
+    uint32_t alloc = 16 + (uint32_t)(map->ie.count + map->drives.count) * 64;
+    uint8_t *buf = malloc(alloc);
+    int rc = full && items && ports && drives && buf && read_slot_occupancy(handle, map, full) == 0 &&
+             read_element_range(handle, 0x04, &map->drives, buf, alloc, RES_MEMORY, drives) == 0
+                 ? MCHANGER_OK : MCHANGER_ERR_SCSI;
+    MChangerExportProgress p = { .total = count };
+    size_t n = 0;
+    for (size_t i = 0; i < count && rc == MCHANGER_OK; i++) {
+        ExportItem item = { .slot = slots[i], .source = element_addr(&map->slots, slots[i] - 1) };
+        if (!full[slots[i] - 1]) {
+            // Not in its slot: loaded, or there is nothing to export
+            for (size_t d = 0; d < map->drives.count; d++) {
+                if (drives[d].full && drives[d].valid_src && drives[d].src_addr == item.source) {
+                    item.source = element_addr(&map->drives, d);
+                    item.drive = (int)d + 1;
+                    break;
+                }
+            }
+            if (item.drive == 0) {
+                p.stage = MCHANGER_EXPORT_SKIPPED;
+                p.slot = item.slot;
+                p.result = MCHANGER_ERR_EMPTY;
+                if (callback && !callback(&p, context)) rc = MCHANGER_ERR_BUSY;
+                continue;
+            }
+        }
+        uint16_t robot = transport != ANY_TRANSPORT ? transport
+                       : pick_transport(handle, map, layout, item.source, element_addr(&map->ie, 0));
+        if (!motion_estimate(handle->motion, map, layout, robot, item.source, element_addr(&map->ie, 0), &item.cost)) {
+            item.cost = item.drive ? 0 : (double)slot_distance(layout, map->slots.count, item.slot);
+        }
+        items[n++] = item;
+    }
+    qsort(items, n, sizeof(ExportItem), compare_export_items);
+
+    for (size_t i = 0; i < n && rc == MCHANGER_OK && !g_stop; i++) {
+        // Wait for the operator to empty a port, then use the nearest empty one
+        uint16_t robot = transport != ANY_TRANSPORT ? transport
+                       : pick_transport(handle, map, layout, items[i].source, element_addr(&map->ie, 0));
+        int port = -1;
+        while (port < 0 && rc == MCHANGER_OK && !g_stop) {
+            if (read_element_range(handle, 0x03, &map->ie, buf, alloc, RES_MEMORY, ports) != 0) {
+                rc = MCHANGER_ERR_SCSI;
+                break;
+            }
+            double best = 0;
+            for (size_t j = 0; j < map->ie.count; j++) {
+                if (ports[j].full || !ports[j].access) continue;
+                double cost = move_cost(handle, map, layout, robot, items[i].source, element_addr(&map->ie, j));
+                if (port < 0 || cost < best) {
+                    port = (int)j;
+                    best = cost;
+                }
+            }
+            if (port >= 0) break;
+            p.stage = MCHANGER_EXPORT_WAITING;
+            p.slot = items[i].slot;
+            p.result = MCHANGER_OK;
+            if (callback && !callback(&p, context)) rc = MCHANGER_ERR_BUSY;
+            else sleep_ms(INGEST_POLL_MS);
+        }
+        if (port < 0) break;
+
+        if (items[i].drive) eject_drive_disc(handle, items[i].source, items[i].drive);
+        int moved = cmd_move_medium(handle, robot, items[i].source, element_addr(&map->ie, port));
+        if (moved != 0) {
+            rc = move_error(moved);
+            break;
+        }
+        // The disc has left the library
+        catalog_note_slot_changed(catalog, items[i].slot);
+        p.done++;
+        p.stage = MCHANGER_EXPORT_MOVED;
+        p.slot = items[i].slot;
+        p.port = port + 1;
+        p.from_drive = items[i].drive;
+        p.result = MCHANGER_OK;
+        if (callback && !callback(&p, context)) break;
+    }
+
+    // Stopped by the callback: not an error
+    if (rc == MCHANGER_ERR_BUSY) rc = MCHANGER_OK;
+    if (out_count) *out_count = p.done;
+    free(full);
+    free(items);
+    free(ports);
+    free(drives);
+    free(buf);
+    return rc;
+}
+
+// "10-50,77" -> sorted, de-duplicated slot numbers. Returns false on a
+// malformed list (including a trailing comma) or a slot outside 1..slot_count.
+static bool parse_slot_list(const char *spec, size_t slot_count, int **out, size_t *out_count) {
+    *out = NULL;
+    *out_count = 0;
+    bool *want = calloc(slot_count + 1, sizeof(bool));
+    if (!want) return false;
+    const char *p = spec;
+    bool ok = *p != '\0';
+    while (ok && *p) {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p) break;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1) {
+                ok = false;
+                break;
+            }
+            p = end;
+        }
+        if (lo < 1 || hi < lo || (size_t)hi > slot_count) {
+            ok = false;
+            break;
+        }
+        for (long s = lo; s <= hi; s++) want[s] = true;
+        if (*p == ',' && p[1]) p++;
+        else if (*p) ok = false;
+    }
+    ok = ok && *p == '\0';
+    size_t n = 0;
+    for (size_t s = 1; s <= slot_count; s++) n += want[s];
+    if (ok && n > 0) {
+        *out = malloc(n * sizeof(int));
+        ok = *out != NULL;
+        for (size_t s = 1; ok && s <= slot_count; s++) {
+            if (want[s]) (*out)[(*out_count)++] = (int)s;
+        }
+    } else {
+        ok = false;
+    }
+    free(want);
+    return ok;
+}
+
+static bool print_export_progress(const MChangerExportProgress *p, void *context) {
+    bool *waiting_shown = context;
+    switch (p->stage) {
+        case MCHANGER_EXPORT_WAITING:
+            if (!*waiting_shown) printf("Take the disc out of the I/E port to continue...\n");
+            *waiting_shown = true;
+            break;
+        case MCHANGER_EXPORT_SKIPPED:
+            printf("Slot %d is empty; skipped.\n", p->slot);
+            break;
+        case MCHANGER_EXPORT_MOVED:
+            if (p->from_drive) {
+                printf("\a%zu/%zu: disc from slot %d (was in drive %d) is in I/E port %d.\n", p->done, p->total,
+                       p->slot, p->from_drive, p->port);
+            } else {
+                printf("\a%zu/%zu: disc from slot %d is in I/E port %d.\n", p->done, p->total, p->slot, p->port);
+            }
+            *waiting_shown = false;
+            break;
+    }
+    fflush(stdout);
+    return !g_stop;
+}
+
+static int cmd_export(ChangerHandle *handle, MChangerCatalog *catalog, const SlotLayout *layout,
+                      int argc, char **argv) {
+    const char *spec = NULL;
+    bool have_transport = false;
+    uint16_t transport = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) spec = argv[++i];
+        else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) have_transport = parse_u16(argv[++i], &transport);
+    }
+    if (!spec) {
+        fprintf(stderr, "Missing --slots (e.g. --slots 10-50,77).\n");
+        return 1;
+    }
+
+    handle->quiet = true;
+    ElementMap map = {0};
+    if (fetch_element_map(handle, &map) != 0) {
+        fprintf(stderr, "Failed to read element map.\n");
+        element_map_free(&map);
+        return 1;
+    }
+    int *slots = NULL;
+    size_t count = 0;
+    if (!parse_slot_list(spec, map.slots.count, &slots, &count)) {
+        fprintf(stderr, "Invalid --slots %s. Slots: 1-%zu\n", spec, map.slots.count);
+        element_map_free(&map);
+        return 1;
+    }
+    if (!have_transport && map.transports.count == 0) {
+        fprintf(stderr, "No transport element found.\n");
+        free(slots);
+        element_map_free(&map);
+        return 1;
+    }
+    if (!have_transport) transport = ANY_TRANSPORT;
+
+    catch_stop_signals(true);
+    bool waiting_shown = false;
+    size_t done = 0;
+    int rc = export_discs(handle, catalog, &map, layout, transport, slots, count,
+                          print_export_progress, &waiting_shown, &done);
+    catch_stop_signals(false);
+    if (rc == MCHANGER_ERR_NOT_FOUND) fprintf(stderr, "No import/export element found.\n");
+    else if (rc != MCHANGER_OK) fprintf(stderr, "Changer command failed.\n");
+    printf("Exported %zu disc%s.\n", done, done == 1 ? "" : "s");
+    free(slots);
+    element_map_free(&map);
+    return rc == MCHANGER_OK ? 0 : 1;
+}
+
+/*
+ * =============================================================================
+ * CLI Main (excluded when building as library with -DMCHANGER_NO_MAIN)
+ * =============================================================================
+ */
+
+#ifndef MCHANGER_NO_MAIN
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    bool force = false;
+    bool skip_tur = false;
+    bool dry_run = false;
+    bool confirm = false;
+    const char *catalog_path = NULL;
+    const char *cache_dir = NULL;
+    uint64_t cache_max_bytes = 0;
+    SlotLayout layout = {0};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--catalog") == 0 && i + 1 < argc) catalog_path = argv[i + 1];
+        if (strcmp(argv[i], "--near-slot") == 0 && i + 1 < argc) layout.near_slot = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--ring") == 0) layout.ring = true;
+        if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) cache_dir = argv[i + 1];
+        if (strcmp(argv[i], "--cache-max-gb") == 0 && i + 1 < argc) {
+            cache_max_bytes = (uint64_t)(strtod(argv[i + 1], NULL) * 1e9);
+        }
+        if (strcmp(argv[i], "--force") == 0) force = true;
+        if (strcmp(argv[i], "--no-tur") == 0) skip_tur = true;
+        if (strcmp(argv[i], "--dry-run") == 0) dry_run = true;
+        if (strcmp(argv[i], "--confirm") == 0) confirm = true;
+        if (strcmp(argv[i], "--debug") == 0) g_debug = true;
+        if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) g_verbose = true;
+    }
+
+    if (strcmp(argv[1], "list") == 0) {
+        list_changers();
+        return 0;
+    }
+    if (strcmp(argv[1], "list-all") == 0) {
+        list_all_scsi_devices();
+        return 0;
+    }
+    if (strcmp(argv[1], "scan-changers") == 0) {
+        scan_changers();
+        return 0;
+    }
+    if (strcmp(argv[1], "list-sbp2") == 0) {
+        list_sbp2_luns();
+        return 0;
+    }
+    if (strcmp(argv[1], "scan-sbp2") == 0) {
+        scan_sbp2_luns();
+        return 0;
+    }
+    if (strcmp(argv[1], "catalog") == 0) {
+        return cmd_catalog(argc, argv, catalog_path);
+    }
+    if (strcmp(argv[1], "cache") == 0) {
+        return cmd_cache(argc, argv, cache_dir, cache_max_bytes);
+    }
+    if (strcmp(argv[1], "plan") == 0) {
+        return cmd_plan(argc, argv, &layout, catalog_path);
+    }
+    if (strcmp(argv[1], "board") == 0) {
+        return cmd_board(argc, argv);
+    }
+
+    ChangerHandle handle = open_changer(!force);
+    if ((handle.backend == BACKEND_SCSITASK && !handle.scsi_device) ||
+        (handle.backend == BACKEND_SBP2 && !handle.sbp2_login)) {
+        return 1;
+    }
+
+    // The catalog is optional: without a usable path, moves simply aren't recorded
+    MChangerCatalog *catalog = mchanger_catalog_open(catalog_path);
+    // Likewise the motion log: every move is timed into it when it can be opened
+    handle.motion = motion_open(NULL);
+
+    int rc = 0;
+    if (strcmp(argv[1], "sanity-check") == 0) {
+        if (handle.backend == BACKEND_SCSITASK) {
+            printf("Backend: SCSITask\n");
+        } else if (handle.backend == BACKEND_SBP2) {
+            printf("Backend: SBP2\n");
+        } else {
+            printf("Backend: unknown\n");
+        }
+        printf("User client open: OK\n");
+        rc = 0;
+        goto out;
+    }
+    if (!skip_tur && strcmp(argv[1], "test-unit-ready") != 0) {
+        int tur = cmd_test_unit_ready(&handle);
+        if (tur != 0 && !force) {
+            fprintf(stderr, "TEST UNIT READY failed. Use --force to continue.\n");
+            rc = 1; goto out;
+        }
+    }
+
+    if (strcmp(argv[1], "test-unit-ready") == 0) {
+        rc = cmd_test_unit_ready(&handle);
+    } else if (strcmp(argv[1], "inquiry") == 0) {
+        rc = cmd_inquiry(&handle);
+    } else if (strcmp(argv[1], "inquiry-vpd") == 0) {
+        uint8_t page = 0;
+        bool have_page = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--page") == 0 && i + 1 < argc) {
+                have_page = parse_u8(argv[++i], &page);
+            }
+        }
+        if (!have_page) {
+            fprintf(stderr, "Missing or invalid --page.\n");
+            rc = 1; goto out;
+        }
+        rc = cmd_inquiry_vpd(&handle, page);
+    } else if (strcmp(argv[1], "report-luns") == 0) {
+        rc = cmd_report_luns(&handle);
+    } else if (strcmp(argv[1], "log-sense") == 0) {
+        uint8_t page = 0;
+        bool have_page = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--page") == 0 && i + 1 < argc) {
+                have_page = parse_u8(argv[++i], &page);
+            }
+        }
+        if (!have_page) {
+            fprintf(stderr, "Missing or invalid --page.\n");
+            rc = 1; goto out;
+        }
+        rc = cmd_log_sense(&handle, page);
+    } else if (strcmp(argv[1], "mode-sense-element") == 0) {
+        rc = cmd_mode_sense_element(&handle);
+    } else if (strcmp(argv[1], "probe-storage") == 0) {
+        rc = cmd_probe_storage(&handle);
+    } else if (strcmp(argv[1], "init-status") == 0) {
+        rc = cmd_init_status(&handle);
+    } else if (strcmp(argv[1], "read-element-status") == 0) {
+        uint8_t element_type = 0;
+        uint16_t start = 0;
+        uint16_t count = 0;
+        uint32_t alloc = 0;
+        uint8_t flags = 0;
+        bool dump_raw = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--element-type") == 0 && i + 1 < argc) {
+                if (!parse_element_type(argv[++i], &element_type)) {
+                    fprintf(stderr, "Invalid element type.\n");
+                    rc = 1; goto out;
+                }
+            } else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) {
+                if (!parse_u16(argv[++i], &start)) {
+                    fprintf(stderr, "Invalid --start.\n");
+                    rc = 1; goto out;
+                }
+            } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+                if (!parse_u16(argv[++i], &count)) {
+                    fprintf(stderr, "Invalid --count.\n");
+                    rc = 1; goto out;
+                }
+            } else if (strcmp(argv[i], "--alloc") == 0 && i + 1 < argc) {
+                if (!parse_u32(argv[++i], &alloc)) {
+                    fprintf(stderr, "Invalid --alloc.\n");
+                    rc = 1; goto out;
+                }
+            } else if (strcmp(argv[i], "--raw") == 0) {
+                dump_raw = true;
+            } else if (strcmp(argv[i], "--curdata") == 0) {
+                flags |= RES_CURDATA;
+            } else if (strcmp(argv[i], "--dvcid") == 0) {
+                flags |= RES_DVCID;
+            }
+        }
+        if (alloc == 0) {
+            fprintf(stderr, "Missing --alloc.\n");
+            rc = 1; goto out;
+        }
+        rc = cmd_read_element_status(&handle, element_type, start, count, alloc, flags, dump_raw);
+    } else if (strcmp(argv[1], "move") == 0) {
+        uint16_t transport = 0, source = 0, dest = 0;
+        bool have_transport = false, have_source = false, have_dest = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+                have_transport = parse_u16(argv[++i], &transport);
+            } else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+                have_source = parse_u16(argv[++i], &source);
+            } else if (strcmp(argv[i], "--dest") == 0 && i + 1 < argc) {
+                have_dest = parse_u16(argv[++i], &dest);
+            }
+        }
+        if (!have_transport || !have_source || !have_dest) {
+            fprintf(stderr, "Missing --transport, --source, or --dest.\n");
+            rc = 1; goto out;
+        }
+        // Fail fast on a stale plan instead of an ILLEGAL REQUEST after the move times out
+        ElementStatus src_st = {0}, dst_st = {0};
+        if (!force && read_element_pair(&handle, source, &src_st, dest, &dst_st, RES_MEMORY) == 0 &&
+            (!src_st.full || dst_st.full)) {
+            fprintf(stderr, "%s 0x%04x is %s. Use --force to move anyway.\n", !src_st.full ? "Source" : "Destination",
+                    !src_st.full ? source : dest, !src_st.full ? "empty" : "full");
+            rc = 1; goto out;
+        }
+        if (dry_run) {
+            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
+                   transport, source, dest);
+        } else {
+            if (confirm && !confirm_move()) {
+                fprintf(stderr, "Aborted.\n");
+                rc = 1; goto out;
+            }
+            rc = cmd_move_medium(&handle, transport, source, dest);
+        }
+    } else if (strcmp(argv[1], "list-map") == 0) {
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc == 0) {
+            print_element_map(&map);
+            warn_if_slot_mismatch(&handle, &map);
+        } else {
+            fprintf(stderr, "Failed to read element map.\n");
+        }
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "load") == 0 || strcmp(argv[1], "load-slot") == 0) {
+        size_t slot_index = 0, drive_index = 1; // default to drive 1
+        bool have_slot = false;
+        bool have_transport = false;
+        uint16_t transport = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+                have_slot = parse_index(argv[++i], &slot_index);
+            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
+                parse_index(argv[++i], &drive_index);
+            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+                have_transport = parse_u16(argv[++i], &transport);
+            }
+        }
+        if (!have_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1; goto out;
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            element_map_free(&map);
+            goto out;
+        }
+        if (slot_index == 0 || slot_index > map.slots.count ||
+            drive_index == 0 || drive_index > map.drives.count) {
+            fprintf(stderr, "Slot/drive out of range. Slots: %zu, Drives: %zu\n",
+                    map.slots.count, map.drives.count);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (!have_transport) {
+            if (map.transports.count == 0) {
+                fprintf(stderr, "No transport element found.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+        }
+        uint16_t slot_addr = element_addr(&map.slots, slot_index - 1);
+        uint16_t drive_addr = element_addr(&map.drives, drive_index - 1);
+        if (!have_transport) transport = pick_transport(&handle, &map, &layout, slot_addr, drive_addr);
+
+        // Check if drive already has a disc - if so, unload it first
+        ElementStatus drive_st = {0}, target_slot_st = {0};
+        // About to move media: let the device verify rather than trust its memory
+        rc = read_element_pair(&handle, drive_addr, &drive_st, slot_addr, &target_slot_st, 0);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element status.\n");
+            element_map_free(&map);
+            goto out;
+        }
+
+        // Check if the target slot's disc is already in the drive
+        if (target_slot_st.full) {
+            // Slot has disc, we can load it
+        } else if (drive_st.full && drive_st.valid_src && drive_st.src_addr == slot_addr) {
+            // The disc we want is already in the drive
+            printf("LOAD: Disc from slot %u is already in drive %u.\n",
+                   (unsigned)slot_index, (unsigned)drive_index);
+            if (!dry_run) catalog_note_access(catalog, (int)slot_index);
+            element_map_free(&map);
+            goto out;
+        } else if (!target_slot_st.full) {
+            fprintf(stderr, "Slot %u is empty.\n", (unsigned)slot_index);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+
+        printf("LOAD: transport=0x%04x slot=%u(0x%04x) drive=%u(0x%04x)\n",
+               transport, (unsigned)slot_index, slot_addr,
+               (unsigned)drive_index, drive_addr);
+
+        // Show current mounted disc in verbose mode
+        if (g_verbose && drive_st.full) {
+            DiscInfo current;
+            if (get_mounted_disc_info(&current)) {
+                printf("  Currently mounted: %s (%s)\n",
+                       current.name[0] ? current.name : "Unknown", current.size[0] ? current.size : "?");
+            }
+        }
+
+        // If drive has a different disc, unload it first
+        if (drive_st.full) {
+            uint16_t unload_slot_addr = 0;
+            size_t unload_slot_index = 0;
+
+            if (drive_st.valid_src) {
+                unload_slot_addr = drive_st.src_addr;
+                unload_slot_index = (size_t)slot_index_for_addr(&map, unload_slot_addr);
+            }
+
+            if (unload_slot_addr == 0 || unload_slot_index == 0) {
+                fprintf(stderr, "Drive has a disc but cannot determine source slot.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+
+            printf("  Drive has disc from slot %zu(0x%04x), unloading first...\n",
+                   unload_slot_index, unload_slot_addr);
+
+            if (dry_run) {
+                printf("DRY RUN: Eject from macOS\n");
+                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (unload)\n",
+                       transport, drive_addr, unload_slot_addr);
+                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (load)\n",
+                       transport, slot_addr, drive_addr);
+            } else {
+                if (confirm && !confirm_move()) {
+                    fprintf(stderr, "Aborted.\n");
+                    rc = 1;
+                    element_map_free(&map);
+                    goto out;
+                }
+                // Eject from macOS
+                eject_optical_media();
+                // Unload current disc
+                rc = cmd_move_medium(&handle, transport, drive_addr, unload_slot_addr);
+                if (rc != 0) {
+                    fprintf(stderr, "Failed to unload current disc.\n");
+                    element_map_free(&map);
+                    goto out;
+                }
+                // Load requested disc
+                printf("  Loading slot %u...\n", (unsigned)slot_index);
+                rc = cmd_move_medium(&handle, transport, slot_addr, drive_addr);
+            }
+        } else {
+            // Drive is empty, just load
+            if (dry_run) {
+                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
+                       transport, slot_addr, drive_addr);
+            } else {
+                if (confirm && !confirm_move()) {
+                    fprintf(stderr, "Aborted.\n");
+                    rc = 1;
+                    element_map_free(&map);
+                    goto out;
+                }
+                rc = cmd_move_medium(&handle, transport, slot_addr, drive_addr);
+            }
+        }
+        // Fingerprint the new disc when it is worth the spin-up wait:
+        // to check it against the catalog, or to report it in verbose mode
+        MChangerCatalogEntry expected;
+        bool have_expected = mchanger_catalog_get(catalog, (int)slot_index, &expected) == MCHANGER_OK &&
+                             expected.fingerprint[0];
+        if ((have_expected || g_verbose) && rc == 0 && !dry_run) {
+            DiscInfo id;
+            int id_rc = identify_disc(&handle, drive_addr, (int)drive_index, 20, &id, NULL);
+            if (id_rc == MCHANGER_OK) {
+                if (g_verbose) {
+                    printf("  Disc: %s %s (%s)\n", id.fingerprint, id.media_type[0] ? id.media_type : "?",
+                           id.size[0] ? id.size : "?");
+                }
+                if (have_expected && strcasecmp(expected.fingerprint, id.fingerprint) != 0) {
+                    fprintf(stderr, "Warning: disc in drive %zu is not the one cataloged for slot %zu "
+                            "(expected %s, found %s). Updating catalog.\n",
+                            drive_index, slot_index, expected.fingerprint, id.fingerprint);
+                }
+                catalog_note_disc(catalog, (int)slot_index, &id);
+            } else if (g_verbose) {
+                printf("  Disc: (unable to identify, error %d)\n", id_rc);
+            }
+        }
+        if (rc == 0 && !dry_run) catalog_note_access(catalog, (int)slot_index);
+        // Show newly mounted disc in verbose mode, and remember it in the catalog
+        if (g_verbose && rc == 0 && !dry_run) {
+            DiscInfo mounted;
+            if (wait_and_print_mounted_disc(&mounted)) {
+                catalog_note_mount(catalog, (int)slot_index, &mounted);
+            }
+        }
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "scan-library") == 0) {
+        bool restart = false;
+        uint32_t timeout_secs = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--restart") == 0) {
+                restart = true;
+            } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+                parse_u32(argv[++i], &timeout_secs);
+            }
+        }
+        if (!catalog) {
+            fprintf(stderr, "scan-library needs a catalog; use --catalog <path>.\n");
+            rc = 1; goto out;
+        }
+        if (dry_run) {
+            printf("DRY RUN: would fingerprint every occupied slot into %s\n", mchanger_catalog_path(catalog));
+            goto out;
+        }
+        if (confirm && !confirm_move()) {
+            fprintf(stderr, "Aborted.\n");
+            rc = 1; goto out;
+        }
+        printf("Scanning library into %s%s\n", mchanger_catalog_path(catalog),
+               restart ? " (restarting)" : "");
+        double started = monotonic_secs();
+        catch_stop_signals(true);
+        int scan_rc = scan_library(&handle, catalog, restart, (int)timeout_secs, print_scan_progress, NULL);
+        catch_stop_signals(false);
+        char took[32];
+        format_duration(monotonic_secs() - started, took, sizeof(took));
+        if (scan_rc == MCHANGER_OK) {
+            printf("Scan complete in %s. Catalog now holds %zu discs.\n", took, mchanger_catalog_count(catalog));
+        } else {
+            fprintf(stderr, "Scan stopped (error %d) after %s. Run scan-library again to resume.\n",
+                    scan_rc, took);
+            rc = 1;
+        }
+    } else if (strcmp(argv[1], "fetch") == 0) {
+        size_t slot_index = 0, drive_index = 1;
+        bool have_slot = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+                have_slot = parse_index(argv[++i], &slot_index);
+            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
+                parse_index(argv[++i], &drive_index);
+            }
+        }
+        if (!have_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1; goto out;
+        }
+        MChangerImageCache *cache = mchanger_cache_open(cache_dir, cache_max_bytes);
+        if (!cache) {
+            fprintf(stderr, "Unable to open image cache.\n");
+            rc = 1; goto out;
+        }
+        // Borrow the open device for the library path, which knows about the cache
+        MChangerHandle changer = { .internal = handle, .catalog = catalog };
+        char image[1100];
+        int fetch_rc = mchanger_fetch_image(&changer, cache, (int)slot_index, (int)drive_index,
+                                            image, sizeof(image));
+        handle = changer.internal;
+        mchanger_cache_close(cache);
+        if (fetch_rc == MCHANGER_OK) {
+            printf("%s\n", image);
+        } else {
+            fprintf(stderr, "Unable to fetch an image of slot %zu (error %d).\n", slot_index, fetch_rc);
+            rc = 1;
+        }
+    } else if (strcmp(argv[1], "rebalance") == 0) {
+        uint32_t max_moves = 20;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc) {
+                parse_u32(argv[++i], &max_moves);
+            }
+        }
+        if (!catalog) {
+            fprintf(stderr, "rebalance needs a catalog; use --catalog <path>.\n");
+            rc = 1; goto out;
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0 || map.transports.count == 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        size_t slots = map.slots.count;
+        bool *full = calloc(slots ? slots : 1, sizeof(bool));
+        bool *loaded = calloc(slots ? slots : 1, sizeof(bool));
+        SlotMove *moves = calloc(max_moves ? max_moves : 1, sizeof(SlotMove));
+        size_t planned = 0;
+        if (!full || !loaded || !moves || read_placement_state(&handle, &map, full, loaded) != MCHANGER_OK) {
+            fprintf(stderr, "Failed to read slot occupancy.\n");
+            rc = 1;
+        } else {
+            planned = plan_rebalance(&layout, catalog, full, loaded, slots, max_moves, moves);
+        }
+        if (rc == 0 && planned == 0) {
+            printf("Often-loaded discs are already as close to the drives as they can be.\n");
+        } else if (rc == 0) {
+            double robot_ms = 0;
+            bool estimated = true;
+            for (size_t i = 0; i < planned; i++) {
+                MChangerCatalogEntry e;
+                bool known = mchanger_catalog_get(catalog, moves[i].from, &e) == MCHANGER_OK;
+                printf("%s slot %d -> slot %d  (%u loads%s%s)\n", dry_run ? "DRY RUN: MOVE" : "MOVE",
+                       moves[i].from, moves[i].to, known ? e.loads : 0,
+                       known && e.volume[0] ? ", " : "", known ? e.volume : "");
+                double ms;
+                uint16_t from = element_addr(&map.slots, moves[i].from - 1), to = element_addr(&map.slots, moves[i].to - 1);
+                estimated = estimated && motion_estimate(handle.motion, &map, &layout,
+                                                         pick_transport(&handle, &map, &layout, from, to),
+                                                         from, to, &ms);
+                if (estimated) robot_ms += ms;
+            }
+            if (estimated) {
+                char took[32];
+                format_duration(robot_ms / 1000.0, took, sizeof(took));
+                printf("Estimated robot time: %s\n", took);
+            }
+            if (!dry_run) {
+                if (confirm && !confirm_move()) {
+                    fprintf(stderr, "Aborted.\n");
+                    rc = 1;
+                } else {
+                    size_t done = 0;
+                    catch_stop_signals(true);
+                    int move_rc = run_slot_moves(&handle, catalog, &map, moves, planned, &done);
+                    catch_stop_signals(false);
+                    printf("Moved %zu of %zu discs.\n", done, planned);
+                    if (move_rc != MCHANGER_OK) rc = 1;
+                }
+            }
+        }
+        free(full);
+        free(loaded);
+        free(moves);
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "calibrate") == 0) {
+        uint32_t moves = 10;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc) {
+                parse_u32(argv[++i], &moves);
+            }
+        }
+        if (!handle.motion) {
+            fprintf(stderr, "No motion log available; set MCHANGER_MOTION or HOME.\n");
+            rc = 1; goto out;
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0 || map.transports.count == 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (moves > 0 && dry_run) {
+            printf("DRY RUN: would make up to %u probing moves\n", moves);
+        } else if (moves > 0) {
+            if (confirm && !confirm_move()) {
+                fprintf(stderr, "Aborted.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+            catch_stop_signals(true);
+            size_t made = calibrate_motion(&handle, &map, &layout, moves);
+            catch_stop_signals(false);
+            printf("Made %zu probing move%s.\n", made, made == 1 ? "" : "s");
+        }
+        for (size_t t = 0; t < map.transports.count; t++) {
+            print_motion_model(handle.motion, &map, &layout, element_addr(&map.transports, t));
+        }
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "door") == 0) {
+        // Batches lock and unlock the door themselves; this recovers from one
+        // that was killed outright, or holds the door shut for manual work
+        bool lock = argc > 2 && strcmp(argv[2], "lock") == 0;
+        if (argc < 3 || (!lock && strcmp(argv[2], "unlock") != 0)) {
+            fprintf(stderr, "Usage: door lock|unlock\n");
+            rc = 1; goto out;
+        }
+        rc = cmd_prevent_removal(&handle, lock, NULL);
+        if (rc == 0) printf("Door and I/E port %s.\n", lock ? "locked" : "unlocked");
+    } else if (strcmp(argv[1], "export") == 0) {
+        rc = cmd_export(&handle, catalog, &layout, argc, argv);
+    } else if (strcmp(argv[1], "ingest") == 0) {
+        rc = cmd_ingest(&handle, catalog, &layout, argc, argv);
+    } else if (strcmp(argv[1], "watch") == 0) {
+        rc = cmd_watch(&handle, argc, argv);
+    } else if (strcmp(argv[1], "snapshot") == 0) {
+        const char *out_path = NULL;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_path = argv[++i];
+        }
+        char default_path[1024];
+        if (!out_path) {
+            if (!inventory_default_path(default_path, sizeof(default_path))) {
+                fprintf(stderr, "No inventory location; use --out <path>.\n");
+                rc = 1; goto out;
+            }
+            out_path = default_path;
+        }
+        Inventory inv;
+        if (inventory_read(&handle, &inv) != MCHANGER_OK) {
+            fprintf(stderr, "Failed to read inventory.\n");
+            rc = 1;
+        } else if (inventory_save(&inv, out_path) != MCHANGER_OK) {
+            fprintf(stderr, "Failed to save %s\n", out_path);
+            rc = 1;
+        } else {
+            size_t slots_full = 0, drives_full = 0;
+            for (size_t i = 0; i < inv.map.slots.count; i++) slots_full += inv.states[1][i].full;
+            for (size_t i = 0; i < inv.map.drives.count; i++) drives_full += inv.states[2][i].full;
+            printf("Saved inventory to %s: %zu of %zu slots full, %zu of %zu drives loaded\n", out_path,
+                   slots_full, inv.map.slots.count, drives_full, inv.map.drives.count);
+        }
+        inventory_free(&inv);
+    } else if (strcmp(argv[1], "identify") == 0) {
+        size_t drive_index = 1;
+        uint32_t timeout_secs = 20;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
+                parse_index(argv[++i], &drive_index);
+            } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+                parse_u32(argv[++i], &timeout_secs);
+            }
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            element_map_free(&map);
+            goto out;
+        }
+        if (drive_index == 0 || drive_index > map.drives.count) {
+            fprintf(stderr, "Drive out of range. Drives: %zu\n", map.drives.count);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        uint16_t drive_addr = element_addr(&map.drives, drive_index - 1);
+        element_map_free(&map);
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        DiscInfo id;
+        int tracks = 0;
+        int id_rc = identify_disc(&handle, drive_addr, (int)drive_index, (int)timeout_secs, &id, &tracks);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        long elapsed_ms = (long)((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000);
+
+        if (id_rc == MCHANGER_ERR_EMPTY) {
+            printf("Drive %zu: no disc.\n", drive_index);
+            rc = 1;
+        } else if (id_rc != MCHANGER_OK) {
+            fprintf(stderr, "Unable to identify disc in drive %zu (error %d).\n", drive_index, id_rc);
+            rc = 1;
+        } else {
+            printf("Drive %zu: fingerprint %s\n", drive_index, id.fingerprint);
+            printf("  Media: %s, %d track%s, %s\n", id.media_type[0] ? id.media_type : "unknown",
+                   tracks, tracks == 1 ? "" : "s", id.size[0] ? id.size : "size unknown");
+            printf("  Identified in %ld ms\n", elapsed_ms);
+            MChangerCatalogEntry entry;
+            if (mchanger_catalog_find_fingerprint(catalog, id.fingerprint, &entry) == MCHANGER_OK) {
+                printf("  Catalog: slot %d%s%s\n", entry.slot, entry.volume[0] ? ", " : "", entry.volume);
+            }
+        }
+    } else if (strcmp(argv[1], "unload") == 0 || strcmp(argv[1], "unload-drive") == 0) {
+        size_t slot_index = 0, drive_index = 1; // default to drive 1
+        bool have_slot = false;
+        bool have_transport = false;
+        uint16_t transport = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+                have_slot = parse_index(argv[++i], &slot_index);
+            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
+                parse_index(argv[++i], &drive_index);
+            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+                have_transport = parse_u16(argv[++i], &transport);
+            }
+        }
+        if (!have_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1; goto out;
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            element_map_free(&map);
+            goto out;
+        }
+        if (slot_index == 0 || slot_index > map.slots.count ||
+            drive_index == 0 || drive_index > map.drives.count) {
+            fprintf(stderr, "Slot/drive out of range. Slots: %zu, Drives: %zu\n",
+                    map.slots.count, map.drives.count);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (!have_transport) {
+            if (map.transports.count == 0) {
+                fprintf(stderr, "No transport element found.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+        }
+        uint16_t slot_addr = element_addr(&map.slots, slot_index - 1);
+        uint16_t drive_addr = element_addr(&map.drives, drive_index - 1);
+        if (!have_transport) transport = pick_transport(&handle, &map, &layout, drive_addr, slot_addr);
+        printf("UNLOAD: transport=0x%04x drive=%u(0x%04x) slot=%u(0x%04x)\n",
+               transport, (unsigned)drive_index, drive_addr,
+               (unsigned)slot_index, slot_addr);
+        if (dry_run) {
+            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
+                   transport, drive_addr, slot_addr);
+        } else {
+            if (confirm && !confirm_move()) {
+                fprintf(stderr, "Aborted.\n");
+                rc = 1; goto out;
+            }
+            // Eject optical media from macOS before physical unload
+            eject_optical_media();
+            rc = cmd_move_medium(&handle, transport, drive_addr, slot_addr);
+        }
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "eject") == 0) {
+        // Eject a disc from the machine via the I/E slot
+        // If the disc is currently in the drive, unload it first
+        size_t slot_index = 0, drive_index = 1; // default drive 1
+        bool have_slot = false, have_drive = false;
+        bool have_transport = false;
+        uint16_t transport = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+                have_slot = parse_index(argv[++i], &slot_index);
+            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
+                have_drive = parse_index(argv[++i], &drive_index);
+            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+                have_transport = parse_u16(argv[++i], &transport);
+            }
+        }
+        if (!have_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1; goto out;
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            element_map_free(&map);
+            goto out;
+        }
+        if (slot_index == 0 || slot_index > map.slots.count) {
+            fprintf(stderr, "Slot out of range. Slots: %zu\n", map.slots.count);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (!have_drive) drive_index = 1;
+        if (drive_index == 0 || drive_index > map.drives.count) {
+            fprintf(stderr, "Drive out of range. Drives: %zu\n", map.drives.count);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (map.ie.count == 0) {
+            fprintf(stderr, "No import/export element found.\n");
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (!have_transport) {
+            if (map.transports.count == 0) {
+                fprintf(stderr, "No transport element found.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+        }
+        uint16_t slot_addr = element_addr(&map.slots, slot_index - 1);
+        uint16_t drive_addr = element_addr(&map.drives, drive_index - 1);
+        uint16_t ie_addr = pick_ie_port(&handle, &map, &layout, have_transport ? transport : element_addr(&map.transports, 0),
+                                        slot_addr, true);
+        if (!have_transport) transport = pick_transport(&handle, &map, &layout, slot_addr, ie_addr);
+
+        // Check element status to see if disc is in slot or in drive
+        ElementStatus drive_st = {0}, slot_st = {0};
+        rc = read_element_pair(&handle, drive_addr, &drive_st, slot_addr, &slot_st, 0);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element status.\n");
+            element_map_free(&map);
+            goto out;
+        }
+
+        bool disc_in_drive = false;
+        if (!slot_st.full && drive_st.full) {
+            // Slot is empty and drive has a disc - check if it came from this slot
+            if (drive_st.valid_src && drive_st.src_addr == slot_addr) {
+                disc_in_drive = true;
+            } else if (!drive_st.valid_src) {
+                // No source info, assume disc in drive belongs to this slot if slot is empty
+                disc_in_drive = true;
+            }
+        }
+
+        if (!slot_st.full && !disc_in_drive) {
+            fprintf(stderr, "Slot %zu is empty and disc is not in drive.\n", slot_index);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+
+        printf("EJECT: slot=%zu(0x%04x) via ie(0x%04x)\n", slot_index, slot_addr, ie_addr);
+
+        if (disc_in_drive) {
+            printf("  Disc is currently in drive %zu(0x%04x), unloading first...\n",
+                   drive_index, drive_addr);
+            if (dry_run) {
+                printf("DRY RUN: Eject from macOS\n");
+                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (unload to slot)\n",
+                       transport, drive_addr, slot_addr);
+                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (eject to I/E)\n",
+                       transport, slot_addr, ie_addr);
+            } else {
+                if (confirm && !confirm_move()) {
+                    fprintf(stderr, "Aborted.\n");
+                    rc = 1;
+                    element_map_free(&map);
+                    goto out;
+                }
+                // Step 1: Eject from macOS
+                eject_optical_media();
+                // Step 2: Unload from drive to slot
+                printf("  Moving from drive to slot...\n");
+                rc = cmd_move_medium(&handle, transport, drive_addr, slot_addr);
+                if (rc != 0) {
+                    fprintf(stderr, "Failed to unload from drive.\n");
+                    element_map_free(&map);
+                    goto out;
+                }
+                // Step 3: Move from slot to I/E
+                printf("  Moving from slot to I/E...\n");
+                rc = cmd_move_medium(&handle, transport, slot_addr, ie_addr);
+                if (rc != 0) {
+                    fprintf(stderr, "Failed to move to I/E slot.\n");
+                }
+            }
+        } else {
+            // Disc is in slot, just move to I/E
+            if (dry_run) {
+                printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x (eject to I/E)\n",
+                       transport, slot_addr, ie_addr);
+            } else {
+                if (confirm && !confirm_move()) {
+                    fprintf(stderr, "Aborted.\n");
+                    rc = 1;
+                    element_map_free(&map);
+                    goto out;
+                }
+                printf("  Moving from slot to I/E...\n");
+                rc = cmd_move_medium(&handle, transport, slot_addr, ie_addr);
+                if (rc != 0) {
+                    fprintf(stderr, "Failed to move to I/E slot.\n");
+                }
+            }
+        }
+
+        if (rc == 0) {
+            printf("Disc ejected to I/E slot. You can now remove it from the changer.\n");
+            if (!dry_run) catalog_note_slot_changed(catalog, (int)slot_index);
+        }
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "insert") == 0) {
+        // Insert a disc from the IE port into a slot
+        size_t slot_index = 0;
+        bool have_slot = false, auto_slot = false, hot = false;
+        bool have_transport = false;
+        uint16_t transport = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc && strcmp(argv[i + 1], "auto") == 0) {
+                auto_slot = true;
+                i++;
+            } else if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+                have_slot = parse_index(argv[++i], &slot_index);
+            } else if (strcmp(argv[i], "--hot") == 0) {
+                hot = true;
+            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+                have_transport = parse_u16(argv[++i], &transport);
+            }
+        }
+        if (!have_slot && !auto_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1; goto out;
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            element_map_free(&map);
+            goto out;
+        }
+        if (auto_slot) {
+            // New discs go far from the drives unless they are known to be busy
+            bool *full = calloc(map.slots.count ? map.slots.count : 1, sizeof(bool));
+            bool *loaded = calloc(map.slots.count ? map.slots.count : 1, sizeof(bool));
+            if (full && loaded && read_placement_state(&handle, &map, full, loaded) == MCHANGER_OK) {
+                slot_index = (size_t)pick_free_slot(&layout, full, map.slots.count, hot);
+            }
+            free(full);
+            free(loaded);
+            if (slot_index == 0) {
+                fprintf(stderr, "No free slot found.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+        }
+        if (slot_index == 0 || slot_index > map.slots.count) {
+            fprintf(stderr, "Slot out of range. Slots: %zu\n", map.slots.count);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (map.ie.count == 0) {
+            fprintf(stderr, "No import/export element found.\n");
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (!have_transport) {
+            if (map.transports.count == 0) {
+                fprintf(stderr, "No transport element found.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+        }
+        uint16_t slot_addr = element_addr(&map.slots, slot_index - 1);
+        uint16_t ie_addr = pick_ie_port(&handle, &map, &layout, have_transport ? transport : element_addr(&map.transports, 0),
+                                        slot_addr, false);
+        if (!have_transport) transport = pick_transport(&handle, &map, &layout, ie_addr, slot_addr);
+
+        printf("INSERT: IE(0x%04x) -> slot %zu(0x%04x)\n", ie_addr, slot_index, slot_addr);
+        printf("Place a disc in the IE port, then press Enter to continue...\n");
+        if (!dry_run) {
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF);
+        }
+
+        if (dry_run) {
+            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
+                   transport, ie_addr, slot_addr);
+        } else {
+            if (confirm && !confirm_move()) {
+                fprintf(stderr, "Aborted.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+            rc = cmd_move_medium(&handle, transport, ie_addr, slot_addr);
+            if (rc == 0) {
+                printf("Disc inserted into slot %zu.\n", slot_index);
+                // A new, unidentified disc now lives here
+                catalog_note_slot_changed(catalog, (int)slot_index);
+            }
+        }
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "retrieve") == 0) {
+        // Retrieve a disc from a slot to the IE port
+        size_t slot_index = 0;
+        bool have_slot = false;
+        bool have_transport = false;
+        uint16_t transport = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+                have_slot = parse_index(argv[++i], &slot_index);
+            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+                have_transport = parse_u16(argv[++i], &transport);
+            }
+        }
+        if (!have_slot) {
+            fprintf(stderr, "Missing --slot.\n");
+            rc = 1; goto out;
+        }
+        ElementMap map = {0};
+        rc = fetch_element_map(&handle, &map);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to read element map.\n");
+            element_map_free(&map);
+            goto out;
+        }
+        if (slot_index == 0 || slot_index > map.slots.count) {
+            fprintf(stderr, "Slot out of range. Slots: %zu\n", map.slots.count);
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (map.ie.count == 0) {
+            fprintf(stderr, "No import/export element found.\n");
+            rc = 1;
+            element_map_free(&map);
+            goto out;
+        }
+        if (!have_transport) {
+            if (map.transports.count == 0) {
                 fprintf(stderr, "No transport element found.\n");
                 rc = 1;
                 element_map_free(&map);
                 goto out;
             }
-            transport = map.transports.addrs[0];
         }
-        uint16_t slot_addr = map.slots.addrs[slot_index - 1];
-        uint16_t ie_addr = map.ie.addrs[0];
+        uint16_t slot_addr = element_addr(&map.slots, slot_index - 1);
+        uint16_t ie_addr = pick_ie_port(&handle, &map, &layout, have_transport ? transport : element_addr(&map.transports, 0),
+                                        slot_addr, true);
+        if (!have_transport) transport = pick_transport(&handle, &map, &layout, slot_addr, ie_addr);
+
+        printf("RETRIEVE: slot %zu(0x%04x) -> IE(0x%04x)\n", slot_index, slot_addr, ie_addr);
+
+        if (dry_run) {
+            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
+                   transport, slot_addr, ie_addr);
+        } else {
+            if (confirm && !confirm_move()) {
+                fprintf(stderr, "Aborted.\n");
+                rc = 1;
+                element_map_free(&map);
+                goto out;
+            }
+            rc = cmd_move_medium(&handle, transport, slot_addr, ie_addr);
+            if (rc == 0) {
+                printf("Disc from slot %zu is now in the IE port. You can remove it.\n", slot_index);
+                catalog_note_slot_changed(catalog, (int)slot_index);
+            }
+        }
+        element_map_free(&map);
+    } else if (strcmp(argv[1], "unload") == 0) {
+        uint16_t transport = 0, slot = 0, drive = 0;
+        bool have_transport = false, have_slot = false, have_drive = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+                have_transport = parse_u16(argv[++i], &transport);
+            } else if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
+                have_slot = parse_u16(argv[++i], &slot);
+            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
+                have_drive = parse_u16(argv[++i], &drive);
+            }
+        }
+        if (!have_transport || !have_slot || !have_drive) {
+            fprintf(stderr, "Missing --transport, --drive, or --slot.\n");
+            rc = 1; goto out;
+        }
+        if (dry_run) {
+            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
+                   transport, drive, slot);
+        } else {
+            if (confirm && !confirm_move()) {
+                fprintf(stderr, "Aborted.\n");
+                rc = 1; goto out;
+            }
+            // Eject optical media from macOS before physical unload
+            eject_optical_media();
+            rc = cmd_move_medium(&handle, transport, drive, slot);
+        }
+    } else {
+        print_usage(argv[0]);
+        rc = 1;
+    }
+
+out:
+    mchanger_catalog_close(catalog);
+    close_changer(&handle);
+    return rc;
+}
+
+#endif /* MCHANGER_NO_MAIN */
+
+/*
+ * =============================================================================
+ * Public API Implementation
+ * =============================================================================
+ */
+
+/* List available changer devices */
+int mchanger_list_changers(MChangerHandleInfo **out_list, size_t *out_count) {
+    if (!out_list || !out_count) return MCHANGER_ERR_INVALID;
+
+    *out_list = NULL;
+    *out_count = 0;
+
+    io_iterator_t iter = match_scsi_devices();
+    if (iter == IO_OBJECT_NULL) return MCHANGER_ERR_NOT_FOUND;
+
+    /* Count changers first */
+    size_t count = 0;
+    io_service_t service;
+    while ((service = IOIteratorNext(iter))) {
+        if (is_changer_device(service)) count++;
+        IOObjectRelease(service);
+    }
+
+    if (count == 0) {
+        IOObjectRelease(iter);
+        return MCHANGER_OK; /* No changers found, but not an error */
+    }
+
+    /* Allocate and fill */
+    MChangerHandleInfo *list = calloc(count, sizeof(MChangerHandleInfo));
+    if (!list) {
+        IOObjectRelease(iter);
+        return MCHANGER_ERR_INVALID;
+    }
+
+    IOIteratorReset(iter);
+    size_t idx = 0;
+    while ((service = IOIteratorNext(iter)) && idx < count) {
+        if (is_changer_device(service)) {
+            get_vendor_product(service, list[idx].vendor, sizeof(list[idx].vendor),
+                              list[idx].product, sizeof(list[idx].product));
+            io_string_t path;
+            if (IORegistryEntryGetPath(service, kIOServicePlane, path) == KERN_SUCCESS) {
+                strncpy(list[idx].path, path, sizeof(list[idx].path) - 1);
+            }
+            idx++;
+        }
+        IOObjectRelease(service);
+    }
+    IOObjectRelease(iter);
+
+    *out_list = list;
+    *out_count = idx;
+    return MCHANGER_OK;
+}
+
+void mchanger_free_changer_list(MChangerHandleInfo *list) {
+    free(list);
+}
+
+/*
+ * Inventory prefetch: the element map, then what every element holds, read on
+ * a thread of its own from open, so the first call usually finds them read.
+ * handle_map() waits for the map stage rather than read the map twice.
+ */
+static void *prefetch_thread(void *arg) {
+    MChangerHandle *changer = arg;
+    Prefetch *pf = &changer->prefetch;
+
+    const ElementMap *map = handle_map_read(changer);
+    pthread_mutex_lock(&pf->lock);
+    pf->state = map ? MCHANGER_PREFETCH_STATUS : MCHANGER_PREFETCH_FAILED;
+    pf->generation = __atomic_load_n(&changer->internal.generation, __ATOMIC_SEQ_CST);
+    bool stopping = pf->stopping;
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    if (!map) return NULL;
+
+    Inventory *inv = stopping ? NULL : calloc(1, sizeof(Inventory));
+    int rc = MCHANGER_ERR_INVALID;
+    if (inv && element_map_copy(&inv->map, map)) rc = inventory_read_states(&changer->internal, inv);
+
+    pthread_mutex_lock(&pf->lock);
+    if (rc == MCHANGER_OK) {
+        pf->inv = inv;
+        pf->updated_ms = wall_ms();
+    }
+    pf->state = rc == MCHANGER_OK ? MCHANGER_PREFETCH_READY : MCHANGER_PREFETCH_FAILED;
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    if (rc != MCHANGER_OK && inv) {
+        inventory_free(inv);
+        free(inv);
+    }
+    return NULL;
+}
+
+static void prefetch_start(MChangerHandle *changer) {
+    Prefetch *pf = &changer->prefetch;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->cond, NULL);
+    pf->state = MCHANGER_PREFETCH_MAP;
+    pf->running = true;
+    if (pthread_create(&pf->thread, NULL, prefetch_thread, changer) != 0) {
+        pf->running = false;
+        pf->state = MCHANGER_PREFETCH_FAILED;
+    }
+}
+
+/* Skips the status stage if it has not begun; waits out a read in progress */
+static void prefetch_stop(MChangerHandle *changer) {
+    Prefetch *pf = &changer->prefetch;
+    if (!pf->running) return;
+    pthread_mutex_lock(&pf->lock);
+    pf->stopping = true;
+    pthread_mutex_unlock(&pf->lock);
+    pthread_join(pf->thread, NULL);
+    pf->running = false;
+    if (pf->inv) {
+        inventory_free(pf->inv);
+        free(pf->inv);
+        pf->inv = NULL;
+    }
+    pthread_cond_destroy(&pf->cond);
+    pthread_mutex_destroy(&pf->lock);
+}
+
+/* Publish the prefetched inventory if no move has been made since it was read */
+static bool prefetch_publish(MChangerHandle *changer, StatusBoard *board) {
+    Prefetch *pf = &changer->prefetch;
+    if (!pf->running) return false;
+    pthread_mutex_lock(&pf->lock);
+    bool fresh = pf->state == MCHANGER_PREFETCH_READY &&
+                 pf->generation == __atomic_load_n(&changer->internal.generation, __ATOMIC_SEQ_CST);
+    if (fresh) board_publish(board, pf->inv);
+    pthread_mutex_unlock(&pf->lock);
+    return fresh;
+}
+
+/* Open a changer device */
+MChangerHandle *mchanger_open(const char *device_name) {
+    return mchanger_open_ex(device_name, false, false);
+}
+
+/* Wrap an opened device in a public handle and start reading its inventory */
+static MChangerHandle *handle_create(ChangerHandle internal) {
+    MChangerHandle *changer = calloc(1, sizeof(MChangerHandle));
+    if (!changer) return NULL;
+
+    changer->internal = internal;
+    pthread_mutex_init(&changer->idle.lock, NULL);
+    pthread_cond_init(&changer->idle.cond, NULL);
+    pthread_mutex_init(&changer->reservations.lock, NULL);
+    pthread_cond_init(&changer->reservations.cond, NULL);
+    changer->reservations.ready = true;
+    device_locks_init(&changer->locks);
+    changer->internal.locks = &changer->locks;
+    changer->internal.motion = motion_open(NULL);
+    prefetch_start(changer);
+
+    return changer;
+}
+
+MChangerHandle *mchanger_open_ex(const char *device_name, bool force, bool skip_tur) {
+    (void)device_name; /* TODO: support opening specific device by name */
+
+    ChangerHandle internal = open_changer(!force);
+    if (!internal.service && !internal.sbp2_lun) return NULL;
+
+    if (!skip_tur && !force) {
+        if (cmd_test_unit_ready(&internal) != 0) {
+            close_changer(&internal);
+            return NULL;
+        }
+    }
+
+    MChangerHandle *changer = handle_create(internal);
+    if (!changer) close_changer(&internal);
+    return changer;
+}
+
+void mchanger_close(MChangerHandle *changer) {
+    if (!changer) return;
+    prefetch_stop(changer);
+    mchanger_set_idle_return(changer, 0);
+    /* The last command may have come from another thread's run loop */
+    sbp2_bind_runloop(&changer->internal, CFRunLoopGetCurrent());
+    pthread_cond_destroy(&changer->idle.cond);
+    pthread_mutex_destroy(&changer->idle.lock);
+    /* A caller that forgot mchanger_set_door_lock(false) shouldn't leave the door shut */
+    if (changer->internal.door_locks > 0 && !changer->internal.prevent_unsupported) {
+        cmd_prevent_removal(&changer->internal, false, NULL);
+    }
+    close_changer(&changer->internal);
+    board_close(changer->internal.board);
+    device_locks_destroy(&changer->locks);
+    pthread_cond_destroy(&changer->reservations.cond);
+    pthread_mutex_destroy(&changer->reservations.lock);
+    free(changer->reservations.claims);
+    element_map_free(&changer->map);
+    free(changer->residency.history);
+    free(changer);
+}
+
+/* Get element map */
+int mchanger_get_element_map(MChangerHandle *changer, MChangerElementMap *out_map) {
+    if (!changer || !out_map) return MCHANGER_ERR_INVALID;
+
+    memset(out_map, 0, sizeof(*out_map));
+
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+
+    /* Copy to public structure */
+    if (map->slots.count > 0) {
+        out_map->slot_addrs = malloc(map->slots.count * sizeof(uint16_t));
+        if (out_map->slot_addrs) {
+            element_list_expand(&map->slots, out_map->slot_addrs);
+            out_map->slot_count = map->slots.count;
+        }
+    }
+
+    if (map->drives.count > 0) {
+        out_map->drive_addrs = malloc(map->drives.count * sizeof(uint16_t));
+        if (out_map->drive_addrs) {
+            element_list_expand(&map->drives, out_map->drive_addrs);
+            out_map->drive_count = map->drives.count;
+        }
+    }
+
+    if (map->transports.count > 0) {
+        out_map->transport_addrs = malloc(map->transports.count * sizeof(uint16_t));
+        if (out_map->transport_addrs) {
+            element_list_expand(&map->transports, out_map->transport_addrs);
+            out_map->transport_count = map->transports.count;
+        }
+    }
+
+    if (map->ie.count > 0) {
+        out_map->ie_addrs = malloc(map->ie.count * sizeof(uint16_t));
+        if (out_map->ie_addrs) {
+            element_list_expand(&map->ie, out_map->ie_addrs);
+            out_map->ie_count = map->ie.count;
+        }
+    }
+
+    return MCHANGER_OK;
+}
+
+void mchanger_free_element_map(MChangerElementMap *map) {
+    if (!map) return;
+    free(map->slot_addrs);
+    free(map->drive_addrs);
+    free(map->transport_addrs);
+    free(map->ie_addrs);
+    memset(map, 0, sizeof(*map));
+}
+
+/*
+ * Map a public status mode onto READ ELEMENT STATUS flags. The _ex calls ask
+ * for strict CACHED reads and fail on a changer without CURDATA; the legacy
+ * calls predate CURDATA and must keep working there, so they fall back to a
+ * plain read once the changer has rejected it.
+ */
+static uint8_t status_mode_flags(MChangerStatusMode mode, bool strict) {
+    if (mode == MCHANGER_STATUS_VERIFIED) return 0;
+    return strict ? RES_CURDATA : RES_MEMORY;
+}
+
+static int get_slot_status(MChangerHandle *changer, int slot, uint8_t flags,
+                           MChangerElementStatus *out_status) {
+    if (!changer || !out_status || slot < 1) return MCHANGER_ERR_INVALID;
+
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+
+    if ((size_t)slot > map->slots.count) {
+        return MCHANGER_ERR_INVALID;
+    }
+
+    uint16_t slot_addr = element_addr(&map->slots, slot - 1);
+
+    ElementStatus internal_st = {0};
+    int rc = read_element_pair(&changer->internal, slot_addr, &internal_st, 0, NULL, flags);
+
+    if (rc != 0) return MCHANGER_ERR_SCSI;
+
+    out_status->address = internal_st.addr;
+    out_status->full = internal_st.full;
+    out_status->except = internal_st.except;
+    out_status->valid_source = internal_st.valid_src;
+    out_status->source_addr = internal_st.src_addr;
+
+    return MCHANGER_OK;
+}
+
+/* Get element status */
+int mchanger_get_slot_status(MChangerHandle *changer, int slot, MChangerElementStatus *out_status) {
+    return get_slot_status(changer, slot, status_mode_flags(MCHANGER_STATUS_CACHED, false), out_status);
+}
+
+int mchanger_get_slot_status_ex(MChangerHandle *changer, int slot, MChangerStatusMode mode,
+                                MChangerElementStatus *out_status) {
+    return get_slot_status(changer, slot, status_mode_flags(mode, true), out_status);
+}
+
+static int get_drive_status(MChangerHandle *changer, int drive, uint8_t flags,
+                            MChangerElementStatus *out_status) {
+    if (!changer || !out_status || drive < 1) return MCHANGER_ERR_INVALID;
+
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+
+    if ((size_t)drive > map->drives.count) {
+        return MCHANGER_ERR_INVALID;
+    }
+
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+
+    ElementStatus internal_st = {0};
+    int rc = read_element_pair(&changer->internal, drive_addr, &internal_st, 0, NULL, flags);
+
+    if (rc != 0) return MCHANGER_ERR_SCSI;
+
+    out_status->address = internal_st.addr;
+    out_status->full = internal_st.full;
+    out_status->except = internal_st.except;
+    out_status->valid_source = internal_st.valid_src;
+    out_status->source_addr = internal_st.src_addr;
+
+    return MCHANGER_OK;
+}
+
+int mchanger_get_drive_status(MChangerHandle *changer, int drive, MChangerElementStatus *out_status) {
+    return get_drive_status(changer, drive, status_mode_flags(MCHANGER_STATUS_CACHED, false), out_status);
+}
+
+int mchanger_get_drive_status_ex(MChangerHandle *changer, int drive, MChangerStatusMode mode,
+                                 MChangerElementStatus *out_status) {
+    return get_drive_status(changer, drive, status_mode_flags(mode, true), out_status);
+}
+
+/*
+ * Read the device identifier the changer reports for a drive (DVCID). This is
+ * the only place the library asks for DVCID: it lengthens every drive
+ * descriptor and is only useful for matching a drive element to a drive LUN.
+ */
+int mchanger_get_drive_identifier(MChangerHandle *changer, int drive, char *out_id, size_t id_len) {
+    if (!changer || !out_id || id_len == 0 || drive < 1) return MCHANGER_ERR_INVALID;
+    out_id[0] = '\0';
+
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    if ((size_t)drive > map->drives.count) {
+        return MCHANGER_ERR_INVALID;
+    }
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+
+    return read_drive_identifier(&changer->internal, drive_addr, out_id, id_len);
+}
+
+static int get_bulk_status(MChangerHandle *changer,
+                           const uint16_t *slot_addrs,
+                           size_t slot_count,
+                           uint16_t drive_addr,
+                           uint8_t flags,
+                           MChangerElementStatus *out_drive,
+                           MChangerElementStatus *out_slots,
+                           bool *out_drive_supported) {
+    if (!changer || !out_slots) return MCHANGER_ERR_INVALID;
+    if (slot_count > 0 && !slot_addrs) return MCHANGER_ERR_INVALID;
+
+    if (out_drive_supported) *out_drive_supported = false;
+
+    /* Initialize outputs to "empty/unknown" */
+    for (size_t i = 0; i < slot_count; i++) {
+        out_slots[i].address = slot_addrs[i];
+        out_slots[i].full = false;
+        out_slots[i].except = false;
+        out_slots[i].valid_source = false;
+        out_slots[i].source_addr = 0;
+    }
+
+    if (out_drive) {
+        out_drive->address = drive_addr;
+        out_drive->full = false;
+        out_drive->except = false;
+        out_drive->valid_source = false;
+        out_drive->source_addr = 0;
+    }
+
+    uint32_t alloc = 4096;
+    uint8_t *buf = calloc(1, alloc);
+    if (!buf) return MCHANGER_ERR_INVALID;
+
+    int rc = execute_read_element_status(&changer->internal, 0x00, 0, 0xFFFF, buf, alloc, flags, 30000);
+    if (rc != 0) {
+        free(buf);
+        return MCHANGER_ERR_SCSI;
+    }
+
+    uint32_t report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
+    uint32_t needed = report_bytes > 0 ? report_bytes + 8 : 0;
+    if (needed > alloc && needed < 65535) {
+        free(buf);
+        alloc = needed;
+        buf = calloc(1, alloc);
+        if (!buf) return MCHANGER_ERR_INVALID;
+
+        rc = execute_read_element_status(&changer->internal, 0x00, 0, 0xFFFF, buf, alloc, flags, 30000);
+        if (rc != 0) {
+            free(buf);
+            return MCHANGER_ERR_SCSI;
+        }
+        report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
+    }
+
+    uint32_t parse_len = alloc;
+    if (report_bytes > 0 && report_bytes + 8 < parse_len) {
+        parse_len = report_bytes + 8;
+    }
+    if (parse_len < 8) {
+        free(buf);
+        return MCHANGER_OK;
+    }
+
+    bool drive_page_present = false;
+
+    /* Parse element status pages (same wire format as read_element_status_info()) */
+    uint32_t offset = 8;
+    while (offset + 8 <= parse_len) {
+        uint8_t elem_type = buf[offset];
+        uint16_t desc_len = (buf[offset + 2] << 8) | buf[offset + 3];
+        uint32_t page_bytes = (buf[offset + 5] << 16) | (buf[offset + 6] << 8) | buf[offset + 7];
+        offset += 8;
+
+        if (desc_len == 0 || page_bytes == 0) break;
+
+        uint32_t page_end = offset + page_bytes;
+        if (page_end > parse_len) page_end = parse_len;
+
+        if (elem_type == 0x04) {
+            drive_page_present = true;
+        }
+
+        while (offset + desc_len <= page_end) {
+            uint16_t elem_addr = (buf[offset] << 8) | buf[offset + 1];
+            uint8_t elem_flags = buf[offset + 2];
+            bool full = (elem_flags & 0x01) != 0;
+            bool except = (elem_flags & 0x04) != 0;
+
+            bool svalid = false;
+            uint16_t src = 0;
+            if (desc_len >= 12) {
+                svalid = (buf[offset + 9] & 0x80) != 0;
+                src = (buf[offset + 10] << 8) | buf[offset + 11];
+            }
+
+            if (out_drive && drive_addr != 0 && elem_addr == drive_addr) {
+                out_drive->full = full;
+                out_drive->except = except;
+                out_drive->valid_source = svalid;
+                out_drive->source_addr = src;
+            }
+
+            /* Fill any matching slot entry */
+            for (size_t i = 0; i < slot_count; i++) {
+                if (slot_addrs[i] == elem_addr) {
+                    out_slots[i].full = full;
+                    out_slots[i].except = except;
+                    out_slots[i].valid_source = svalid;
+                    out_slots[i].source_addr = src;
+                    break;
+                }
+            }
+
+            offset += desc_len;
+        }
 
-        printf("INSERT: IE(0x%04x) -> slot %zu(0x%04x)\n", ie_addr, slot_index, slot_addr);
-        printf("Place a disc in the IE port, then press Enter to continue...\n");
-        if (!dry_run) {
-            int c;
-            while ((c = getchar()) != '\n' && c != EOF);
+        if (offset < page_end) {
+            offset = page_end;
         }
+    }
 
-        if (dry_run) {
-            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
-                   transport, ie_addr, slot_addr);
-        } else {
-            if (confirm && !confirm_move()) {
-                fprintf(stderr, "Aborted.\n");
-                rc = 1;
-                element_map_free(&map);
-                goto out;
-            }
-            rc = cmd_move_medium(&handle, transport, ie_addr, slot_addr);
-            if (rc == 0) {
-                printf("Disc inserted into slot %zu.\n", slot_index);
-            }
+    if (out_drive_supported) *out_drive_supported = drive_page_present;
+    free(buf);
+    return MCHANGER_OK;
+}
+
+int mchanger_get_bulk_status(MChangerHandle *changer,
+                             const uint16_t *slot_addrs,
+                             size_t slot_count,
+                             uint16_t drive_addr,
+                             MChangerElementStatus *out_drive,
+                             MChangerElementStatus *out_slots,
+                             bool *out_drive_supported) {
+    return get_bulk_status(changer, slot_addrs, slot_count, drive_addr,
+                           status_mode_flags(MCHANGER_STATUS_CACHED, false),
+                           out_drive, out_slots, out_drive_supported);
+}
+
+int mchanger_get_bulk_status_ex(MChangerHandle *changer,
+                                const uint16_t *slot_addrs,
+                                size_t slot_count,
+                                uint16_t drive_addr,
+                                MChangerStatusMode mode,
+                                MChangerElementStatus *out_drive,
+                                MChangerElementStatus *out_slots,
+                                bool *out_drive_supported) {
+    return get_bulk_status(changer, slot_addrs, slot_count, drive_addr,
+                           status_mode_flags(mode, true), out_drive, out_slots,
+                           out_drive_supported);
+}
+
+/*
+ * Element reservations
+ *
+ * Public calls claim the slots, drives and I/E ports they touch, all at once,
+ * and wait only while another thread holds one of them; claims nest within a
+ * thread. MOVE MEDIUM itself is serialized by the transport lock, so a long
+ * mount wait in one drive no longer holds up status reads, planning or loads
+ * in another. Handles the CLI borrows serve one thread and claim nothing.
+ */
+
+/* Activity keeps the idle-return thread waiting */
+static void idle_touch(MChangerHandle *changer) {
+    if (!changer->idle.running) return;
+    pthread_mutex_lock(&changer->idle.lock);
+    changer->idle.last_activity = monotonic_secs();
+    pthread_mutex_unlock(&changer->idle.lock);
+}
+
+static bool others_hold_claims_locked(const Reservations *r, pthread_t self) {
+    for (size_t i = 0; i < r->count; i++) {
+        if (!pthread_equal(r->claims[i].owner, self)) return true;
+    }
+    return false;
+}
+
+/* Whether this thread may claim addrs now. Caller holds r->lock. */
+static bool claims_free_locked(const Reservations *r, const uint16_t *addrs, size_t count, pthread_t self) {
+    if (r->exclusive_depth > 0) return pthread_equal(r->exclusive_owner, self);
+    bool holds_any = false;
+    for (size_t i = 0; i < r->count; i++) {
+        if (pthread_equal(r->claims[i].owner, self)) {
+            holds_any = true;
+            continue;
         }
-        element_map_free(&map);
-    } else if (strcmp(argv[1], "retrieve") == 0) {
-        // Retrieve a disc from a slot to the IE port
-        size_t slot_index = 0;
-        bool have_slot = false;
-        bool have_transport = false;
-        uint16_t transport = 0;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
-                have_slot = parse_index(argv[++i], &slot_index);
-            } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
-                have_transport = parse_u16(argv[++i], &transport);
-            }
+        for (size_t j = 0; j < count; j++) {
+            if (r->claims[i].addr == addrs[j]) return false;
         }
-        if (!have_slot) {
-            fprintf(stderr, "Missing --slot.\n");
-            rc = 1; goto out;
+    }
+    /* A thread starting afresh lets a waiting whole-changer call go first */
+    return holds_any || r->exclusive_waiting == 0;
+}
+
+static bool claims_add_locked(Reservations *r, const uint16_t *addrs, size_t count, pthread_t self) {
+    if (r->count + count > r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 16;
+        while (cap < r->count + count) cap *= 2;
+        ElementClaim *claims = realloc(r->claims, cap * sizeof(ElementClaim));
+        if (!claims) return false;
+        r->claims = claims;
+        r->cap = cap;
+    }
+    for (size_t j = 0; j < count; j++) {
+        ElementClaim *mine = NULL;
+        for (size_t i = 0; i < r->count && !mine; i++) {
+            if (r->claims[i].addr == addrs[j]) mine = &r->claims[i];
         }
-        ElementMap map = {0};
-        rc = fetch_element_map(&handle, &map);
-        if (rc != 0) {
-            fprintf(stderr, "Failed to read element map.\n");
-            element_map_free(&map);
-            goto out;
+        if (mine) {
+            mine->depth++;
+        } else {
+            r->claims[r->count++] = (ElementClaim){ addrs[j], self, 1 };
         }
-        if (slot_index == 0 || slot_index > map.slots.count) {
-            fprintf(stderr, "Slot out of range. Slots: %zu\n", map.slots.count);
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+    }
+    return true;
+}
+
+/* Claim every address in addrs, or none. false if busy (without wait) or out of memory. */
+static bool claim_elements(MChangerHandle *changer, const uint16_t *addrs, size_t count, bool wait) {
+    Reservations *r = &changer->reservations;
+    if (!r->ready) return true;
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&r->lock);
+    while (!claims_free_locked(r, addrs, count, self)) {
+        if (!wait) {
+            pthread_mutex_unlock(&r->lock);
+            return false;
         }
-        if (map.ie.count == 0) {
-            fprintf(stderr, "No import/export element found.\n");
-            rc = 1;
-            element_map_free(&map);
-            goto out;
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    bool ok = claims_add_locked(r, addrs, count, self);
+    pthread_mutex_unlock(&r->lock);
+    if (ok) idle_touch(changer);
+    return ok;
+}
+
+static void release_elements(MChangerHandle *changer, const uint16_t *addrs, size_t count) {
+    Reservations *r = &changer->reservations;
+    if (!r->ready) return;
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&r->lock);
+    for (size_t j = 0; j < count; j++) {
+        for (size_t i = 0; i < r->count; i++) {
+            if (r->claims[i].addr != addrs[j] || !pthread_equal(r->claims[i].owner, self)) continue;
+            if (--r->claims[i].depth == 0) r->claims[i] = r->claims[--r->count];
+            break;
         }
-        if (!have_transport) {
-            if (map.transports.count == 0) {
-                fprintf(stderr, "No transport element found.\n");
-                rc = 1;
-                element_map_free(&map);
-                goto out;
-            }
-            transport = map.transports.addrs[0];
+    }
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    idle_touch(changer);
+}
+
+/* Whole-changer claim, for calls that may touch any element (scan, rebalance) */
+static void claim_changer(MChangerHandle *changer) {
+    Reservations *r = &changer->reservations;
+    if (!r->ready) return;
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&r->lock);
+    if (r->exclusive_depth > 0 && pthread_equal(r->exclusive_owner, self)) {
+        r->exclusive_depth++;
+    } else {
+        r->exclusive_waiting++;
+        while (r->exclusive_depth > 0 || others_hold_claims_locked(r, self)) {
+            pthread_cond_wait(&r->cond, &r->lock);
         }
-        uint16_t slot_addr = map.slots.addrs[slot_index - 1];
-        uint16_t ie_addr = map.ie.addrs[0];
+        r->exclusive_waiting--;
+        r->exclusive_owner = self;
+        r->exclusive_depth = 1;
+    }
+    pthread_mutex_unlock(&r->lock);
+    idle_touch(changer);
+}
 
-        printf("RETRIEVE: slot %zu(0x%04x) -> IE(0x%04x)\n", slot_index, slot_addr, ie_addr);
+static void release_changer(MChangerHandle *changer) {
+    Reservations *r = &changer->reservations;
+    if (!r->ready) return;
+    pthread_mutex_lock(&r->lock);
+    if (r->exclusive_depth > 0 && --r->exclusive_depth == 0) pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    idle_touch(changer);
+}
 
-        if (dry_run) {
-            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
-                   transport, slot_addr, ie_addr);
+static bool handle_has_map(MChangerHandle *changer) {
+    Reservations *r = &changer->reservations;
+    if (r->ready) pthread_mutex_lock(&r->lock);
+    bool have = changer->have_map;
+    if (r->ready) pthread_mutex_unlock(&r->lock);
+    return have;
+}
+
+/* Read the map into the handle's cache unless it is already there */
+static const ElementMap *handle_map_read(MChangerHandle *changer) {
+    if (handle_has_map(changer)) return &changer->map;
+
+    Reservations *r = &changer->reservations;
+    ElementMap map = {0};
+    if (fetch_element_map(&changer->internal, &map) != 0) {
+        element_map_free(&map);
+        return NULL;
+    }
+    if (r->ready) pthread_mutex_lock(&r->lock);
+    if (changer->have_map) {
+        element_map_free(&map);     /* another thread got there first */
+    } else {
+        changer->map = map;
+        changer->have_map = true;
+    }
+    if (r->ready) pthread_mutex_unlock(&r->lock);
+    return &changer->map;
+}
+
+/* Element map cached on the handle: planners and claims ask for it often */
+static const ElementMap *handle_map(MChangerHandle *changer) {
+    if (handle_has_map(changer)) return &changer->map;
+    /* The prefetch thread is reading it: wait rather than read it twice */
+    Prefetch *pf = &changer->prefetch;
+    if (pf->running) {
+        pthread_mutex_lock(&pf->lock);
+        while (pf->state == MCHANGER_PREFETCH_MAP) pthread_cond_wait(&pf->cond, &pf->lock);
+        pthread_mutex_unlock(&pf->lock);
+    }
+    return handle_map_read(changer);
+}
+
+/* inventory_read() on the cached map: only what the elements hold is read */
+static int handle_inventory_read(MChangerHandle *changer, Inventory *inv) {
+    memset(inv, 0, sizeof(*inv));
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    if (!element_map_copy(&inv->map, map)) return MCHANGER_ERR_INVALID;
+    return inventory_read_states(&changer->internal, inv);
+}
+
+/* Slot a drive's disc goes home to, from changer memory; 0 if empty or unknown */
+static uint16_t drive_home_addr(MChangerHandle *changer, uint16_t drive_addr) {
+    ElementStatus st = {0};
+    if (read_element_pair(&changer->internal, drive_addr, &st, 0, NULL, RES_MEMORY) != 0 ||
+        !st.full || !st.valid_src) {
+        return 0;
+    }
+    return st.src_addr;
+}
+
+/*
+ * Claim a drive, a slot (0 to leave it out) and the slot the drive's disc
+ * goes home to, which a load or eject may move it into. Claims nothing, and
+ * leaves the call to report bad numbers, when they are out of range. Returns
+ * MCHANGER_ERR_BUSY if the claim could not be made.
+ */
+static int claim_drive_swap(MChangerHandle *changer, int slot, int drive, uint16_t addrs[3], size_t *out_count) {
+    *out_count = 0;
+    if (!changer->reservations.ready) return MCHANGER_OK;
+    const ElementMap *map = handle_map(changer);
+    if (!map || slot < 0 || drive < 1 || (size_t)slot > map->slots.count || (size_t)drive > map->drives.count) {
+        return MCHANGER_OK;
+    }
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+    uint16_t slot_addr = slot > 0 ? element_addr(&map->slots, slot - 1) : 0;
+
+    /* The disc in the drive can change before the claim is granted */
+    for (int attempt = 0; attempt < 3; attempt++) {
+        uint16_t home = drive_home_addr(changer, drive_addr);
+        size_t n = 0;
+        addrs[n++] = drive_addr;
+        if (slot_addr) addrs[n++] = slot_addr;
+        if (home && home != slot_addr) addrs[n++] = home;
+        if (!claim_elements(changer, addrs, n, true)) return MCHANGER_ERR_BUSY;
+        if (drive_home_addr(changer, drive_addr) == home) {
+            *out_count = n;
+            return MCHANGER_OK;
+        }
+        release_elements(changer, addrs, n);
+    }
+    return MCHANGER_ERR_BUSY;
+}
+
+int mchanger_reserve_elements(MChangerHandle *changer, const uint16_t *addrs, size_t count, bool wait) {
+    if (!changer || !addrs || count == 0) return MCHANGER_ERR_INVALID;
+    return claim_elements(changer, addrs, count, wait) ? MCHANGER_OK : MCHANGER_ERR_BUSY;
+}
+
+void mchanger_release_elements(MChangerHandle *changer, const uint16_t *addrs, size_t count) {
+    if (!changer || !addrs) return;
+    release_elements(changer, addrs, count);
+}
+
+/*
+ * Shared load path. With identify set, the disc is fingerprinted
+ * after the move (or in place, if it was already loaded), recorded in the
+ * attached catalog, and returned through out_id when non-NULL.
+ */
+
+/* Score an earlier idle return of this drive against the load that follows it */
+static void idle_note_load(MChangerHandle *changer, int slot, int drive, bool drive_full) {
+    if (drive > MAX_TRACKED_DRIVES) return;
+    IdleReturn *idle = &changer->idle;
+    bool locked = idle->running;
+    if (locked) pthread_mutex_lock(&idle->lock);
+    int returned = idle->returned_slot[drive - 1];
+    idle->returned_slot[drive - 1] = 0;
+    /* Unless someone else used the drive in between */
+    if (returned && !drive_full) {
+        if (returned == slot) {
+            idle->stats.wasted++;
         } else {
-            if (confirm && !confirm_move()) {
-                fprintf(stderr, "Aborted.\n");
-                rc = 1;
-                element_map_free(&map);
-                goto out;
-            }
-            rc = cmd_move_medium(&handle, transport, slot_addr, ie_addr);
-            if (rc == 0) {
-                printf("Disc from slot %zu is now in the IE port. You can remove it.\n", slot_index);
-            }
+            idle->stats.saved++;
         }
-        element_map_free(&map);
-    } else if (strcmp(argv[1], "unload") == 0) {
-        uint16_t transport = 0, slot = 0, drive = 0;
-        bool have_transport = false, have_slot = false, have_drive = false;
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
-                have_transport = parse_u16(argv[++i], &transport);
-            } else if (strcmp(argv[i], "--slot") == 0 && i + 1 < argc) {
-                have_slot = parse_u16(argv[++i], &slot);
-            } else if (strcmp(argv[i], "--drive") == 0 && i + 1 < argc) {
-                have_drive = parse_u16(argv[++i], &drive);
-            }
+    }
+    if (locked) pthread_mutex_unlock(&idle->lock);
+}
+
+static int load_slot_held(MChangerHandle *changer, int slot, int drive,
+                          MChangerMountCallback callback, void *context,
+                          bool identify, DiscInfo *out_id) {
+    if (out_id) memset(out_id, 0, sizeof(*out_id));
+    if (!changer || slot < 1 || drive < 1) return MCHANGER_ERR_INVALID;
+
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+
+    if ((size_t)slot > map->slots.count || (size_t)drive > map->drives.count) {
+        return MCHANGER_ERR_INVALID;
+    }
+
+    uint16_t slot_addr = element_addr(&map->slots, slot - 1);
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+    uint16_t transport = pick_transport(&changer->internal, map, &changer->layout, slot_addr, drive_addr);
+
+    /* Check current status */
+    ElementStatus drive_st = {0}, slot_st = {0};
+    if (read_element_pair(&changer->internal, drive_addr, &drive_st, slot_addr, &slot_st, 0) != 0) {
+        return MCHANGER_ERR_SCSI;
+    }
+
+    /* Already loaded? */
+    bool already_loaded = !slot_st.full && drive_st.full && drive_st.valid_src && drive_st.src_addr == slot_addr;
+    if (already_loaded) {
+        if (identify && out_id) identify_disc(&changer->internal, drive_addr, drive, 20, out_id, NULL);
+        catalog_note_access(changer->catalog, slot);
+        return MCHANGER_OK;
+    }
+
+    /* Slot empty and disc not in drive? */
+    if (!slot_st.full && !(drive_st.full && drive_st.valid_src && drive_st.src_addr == slot_addr)) {
+        return MCHANGER_ERR_EMPTY;
+    }
+
+    int rc = 0;
+    idle_note_load(changer, slot, drive, drive_st.full);
+
+    /* If drive has a different disc, unload it first */
+    if (drive_st.full) {
+        uint16_t unload_addr = drive_st.valid_src ? drive_st.src_addr : slot_addr;
+        eject_optical_media();
+        rc = cmd_move_medium(&changer->internal, transport, drive_addr, unload_addr);
+        if (rc != 0) {
+            return move_error(rc);
         }
-        if (!have_transport || !have_slot || !have_drive) {
-            fprintf(stderr, "Missing --transport, --drive, or --slot.\n");
-            rc = 1; goto out;
+    }
+
+    /* Load the disc */
+    rc = cmd_move_medium(&changer->internal, transport, slot_addr, drive_addr);
+
+    if (rc != 0) return move_error(rc);
+
+    /* Fingerprint from the drive: no mount needed, so this is quick and also covers audio CDs */
+    if (identify) {
+        DiscInfo id;
+        if (identify_disc(&changer->internal, drive_addr, drive, 20, &id, NULL) == MCHANGER_OK) {
+            catalog_note_disc(changer->catalog, slot, &id);
+            if (out_id) *out_id = id;
         }
-        if (dry_run) {
-            printf("DRY RUN: MOVE transport=0x%04x source=0x%04x dest=0x%04x\n",
-                   transport, drive, slot);
-        } else {
-            if (confirm && !confirm_move()) {
-                fprintf(stderr, "Aborted.\n");
-                rc = 1; goto out;
-            }
-            // Eject optical media from macOS before physical unload
-            eject_optical_media();
-            rc = cmd_move_medium(&handle, transport, drive, slot);
+    }
+    catalog_note_access(changer->catalog, slot);
+
+    /* Notify about mounted disc if callback provided */
+    if (callback) {
+        DiscInfo info;
+        if (wait_for_disc(&info, 30) == MCHANGER_OK) {
+            catalog_note_mount(changer->catalog, slot, &info);
         }
-    } else {
-        print_usage(argv[0]);
-        rc = 1;
+        callback(info.name[0] ? info.name : "Unknown", info.size[0] ? info.size : "?", context);
+    }
+
+    return MCHANGER_OK;
+}
+
+static int load_slot(MChangerHandle *changer, int slot, int drive,
+                     MChangerMountCallback callback, void *context,
+                     bool identify, DiscInfo *out_id) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    uint16_t claimed[3];
+    size_t n;
+    int rc = claim_drive_swap(changer, slot, drive, claimed, &n);
+    if (rc != MCHANGER_OK) return rc;
+    rc = load_slot_held(changer, slot, drive, callback, context, identify, out_id);
+    release_elements(changer, claimed, n);
+    return rc;
+}
+
+/* Load a disc from slot into drive */
+int mchanger_load_slot(MChangerHandle *changer, int slot, int drive) {
+    return mchanger_load_slot_verbose(changer, slot, drive, NULL, NULL);
+}
+
+int mchanger_load_slot_verbose(MChangerHandle *changer, int slot, int drive,
+                           MChangerMountCallback callback, void *context) {
+    /* Identify only when someone will use the answer: it waits for spin-up */
+    bool identify = changer && (changer->catalog || callback);
+    return load_slot(changer, slot, drive, callback, context, identify, NULL);
+}
+
+int mchanger_load_slot_expect(MChangerHandle *changer, int slot, int drive, const char *fingerprint) {
+    if (!changer || slot < 1 || drive < 1) return MCHANGER_ERR_INVALID;
+
+    /* Read the expectation before the load refreshes the catalog */
+    char expected[33] = {0};
+    MChangerCatalogEntry entry;
+    if (fingerprint && *fingerprint) {
+        snprintf(expected, sizeof(expected), "%s", fingerprint);
+    } else if (mchanger_catalog_get(changer->catalog, slot, &entry) == MCHANGER_OK) {
+        snprintf(expected, sizeof(expected), "%s", entry.fingerprint);
     }
 
-out:
-    close_changer(&handle);
-    return rc;
+    DiscInfo loaded;
+    int rc = load_slot(changer, slot, drive, NULL, NULL, expected[0] != '\0', &loaded);
+    if (rc != MCHANGER_OK || !expected[0]) return rc;
+    if (!loaded.fingerprint[0]) return MCHANGER_ERR_SCSI;
+    return strcasecmp(loaded.fingerprint, expected) == 0 ? MCHANGER_OK : MCHANGER_ERR_MISMATCH;
 }
 
-#endif /* MCHANGER_NO_MAIN */
-
 /*
- * =============================================================================
- * Public API Implementation
- * =============================================================================
+ * Drive residency
  */
 
-/* Internal handle is compatible with public handle */
-struct MChangerHandle {
-    ChangerHandle internal;
-};
+static bool slot_list_contains(const SlotList *list, int slot) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->slots[i] == slot) return true;
+    }
+    return false;
+}
 
-/* List available changer devices */
-int mchanger_list_changers(MChangerHandleInfo **out_list, size_t *out_count) {
-    if (!out_list || !out_count) return MCHANGER_ERR_INVALID;
+static bool slot_list_remove(SlotList *list, int slot) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->slots[i] != slot) continue;
+        memmove(&list->slots[i], &list->slots[i + 1], (list->count - i - 1) * sizeof(int));
+        list->count--;
+        return true;
+    }
+    return false;
+}
 
-    *out_list = NULL;
-    *out_count = 0;
+/* Drop the least recently used entry */
+static void slot_list_pop(SlotList *list) {
+    if (list->count == 0) return;
+    memmove(&list->slots[0], &list->slots[1], (list->count - 1) * sizeof(int));
+    list->count--;
+}
 
-    io_iterator_t iter = match_scsi_devices();
-    if (iter == IO_OBJECT_NULL) return MCHANGER_ERR_NOT_FOUND;
+/* Add as most recently used */
+static void slot_list_push(SlotList *list, int slot) {
+    slot_list_remove(list, slot);
+    if (list->count == sizeof(list->slots) / sizeof(list->slots[0])) slot_list_pop(list);
+    list->slots[list->count++] = slot;
+}
 
-    /* Count changers first */
-    size_t count = 0;
-    io_service_t service;
-    while ((service = IOIteratorNext(iter))) {
-        if (is_changer_device(service)) count++;
-        IOObjectRelease(service);
-    }
+static SlotHistory *residency_history(Residency *r, int slot) {
+    if ((size_t)slot > r->history_len) {
+        size_t len = r->history_len ? r->history_len : 64;
+        while (len < (size_t)slot) len *= 2;
+        SlotHistory *grown = realloc(r->history, len * sizeof(SlotHistory));
+        if (!grown) return NULL;
+        memset(grown + r->history_len, 0, (len - r->history_len) * sizeof(SlotHistory));
+        r->history = grown;
+        r->history_len = len;
+    }
+    return &r->history[slot - 1];
+}
 
-    if (count == 0) {
-        IOObjectRelease(iter);
-        return MCHANGER_OK; /* No changers found, but not an error */
+/* Keep ghost lists within ARC's bounds for a cache of `drives` entries */
+static void residency_trim_ghosts(Residency *r, size_t drives) {
+    while (r->b1.count > 0 && r->t1.count + r->b1.count > drives) slot_list_pop(&r->b1);
+    while (r->b2.count > 0 && r->t1.count + r->t2.count + r->b1.count + r->b2.count > 2 * drives) {
+        slot_list_pop(&r->b2);
     }
+}
 
-    /* Allocate and fill */
-    MChangerHandleInfo *list = calloc(count, sizeof(MChangerHandleInfo));
-    if (!list) {
-        IOObjectRelease(iter);
-        return MCHANGER_ERR_INVALID;
-    }
+static void residency_evicted(Residency *r, int slot, size_t drives) {
+    if (slot_list_remove(&r->t1, slot)) slot_list_push(&r->b1, slot);
+    else if (slot_list_remove(&r->t2, slot)) slot_list_push(&r->b2, slot);
+    residency_trim_ghosts(r, drives);
+}
 
-    IOIteratorReset(iter);
-    size_t idx = 0;
-    while ((service = IOIteratorNext(iter)) && idx < count) {
-        if (is_changer_device(service)) {
-            get_vendor_product(service, list[idx].vendor, sizeof(list[idx].vendor),
-                              list[idx].product, sizeof(list[idx].product));
-            io_string_t path;
-            if (IORegistryEntryGetPath(service, kIOServicePlane, path) == KERN_SUCCESS) {
-                strncpy(list[idx].path, path, sizeof(list[idx].path) - 1);
+/*
+ * Bring the lists in line with what the drives hold: discs moved by other
+ * commands (or by hand) leave or join the cache without any history.
+ */
+static void residency_sync(Residency *r, const int *resident, size_t drives) {
+    SlotList *lists[] = { &r->t1, &r->t2 };
+    for (size_t l = 0; l < 2; l++) {
+        for (size_t i = 0; i < lists[l]->count;) {
+            int slot = lists[l]->slots[i];
+            bool loaded = false;
+            for (size_t d = 0; d < drives; d++) loaded = loaded || resident[d] == slot;
+            if (loaded) {
+                i++;
+            } else {
+                residency_evicted(r, slot, drives);
             }
-            idx++;
         }
-        IOObjectRelease(service);
     }
-    IOObjectRelease(iter);
-
-    *out_list = list;
-    *out_count = idx;
-    return MCHANGER_OK;
-}
-
-void mchanger_free_changer_list(MChangerHandleInfo *list) {
-    free(list);
+    for (size_t d = 0; d < drives; d++) {
+        int slot = resident[d];
+        if (slot > 0 && !slot_list_contains(&r->t1, slot) && !slot_list_contains(&r->t2, slot)) {
+            slot_list_remove(&r->b1, slot);
+            slot_list_remove(&r->b2, slot);
+            slot_list_push(&r->t1, slot);
+        }
+    }
+    residency_trim_ghosts(r, drives);
 }
 
-/* Open a changer device */
-MChangerHandle *mchanger_open(const char *device_name) {
-    return mchanger_open_ex(device_name, false, false);
+/* On a miss, a disc ARC evicted recently shows which list was too small */
+static void residency_adapt(Residency *r, int slot, size_t drives) {
+    if (slot_list_contains(&r->b1, slot)) {
+        size_t step = r->b2.count > r->b1.count ? r->b2.count / r->b1.count : 1;
+        r->arc_target = r->arc_target + step > drives ? drives : r->arc_target + step;
+    } else if (slot_list_contains(&r->b2, slot)) {
+        size_t step = r->b1.count > r->b2.count ? r->b1.count / r->b2.count : 1;
+        r->arc_target = r->arc_target > step ? r->arc_target - step : 0;
+    }
 }
 
-MChangerHandle *mchanger_open_ex(const char *device_name, bool force, bool skip_tur) {
-    (void)device_name; /* TODO: support opening specific device by name */
-
-    MChangerHandle *changer = calloc(1, sizeof(MChangerHandle));
-    if (!changer) return NULL;
+/* Record a use of a disc that is now in a drive */
+static void residency_touch(Residency *r, int slot, size_t drives) {
+    SlotHistory *h = residency_history(r, slot);
+    if (h) {
+        h->last_use = ++r->clock;
+        h->uses++;
+    }
 
-    changer->internal = open_changer(!force);
-    if (!changer->internal.service && !changer->internal.sbp2_lun) {
-        free(changer);
-        return NULL;
+    /* Seen before, in a drive or recently evicted: it is now a frequent disc */
+    bool seen = false;
+    SlotList *lists[] = { &r->t1, &r->t2, &r->b1, &r->b2 };
+    for (size_t l = 0; l < 4; l++) {
+        if (slot_list_remove(lists[l], slot)) seen = true;
     }
+    slot_list_push(seen ? &r->t2 : &r->t1, slot);
+    residency_trim_ghosts(r, drives);
+}
 
-    if (!skip_tur && !force) {
-        if (cmd_test_unit_ready(&changer->internal) != 0) {
-            close_changer(&changer->internal);
-            free(changer);
-            return NULL;
+/*
+ * Pick the drive whose disc goes home to make room for `slot`. resident[d] is
+ * the home slot of drive d's disc, or -1 when unknown; such drives are never
+ * picked. Returns -1 if no drive can be used.
+ */
+static int residency_victim(Residency *r, const int *resident, size_t drives, int slot) {
+    int victim = -1;
+    if (r->policy == MCHANGER_RESIDENCY_ARC) {
+        bool in_b2 = slot_list_contains(&r->b2, slot);
+        bool from_t1 = r->t1.count > 0 &&
+                       (r->t1.count > r->arc_target || (in_b2 && r->t1.count == r->arc_target));
+        const SlotList *order[] = { from_t1 ? &r->t1 : &r->t2, from_t1 ? &r->t2 : &r->t1 };
+        for (size_t l = 0; l < 2 && victim < 0; l++) {
+            for (size_t i = 0; i < order[l]->count && victim < 0; i++) {
+                for (size_t d = 0; d < drives; d++) {
+                    if (resident[d] == order[l]->slots[i]) {
+                        victim = (int)d;
+                        break;
+                    }
+                }
+            }
+        }
+        return victim;
+    }
+
+    SlotHistory best = {0};
+    for (size_t d = 0; d < drives; d++) {
+        if (resident[d] <= 0) continue;
+        SlotHistory *h = residency_history(r, resident[d]);
+        SlotHistory cur = h ? *h : (SlotHistory){0};
+        bool better;
+        if (victim < 0) {
+            better = true;
+        } else if (r->policy == MCHANGER_RESIDENCY_LFU && cur.uses != best.uses) {
+            better = cur.uses < best.uses;
+        } else {
+            better = cur.last_use < best.last_use;
+        }
+        if (better) {
+            victim = (int)d;
+            best = cur;
         }
     }
-
-    return changer;
+    return victim;
 }
 
-void mchanger_close(MChangerHandle *changer) {
-    if (!changer) return;
-    close_changer(&changer->internal);
-    free(changer);
+int mchanger_set_residency_policy(MChangerHandle *changer, MChangerResidencyPolicy policy) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    if (policy != MCHANGER_RESIDENCY_LRU && policy != MCHANGER_RESIDENCY_LFU &&
+        policy != MCHANGER_RESIDENCY_ARC) {
+        return MCHANGER_ERR_INVALID;
+    }
+    free(changer->residency.history);
+    memset(&changer->residency, 0, sizeof(changer->residency));
+    changer->residency.policy = policy;
+    return MCHANGER_OK;
 }
 
-/* Get element map */
-int mchanger_get_element_map(MChangerHandle *changer, MChangerElementMap *out_map) {
-    if (!changer || !out_map) return MCHANGER_ERR_INVALID;
-
-    memset(out_map, 0, sizeof(*out_map));
-
-    ElementMap internal_map = {0};
-    int rc = fetch_element_map(&changer->internal, &internal_map);
-    if (rc != 0) return MCHANGER_ERR_SCSI;
+static int load_slot_auto_held(MChangerHandle *changer, int slot, int *out_drive) {
+    if (out_drive) *out_drive = 0;
+    if (!changer || slot < 1) return MCHANGER_ERR_INVALID;
 
-    /* Copy to public structure */
-    if (internal_map.slots.count > 0) {
-        out_map->slot_addrs = malloc(internal_map.slots.count * sizeof(uint16_t));
-        if (out_map->slot_addrs) {
-            memcpy(out_map->slot_addrs, internal_map.slots.addrs,
-                   internal_map.slots.count * sizeof(uint16_t));
-            out_map->slot_count = internal_map.slots.count;
-        }
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    if ((size_t)slot > map->slots.count || map->drives.count == 0) {
+        return MCHANGER_ERR_INVALID;
     }
 
-    if (internal_map.drives.count > 0) {
-        out_map->drive_addrs = malloc(internal_map.drives.count * sizeof(uint16_t));
-        if (out_map->drive_addrs) {
-            memcpy(out_map->drive_addrs, internal_map.drives.addrs,
-                   internal_map.drives.count * sizeof(uint16_t));
-            out_map->drive_count = internal_map.drives.count;
+    /* Home slot of each drive's disc: 0 when empty, -1 when unknown */
+    size_t drives = map->drives.count < MAX_TRACKED_DRIVES ? map->drives.count : MAX_TRACKED_DRIVES;
+    int resident[MAX_TRACKED_DRIVES];
+    for (size_t d = 0; d < drives; d++) {
+        ElementStatus st = {0};
+        if (read_element_pair(&changer->internal, element_addr(&map->drives, d), &st, 0, NULL, RES_MEMORY) != 0) {
+            return MCHANGER_ERR_SCSI;
         }
+        int home = st.valid_src ? slot_index_for_addr(map, st.src_addr) : 0;
+        resident[d] = !st.full ? 0 : home > 0 ? home : -1;
     }
 
-    if (internal_map.transports.count > 0) {
-        out_map->transport_addrs = malloc(internal_map.transports.count * sizeof(uint16_t));
-        if (out_map->transport_addrs) {
-            memcpy(out_map->transport_addrs, internal_map.transports.addrs,
-                   internal_map.transports.count * sizeof(uint16_t));
-            out_map->transport_count = internal_map.transports.count;
+    Residency *r = &changer->residency;
+    residency_sync(r, resident, drives);
+
+    for (size_t d = 0; d < drives; d++) {
+        if (resident[d] == slot) {
+            r->stats.hits++;
+            residency_touch(r, slot, drives);
+            catalog_note_access(changer->catalog, slot);
+            if (out_drive) *out_drive = (int)d + 1;
+            return MCHANGER_OK;
         }
     }
 
-    if (internal_map.ie.count > 0) {
-        out_map->ie_addrs = malloc(internal_map.ie.count * sizeof(uint16_t));
-        if (out_map->ie_addrs) {
-            memcpy(out_map->ie_addrs, internal_map.ie.addrs,
-                   internal_map.ie.count * sizeof(uint16_t));
-            out_map->ie_count = internal_map.ie.count;
-        }
+    residency_adapt(r, slot, drives);
+    int target = -1;
+    for (size_t d = 0; d < drives && target < 0; d++) {
+        if (resident[d] == 0) target = (int)d;
     }
+    bool evict = target < 0;
+    if (evict) target = residency_victim(r, resident, drives, slot);
+    if (target < 0) return MCHANGER_ERR_BUSY;
+
+    /* load_slot() returns the drive's disc to its own slot first */
+    int rc = load_slot(changer, slot, target + 1, NULL, NULL, changer->catalog != NULL, NULL);
+    if (rc != MCHANGER_OK) return rc;
 
-    element_map_free(&internal_map);
+    if (evict) {
+        residency_evicted(r, resident[target], drives);
+        r->stats.evictions++;
+    }
+    r->stats.misses++;
+    residency_touch(r, slot, drives);
+    if (out_drive) *out_drive = target + 1;
     return MCHANGER_OK;
 }
 
-void mchanger_free_element_map(MChangerElementMap *map) {
-    if (!map) return;
-    free(map->slot_addrs);
-    free(map->drive_addrs);
-    free(map->transport_addrs);
-    free(map->ie_addrs);
-    memset(map, 0, sizeof(*map));
+int mchanger_load_slot_auto(MChangerHandle *changer, int slot, int *out_drive) {
+    if (out_drive) *out_drive = 0;
+    if (!changer) return MCHANGER_ERR_INVALID;
+    /* Any drive may be chosen, and the residency lists are shared: claim all drives */
+    const ElementMap *map = changer->reservations.ready ? handle_map(changer) : NULL;
+    size_t n = map ? map->drives.count : 0;
+    uint16_t *drives = n > 0 ? malloc(n * sizeof(uint16_t)) : NULL;
+    if (n > 0 && !drives) return MCHANGER_ERR_INVALID;
+    if (n > 0) element_list_expand(&map->drives, drives);
+    if (n > 0 && !claim_elements(changer, drives, n, true)) {
+        free(drives);
+        return MCHANGER_ERR_BUSY;
+    }
+    int rc = load_slot_auto_held(changer, slot, out_drive);
+    if (n > 0) release_elements(changer, drives, n);
+    free(drives);
+    return rc;
 }
 
-/* Get element status */
-int mchanger_get_slot_status(MChangerHandle *changer, int slot, MChangerElementStatus *out_status) {
-    if (!changer || !out_status || slot < 1) return MCHANGER_ERR_INVALID;
+void mchanger_get_residency_stats(const MChangerHandle *changer, MChangerResidencyStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (changer) *out = changer->residency.stats;
+}
 
-    ElementMap map = {0};
-    if (fetch_element_map(&changer->internal, &map) != 0) return MCHANGER_ERR_SCSI;
+/*
+ * Idle return
+ */
 
-    if ((size_t)slot > map.slots.count) {
-        element_map_free(&map);
-        return MCHANGER_ERR_INVALID;
-    }
+/*
+ * Send every disc with a known, empty home slot back. A drive or slot that
+ * another call has claimed is in use and left alone. Runs without idle.lock.
+ */
+static void idle_return_discs(MChangerHandle *changer) {
+    ChangerHandle *handle = &changer->internal;
+    const ElementMap *map = handle_map(changer);
+    if (!map || map->transports.count == 0) return;
+    size_t drives = map->drives.count < MAX_TRACKED_DRIVES ? map->drives.count : MAX_TRACKED_DRIVES;
+
+    for (size_t d = 0; d < drives; d++) {
+        uint16_t claimed[2] = { element_addr(&map->drives, d), drive_home_addr(changer, element_addr(&map->drives, d)) };
+        int slot = claimed[1] ? slot_index_for_addr(map, claimed[1]) : 0;
+        if (slot == 0 || !claim_elements(changer, claimed, 2, false)) continue;
+
+        /* Check again now that nobody else can move these */
+        ElementStatus drive_st = {0}, slot_st = {0};
+        bool ready = read_element_pair(handle, claimed[0], &drive_st, claimed[1], &slot_st, RES_MEMORY) == 0 &&
+                     drive_st.valid_src && pick_home_slot(map, drive_st.full, drive_st.src_addr, slot_st.full) == slot;
+
+        /* A volume that will not unmount is in use: leave the disc alone */
+        io_service_t service = ready ? find_changer_drive_service(handle, claimed[0], (int)d + 1) : IO_OBJECT_NULL;
+        if (service != IO_OBJECT_NULL) {
+            char bsd[64];
+            ready = !(get_drive_bsd_name(service, bsd, sizeof(bsd)) && eject_optical_disk(bsd) != 0);
+            IOObjectRelease(service);
+        }
 
-    uint16_t slot_addr = map.slots.addrs[slot - 1];
-    uint16_t drive_addr = map.drives.count > 0 ? map.drives.addrs[0] : 0;
+        uint16_t transport = pick_transport(handle, map, &changer->layout, claimed[0], claimed[1]);
+        if (ready && cmd_move_medium(handle, transport, claimed[0], claimed[1]) == 0) {
+            pthread_mutex_lock(&changer->idle.lock);
+            changer->idle.returned_slot[d] = slot;
+            changer->idle.stats.returns++;
+            pthread_mutex_unlock(&changer->idle.lock);
+        }
+        release_elements(changer, claimed, 2);
+    }
+}
 
-    ElementStatus internal_st = {0};
-    int rc = read_element_status_info(&changer->internal, drive_addr, NULL, slot_addr, &internal_st);
-    element_map_free(&map);
+static void *idle_return_thread(void *arg) {
+    MChangerHandle *changer = arg;
+    IdleReturn *idle = &changer->idle;
+
+    pthread_mutex_lock(&idle->lock);
+    while (!idle->stopping) {
+        double remaining = idle->last_activity + idle->idle_secs - monotonic_secs();
+        if (remaining > 0) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += (time_t)remaining;
+            until.tv_nsec += (long)((remaining - (double)(time_t)remaining) * 1e9);
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&idle->cond, &idle->lock, &until);
+            continue;
+        }
 
-    if (rc != 0) return MCHANGER_ERR_SCSI;
+        /* Calls on other elements go ahead meanwhile; execute_cdb() routes SBP2 replies here */
+        pthread_mutex_unlock(&idle->lock);
+        idle_return_discs(changer);
+        pthread_mutex_lock(&idle->lock);
 
-    out_status->address = internal_st.addr;
-    out_status->full = internal_st.full;
-    out_status->except = false; /* TODO: extract from flags */
-    out_status->valid_source = internal_st.valid_src;
-    out_status->source_addr = internal_st.src_addr;
+        /* Returns that failed (busy volume) are retried after another idle period */
+        idle->last_activity = monotonic_secs();
+    }
+    pthread_mutex_unlock(&idle->lock);
+    return NULL;
+}
 
+int mchanger_set_idle_return(MChangerHandle *changer, int idle_secs) {
+    if (!changer || idle_secs < 0) return MCHANGER_ERR_INVALID;
+    IdleReturn *idle = &changer->idle;
+
+    if (idle->running) {
+        pthread_mutex_lock(&idle->lock);
+        idle->stopping = true;
+        pthread_cond_signal(&idle->cond);
+        pthread_mutex_unlock(&idle->lock);
+        pthread_join(idle->thread, NULL);
+        idle->running = false;
+    }
+    idle->idle_secs = idle_secs;
+    if (idle_secs == 0) return MCHANGER_OK;
+
+    idle->stopping = false;
+    idle->last_activity = monotonic_secs();
+    if (pthread_create(&idle->thread, NULL, idle_return_thread, changer) != 0) return MCHANGER_ERR_BUSY;
+    idle->running = true;
     return MCHANGER_OK;
 }
 
-int mchanger_get_drive_status(MChangerHandle *changer, int drive, MChangerElementStatus *out_status) {
-    if (!changer || !out_status || drive < 1) return MCHANGER_ERR_INVALID;
+void mchanger_get_idle_stats(MChangerHandle *changer, MChangerIdleStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!changer) return;
+    bool locked = changer->idle.running;
+    if (locked) pthread_mutex_lock(&changer->idle.lock);
+    *out = changer->idle.stats;
+    if (locked) pthread_mutex_unlock(&changer->idle.lock);
+}
 
-    ElementMap map = {0};
-    if (fetch_element_map(&changer->internal, &map) != 0) return MCHANGER_ERR_SCSI;
+int mchanger_set_slot_layout(MChangerHandle *changer, int near_slot, bool ring) {
+    if (!changer || near_slot < 0) return MCHANGER_ERR_INVALID;
+    changer->layout.near_slot = near_slot;
+    changer->layout.ring = ring;
+    return MCHANGER_OK;
+}
 
-    if ((size_t)drive > map.drives.count) {
-        element_map_free(&map);
-        return MCHANGER_ERR_INVALID;
-    }
+int mchanger_pick_free_slot(MChangerHandle *changer, bool hot, int *out_slot) {
+    if (out_slot) *out_slot = 0;
+    if (!changer || !out_slot) return MCHANGER_ERR_INVALID;
+
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    bool *full = calloc(map->slots.count ? map->slots.count : 1, sizeof(bool));
+    bool *loaded = calloc(map->slots.count ? map->slots.count : 1, sizeof(bool));
+    int rc = full && loaded ? read_placement_state(&changer->internal, map, full, loaded) : MCHANGER_ERR_INVALID;
+    if (rc == MCHANGER_OK) {
+        *out_slot = pick_free_slot(&changer->layout, full, map->slots.count, hot);
+        if (*out_slot == 0) rc = MCHANGER_ERR_NOT_FOUND;
+    }
+    free(full);
+    free(loaded);
+    return rc;
+}
 
-    uint16_t drive_addr = map.drives.addrs[drive - 1];
+static int rebalance_held(MChangerHandle *changer, size_t max_moves, size_t *out_moves) {
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    size_t slots = map->slots.count;
+    if (max_moves == 0 || max_moves > 2 * slots) max_moves = 2 * slots;
+
+    bool *full = calloc(slots ? slots : 1, sizeof(bool));
+    bool *loaded = calloc(slots ? slots : 1, sizeof(bool));
+    SlotMove *moves = calloc(max_moves ? max_moves : 1, sizeof(SlotMove));
+    int rc = full && loaded && moves ? read_placement_state(&changer->internal, map, full, loaded)
+                                     : MCHANGER_ERR_INVALID;
+    if (rc == MCHANGER_OK) {
+        size_t planned = plan_rebalance(&changer->layout, changer->catalog, full, loaded, slots, max_moves, moves);
+        rc = run_slot_moves(&changer->internal, changer->catalog, map, moves, planned, out_moves);
+    }
+    free(full);
+    free(loaded);
+    free(moves);
+    return rc;
+}
 
-    ElementStatus internal_st = {0};
-    int rc = read_element_status_info(&changer->internal, drive_addr, &internal_st, 0, NULL);
-    element_map_free(&map);
+int mchanger_rebalance(MChangerHandle *changer, size_t max_moves, size_t *out_moves) {
+    if (out_moves) *out_moves = 0;
+    if (!changer || !changer->catalog) return MCHANGER_ERR_INVALID;
+    claim_changer(changer);
+    int rc = rebalance_held(changer, max_moves, out_moves);
+    release_changer(changer);
+    return rc;
+}
 
-    if (rc != 0) return MCHANGER_ERR_SCSI;
+int mchanger_estimate_move_ms(MChangerHandle *changer, uint16_t transport, uint16_t source, uint16_t dest,
+                              uint32_t *out_ms) {
+    if (out_ms) *out_ms = 0;
+    if (!changer || !out_ms) return MCHANGER_ERR_INVALID;
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    double ms;
+    if (!motion_estimate(changer->internal.motion, map, &changer->layout, transport, source, dest, &ms)) {
+        return MCHANGER_ERR_NOT_FOUND;
+    }
+    *out_ms = (uint32_t)(ms + 0.5);
+    return MCHANGER_OK;
+}
 
-    out_status->address = internal_st.addr;
-    out_status->full = internal_st.full;
-    out_status->except = false;
-    out_status->valid_source = internal_st.valid_src;
-    out_status->source_addr = internal_st.src_addr;
+/* Load plus the unload that later returns the disc, through a drive */
+static bool estimate_visit_ms(MChangerHandle *changer, int slot, int drive, double *out_ms) {
+    const ElementMap *map = handle_map(changer);
+    if (!map || slot < 1 || (size_t)slot > map->slots.count || drive < 1 || (size_t)drive > map->drives.count) {
+        return false;
+    }
+    uint16_t slot_addr = element_addr(&map->slots, slot - 1);
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+    uint16_t transport = pick_transport(&changer->internal, map, &changer->layout, slot_addr, drive_addr);
+    double load, unload;
+    if (!motion_estimate(changer->internal.motion, map, &changer->layout, transport, slot_addr, drive_addr, &load) ||
+        !motion_estimate(changer->internal.motion, map, &changer->layout, transport, drive_addr, slot_addr, &unload)) {
+        return false;
+    }
+    *out_ms = load + unload;
+    return true;
+}
 
-    return MCHANGER_OK;
+int mchanger_calibrate(MChangerHandle *changer, size_t moves, size_t *out_moves) {
+    if (out_moves) *out_moves = 0;
+    if (!changer) return MCHANGER_ERR_INVALID;
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    if (!changer->internal.motion) return MCHANGER_ERR_OPEN;
+    claim_changer(changer);
+    size_t made = calibrate_motion(&changer->internal, map, &changer->layout, moves);
+    release_changer(changer);
+    if (out_moves) *out_moves = made;
+    return made > 0 || moves < 2 ? MCHANGER_OK : MCHANGER_ERR_SCSI;
 }
 
-int mchanger_get_bulk_status(MChangerHandle *changer,
-                             const uint16_t *slot_addrs,
-                             size_t slot_count,
-                             uint16_t drive_addr,
-                             MChangerElementStatus *out_drive,
-                             MChangerElementStatus *out_slots,
-                             bool *out_drive_supported) {
-    if (!changer || !out_slots) return MCHANGER_ERR_INVALID;
-    if (slot_count > 0 && !slot_addrs) return MCHANGER_ERR_INVALID;
+int mchanger_save_inventory(MChangerHandle *changer, const char *path) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    char default_path[1024];
+    if (!path || !*path) {
+        if (!inventory_default_path(default_path, sizeof(default_path))) return MCHANGER_ERR_OPEN;
+        path = default_path;
+    }
+    /* Status reads only: nothing to claim */
+    Inventory inv;
+    int rc = handle_inventory_read(changer, &inv);
+    if (rc == MCHANGER_OK) rc = inventory_save(&inv, path);
+    inventory_free(&inv);
+    return rc;
+}
 
-    if (out_drive_supported) *out_drive_supported = false;
+int mchanger_plan_batch(const char *inventory_path, const char *ops_path, const MChangerPlanOptions *options,
+                        MChangerPlanResult *out) {
+    if (out) memset(out, 0, sizeof(*out));
+    if (!ops_path || !out || (options && options->near_slot < 0)) return MCHANGER_ERR_INVALID;
+    MChangerPlanOptions defaults = {0};
+    if (!options) options = &defaults;
+    char default_path[1024];
+    if (!inventory_path || !*inventory_path) {
+        if (!inventory_default_path(default_path, sizeof(default_path))) return MCHANGER_ERR_OPEN;
+        inventory_path = default_path;
+    }
+
+    Inventory inv;
+    int rc = inventory_load(inventory_path, &inv);
+    if (rc != MCHANGER_OK) return rc;
+    FILE *ops = fopen(ops_path, "r");
+    if (!ops) {
+        inventory_free(&inv);
+        return MCHANGER_ERR_OPEN;
+    }
+
+    SlotLayout layout = { options->near_slot, options->ring };
+    MotionLog *motion = motion_open(options->motion_path);
+    PlanRun run = { motion, &layout, options->catalog, 0, 0, 0, true, false };
+    plan_ops(&inv, &run, ops, &out->operations, &out->illegal);
+    fclose(ops);
+
+    out->moves = run.moves;
+    out->estimated = run.moves > 0 && run.estimated;
+    if (out->estimated) out->robot_ms = (uint32_t)(run.robot_ms + 0.5);
+    if (options->save_path) rc = inventory_save(&inv, options->save_path);
+    motion_close(motion);
+    inventory_free(&inv);
+    return rc;
+}
 
-    /* Initialize outputs to "empty/unknown" */
-    for (size_t i = 0; i < slot_count; i++) {
-        out_slots[i].address = slot_addrs[i];
-        out_slots[i].full = false;
-        out_slots[i].except = false;
-        out_slots[i].valid_source = false;
-        out_slots[i].source_addr = 0;
+int mchanger_publish_board(MChangerHandle *changer, const char *name) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    if (!changer->internal.board) {
+        StatusBoard *board = board_create(name);
+        if (!board) return MCHANGER_ERR_OPEN;
+        /* Another thread's moves see the board only once it is filled in */
+        int rc = MCHANGER_OK;
+        if (!prefetch_publish(changer, board)) {
+            Inventory inv;
+            rc = handle_inventory_read(changer, &inv);
+            if (rc == MCHANGER_OK) board_publish(board, &inv);
+            inventory_free(&inv);
+        }
+        if (rc != MCHANGER_OK) {
+            board_close(board);
+            return rc;
+        }
+        StatusBoard *expected = NULL;
+        if (!__atomic_compare_exchange_n(&changer->internal.board, &expected, board, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            board_close(board);
+            return MCHANGER_ERR_BUSY;
+        }
+        return MCHANGER_OK;
+    }
+    /* Already published: re-read, e.g. after discs were added through the door */
+    Inventory inv;
+    int rc = handle_inventory_read(changer, &inv);
+    if (rc == MCHANGER_OK) board_publish(changer->internal.board, &inv);
+    inventory_free(&inv);
+    return rc;
+}
+
+MChangerBoard *mchanger_board_attach(const char *name) {
+    int fd = shm_open(board_name(name), O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BoardSegment)) {
+        close(fd);
+        return NULL;
+    }
+    void *mem = mmap(NULL, sizeof(BoardSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) return NULL;
+    const BoardSegment *seg = mem;
+    if (seg->magic != BOARD_MAGIC || seg->version != BOARD_VERSION) {
+        munmap(mem, sizeof(BoardSegment));
+        return NULL;
+    }
+    MChangerBoard *board = calloc(1, sizeof(MChangerBoard));
+    if (!board) {
+        munmap(mem, sizeof(BoardSegment));
+        return NULL;
     }
+    board->seg = seg;
+    return board;
+}
 
-    if (out_drive) {
-        out_drive->address = drive_addr;
-        out_drive->full = false;
-        out_drive->except = false;
-        out_drive->valid_source = false;
-        out_drive->source_addr = 0;
+int mchanger_board_read(MChangerBoard *board, MChangerBoardSnapshot *out) {
+    if (!board || !out) return MCHANGER_ERR_INVALID;
+    for (int i = 0; i < BOARD_READ_RETRIES; i++) {
+        if (board_try_copy(board->seg, out)) return MCHANGER_OK;
+        /* A write takes microseconds; let the owner finish it */
+        if (i % 64 == 63) sched_yield();
     }
+    return MCHANGER_ERR_BUSY;
+}
 
-    uint32_t alloc = 4096;
-    uint8_t cdb[12] = {0};
-    cdb[0] = 0xB8; // READ ELEMENT STATUS
-    cdb[1] = 0x00; // all element types
-    cdb[4] = 0xFF;
-    cdb[5] = 0xFF;
-    cdb[6] = (alloc >> 16) & 0xFF;
-    cdb[7] = (alloc >> 8) & 0xFF;
-    cdb[8] = alloc & 0xFF;
+void mchanger_board_detach(MChangerBoard *board) {
+    if (!board) return;
+    munmap((void *)board->seg, sizeof(BoardSegment));
+    free(board);
+}
 
-    uint8_t *buf = calloc(1, alloc);
-    if (!buf) return MCHANGER_ERR_INVALID;
+struct MChangerWatch {
+    MChangerHandle *changer;
+    Watch w;
+};
+
+MChangerWatch *mchanger_watch_open(MChangerHandle *changer) {
+    if (!changer) return NULL;
+    MChangerWatch *watch = calloc(1, sizeof(MChangerWatch));
+    if (!watch) return NULL;
+    watch->changer = changer;
+    if (watch_open(&changer->internal, &watch->w) != 0) {
+        mchanger_watch_close(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+int mchanger_watch_poll(MChangerWatch *watch, MChangerEvent *events, size_t max_events, size_t *out_count) {
+    if (out_count) *out_count = 0;
+    if (!watch || !events || max_events == 0 || !out_count) return MCHANGER_ERR_INVALID;
+    Watch *w = &watch->w;
+    /* Hand out what the last poll found before reading again */
+    if (w->next >= w->count) {
+        if (watch_poll(&watch->changer->internal, w) != 0) return MCHANGER_ERR_SCSI;
+    }
+    size_t n = w->count - w->next < max_events ? w->count - w->next : max_events;
+    memcpy(events, w->events + w->next, n * sizeof(MChangerEvent));
+    w->next += n;
+    *out_count = n;
+    return MCHANGER_OK;
+}
 
-    int rc = execute_cdb(&changer->internal, cdb, sizeof(cdb), buf, alloc,
-                         kSCSIDataTransfer_FromTargetToInitiator, 30000);
-    if (rc != 0) {
-        free(buf);
-        return MCHANGER_ERR_SCSI;
-    }
+void mchanger_watch_close(MChangerWatch *watch) {
+    if (!watch) return;
+    watch_free(&watch->w);
+    free(watch);
+}
 
-    uint32_t report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
-    uint32_t needed = report_bytes > 0 ? report_bytes + 8 : 0;
-    if (needed > alloc && needed < 65535) {
-        free(buf);
-        alloc = needed;
-        buf = calloc(1, alloc);
-        if (!buf) return MCHANGER_ERR_INVALID;
-        cdb[6] = (alloc >> 16) & 0xFF;
-        cdb[7] = (alloc >> 8) & 0xFF;
-        cdb[8] = alloc & 0xFF;
+int mchanger_scan_library(MChangerHandle *changer, bool restart, int timeout_secs,
+                          MChangerScanCallback callback, void *context) {
+    if (!changer || !changer->catalog) return MCHANGER_ERR_INVALID;
+    claim_changer(changer);
+    int rc = scan_library(&changer->internal, changer->catalog, restart, timeout_secs, callback, context);
+    release_changer(changer);
+    return rc;
+}
 
-        rc = execute_cdb(&changer->internal, cdb, sizeof(cdb), buf, alloc,
-                         kSCSIDataTransfer_FromTargetToInitiator, 30000);
-        if (rc != 0) {
-            free(buf);
-            return MCHANGER_ERR_SCSI;
-        }
-        report_bytes = (buf[5] << 16) | (buf[6] << 8) | buf[7];
-    }
+static int fetch_image_held(MChangerHandle *changer, MChangerImageCache *cache, int slot, int drive,
+                            char *out_path, size_t path_len) {
+    if (!changer || !cache || slot < 1 || drive < 1 || !out_path || path_len == 0) return MCHANGER_ERR_INVALID;
+    out_path[0] = '\0';
 
-    uint32_t parse_len = alloc;
-    if (report_bytes > 0 && report_bytes + 8 < parse_len) {
-        parse_len = report_bytes + 8;
-    }
-    if (parse_len < 8) {
-        free(buf);
+    /* Cached under the fingerprint the catalog expects: no robot, no mount */
+    MChangerCatalogEntry entry;
+    if (mchanger_catalog_get(changer->catalog, slot, &entry) == MCHANGER_OK && entry.fingerprint[0] &&
+        mchanger_cache_lookup(cache, entry.fingerprint, out_path, path_len) == MCHANGER_OK) {
         return MCHANGER_OK;
     }
 
-    bool drive_page_present = false;
+    DiscInfo disc;
+    int rc = load_slot(changer, slot, drive, NULL, NULL, true, &disc);
+    if (rc != MCHANGER_OK) return rc;
+    if (!disc.fingerprint[0]) return MCHANGER_ERR_SCSI;
 
-    /* Parse element status pages (same wire format as read_element_status_info()) */
-    uint32_t offset = 8;
-    while (offset + 8 <= parse_len) {
-        uint8_t elem_type = buf[offset];
-        uint16_t desc_len = (buf[offset + 2] << 8) | buf[offset + 3];
-        uint32_t page_bytes = (buf[offset + 5] << 16) | (buf[offset + 6] << 8) | buf[offset + 7];
-        offset += 8;
+    /* The catalog may not have known this disc yet */
+    if (mchanger_cache_lookup(cache, disc.fingerprint, out_path, path_len) == MCHANGER_OK) {
+        return MCHANGER_OK;
+    }
 
-        if (desc_len == 0 || page_bytes == 0) break;
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    uint16_t drive_addr = (size_t)drive <= map->drives.count ? element_addr(&map->drives, drive - 1) : 0;
 
-        uint32_t page_end = offset + page_bytes;
-        if (page_end > parse_len) page_end = parse_len;
+    io_service_t service = find_changer_drive_service(&changer->internal, drive_addr, drive);
+    if (service == IO_OBJECT_NULL) return MCHANGER_ERR_NOT_FOUND;
+    rc = cache_store_from_drive(cache, service, &disc, out_path, path_len);
+    IOObjectRelease(service);
+    return rc;
+}
 
-        if (elem_type == 0x04) {
-            drive_page_present = true;
-        }
+int mchanger_fetch_image(MChangerHandle *changer, MChangerImageCache *cache, int slot, int drive,
+                         char *out_path, size_t path_len) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    uint16_t claimed[3];
+    size_t n;
+    int rc = claim_drive_swap(changer, slot, drive, claimed, &n);
+    if (rc != MCHANGER_OK) return rc;
+    rc = fetch_image_held(changer, cache, slot, drive, out_path, path_len);
+    release_elements(changer, claimed, n);
+    return rc;
+}
 
-        while (offset + desc_len <= page_end) {
-            uint16_t elem_addr = (buf[offset] << 8) | buf[offset + 1];
-            uint8_t elem_flags = buf[offset + 2];
-            bool full = (elem_flags & 0x01) != 0;
+/*
+ * Read job queue
+ *
+ * Jobs are kept in arrival order. Only jobs of the most urgent class waiting
+ * are considered, after aging and deadlines have lifted jobs between classes.
+ * The worker stays on the loaded disc while it has such jobs, up to max_batch
+ * in a row if other discs are waiting, and leaves it early if some other job
+ * has waited longer than max_wait_secs. When it does switch, it goes to the
+ * disc of the job with the earliest deadline, or else the oldest one.
+ */
 
-            bool svalid = false;
-            uint16_t src = 0;
-            if (desc_len >= 12) {
-                svalid = (buf[offset + 9] & 0x80) != 0;
-                src = (buf[offset + 10] << 8) | buf[offset + 11];
-            }
+typedef struct QueueJob {
+    struct QueueJob *next;
+    int slot;
+    MChangerJobFn fn;
+    void *context;
+    MChangerJobPriority priority;
+    double submitted;
+    double deadline;            /* monotonic seconds, 0 for none */
+} QueueJob;
+
+struct MChangerJobQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    QueueJob *head;             /* oldest first */
+    QueueJob *tail;
+    size_t pending;
+    MChangerQueueOptions options;
+    int current_slot;           /* disc in the worker's drive (0 if unknown) */
+    size_t batch_served;        /* jobs served from current_slot in a row */
+    int running_class;          /* class of the job being run, -1 if none */
+    bool stopping;
+    MChangerQueueStats stats;
+};
 
-            if (out_drive && drive_addr != 0 && elem_addr == drive_addr) {
-                out_drive->full = full;
-                out_drive->valid_source = svalid;
-                out_drive->source_addr = src;
-            }
+MChangerJobQueue *mchanger_queue_create(const MChangerQueueOptions *options) {
+    MChangerJobQueue *queue = calloc(1, sizeof(MChangerJobQueue));
+    if (!queue) return NULL;
+    if (options) queue->options = *options;
+    if (queue->options.max_batch == 0) queue->options.max_batch = 32;
+    if (queue->options.max_wait_secs <= 0) queue->options.max_wait_secs = 300;
+    if (queue->options.aging_secs <= 0) queue->options.aging_secs = 600;
+    queue->running_class = -1;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    return queue;
+}
 
-            /* Fill any matching slot entry */
-            for (size_t i = 0; i < slot_count; i++) {
-                if (slot_addrs[i] == elem_addr) {
-                    out_slots[i].full = full;
-                    out_slots[i].valid_source = svalid;
-                    out_slots[i].source_addr = src;
-                    break;
-                }
-            }
+void mchanger_queue_destroy(MChangerJobQueue *queue) {
+    if (!queue) return;
+    QueueJob *job = queue->head;
+    while (job) {
+        QueueJob *next = job->next;
+        free(job);
+        job = next;
+    }
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
 
-            offset += desc_len;
-        }
+int mchanger_queue_submit(MChangerJobQueue *queue, int slot, MChangerJobFn fn, void *context) {
+    return mchanger_queue_submit_ex(queue, slot, MCHANGER_PRIORITY_BATCH, 0, fn, context);
+}
 
-        if (offset < page_end) {
-            offset = page_end;
-        }
+int mchanger_queue_submit_ex(MChangerJobQueue *queue, int slot, MChangerJobPriority priority,
+                             double deadline_secs, MChangerJobFn fn, void *context) {
+    if (!queue || slot < 1 || !fn || priority < MCHANGER_PRIORITY_INTERACTIVE ||
+        priority > MCHANGER_PRIORITY_BACKGROUND || deadline_secs < 0) {
+        return MCHANGER_ERR_INVALID;
     }
-
-    if (out_drive_supported) *out_drive_supported = drive_page_present;
-    free(buf);
+    QueueJob *job = calloc(1, sizeof(QueueJob));
+    if (!job) return MCHANGER_ERR_INVALID;
+    job->slot = slot;
+    job->fn = fn;
+    job->context = context;
+    job->priority = priority;
+    job->submitted = monotonic_secs();
+    job->deadline = deadline_secs > 0 ? job->submitted + deadline_secs : 0;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail) {
+        queue->tail->next = job;
+    } else {
+        queue->head = job;
+    }
+    queue->tail = job;
+    queue->pending++;
+    queue->stats.submitted++;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
     return MCHANGER_OK;
 }
 
-/* Load a disc from slot into drive */
-int mchanger_load_slot(MChangerHandle *changer, int slot, int drive) {
-    return mchanger_load_slot_verbose(changer, slot, drive, NULL, NULL);
+size_t mchanger_queue_pending(MChangerJobQueue *queue) {
+    if (!queue) return 0;
+    pthread_mutex_lock(&queue->lock);
+    size_t pending = queue->pending;
+    pthread_mutex_unlock(&queue->lock);
+    return pending;
 }
 
-int mchanger_load_slot_verbose(MChangerHandle *changer, int slot, int drive,
-                           MChangerMountCallback callback, void *context) {
-    if (!changer || slot < 1 || drive < 1) return MCHANGER_ERR_INVALID;
+/*
+ * Class a job competes in now: one class more urgent for every aging_secs it
+ * has waited, and interactive once its deadline is less than aging_secs away.
+ */
+static int queue_job_class(const MChangerJobQueue *queue, const QueueJob *job, double now) {
+    if (job->deadline > 0 && job->deadline - now < queue->options.aging_secs) return MCHANGER_PRIORITY_INTERACTIVE;
+    int lift = (int)((now - job->submitted) / queue->options.aging_secs);
+    int cls = (int)job->priority - lift;
+    return cls > MCHANGER_PRIORITY_INTERACTIVE ? cls : MCHANGER_PRIORITY_INTERACTIVE;
+}
 
-    ElementMap map = {0};
-    if (fetch_element_map(&changer->internal, &map) != 0) return MCHANGER_ERR_SCSI;
+/* Within a class: earliest deadline first, then arrival order */
+static bool queue_job_before(const QueueJob *a, const QueueJob *b) {
+    if (a->deadline > 0 || b->deadline > 0) {
+        if (b->deadline == 0) return true;
+        if (a->deadline == 0) return false;
+        if (a->deadline != b->deadline) return a->deadline < b->deadline;
+    }
+    return a->submitted < b->submitted;
+}
 
-    if ((size_t)slot > map.slots.count || (size_t)drive > map.drives.count) {
-        element_map_free(&map);
-        return MCHANGER_ERR_INVALID;
+/* Most urgent class with a pending job. Caller holds the lock. */
+static int queue_top_class_locked(const MChangerJobQueue *queue, double now) {
+    int top = MCHANGER_PRIORITY_BACKGROUND;
+    for (const QueueJob *job = queue->head; job && top > MCHANGER_PRIORITY_INTERACTIVE; job = job->next) {
+        int cls = queue_job_class(queue, job, now);
+        if (cls < top) top = cls;
     }
+    return top;
+}
 
-    uint16_t transport = map.transports.count > 0 ? map.transports.addrs[0] : 0;
-    uint16_t slot_addr = map.slots.addrs[slot - 1];
-    uint16_t drive_addr = map.drives.addrs[drive - 1];
+/* Most urgent class among a slot's jobs, past background if it has none. Caller holds the lock. */
+static int queue_slot_class_locked(const MChangerJobQueue *queue, int slot, double now) {
+    int best = MCHANGER_PRIORITY_BACKGROUND + 1;
+    for (const QueueJob *job = queue->head; job; job = job->next) {
+        if (job->slot != slot) continue;
+        int cls = queue_job_class(queue, job, now);
+        if (cls < best) best = cls;
+    }
+    return best;
+}
 
-    /* Check current status */
-    ElementStatus drive_st = {0}, slot_st = {0};
-    if (read_element_status_info(&changer->internal, drive_addr, &drive_st, slot_addr, &slot_st) != 0) {
-        element_map_free(&map);
-        return MCHANGER_ERR_SCSI;
+/* Choose the slot to serve next. Caller holds the lock. */
+static int queue_pick_slot_locked(const MChangerJobQueue *queue, double now) {
+    if (!queue->head) return 0;
+
+    int top = queue_top_class_locked(queue, now);
+    bool current_has_jobs = false;
+    const QueueJob *best_other = NULL;
+    const QueueJob *oldest_other = NULL;
+    for (const QueueJob *job = queue->head; job; job = job->next) {
+        if (queue_job_class(queue, job, now) != top) continue;
+        if (job->slot == queue->current_slot) {
+            current_has_jobs = true;
+            continue;
+        }
+        if (!oldest_other) oldest_other = job;
+        if (!best_other || queue_job_before(job, best_other)) best_other = job;
     }
 
-    /* Already loaded? */
-    if (!slot_st.full && drive_st.full && drive_st.valid_src && drive_st.src_addr == slot_addr) {
-        element_map_free(&map);
-        return MCHANGER_OK;
+    /* The loaded disc keeps the drive only for work as urgent as any waiting */
+    if (current_has_jobs) {
+        if (!best_other) return queue->current_slot;
+        bool batch_left = queue->batch_served < queue->options.max_batch;
+        bool other_overdue = now - oldest_other->submitted >= queue->options.max_wait_secs;
+        if (batch_left && !other_overdue) return queue->current_slot;
     }
+    return best_other ? best_other->slot : queue->current_slot;
+}
 
-    /* Slot empty and disc not in drive? */
-    if (!slot_st.full && !(drive_st.full && drive_st.valid_src && drive_st.src_addr == slot_addr)) {
-        element_map_free(&map);
-        return MCHANGER_ERR_EMPTY;
+int mchanger_queue_next_slot(MChangerJobQueue *queue) {
+    if (!queue) return 0;
+    pthread_mutex_lock(&queue->lock);
+    int slot = queue_pick_slot_locked(queue, monotonic_secs());
+    pthread_mutex_unlock(&queue->lock);
+    return slot;
+}
+
+/* Take the most urgent job for a slot off the queue. Caller holds the lock. */
+static QueueJob *queue_take_locked(MChangerJobQueue *queue, int slot, double now) {
+    QueueJob *best = NULL, *best_prev = NULL;
+    int best_class = 0;
+    QueueJob *prev = NULL;
+    for (QueueJob *job = queue->head; job; prev = job, job = job->next) {
+        if (job->slot != slot) continue;
+        int cls = queue_job_class(queue, job, now);
+        if (!best || cls < best_class || (cls == best_class && queue_job_before(job, best))) {
+            best = job;
+            best_prev = prev;
+            best_class = cls;
+        }
+    }
+    if (!best) return NULL;
+    if (best_prev) {
+        best_prev->next = best->next;
+    } else {
+        queue->head = best->next;
     }
+    if (queue->tail == best) queue->tail = best_prev;
+    best->next = NULL;
+    queue->pending--;
+    queue->running_class = best_class;
+    return best;
+}
 
-    int rc = 0;
+bool mchanger_queue_should_yield(MChangerJobQueue *queue) {
+    if (!queue) return false;
+    pthread_mutex_lock(&queue->lock);
+    bool yield = queue->running_class > MCHANGER_PRIORITY_INTERACTIVE && queue->head &&
+                 queue_top_class_locked(queue, monotonic_secs()) < queue->running_class;
+    pthread_mutex_unlock(&queue->lock);
+    return yield;
+}
 
-    /* If drive has a different disc, unload it first */
-    if (drive_st.full) {
-        uint16_t unload_addr = drive_st.valid_src ? drive_st.src_addr : slot_addr;
-        eject_optical_media();
-        rc = cmd_move_medium(&changer->internal, transport, drive_addr, unload_addr);
-        if (rc != 0) {
-            element_map_free(&map);
-            return MCHANGER_ERR_SCSI;
+/* Load a slot for the queue and describe the mounted disc */
+static int queue_load_disc(MChangerHandle *changer, int slot, int drive, MChangerJobDisc *disc) {
+    memset(disc, 0, sizeof(*disc));
+    DiscInfo id;
+    int rc = load_slot(changer, slot, drive, NULL, NULL, changer->catalog != NULL, &id);
+    if (rc != MCHANGER_OK) return rc;
+
+    disc->slot = slot;
+    disc->drive = drive;
+    snprintf(disc->fingerprint, sizeof(disc->fingerprint), "%s", id.fingerprint);
+
+    DiscInfo mounted;
+    if (wait_for_disc(&mounted, 30) == MCHANGER_OK) {
+        catalog_note_mount(changer->catalog, slot, &mounted);
+        snprintf(disc->volume, sizeof(disc->volume), "%s", mounted.name);
+        resolve_mount_path(&mounted, disc->mount_path, sizeof(disc->mount_path));
+    }
+    return MCHANGER_OK;
+}
+
+int mchanger_queue_run(MChangerJobQueue *queue, MChangerHandle *changer, int drive, bool wait) {
+    if (!queue || !changer || drive < 1) return MCHANGER_ERR_INVALID;
+
+    MChangerJobDisc disc = {0};
+    bool disc_ok = false;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->stopping = false;
+    for (;;) {
+        while (!queue->head && wait && !queue->stopping) {
+            pthread_cond_wait(&queue->cond, &queue->lock);
         }
+        if (!queue->head || queue->stopping) break;
+
+        double now = monotonic_secs();
+        int slot = queue_pick_slot_locked(queue, now);
+        bool swap = slot != queue->current_slot || !disc_ok;
+        if (slot != queue->current_slot) {
+            /* Leaving a disc that still has work because more urgent work is waiting */
+            int left = queue_slot_class_locked(queue, queue->current_slot, now);
+            if (left <= MCHANGER_PRIORITY_BACKGROUND && left > queue_top_class_locked(queue, now)) {
+                queue->stats.preempted++;
+            }
+            queue->current_slot = slot;
+            queue->batch_served = 0;
+        }
+
+        if (swap) {
+            /* Load without holding the lock so submitters never wait on the robot */
+            pthread_mutex_unlock(&queue->lock);
+            int rc = queue_load_disc(changer, slot, drive, &disc);
+            pthread_mutex_lock(&queue->lock);
+            disc_ok = rc == MCHANGER_OK;
+            queue->stats.loads++;
+        }
+
+        QueueJob *job = queue_take_locked(queue, slot, monotonic_secs());
+        if (!job) continue;
+        queue->batch_served++;
+        pthread_mutex_unlock(&queue->lock);
+
+        /* The job is using the disc: keep its drive and slot */
+        uint16_t claimed[3];
+        size_t n = 0;
+        claim_drive_swap(changer, slot, drive, claimed, &n);
+        int result = job->fn(disc_ok ? &disc : NULL, job->context);
+        release_elements(changer, claimed, n);
+        free(job);
+
+        pthread_mutex_lock(&queue->lock);
+        queue->running_class = -1;
+        queue->stats.served++;
+        if (result != 0 || !disc_ok) queue->stats.failed++;
+        /* A failed load is retried for the next job rather than trusted */
+        if (!disc_ok) queue->current_slot = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return MCHANGER_OK;
+}
+
+void mchanger_queue_stop(MChangerJobQueue *queue) {
+    if (!queue) return;
+    pthread_mutex_lock(&queue->lock);
+    queue->stopping = true;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+int mchanger_queue_estimate_ms(MChangerJobQueue *queue, MChangerHandle *changer, int drive, uint64_t *out_ms) {
+    if (out_ms) *out_ms = 0;
+    if (!queue || !changer || !out_ms) return MCHANGER_ERR_INVALID;
+
+    /* Every other disc with pending jobs costs one load and one unload */
+    pthread_mutex_lock(&queue->lock);
+    size_t slot_count = 0;
+    for (QueueJob *job = queue->head; job; job = job->next) slot_count++;
+    int *slots = calloc(slot_count ? slot_count : 1, sizeof(int));
+    size_t distinct = 0;
+    for (QueueJob *job = queue->head; job && slots; job = job->next) {
+        if (job->slot == queue->current_slot) continue;
+        bool seen = false;
+        for (size_t i = 0; i < distinct && !seen; i++) seen = slots[i] == job->slot;
+        if (!seen) slots[distinct++] = job->slot;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    if (!slots) return MCHANGER_ERR_INVALID;
+
+    double total = 0;
+    int rc = MCHANGER_OK;
+    for (size_t i = 0; i < distinct; i++) {
+        double ms;
+        if (!estimate_visit_ms(changer, slots[i], drive, &ms)) {
+            rc = MCHANGER_ERR_NOT_FOUND;
+            break;
+        }
+        total += ms;
     }
+    free(slots);
+    if (rc == MCHANGER_OK) *out_ms = (uint64_t)(total + 0.5);
+    return rc;
+}
 
-    /* Load the disc */
-    rc = cmd_move_medium(&changer->internal, transport, slot_addr, drive_addr);
-    element_map_free(&map);
+void mchanger_queue_get_stats(MChangerJobQueue *queue, MChangerQueueStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!queue) return;
+    pthread_mutex_lock(&queue->lock);
+    *out = queue->stats;
+    pthread_mutex_unlock(&queue->lock);
+}
 
-    if (rc != 0) return MCHANGER_ERR_SCSI;
+int mchanger_identify_disc(MChangerHandle *changer, int drive, int timeout_secs, MChangerDiscId *out) {
+    if (!changer || drive < 1 || !out) return MCHANGER_ERR_INVALID;
+    memset(out, 0, sizeof(*out));
 
-    /* Notify about mounted disc if callback provided */
-    if (callback) {
-        char name[256] = {0}, size[64] = {0};
-        mchanger_wait_for_mount(name, sizeof(name), size, sizeof(size), 30);
-        callback(name[0] ? name : "Unknown", size[0] ? size : "?", context);
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    if ((size_t)drive > map->drives.count) {
+        return MCHANGER_ERR_INVALID;
     }
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
 
+    DiscInfo info;
+    int tracks = 0;
+    if (!claim_elements(changer, &drive_addr, 1, true)) return MCHANGER_ERR_BUSY;
+    int rc = identify_disc(&changer->internal, drive_addr, drive, timeout_secs, &info, &tracks);
+    release_elements(changer, &drive_addr, 1);
+    if (rc != MCHANGER_OK) return rc;
+
+    disc_id_from_info(&info, tracks, out);
     return MCHANGER_OK;
 }
 
@@ -3242,46 +10243,46 @@ int mchanger_load_slot_verbose(MChangerHandle *changer, int slot, int drive,
 int mchanger_unload_drive(MChangerHandle *changer, int slot, int drive) {
     if (!changer || slot < 1 || drive < 1) return MCHANGER_ERR_INVALID;
 
-    ElementMap map = {0};
-    if (fetch_element_map(&changer->internal, &map) != 0) return MCHANGER_ERR_SCSI;
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
 
-    if ((size_t)slot > map.slots.count || (size_t)drive > map.drives.count) {
-        element_map_free(&map);
+    if ((size_t)slot > map->slots.count || (size_t)drive > map->drives.count) {
         return MCHANGER_ERR_INVALID;
     }
 
-    uint16_t transport = map.transports.count > 0 ? map.transports.addrs[0] : 0;
-    uint16_t slot_addr = map.slots.addrs[slot - 1];
-    uint16_t drive_addr = map.drives.addrs[drive - 1];
+    uint16_t slot_addr = element_addr(&map->slots, slot - 1);
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+    uint16_t transport = pick_transport(&changer->internal, map, &changer->layout, drive_addr, slot_addr);
 
+    uint16_t claimed[2] = { drive_addr, slot_addr };
+    if (!claim_elements(changer, claimed, 2, true)) {
+        return MCHANGER_ERR_BUSY;
+    }
     eject_optical_media();
     int rc = cmd_move_medium(&changer->internal, transport, drive_addr, slot_addr);
-    element_map_free(&map);
+    release_elements(changer, claimed, 2);
 
-    return rc == 0 ? MCHANGER_OK : MCHANGER_ERR_SCSI;
+    return rc == 0 ? MCHANGER_OK : move_error(rc);
 }
 
-/* Eject a disc to the import/export slot */
-int mchanger_eject(MChangerHandle *changer, int slot, int drive) {
+/* Eject a disc to the import/export slot at *port, or the first one if port is NULL */
+static int eject_slot_held(MChangerHandle *changer, int slot, int drive, const uint16_t *port) {
     if (!changer || slot < 1 || drive < 1) return MCHANGER_ERR_INVALID;
 
-    ElementMap map = {0};
-    if (fetch_element_map(&changer->internal, &map) != 0) return MCHANGER_ERR_SCSI;
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
 
-    if ((size_t)slot > map.slots.count || (size_t)drive > map.drives.count || map.ie.count == 0) {
-        element_map_free(&map);
+    if ((size_t)slot > map->slots.count || (size_t)drive > map->drives.count || map->ie.count == 0) {
         return MCHANGER_ERR_INVALID;
     }
 
-    uint16_t transport = map.transports.count > 0 ? map.transports.addrs[0] : 0;
-    uint16_t slot_addr = map.slots.addrs[slot - 1];
-    uint16_t drive_addr = map.drives.addrs[drive - 1];
-    uint16_t ie_addr = map.ie.addrs[0];
+    uint16_t slot_addr = element_addr(&map->slots, slot - 1);
+    uint16_t drive_addr = element_addr(&map->drives, drive - 1);
+    uint16_t ie_addr = port ? *port : element_addr(&map->ie, 0);
 
     /* Check if disc is in drive */
     ElementStatus drive_st = {0}, slot_st = {0};
-    if (read_element_status_info(&changer->internal, drive_addr, &drive_st, slot_addr, &slot_st) != 0) {
-        element_map_free(&map);
+    if (read_element_pair(&changer->internal, drive_addr, &drive_st, slot_addr, &slot_st, 0) != 0) {
         return MCHANGER_ERR_SCSI;
     }
 
@@ -3290,71 +10291,268 @@ int mchanger_eject(MChangerHandle *changer, int slot, int drive) {
     /* If disc is in drive, unload to slot first */
     if (!slot_st.full && drive_st.full) {
         eject_optical_media();
-        rc = cmd_move_medium(&changer->internal, transport, drive_addr, slot_addr);
+        rc = cmd_move_medium(&changer->internal, pick_transport(&changer->internal, map, &changer->layout,
+                                                                drive_addr, slot_addr), drive_addr, slot_addr);
         if (rc != 0) {
-            element_map_free(&map);
-            return MCHANGER_ERR_SCSI;
+            return move_error(rc);
         }
     }
 
     /* Move from slot to I/E */
+    uint16_t transport = pick_transport(&changer->internal, map, &changer->layout, slot_addr, ie_addr);
     rc = cmd_move_medium(&changer->internal, transport, slot_addr, ie_addr);
-    element_map_free(&map);
 
-    return rc == 0 ? MCHANGER_OK : MCHANGER_ERR_SCSI;
+    if (rc != 0) return move_error(rc);
+    catalog_note_slot_changed(changer->catalog, slot);
+    return MCHANGER_OK;
 }
 
-/* Low-level move medium */
-int mchanger_move_medium(MChangerHandle *changer, uint16_t transport, uint16_t source, uint16_t dest) {
+int mchanger_eject(MChangerHandle *changer, int slot, int drive) {
     if (!changer) return MCHANGER_ERR_INVALID;
-    return cmd_move_medium(&changer->internal, transport, source, dest) == 0 ? MCHANGER_OK : MCHANGER_ERR_SCSI;
+    uint16_t claimed[3];
+    size_t n;
+    int rc = claim_drive_swap(changer, slot, drive, claimed, &n);
+    if (rc != MCHANGER_OK) return rc;
+    /* and the I/E port the disc leaves through: the nearest free one */
+    const ElementMap *map = handle_map(changer);
+    bool picked = map && map->ie.count > 0 && slot >= 1 && (size_t)slot <= map->slots.count;
+    uint16_t ie_addr = 0;
+    if (picked) {
+        uint16_t slot_addr = element_addr(&map->slots, slot - 1);
+        uint16_t transport = pick_transport(&changer->internal, map, &changer->layout, slot_addr, element_addr(&map->ie, 0));
+        ie_addr = pick_ie_port(&changer->internal, map, &changer->layout, transport, slot_addr, true);
+    }
+    bool ie = picked && n > 0 && claim_elements(changer, &ie_addr, 1, true);
+    rc = eject_slot_held(changer, slot, drive, picked ? &ie_addr : NULL);
+    if (ie) release_elements(changer, &ie_addr, 1);
+    release_elements(changer, claimed, n);
+    return rc;
 }
 
-/* Eject from macOS */
-int mchanger_eject_from_macos(void) {
-    return eject_optical_media();
+int mchanger_export_batch(MChangerHandle *changer, const int *slots, size_t count,
+                          MChangerExportCallback callback, void *context, size_t *out_count) {
+    if (out_count) *out_count = 0;
+    if (!changer || (!slots && count > 0)) return MCHANGER_ERR_INVALID;
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    if (map->transports.count == 0 || map->ie.count == 0) return MCHANGER_ERR_NOT_FOUND;
+
+    /* The ports, the selected slots, and any drive holding one of their discs */
+    size_t n = 0;
+    uint16_t *claimed = calloc(map->ie.count + count + map->drives.count, sizeof(uint16_t));
+    if (!claimed) return MCHANGER_ERR_INVALID;
+    for (size_t i = 0; i < map->ie.count; i++) claimed[n++] = element_addr(&map->ie, i);
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i] < 1 || (size_t)slots[i] > map->slots.count) {
+            free(claimed);
+            return MCHANGER_ERR_INVALID;
+        }
+        claimed[n++] = element_addr(&map->slots, slots[i] - 1);
+    }
+    for (size_t d = 0; d < map->drives.count; d++) {
+        uint16_t home = drive_home_addr(changer, element_addr(&map->drives, d));
+        for (size_t i = 0; home && i < count; i++) {
+            if (element_addr(&map->slots, slots[i] - 1) == home) {
+                claimed[n++] = element_addr(&map->drives, d);
+                break;
+            }
+        }
+    }
+    if (!claim_elements(changer, claimed, n, true)) {
+        free(claimed);
+        return MCHANGER_ERR_BUSY;
+    }
+    int rc = export_discs(&changer->internal, changer->catalog, map, &changer->layout, ANY_TRANSPORT,
+                          slots, count, callback, context, out_count);
+    release_elements(changer, claimed, n);
+    free(claimed);
+    return rc;
 }
 
-/* Wait for mount */
-int mchanger_wait_for_mount(char *out_name, size_t name_len, char *out_size, size_t size_len, int timeout_secs) {
-    if (out_name && name_len > 0) out_name[0] = '\0';
-    if (out_size && size_len > 0) out_size[0] = '\0';
-
-    /* First check if already mounted */
-    if (get_mounted_disc_info(out_name, name_len, out_size, size_len)) {
+/* Nested with the batches' own locks: the door stays shut until every holder has released it */
+int mchanger_set_door_lock(MChangerHandle *changer, bool locked) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    ChangerHandle *handle = &changer->internal;
+    if (!locked) {
+        if (__atomic_sub_fetch(&handle->api_door_locks, 1, __ATOMIC_SEQ_CST) < 0) {
+            __atomic_add_fetch(&handle->api_door_locks, 1, __ATOMIC_SEQ_CST);
+            return MCHANGER_ERR_INVALID;
+        }
+        door_unlock(handle);
         return MCHANGER_OK;
     }
+    door_lock(handle);
+    __atomic_add_fetch(&handle->api_door_locks, 1, __ATOMIC_SEQ_CST);
+    return handle->prevent_unsupported ? MCHANGER_ERR_SCSI : MCHANGER_OK;
+}
 
-    /* Set up DiskArbitration session */
-    DASessionRef session = DASessionCreate(kCFAllocatorDefault);
-    if (!session) return MCHANGER_ERR_INVALID;
+MChangerPrefetchState mchanger_prefetch_state(MChangerHandle *changer) {
+    if (!changer || !changer->prefetch.running) return MCHANGER_PREFETCH_FAILED;
+    Prefetch *pf = &changer->prefetch;
+    pthread_mutex_lock(&pf->lock);
+    MChangerPrefetchState state = pf->state;
+    pthread_mutex_unlock(&pf->lock);
+    return state;
+}
 
-    DACallbackContext ctx = {0};
-    bool timed_out = false;
+int mchanger_prefetch_wait(MChangerHandle *changer, int timeout_ms) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    Prefetch *pf = &changer->prefetch;
+    if (!pf->running) return MCHANGER_ERR_SCSI;
+
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    if (timeout_ms > 0) {
+        until.tv_sec += timeout_ms / 1000;
+        until.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+    }
+    pthread_mutex_lock(&pf->lock);
+    int waited = 0;
+    while ((pf->state == MCHANGER_PREFETCH_MAP || pf->state == MCHANGER_PREFETCH_STATUS) && waited != ETIMEDOUT) {
+        if (timeout_ms < 0) pthread_cond_wait(&pf->cond, &pf->lock);
+        else waited = pthread_cond_timedwait(&pf->cond, &pf->lock, &until);
+    }
+    MChangerPrefetchState state = pf->state;
+    pthread_mutex_unlock(&pf->lock);
+    if (state == MCHANGER_PREFETCH_READY) return MCHANGER_OK;
+    return state == MCHANGER_PREFETCH_FAILED ? MCHANGER_ERR_SCSI : MCHANGER_ERR_BUSY;
+}
 
-    DARegisterDiskAppearedCallback(session, NULL, disk_appeared_callback, &ctx);
-    DASessionScheduleWithRunLoop(session, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
+int mchanger_get_prefetched_status(MChangerHandle *changer, MChangerBoardSnapshot *out) {
+    if (!changer || !out) return MCHANGER_ERR_INVALID;
+    out->count = 0;
+    out->total = 0;
+    out->generation = 0;
+    out->updated_ms = 0;
+    out->owner_pid = (int)getpid();
+    if (mchanger_prefetch_state(changer) == MCHANGER_PREFETCH_FAILED) return MCHANGER_ERR_SCSI;
+
+    Prefetch *pf = &changer->prefetch;
+    pthread_mutex_lock(&pf->lock);
+    int rc = pf->state == MCHANGER_PREFETCH_READY ? MCHANGER_OK : MCHANGER_ERR_BUSY;
+    if (rc == MCHANGER_OK) {
+        uint32_t total;
+        out->count = board_fill(out->elements, pf->inv, &total);
+        out->total = total;
+        out->generation = pf->generation;
+        out->updated_ms = pf->updated_ms;
+    }
+    pthread_mutex_unlock(&pf->lock);
+    if (rc == MCHANGER_OK) return rc;
+
+    /* Status still being read: the map alone, every element empty. The map
+       is published under the reservations lock, so read it under that too */
+    Reservations *r = &changer->reservations;
+    if (r->ready) pthread_mutex_lock(&r->lock);
+    if (changer->have_map) {
+        Inventory partial = { .map = changer->map };
+        uint32_t total;
+        out->count = board_fill(out->elements, &partial, &total);
+        out->total = total;
+    } else {
+        rc = MCHANGER_ERR_NOT_FOUND;
+    }
+    if (r->ready) pthread_mutex_unlock(&r->lock);
+    return rc;
+}
 
-    CFRunLoopTimerContext timerCtx = { 0, &timed_out, NULL, NULL, NULL };
-    CFRunLoopTimerRef timer = CFRunLoopTimerCreate(kCFAllocatorDefault,
-        CFAbsoluteTimeGetCurrent() + (double)timeout_secs, 0, 0, 0, timeout_callback, &timerCtx);
-    CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
+int mchanger_ingest(MChangerHandle *changer, const MChangerIngestOptions *options,
+                    MChangerIngestCallback callback, void *context, size_t *out_count) {
+    if (out_count) *out_count = 0;
+    if (!changer) return MCHANGER_ERR_INVALID;
+    MChangerIngestOptions defaults = {0};
+    const MChangerIngestOptions *opts = options ? options : &defaults;
+    const ElementMap *map = handle_map(changer);
+    if (!map) return MCHANGER_ERR_SCSI;
+    if (map->transports.count == 0 || map->ie.count == 0) return MCHANGER_ERR_NOT_FOUND;
+    int drive = opts->drive > 0 ? opts->drive : 1;
+    if (opts->identify && (size_t)drive > map->drives.count) return MCHANGER_ERR_INVALID;
+
+    /* The port (and the drive) for the whole run; slots are re-checked per disc */
+    size_t n = 0;
+    uint16_t *claimed = calloc(map->ie.count + 1, sizeof(uint16_t));
+    if (!claimed) return MCHANGER_ERR_INVALID;
+    for (size_t i = 0; i < map->ie.count; i++) claimed[n++] = element_addr(&map->ie, i);
+    if (opts->identify) claimed[n++] = element_addr(&map->drives, drive - 1);
+    if (!claim_elements(changer, claimed, n, true)) {
+        free(claimed);
+        return MCHANGER_ERR_BUSY;
+    }
+    int rc = ingest_discs(&changer->internal, changer->catalog, map, &changer->layout, ANY_TRANSPORT,
+                          opts, callback, context, out_count);
+    release_elements(changer, claimed, n);
+    free(claimed);
+    return rc;
+}
 
-    CFRunLoopRun();
+/* Low-level move medium */
+int mchanger_move_medium(MChangerHandle *changer, uint16_t transport, uint16_t source, uint16_t dest) {
+    if (!changer) return MCHANGER_ERR_INVALID;
+    uint16_t claimed[2] = { source, dest };
+    if (!claim_elements(changer, claimed, 2, true)) return MCHANGER_ERR_BUSY;
+    int rc = cmd_move_medium(&changer->internal, transport, source, dest);
+    release_elements(changer, claimed, 2);
+    return rc == 0 ? MCHANGER_OK : move_error(rc);
+}
 
-    CFRunLoopRemoveTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
-    CFRelease(timer);
-    DAUnregisterCallback(session, disk_appeared_callback, &ctx);
-    DASessionUnscheduleFromRunLoop(session, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
-    CFRelease(session);
+uint64_t mchanger_get_generation(MChangerHandle *changer) {
+    return changer ? __atomic_load_n(&changer->internal.generation, __ATOMIC_SEQ_CST) : 0;
+}
 
-    if (ctx.found) {
-        if (out_name && name_len > 0) strncpy(out_name, ctx.name, name_len - 1);
-        if (out_size && size_len > 0) strncpy(out_size, ctx.size, size_len - 1);
-        return MCHANGER_OK;
+/* Whether a move through source or dest has been made since generation */
+static bool moved_since(ChangerHandle *handle, uint16_t source, uint16_t dest, uint64_t generation) {
+    if (__atomic_load_n(&handle->moves_untracked, __ATOMIC_SEQ_CST)) {
+        return __atomic_load_n(&handle->generation, __ATOMIC_SEQ_CST) != generation;
     }
+    return element_moved_at(handle, source) > generation || element_moved_at(handle, dest) > generation;
+}
 
-    return timed_out ? MCHANGER_ERR_BUSY : MCHANGER_ERR_NOT_FOUND;
+int mchanger_compare_and_move(MChangerHandle *changer, uint16_t transport, uint16_t source, uint16_t dest,
+                              const MChangerMoveCheck *check) {
+    if (!changer || source == dest) return MCHANGER_ERR_INVALID;
+    uint16_t claimed[2] = { source, dest };
+    if (!claim_elements(changer, claimed, 2, true)) return MCHANGER_ERR_BUSY;
+
+    /* Another thread's move through either element since the plan, or another
+       controller's seen in the two elements */
+    int rc = MCHANGER_OK, moved = 0;
+    ElementStatus src = {0}, dst = {0};
+    if (check && check->generation && moved_since(&changer->internal, source, dest, check->generation)) {
+        rc = MCHANGER_ERR_CONFLICT;
+    } else if (read_element_pair(&changer->internal, source, &src, dest, &dst, RES_MEMORY) != 0) {
+        rc = MCHANGER_ERR_SCSI;
+    } else if (!src.full || dst.full || src.except || dst.except) {
+        rc = MCHANGER_ERR_CONFLICT;
+    } else if (check && check->origin && (!src.valid_src || src.src_addr != check->origin)) {
+        rc = MCHANGER_ERR_CONFLICT;
+    } else if ((moved = cmd_move_medium(&changer->internal, transport, source, dest)) != 0) {
+        rc = move_error(moved);
+    }
+    release_elements(changer, claimed, 2);
+    return rc;
+}
+
+/* Eject from macOS */
+int mchanger_eject_from_macos(void) {
+    return eject_optical_media();
+}
+
+/* Wait for mount */
+int mchanger_wait_for_mount(char *out_name, size_t name_len, char *out_size, size_t size_len, int timeout_secs) {
+    if (out_name && name_len > 0) out_name[0] = '\0';
+    if (out_size && size_len > 0) out_size[0] = '\0';
+
+    DiscInfo info;
+    int rc = wait_for_disc(&info, timeout_secs);
+    if (rc != MCHANGER_OK) return rc;
+
+    if (out_name && name_len > 0) snprintf(out_name, name_len, "%s", info.name);
+    if (out_size && size_len > 0) snprintf(out_size, size_len, "%s", info.size);
+    return MCHANGER_OK;
 }
 
 /* Device info */
@@ -3398,3 +10596,4 @@ int mchanger_test_unit_ready(MChangerHandle *changer) {
     if (!changer) return MCHANGER_ERR_INVALID;
     return cmd_test_unit_ready(&changer->internal) == 0 ? MCHANGER_OK : MCHANGER_ERR_SCSI;
 }
+
@@ -48,9 +48,60 @@ typedef struct {
     size_t ie_count;
 } MChangerElementMap;
 
+/*
+ * How a status read may be answered.
+ *
+ * CACHED sets CURDATA: the changer answers from its own memory and never moves
+ * the robot. Use it for polling and display. Through the _ex calls, a changer
+ * that cannot answer from memory fails the read with MCHANGER_ERR_SCSI rather
+ * than moving the robot to find out; the calls without _ex fall back to a
+ * plain read on such a changer. VERIFIED lets the changer
+ * physically re-scan elements first, which can take seconds; use it right
+ * before moving media when a wrong answer would cause a failed move.
+ */
+typedef enum {
+    MCHANGER_STATUS_CACHED = 0,
+    MCHANGER_STATUS_VERIFIED = 1
+} MChangerStatusMode;
+
 /* Callback for mounted disc info (used with verbose operations) */
 typedef void (*MChangerMountCallback)(const char *name, const char *size, void *context);
 
+/* A catalog entry: the last disc identified in a slot */
+typedef struct {
+    int slot;                   /* 1-based slot index */
+    char volume[256];           /* Volume name ("" if unknown, e.g. audio CD) */
+    uint64_t size_bytes;        /* Media size in bytes (0 if unknown) */
+    char media_type[32];        /* "CD", "DVD", "BD", "CD-ROM", ... */
+    char fingerprint[33];       /* Disc fingerprint as hex ("" if not fingerprinted) */
+    int64_t last_seen;          /* Unix time the disc was last identified */
+    uint32_t loads;             /* Times the disc was loaded, for slot placement */
+} MChangerCatalogEntry;
+
+/* Identity of the disc in a drive, read from its table of contents */
+typedef struct {
+    char fingerprint[33];       /* Hex digest of the TOC and volume descriptors, stable across loads and drives */
+    uint64_t size_bytes;        /* From the lead-out address (0 if unknown) */
+    char media_type[32];        /* "CD", "CD-DA", "DVD", "BD", ... ("" if unknown) */
+    int track_count;
+} MChangerDiscId;
+
+/* Progress of mchanger_scan_library(), reported once per slot */
+typedef struct {
+    int slot;                   /* 1-based slot just finished */
+    int drive;                  /* 1-based drive it was read in */
+    int result;                 /* MCHANGER_OK, or why it could not be identified */
+    MChangerDiscId disc;        /* Valid when result is MCHANGER_OK */
+    size_t done;                /* Slots finished, including ones from a resumed scan */
+    size_t total;               /* Occupied slots in the library */
+    double eta_secs;            /* Estimated time remaining */
+} MChangerScanProgress;
+
+typedef void (*MChangerScanCallback)(const MChangerScanProgress *progress, void *context);
+
+/* Opaque persistent disc catalog */
+typedef struct MChangerCatalog MChangerCatalog;
+
 /* Error codes */
 #define MCHANGER_OK              0
 #define MCHANGER_ERR_NOT_FOUND  -1
@@ -59,6 +110,9 @@ typedef void (*MChangerMountCallback)(const char *name, const char *size, void *
 #define MCHANGER_ERR_INVALID    -4
 #define MCHANGER_ERR_BUSY       -5
 #define MCHANGER_ERR_EMPTY      -6
+#define MCHANGER_ERR_MISMATCH   -7  /* Loaded disc is not the one expected */
+#define MCHANGER_ERR_CONFLICT   -8  /* Element state changed since the caller planned against it */
+#define MCHANGER_ERR_STRANDED   -9  /* A move left the disc in the robot or half-seated; don't retry it */
 
 /*
  * Discovery
@@ -97,12 +151,33 @@ void mchanger_free_element_map(MChangerElementMap *map);
  * Status
  */
 
-/* Get status of a specific slot (1-based index) */
+/*
+ * Get status of a specific slot (1-based index). Uses MCHANGER_STATUS_CACHED,
+ * falling back to a plain read on a changer without CURDATA.
+ */
 int mchanger_get_slot_status(MChangerHandle *changer, int slot, MChangerElementStatus *out_status);
 
-/* Get status of a specific drive (1-based index) */
+/* Get status of a specific slot with an explicit read mode */
+int mchanger_get_slot_status_ex(MChangerHandle *changer, int slot, MChangerStatusMode mode,
+                                MChangerElementStatus *out_status);
+
+/*
+ * Get status of a specific drive (1-based index). Uses MCHANGER_STATUS_CACHED,
+ * falling back to a plain read on a changer without CURDATA.
+ */
 int mchanger_get_drive_status(MChangerHandle *changer, int drive, MChangerElementStatus *out_status);
 
+/* Get status of a specific drive with an explicit read mode */
+int mchanger_get_drive_status_ex(MChangerHandle *changer, int drive, MChangerStatusMode mode,
+                                 MChangerElementStatus *out_status);
+
+/*
+ * Get the device identifier the changer reports for a drive (READ ELEMENT
+ * STATUS with DVCID). Returns MCHANGER_ERR_NOT_FOUND if the changer does not
+ * report one.
+ */
+int mchanger_get_drive_identifier(MChangerHandle *changer, int drive, char *out_id, size_t id_len);
+
 /*
  * Bulk status
  *
@@ -112,6 +187,10 @@ int mchanger_get_drive_status(MChangerHandle *changer, int drive, MChangerElemen
  * - drive_addr should be an element address from the map (pass 0 to skip drive status).
  * - out_slots must have at least slot_count entries.
  * - out_drive_supported, when non-NULL, is set to true iff a drive element status page was present.
+ *
+ * mchanger_get_bulk_status() uses MCHANGER_STATUS_CACHED so that polling
+ * never causes robot motion, falling back to a plain read on a changer
+ * without CURDATA.
  */
 int mchanger_get_bulk_status(MChangerHandle *changer,
                              const uint16_t *slot_addrs,
@@ -121,6 +200,15 @@ int mchanger_get_bulk_status(MChangerHandle *changer,
                              MChangerElementStatus *out_slots,
                              bool *out_drive_supported);
 
+int mchanger_get_bulk_status_ex(MChangerHandle *changer,
+                                const uint16_t *slot_addrs,
+                                size_t slot_count,
+                                uint16_t drive_addr,
+                                MChangerStatusMode mode,
+                                MChangerElementStatus *out_drive,
+                                MChangerElementStatus *out_slots,
+                                bool *out_drive_supported);
+
 /*
  * Operations
  */
@@ -132,12 +220,374 @@ int mchanger_load_slot(MChangerHandle *changer, int slot, int drive);
 int mchanger_load_slot_verbose(MChangerHandle *changer, int slot, int drive,
                            MChangerMountCallback callback, void *context);
 
+/*
+ * Load a slot and check that the expected disc arrived. With a NULL
+ * fingerprint the slot's catalog entry is used; if neither is available the
+ * load is not verified. Returns MCHANGER_ERR_MISMATCH if a different disc
+ * was loaded (it is left in the drive).
+ */
+int mchanger_load_slot_expect(MChangerHandle *changer, int slot, int drive, const char *fingerprint);
+
+/*
+ * Drive residency
+ *
+ * With several drives, mchanger_load_slot_auto() treats them as a cache of
+ * discs and picks the drive itself. A disc that is already in a drive is a
+ * hit and needs no move; otherwise an empty drive is used, or the policy
+ * picks which loaded disc goes back to its slot. LRU sends home the disc
+ * used longest ago, LFU the one used least often (counted across loads), and
+ * ARC balances the two so a run of one-off requests cannot flush discs that
+ * are used again and again. History is kept per handle, from auto loads.
+ */
+typedef enum {
+    MCHANGER_RESIDENCY_LRU = 0,
+    MCHANGER_RESIDENCY_LFU = 1,
+    MCHANGER_RESIDENCY_ARC = 2
+} MChangerResidencyPolicy;
+
+typedef struct {
+    size_t hits;                /* Disc was already in a drive */
+    size_t misses;              /* Disc had to be loaded */
+    size_t evictions;           /* Misses that sent another disc home first */
+} MChangerResidencyStats;
+
+/* Choose the eviction policy (LRU by default). Clears the access history. */
+int mchanger_set_residency_policy(MChangerHandle *changer, MChangerResidencyPolicy policy);
+
+/*
+ * Make a slot's disc available in some drive and return that drive (1-based)
+ * in out_drive. Returns MCHANGER_ERR_BUSY if every drive holds a disc whose
+ * home slot the changer does not know.
+ */
+int mchanger_load_slot_auto(MChangerHandle *changer, int slot, int *out_drive);
+
+void mchanger_get_residency_stats(const MChangerHandle *changer, MChangerResidencyStats *out);
+
+/*
+ * Element reservations
+ *
+ * A handle may be shared by several threads. Each call reserves the slots,
+ * drives and I/E ports it touches, and waits only while another thread holds
+ * one of them, so calls on disjoint elements run together. Moves themselves
+ * go one at a time through the robot. Scans, rebalancing and calibration
+ * reserve the whole changer. Callers can reserve elements (by element
+ * address) across several calls, e.g. to keep a disc in its drive while
+ * reading it. Reservations nest within a thread.
+ */
+
+/* Reserve all of addrs, or none. MCHANGER_ERR_BUSY if wait is false and one is held. */
+int mchanger_reserve_elements(MChangerHandle *changer, const uint16_t *addrs, size_t count, bool wait);
+
+void mchanger_release_elements(MChangerHandle *changer, const uint16_t *addrs, size_t count);
+
+/*
+ * Idle return
+ *
+ * Optionally send discs back to their slots in the background once the
+ * changer has been idle for idle_secs. Loading a different disc later is then
+ * a single move instead of unmount + unload + load. A disc whose volume is
+ * still in use (it will not unmount) stays in the drive, and so does a disc
+ * whose drive or slot another call has reserved. Turn it on or off only
+ * while no other thread is using the handle.
+ */
+typedef struct {
+    size_t returns;             /* Discs sent home while idle */
+    size_t saved;               /* Later loads into that drive that skipped the unload */
+    size_t wasted;              /* Later loads of the same disc, which had to come back */
+} MChangerIdleStats;
+
+/* Start (idle_secs > 0) or stop (0) background returns */
+int mchanger_set_idle_return(MChangerHandle *changer, int idle_secs);
+
+void mchanger_get_idle_stats(MChangerHandle *changer, MChangerIdleStats *out);
+
+/*
+ * Identify the disc in a drive from its TOC, capacity and, for a data disc,
+ * the volume descriptors at the start of its first data track. Waits up to
+ * timeout_secs for the drive to become ready, but never for a mount, so it
+ * also works for audio CDs. Typically takes well under a second once the
+ * disc has spun up. Reading a data disc the OS has already mounted needs
+ * access to its raw device; without it this returns MCHANGER_ERR_OPEN.
+ */
+int mchanger_identify_disc(MChangerHandle *changer, int drive, int timeout_secs, MChangerDiscId *out);
+
+/*
+ * Fingerprint every occupied slot into the attached catalog (required) and
+ * return each disc to its slot. All drives are used at once, so the robot
+ * loads and returns discs while other drives spin up. Finished slots are
+ * logged next to the catalog ("<catalog>.scan"): an interrupted scan resumes
+ * where it stopped unless restart is set. timeout_secs bounds the wait for
+ * each disc to become readable (0 for the default).
+ */
+int mchanger_scan_library(MChangerHandle *changer, bool restart, int timeout_secs,
+                          MChangerScanCallback callback, void *context);
+
+/*
+ * Slot placement
+ *
+ * Robot travel depends on how far a slot is from the drives. Slots are ranked
+ * by distance from near_slot, wrapping around on carousel (ring) changers;
+ * the default is slot 1 on a straight magazine. Loads are counted in the
+ * attached catalog so often-used discs can be kept close.
+ */
+int mchanger_set_slot_layout(MChangerHandle *changer, int near_slot, bool ring);
+
+/* Free slot nearest the drives (hot) or farthest from them (cold), e.g. for an insert */
+int mchanger_pick_free_slot(MChangerHandle *changer, bool hot, int *out_slot);
+
+/*
+ * Move the most-loaded discs in the attached catalog (required) toward the
+ * drives, sending colder discs in the way to far free slots. Makes at most
+ * max_moves moves (0 for no limit); meant for idle time.
+ */
+int mchanger_rebalance(MChangerHandle *changer, size_t max_moves, size_t *out_moves);
+
+/*
+ * Motion model
+ *
+ * Every successful move is timed and logged ("~/.mchanger/motion.tsv", or
+ * $MCHANGER_MOTION). Estimates fit a line per kind of move (load, unload,
+ * slot to slot, import, export) against slot distance from the drives, using
+ * the latest 512 moves. Returns MCHANGER_ERR_NOT_FOUND until a move has been
+ * logged.
+ */
+int mchanger_estimate_move_ms(MChangerHandle *changer, uint16_t transport, uint16_t source, uint16_t dest,
+                              uint32_t *out_ms);
+
+/*
+ * Make up to `moves` probing moves across near and far slots to fill in the
+ * motion model: load and unload through an empty drive, or slot to slot if
+ * every drive is full. Every disc ends where it started. Meant for idle time.
+ */
+int mchanger_calibrate(MChangerHandle *changer, size_t moves, size_t *out_moves);
+
+/*
+ * Save an inventory snapshot (element map and what each element holds, read
+ * from changer memory) to path, or "~/.mchanger/inventory.tsv" if NULL. The
+ * CLI's plan command simulates batches of moves against it with no device.
+ */
+int mchanger_save_inventory(MChangerHandle *changer, const char *path);
+
+/*
+ * Simulate a batch of operations against a saved inventory with no device,
+ * as the CLI's plan command does: one command per line of ops_path (e.g.
+ * "load --slot 12 --drive 2"), each expanded into the moves it would make
+ * and each move checked the way the changer checks it. Illegal operations
+ * are counted and skipped. inventory_path NULL reads the default snapshot.
+ */
+typedef struct {
+    int near_slot;              /* Slot layout, as for mchanger_set_slot_layout() */
+    bool ring;
+    const char *motion_path;    /* Motion log for estimates; NULL for the default */
+    const MChangerCatalog *catalog;     /* Load counts for "rebalance"; NULL refuses it */
+    const char *save_path;      /* Write the resulting inventory here; NULL to skip */
+} MChangerPlanOptions;
+
+typedef struct {
+    size_t operations;
+    size_t illegal;             /* Operations the changer would refuse */
+    size_t moves;               /* Moves made by the legal operations */
+    uint32_t robot_ms;          /* Estimated robot time; 0 unless estimated */
+    bool estimated;             /* Every move had an estimate from the motion log */
+} MChangerPlanResult;
+
+int mchanger_plan_batch(const char *inventory_path, const char *ops_path, const MChangerPlanOptions *options,
+                        MChangerPlanResult *out);
+
+/*
+ * Status board: the owning process publishes its inventory to POSIX shared
+ * memory ("/mchanger.board" if name is NULL) and keeps it current as media
+ * moves. Other processes attach and copy consistent snapshots lock-free,
+ * without touching the device. Calling publish again re-reads the changer.
+ * The board is removed when the handle is closed.
+ */
+#define MCHANGER_BOARD_MAX_ELEMENTS 1024
+
+typedef enum {
+    MCHANGER_ELEMENT_TRANSPORT = 0,
+    MCHANGER_ELEMENT_SLOT = 1,
+    MCHANGER_ELEMENT_DRIVE = 2,
+    MCHANGER_ELEMENT_IE = 3
+} MChangerElementKind;
+
+typedef struct {
+    uint16_t address;
+    uint16_t source_addr;   /* Where the media came from; 0 if unknown */
+    uint8_t kind;           /* MChangerElementKind */
+    bool full;
+    bool except;
+} MChangerBoardElement;
+
+typedef struct {
+    uint64_t generation;    /* Moves published since the board was created */
+    uint64_t updated_ms;    /* Wall-clock time of the last update */
+    int owner_pid;          /* Publishing process */
+    size_t count;
+    size_t total;           /* Elements in the library; more than count if they didn't all fit */
+    MChangerBoardElement elements[MCHANGER_BOARD_MAX_ELEMENTS];  /* Transport, drives, I/E, then slots */
+} MChangerBoardSnapshot;
+
+typedef struct MChangerBoard MChangerBoard;
+
+int mchanger_publish_board(MChangerHandle *changer, const char *name);
+
+/* Reader side; returns NULL if no board is published under name */
+MChangerBoard *mchanger_board_attach(const char *name);
+
+/* MCHANGER_ERR_BUSY only if the owner kept writing through every retry */
+int mchanger_board_read(MChangerBoard *board, MChangerBoardSnapshot *out);
+void mchanger_board_detach(MChangerBoard *board);
+
+/*
+ * Change watch: poll cheaply and report only what changed. Each poll costs a
+ * TEST UNIT READY plus one status read each for the drives and the I/E ports,
+ * from changer memory when the changer supports CURDATA; slots are re-read when the changer reports activity and
+ * every 30th poll. Exceptions present at the first poll are reported; other
+ * events describe changes since the previous poll. A published status board
+ * is kept up to date as well.
+ */
+typedef enum {
+    MCHANGER_EVENT_FILLED = 0,          /* Element now holds media, e.g. a disc put in the I/E port */
+    MCHANGER_EVENT_EMPTIED,
+    MCHANGER_EVENT_EXCEPTION,           /* Element reports an exception */
+    MCHANGER_EVENT_EXCEPTION_CLEARED,
+    MCHANGER_EVENT_NOT_READY,           /* Changer stopped reporting ready, e.g. door opened */
+    MCHANGER_EVENT_READY
+} MChangerEventType;
+
+typedef struct {
+    MChangerEventType type;
+    MChangerElementKind kind;           /* Element events only */
+    int index;                          /* 1-based slot, drive or I/E port number */
+    uint16_t address;
+    uint16_t source_addr;               /* FILLED: where the media came from, if reported */
+    uint8_t sense_key;                  /* NOT_READY: the reason the changer gave */
+    uint8_t asc;
+    uint8_t ascq;
+} MChangerEvent;
+
+typedef struct MChangerWatch MChangerWatch;
+
+MChangerWatch *mchanger_watch_open(MChangerHandle *changer);
+
+/* One poll (or the rest of the last one if it found more than max_events) */
+int mchanger_watch_poll(MChangerWatch *watch, MChangerEvent *events, size_t max_events, size_t *out_count);
+void mchanger_watch_close(MChangerWatch *watch);
+
 /* Unload the drive to a specific slot */
 int mchanger_unload_drive(MChangerHandle *changer, int slot, int drive);
 
 /* Eject a disc to the import/export slot for physical removal */
 int mchanger_eject(MChangerHandle *changer, int slot, int drive);
 
+/*
+ * Bulk loading through the I/E port. Waits for an operator to put a disc in
+ * the port, stores it in a free slot chosen like mchanger_pick_free_slot(),
+ * and optionally fingerprints it in drive into the attached catalog while the
+ * operator fetches the next one. Only the I/E port is polled while waiting.
+ * Runs until max_discs are in, the port stays empty for idle_secs, or the
+ * callback returns false; MCHANGER_ERR_NOT_FOUND when no free slot is left.
+ */
+typedef struct {
+    size_t max_discs;           /* 0 = no limit */
+    int idle_secs;              /* 0 = wait for the next disc indefinitely */
+    int poll_ms;                /* 0 = 500 */
+    bool hot;                   /* Place near the drives instead of far from them */
+    bool identify;              /* Load each disc and record its fingerprint */
+    int drive;                  /* Drive used to identify (default 1; must be empty) */
+    int timeout_secs;           /* Per disc when identifying (default 60) */
+} MChangerIngestOptions;
+
+typedef enum {
+    MCHANGER_INGEST_WAITING = 0,        /* Port empty; reported on every poll */
+    MCHANGER_INGEST_PORT_BLOCKED,       /* Port holds a disc the changer put out, not a new one */
+    MCHANGER_INGEST_STORED,             /* Disc moved to slot: the operator can feed the next */
+    MCHANGER_INGEST_IDENTIFIED          /* Disc fingerprinted; see result */
+} MChangerIngestStage;
+
+typedef struct {
+    MChangerIngestStage stage;
+    size_t ingested;            /* Discs stored so far */
+    int slot;                   /* Slot of the latest disc */
+    int result;                 /* IDENTIFIED: MCHANGER_OK, or why it could not be identified */
+    MChangerDiscId disc;        /* IDENTIFIED with result MCHANGER_OK */
+} MChangerIngestProgress;
+
+/* Return false to stop */
+typedef bool (*MChangerIngestCallback)(const MChangerIngestProgress *progress, void *context);
+
+int mchanger_ingest(MChangerHandle *changer, const MChangerIngestOptions *options,
+                    MChangerIngestCallback callback, void *context, size_t *out_count);
+
+/*
+ * Bulk export through the I/E port. Discs nearest the port go first; each
+ * waits until the operator has emptied a port, found by polling only the I/E
+ * elements. A selected disc that is loaded goes straight from its drive, and
+ * empty slots are skipped. Exported slots are dropped from the attached
+ * catalog. Returns once the last disc is in the port or the callback returns
+ * false; out_count is the number of discs put out.
+ */
+typedef enum {
+    MCHANGER_EXPORT_WAITING = 0,        /* Port still full; reported on every poll */
+    MCHANGER_EXPORT_MOVED,              /* Disc from slot is in the port */
+    MCHANGER_EXPORT_SKIPPED             /* Slot (and every drive) had no disc from it */
+} MChangerExportStage;
+
+typedef struct {
+    MChangerExportStage stage;
+    int slot;                   /* Slot being exported */
+    int port;                   /* MOVED: 1-based I/E port */
+    int from_drive;             /* MOVED: drive the disc came from, 0 if from its slot */
+    int result;                 /* SKIPPED: MCHANGER_ERR_EMPTY */
+    size_t done;
+    size_t total;
+} MChangerExportProgress;
+
+/* Return false to stop */
+typedef bool (*MChangerExportCallback)(const MChangerExportProgress *progress, void *context);
+
+int mchanger_export_batch(MChangerHandle *changer, const int *slots, size_t count,
+                          MChangerExportCallback callback, void *context, size_t *out_count);
+
+/*
+ * Lock (PREVENT MEDIUM REMOVAL) or unlock the door and I/E port. Scans,
+ * placement and calibration lock it themselves for their duration; locks
+ * nest with theirs, so each lock needs one unlock. Returns MCHANGER_ERR_SCSI
+ * if the device doesn't support locking, MCHANGER_ERR_INVALID when unlocking
+ * without a lock held. mchanger_close() unlocks anything left locked.
+ */
+int mchanger_set_door_lock(MChangerHandle *changer, bool locked);
+
+/*
+ * Inventory prefetch: opening a handle starts reading the element map, then
+ * every element's status, on a background thread. Calls that need the map
+ * before it is read wait for it instead of reading it again; the first
+ * mchanger_publish_board() uses the prefetched status if nothing has moved.
+ */
+typedef enum {
+    MCHANGER_PREFETCH_MAP = 0,      /* Reading the element map */
+    MCHANGER_PREFETCH_STATUS,       /* Map read; reading element status */
+    MCHANGER_PREFETCH_READY,
+    MCHANGER_PREFETCH_FAILED        /* Or never started; calls read for themselves */
+} MChangerPrefetchState;
+
+MChangerPrefetchState mchanger_prefetch_state(MChangerHandle *changer);
+
+/*
+ * Wait up to timeout_ms (negative: no limit) for the prefetch to finish.
+ * Returns MCHANGER_ERR_BUSY on timeout, MCHANGER_ERR_SCSI if it failed.
+ */
+int mchanger_prefetch_wait(MChangerHandle *changer, int timeout_ms);
+
+/*
+ * The prefetched inventory in board form. generation is
+ * mchanger_get_generation() when it was read: a move since makes it stale.
+ * While status is still being read, returns MCHANGER_ERR_BUSY with every
+ * element's address and kind filled in and full left false. Before the map
+ * is read, returns MCHANGER_ERR_NOT_FOUND with count 0.
+ */
+int mchanger_get_prefetched_status(MChangerHandle *changer, MChangerBoardSnapshot *out);
+
 /*
  * Low-level operations (for advanced use)
  */
@@ -145,12 +595,256 @@ int mchanger_eject(MChangerHandle *changer, int slot, int drive);
 /* Move medium between any two element addresses */
 int mchanger_move_medium(MChangerHandle *changer, uint16_t transport, uint16_t source, uint16_t dest);
 
+/*
+ * Compare-and-move: what the caller expects to find before the move.
+ * generation is a value from mchanger_get_generation() (0 = don't check); the
+ * move is refused if a move through this handle has touched source or dest
+ * since, while moves between other elements don't matter. origin is the
+ * element the medium in source came from (0 = don't check).
+ */
+typedef struct {
+    uint64_t generation;
+    uint16_t origin;
+} MChangerMoveCheck;
+
+/* Count of moves made through this handle; changes whenever any element may have */
+uint64_t mchanger_get_generation(MChangerHandle *changer);
+
+/*
+ * Move only if source is still full and dest still empty (re-read in a single
+ * READ ELEMENT STATUS when the two are close together) and check still holds.
+ * Returns MCHANGER_ERR_CONFLICT without moving if not; check may be NULL.
+ */
+int mchanger_compare_and_move(MChangerHandle *changer, uint16_t transport, uint16_t source, uint16_t dest,
+                              const MChangerMoveCheck *check);
+
 /* Eject optical media from macOS before physical move */
 int mchanger_eject_from_macos(void);
 
 /* Wait for disc to mount and get info */
 int mchanger_wait_for_mount(char *out_name, size_t name_len, char *out_size, size_t size_len, int timeout_secs);
 
+/*
+ * Disc catalog
+ *
+ * A persistent slot -> disc table so a disc can be found without loading
+ * candidates. Several slots may record the same fingerprint, e.g. two copies
+ * of one disc. The default location is $MCHANGER_CATALOG, or
+ * ~/.mchanger/catalog.tsv. Lookups are in-memory and never touch the device.
+ * Calls on one catalog may come from several threads, as loads on one handle do.
+ */
+
+/* Open a catalog (NULL path for the default). A missing file opens empty. */
+MChangerCatalog *mchanger_catalog_open(const char *path);
+
+/* Write the catalog back to disk (atomic replace) */
+int mchanger_catalog_save(MChangerCatalog *catalog);
+
+/* Free a catalog. Does not save. */
+void mchanger_catalog_close(MChangerCatalog *catalog);
+
+/* Path the catalog loads from and saves to */
+const char *mchanger_catalog_path(const MChangerCatalog *catalog);
+
+/* Insert or replace the entry for entry->slot. last_seen 0 means "now". */
+int mchanger_catalog_record(MChangerCatalog *catalog, const MChangerCatalogEntry *entry);
+
+/* Remove the entry for a slot. Returns MCHANGER_ERR_NOT_FOUND if none. */
+int mchanger_catalog_forget(MChangerCatalog *catalog, int slot);
+
+/* Lookups. Return MCHANGER_ERR_NOT_FOUND when nothing matches. */
+int mchanger_catalog_get(const MChangerCatalog *catalog, int slot, MChangerCatalogEntry *out);
+int mchanger_catalog_find_volume(const MChangerCatalog *catalog, const char *volume, MChangerCatalogEntry *out);
+int mchanger_catalog_find_fingerprint(const MChangerCatalog *catalog, const char *fingerprint,
+                                      MChangerCatalogEntry *out);
+
+/* Iterate entries in slot order */
+size_t mchanger_catalog_count(const MChangerCatalog *catalog);
+int mchanger_catalog_entry_at(const MChangerCatalog *catalog, size_t index, MChangerCatalogEntry *out);
+
+/*
+ * Attach a catalog to a handle. Loads then fingerprint the disc (waiting for
+ * the drive to spin up) and record it; verbose loads that see the disc mount
+ * also index its files. Moves that take a disc out of the changer forget its
+ * slot. The catalog is saved after every change. Pass NULL to detach; the
+ * caller keeps ownership.
+ */
+void mchanger_set_catalog(MChangerHandle *changer, MChangerCatalog *catalog);
+
+/*
+ * File index
+ *
+ * A listing of every file (path, size, mtime) is kept per fingerprinted disc
+ * in "<catalog>.files/". A file index loads all listings and answers name
+ * searches from a trigram index, so finding a file never loads a disc.
+ */
+
+/* Walk a mounted disc and store its file listing against the slot's catalog
+ * entry, which must have a fingerprint. out_files may be NULL. */
+int mchanger_catalog_index_files(MChangerCatalog *catalog, int slot, const char *mount_path, size_t *out_files);
+
+/* A file found by mchanger_file_index_search() */
+typedef struct {
+    int slot;                   /* Slot holding the disc */
+    char volume[256];
+    char fingerprint[33];
+    char path[1024];            /* Relative to the disc's root */
+    uint64_t size_bytes;
+    int64_t mtime;
+} MChangerFileHit;
+
+typedef struct MChangerFileIndex MChangerFileIndex;
+
+/* Build an index over the listings of every disc currently in the catalog */
+MChangerFileIndex *mchanger_file_index_open(const MChangerCatalog *catalog);
+void mchanger_file_index_close(MChangerFileIndex *index);
+
+/* Number of files indexed */
+size_t mchanger_file_index_count(const MChangerFileIndex *index);
+
+/*
+ * Find files whose name (last path component) contains text, ignoring ASCII
+ * case. Up to max hits are written to out; out_total receives the number of
+ * matches, which may be larger.
+ */
+int mchanger_file_index_search(const MChangerFileIndex *index, const char *text,
+                               MChangerFileHit *out, size_t max, size_t *out_total);
+
+/*
+ * Image cache
+ *
+ * Full images of recently used discs, kept on local disk and keyed by
+ * fingerprint. A cached disc can be read from its image with no robot move
+ * and no mount wait. The cache is bounded in size; the least recently used
+ * images are evicted first. The default location is $MCHANGER_CACHE_DIR, or
+ * ~/.mchanger/images. Only data discs can be imaged. One cache may be shared
+ * by threads fetching at once.
+ */
+
+typedef struct {
+    char fingerprint[33];
+    uint64_t size_bytes;
+    int64_t last_used;          /* Unix time of the last lookup or store */
+    uint32_t hits;              /* Lookups served from the image */
+} MChangerCacheEntry;
+
+typedef struct MChangerImageCache MChangerImageCache;
+
+/* Open a cache (NULL dir for the default; max_bytes 0 for 20 GB) */
+MChangerImageCache *mchanger_cache_open(const char *dir, uint64_t max_bytes);
+void mchanger_cache_close(MChangerImageCache *cache);
+
+/* Path of the cached image for a fingerprint; counts as a use */
+int mchanger_cache_lookup(MChangerImageCache *cache, const char *fingerprint, char *out_path, size_t path_len);
+
+/* Drop one image */
+int mchanger_cache_evict(MChangerImageCache *cache, const char *fingerprint);
+
+size_t mchanger_cache_count(const MChangerImageCache *cache);
+int mchanger_cache_entry_at(const MChangerImageCache *cache, size_t index, MChangerCacheEntry *out);
+uint64_t mchanger_cache_used_bytes(const MChangerImageCache *cache);
+
+/*
+ * Get a readable image of a slot's disc. If the slot's cataloged disc is
+ * cached, the image path is returned without touching the changer. Otherwise
+ * the disc is loaded, identified, imaged into the cache (evicting as needed)
+ * and left in the drive. Imaging reads the raw device, which usually needs
+ * root or the operator group.
+ */
+int mchanger_fetch_image(MChangerHandle *changer, MChangerImageCache *cache, int slot, int drive,
+                         char *out_path, size_t path_len);
+
+/*
+ * Read job queue
+ *
+ * Jobs name the slot whose disc they need. A worker serves every pending job
+ * for the loaded disc before swapping discs, the way tape reads are ordered
+ * by position, instead of in arrival order. Two bounds keep that fair: a disc
+ * is swapped out after max_batch jobs if others are waiting, and a job that
+ * has waited max_wait_secs has its disc served next. Submitting is safe from
+ * any thread while a worker runs.
+ *
+ * Jobs also have a priority class. Only the most urgent class waiting is
+ * served, so an interactive request goes ahead of queued batch work at the
+ * next job boundary. A job moves up one class for every aging_secs it waits,
+ * so background work is never starved. A job whose deadline is less than
+ * aging_secs away counts as interactive. Within a class, the earliest
+ * deadline goes first.
+ */
+
+typedef struct MChangerJobQueue MChangerJobQueue;
+
+/* The disc a job runs against */
+typedef struct {
+    int slot;
+    int drive;
+    char fingerprint[33];       /* "" unless a catalog is attached */
+    char volume[256];           /* "" if the disc did not mount (e.g. audio CD) */
+    char mount_path[1024];      /* "" if the disc did not mount */
+} MChangerJobDisc;
+
+typedef enum {
+    MCHANGER_PRIORITY_INTERACTIVE = 0,  /* Someone is waiting for the disc */
+    MCHANGER_PRIORITY_BATCH = 1,        /* Ingest, rebalance, bulk reads */
+    MCHANGER_PRIORITY_BACKGROUND = 2    /* Scrubbing, calibration */
+} MChangerJobPriority;
+
+/* Run a job. disc is NULL if its disc could not be loaded. Return 0 on success. */
+typedef int (*MChangerJobFn)(const MChangerJobDisc *disc, void *context);
+
+typedef struct {
+    size_t max_batch;           /* Jobs in a row from one disc while others wait (0 for 32) */
+    double max_wait_secs;       /* Longest a job waits before its disc goes next (0 for 300) */
+    double aging_secs;          /* Wait that lifts a job one priority class (0 for 600) */
+} MChangerQueueOptions;
+
+typedef struct {
+    size_t submitted;
+    size_t served;              /* Jobs run, including failed ones */
+    size_t failed;
+    size_t loads;               /* Disc swaps the worker performed */
+    size_t preempted;           /* Discs left with jobs pending for more urgent work */
+} MChangerQueueStats;
+
+/* Create a queue (NULL options for the defaults) */
+MChangerJobQueue *mchanger_queue_create(const MChangerQueueOptions *options);
+
+/* Destroy a queue. Pending jobs are dropped without running. */
+void mchanger_queue_destroy(MChangerJobQueue *queue);
+
+/* Add a batch-priority job for a slot's disc */
+int mchanger_queue_submit(MChangerJobQueue *queue, int slot, MChangerJobFn fn, void *context);
+
+/* Add a job with a priority class and a deadline in seconds from now (0 for none) */
+int mchanger_queue_submit_ex(MChangerJobQueue *queue, int slot, MChangerJobPriority priority,
+                             double deadline_secs, MChangerJobFn fn, void *context);
+
+size_t mchanger_queue_pending(MChangerJobQueue *queue);
+
+/* Slot the worker would serve next (0 if nothing is pending) */
+int mchanger_queue_next_slot(MChangerJobQueue *queue);
+
+/*
+ * Serve jobs through one drive until the queue is empty, or, with wait set,
+ * until mchanger_queue_stop() is called. The last disc is left loaded.
+ */
+int mchanger_queue_run(MChangerJobQueue *queue, MChangerHandle *changer, int drive, bool wait);
+
+/*
+ * True while a job of a more urgent class than the running one is waiting.
+ * Long jobs (a scan, a rebalance) check it between moves, and return early
+ * after resubmitting their remaining work.
+ */
+bool mchanger_queue_should_yield(MChangerJobQueue *queue);
+
+/* Make a waiting mchanger_queue_run() return once its current job finishes */
+void mchanger_queue_stop(MChangerJobQueue *queue);
+
+void mchanger_queue_get_stats(MChangerJobQueue *queue, MChangerQueueStats *out);
+
+/* Estimated robot time for the pending jobs' disc swaps through a drive (see mchanger_estimate_move_ms()) */
+int mchanger_queue_estimate_ms(MChangerJobQueue *queue, MChangerHandle *changer, int drive, uint64_t *out_ms);
+
 /*
  * Device info
  */
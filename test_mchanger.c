@@ -5,13 +5,21 @@
  *
  * Note: Most tests require a physical changer device to be connected.
  * Tests that require hardware will be skipped if no device is found.
+ *
+ * mchanger.c is compiled in, with the CLI's main() renamed, so tests can reach
+ * the library's internals and run its command paths against a fake changer.
  */
 
-#include "mchanger.h"
+#define main mchanger_main
+#include "mchanger.c"
+#undef main
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 static int tests_run = 0;
 static int tests_passed = 0;
@@ -105,12 +113,619 @@ TEST(api_null_changer_returns_invalid) {
     ASSERT_EQ(mchanger_get_element_map(NULL, &map), MCHANGER_ERR_INVALID, "get_element_map");
     ASSERT_EQ(mchanger_get_slot_status(NULL, 1, &status), MCHANGER_ERR_INVALID, "get_slot_status");
     ASSERT_EQ(mchanger_get_drive_status(NULL, 1, &status), MCHANGER_ERR_INVALID, "get_drive_status");
+    ASSERT_EQ(mchanger_get_slot_status_ex(NULL, 1, MCHANGER_STATUS_VERIFIED, &status),
+              MCHANGER_ERR_INVALID, "get_slot_status_ex");
+    ASSERT_EQ(mchanger_get_drive_status_ex(NULL, 1, MCHANGER_STATUS_CACHED, &status),
+              MCHANGER_ERR_INVALID, "get_drive_status_ex");
     ASSERT_EQ(mchanger_load_slot(NULL, 1, 1), MCHANGER_ERR_INVALID, "load_slot");
     ASSERT_EQ(mchanger_unload_drive(NULL, 1, 1), MCHANGER_ERR_INVALID, "unload_drive");
     ASSERT_EQ(mchanger_eject(NULL, 1, 1), MCHANGER_ERR_INVALID, "eject");
     ASSERT_EQ(mchanger_move_medium(NULL, 0, 0, 0), MCHANGER_ERR_INVALID, "move_medium");
     ASSERT_EQ(mchanger_test_unit_ready(NULL), MCHANGER_ERR_INVALID, "test_unit_ready");
+    MChangerDiscId id;
+    ASSERT_EQ(mchanger_identify_disc(NULL, 1, 1, &id), MCHANGER_ERR_INVALID, "identify_disc");
+    ASSERT_EQ(mchanger_load_slot_expect(NULL, 1, 1, "00"), MCHANGER_ERR_INVALID, "load_slot_expect");
+    ASSERT_EQ(mchanger_scan_library(NULL, false, 0, NULL, NULL), MCHANGER_ERR_INVALID, "scan_library");
+    int drive = -1;
+    ASSERT_EQ(mchanger_load_slot_auto(NULL, 1, &drive), MCHANGER_ERR_INVALID, "load_slot_auto");
+    ASSERT_EQ(drive, 0, "load_slot_auto clears out_drive");
+    ASSERT_EQ(mchanger_set_residency_policy(NULL, MCHANGER_RESIDENCY_ARC), MCHANGER_ERR_INVALID,
+              "set_residency_policy");
+    ASSERT_EQ(mchanger_set_idle_return(NULL, 60), MCHANGER_ERR_INVALID, "set_idle_return");
+    int free_slot = -1;
+    ASSERT_EQ(mchanger_pick_free_slot(NULL, true, &free_slot), MCHANGER_ERR_INVALID, "pick_free_slot");
+    ASSERT_EQ(free_slot, 0, "pick_free_slot clears out_slot");
+    ASSERT_EQ(mchanger_rebalance(NULL, 0, NULL), MCHANGER_ERR_INVALID, "rebalance");
+    uint32_t move_ms = 1;
+    ASSERT_EQ(mchanger_estimate_move_ms(NULL, 0, 0, 0, &move_ms), MCHANGER_ERR_INVALID, "estimate_move_ms");
+    ASSERT_EQ(move_ms, 0, "estimate_move_ms clears out_ms");
+    ASSERT_EQ(mchanger_calibrate(NULL, 4, NULL), MCHANGER_ERR_INVALID, "calibrate");
+    ASSERT_EQ(mchanger_save_inventory(NULL, NULL), MCHANGER_ERR_INVALID, "save_inventory");
+    uint16_t addrs[1] = { 0 };
+    ASSERT_EQ(mchanger_reserve_elements(NULL, addrs, 1, false), MCHANGER_ERR_INVALID, "reserve_elements");
+    mchanger_release_elements(NULL, addrs, 1);
+    ASSERT_EQ(mchanger_compare_and_move(NULL, 0, 1, 2, NULL), MCHANGER_ERR_INVALID, "compare_and_move");
+    ASSERT_EQ(mchanger_get_generation(NULL), 0, "get_generation");
+    ASSERT_EQ(mchanger_publish_board(NULL, NULL), MCHANGER_ERR_INVALID, "publish_board");
+    ASSERT_EQ(mchanger_board_read(NULL, NULL), MCHANGER_ERR_INVALID, "board_read");
+    ASSERT(mchanger_board_attach("/mchanger.test.none") == NULL, "board_attach without a board");
+    mchanger_board_detach(NULL);
+    ASSERT(mchanger_watch_open(NULL) == NULL, "watch_open");
+    size_t events = 1;
+    ASSERT_EQ(mchanger_watch_poll(NULL, NULL, 0, &events), MCHANGER_ERR_INVALID, "watch_poll");
+    ASSERT_EQ(events, 0, "watch_poll clears out_count");
+    mchanger_watch_close(NULL);
+    size_t ingested = 1;
+    ASSERT_EQ(mchanger_ingest(NULL, NULL, NULL, NULL, &ingested), MCHANGER_ERR_INVALID, "ingest");
+    ASSERT_EQ(ingested, 0, "ingest clears out_count");
+    int export_slots[1] = { 1 };
+    ASSERT_EQ(mchanger_export_batch(NULL, export_slots, 1, NULL, NULL, NULL), MCHANGER_ERR_INVALID, "export_batch");
+    ASSERT_EQ(mchanger_set_door_lock(NULL, true), MCHANGER_ERR_INVALID, "set_door_lock");
+    ASSERT_EQ(mchanger_prefetch_state(NULL), MCHANGER_PREFETCH_FAILED, "prefetch_state");
+    ASSERT_EQ(mchanger_prefetch_wait(NULL, 0), MCHANGER_ERR_INVALID, "prefetch_wait");
+    ASSERT_EQ(mchanger_get_prefetched_status(NULL, NULL), MCHANGER_ERR_INVALID, "get_prefetched_status");
+
+    PASS();
+}
+
+TEST(catalog_round_trip) {
+    char path[] = "/tmp/mchanger_catalog_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0, "mkstemp");
+    close(fd);
+
+    MChangerCatalog *catalog = mchanger_catalog_open(path);
+    ASSERT_NOT_NULL(catalog, "open empty catalog");
+    ASSERT_EQ(mchanger_catalog_count(catalog), 0, "new catalog is empty");
+
+    MChangerCatalogEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.slot = 42;
+    snprintf(entry.volume, sizeof(entry.volume), "Holiday Photos\t2019");
+    snprintf(entry.media_type, sizeof(entry.media_type), "DVD");
+    snprintf(entry.fingerprint, sizeof(entry.fingerprint), "0123456789abcdef");
+    entry.size_bytes = 4700000000ULL;
+    entry.last_seen = 1700000000;
+    entry.loads = 5;
+    ASSERT_EQ(mchanger_catalog_record(catalog, &entry), MCHANGER_OK, "record");
+    ASSERT_EQ(mchanger_catalog_save(catalog), MCHANGER_OK, "save");
+    mchanger_catalog_close(catalog);
+
+    catalog = mchanger_catalog_open(path);
+    ASSERT_NOT_NULL(catalog, "reopen");
+    MChangerCatalogEntry found;
+    ASSERT_EQ(mchanger_catalog_find_volume(catalog, "holiday photos 2019", &found), MCHANGER_OK,
+              "find volume (case-insensitive, tab flattened)");
+    ASSERT_EQ(found.slot, 42, "slot survives save");
+    ASSERT_EQ(found.size_bytes, 4700000000ULL, "size survives save");
+    ASSERT_EQ(found.last_seen, 1700000000, "last_seen survives save");
+    ASSERT_EQ(found.loads, 5, "load count survives save");
+    ASSERT_EQ(mchanger_catalog_find_fingerprint(catalog, "0123456789ABCDEF", &found), MCHANGER_OK,
+              "find fingerprint");
+
+    /* A second copy of the same disc in another slot leaves the first alone */
+    entry.slot = 7;
+    ASSERT_EQ(mchanger_catalog_record(catalog, &entry), MCHANGER_OK, "record second copy");
+    ASSERT_EQ(mchanger_catalog_get(catalog, 42, &found), MCHANGER_OK, "first copy kept");
+    ASSERT_EQ(mchanger_catalog_count(catalog), 2, "one entry per slot");
+
+    ASSERT_EQ(mchanger_catalog_forget(catalog, 42), MCHANGER_OK, "forget first copy");
+    ASSERT_EQ(mchanger_catalog_forget(catalog, 7), MCHANGER_OK, "forget");
+    ASSERT_EQ(mchanger_catalog_get(catalog, 7, &found), MCHANGER_ERR_NOT_FOUND, "forgotten");
+    mchanger_catalog_close(catalog);
+    unlink(path);
+
+    ASSERT_EQ(mchanger_catalog_record(NULL, &entry), MCHANGER_ERR_INVALID, "record NULL");
+    ASSERT_EQ(mchanger_catalog_count(NULL), 0, "count NULL");
+    mchanger_catalog_close(NULL);
+    PASS();
+}
+
+TEST(file_index_finds_files_by_name) {
+    char path[] = "/tmp/mchanger_catalog_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0, "mkstemp");
+    close(fd);
+    char root[] = "/tmp/mchanger_disc_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(root), "mkdtemp");
+
+    /* A tiny "disc": two photos in a folder and a readme */
+    char file[512];
+    snprintf(file, sizeof(file), "%s/DCIM", root);
+    ASSERT_EQ(mkdir(file, 0755), 0, "mkdir");
+    const char *names[] = { "DCIM/IMG_0001.JPG", "DCIM/IMG_0002.JPG", "ReadMe.txt" };
+    for (size_t i = 0; i < 3; i++) {
+        snprintf(file, sizeof(file), "%s/%s", root, names[i]);
+        FILE *fp = fopen(file, "w");
+        ASSERT_NOT_NULL(fp, "create file");
+        fputs("x", fp);
+        fclose(fp);
+    }
+
+    MChangerCatalog *catalog = mchanger_catalog_open(path);
+    ASSERT_NOT_NULL(catalog, "open catalog");
+    MChangerCatalogEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.slot = 9;
+    snprintf(entry.volume, sizeof(entry.volume), "Photos");
+    snprintf(entry.fingerprint, sizeof(entry.fingerprint), "00112233aabbccdd");
+    ASSERT_EQ(mchanger_catalog_record(catalog, &entry), MCHANGER_OK, "record");
+
+    size_t files = 0;
+    ASSERT_EQ(mchanger_catalog_index_files(catalog, 9, root, &files), MCHANGER_OK, "index files");
+    ASSERT_EQ(files, 3, "three files listed");
+    ASSERT_EQ(mchanger_catalog_index_files(catalog, 10, root, NULL), MCHANGER_ERR_NOT_FOUND,
+              "uncataloged slot");
+
+    MChangerFileIndex *index = mchanger_file_index_open(catalog);
+    ASSERT_NOT_NULL(index, "open index");
+    ASSERT_EQ(mchanger_file_index_count(index), 3, "index holds every file");
+
+    MChangerFileHit hits[4];
+    size_t total = 0;
+    ASSERT_EQ(mchanger_file_index_search(index, "img_0002", hits, 4, &total), MCHANGER_OK, "search");
+    ASSERT_EQ(total, 1, "one exact hit");
+    ASSERT_EQ(hits[0].slot, 9, "hit names the slot");
+    ASSERT(strcmp(hits[0].path, "DCIM/IMG_0002.JPG") == 0, "hit path is relative to the disc");
+    ASSERT_EQ(mchanger_file_index_search(index, "jpg", hits, 1, &total), MCHANGER_OK, "search");
+    ASSERT_EQ(total, 2, "total counts past max");
+    ASSERT_EQ(mchanger_file_index_search(index, "me", hits, 4, &total), MCHANGER_OK, "short search");
+    ASSERT_EQ(total, 1, "short queries scan names");
+    ASSERT_EQ(mchanger_file_index_search(index, "dcim", hits, 4, &total), MCHANGER_OK, "dir search");
+    ASSERT_EQ(total, 0, "directories are not file names");
+    mchanger_file_index_close(index);
+
+    char cmd[1200];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s' '%s.files'", root, path);
+    system(cmd);
+    mchanger_catalog_close(catalog);
+    unlink(path);
+    PASS();
+}
+
+TEST(image_cache_lookup_and_evict) {
+    char dir[] = "/tmp/mchanger_cache_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir), "mkdtemp");
+
+    /* One image on disk, plus an index line for an image that has gone missing */
+    char path[512];
+    snprintf(path, sizeof(path), "%s/aaaaaaaaaaaaaaaa.iso", dir);
+    FILE *fp = fopen(path, "w");
+    ASSERT_NOT_NULL(fp, "create image");
+    fputs("0123456789", fp);
+    fclose(fp);
+    snprintf(path, sizeof(path), "%s/index.tsv", dir);
+    fp = fopen(path, "w");
+    ASSERT_NOT_NULL(fp, "create index");
+    fputs("# mchanger cache v1\naaaaaaaaaaaaaaaa\t10\t100\t0\nbbbbbbbbbbbbbbbb\t10\t200\t0\n", fp);
+    fclose(fp);
+
+    MChangerImageCache *cache = mchanger_cache_open(dir, 1000);
+    ASSERT_NOT_NULL(cache, "open cache");
+    ASSERT_EQ(mchanger_cache_count(cache), 1, "missing images are dropped");
+    ASSERT_EQ(mchanger_cache_used_bytes(cache), 10, "size comes from the image");
+
+    char image[1100];
+    ASSERT_EQ(mchanger_cache_lookup(cache, "AAAAAAAAAAAAAAAA", image, sizeof(image)), MCHANGER_OK, "hit");
+    ASSERT(strstr(image, "aaaaaaaaaaaaaaaa.iso") != NULL, "image path");
+    MChangerCacheEntry e;
+    ASSERT_EQ(mchanger_cache_entry_at(cache, 0, &e), MCHANGER_OK, "entry");
+    ASSERT_EQ(e.hits, 1, "lookup counts as a hit");
+    ASSERT_EQ(mchanger_cache_lookup(cache, "bbbbbbbbbbbbbbbb", image, sizeof(image)), MCHANGER_ERR_NOT_FOUND,
+              "miss");
+
+    ASSERT_EQ(mchanger_cache_evict(cache, "aaaaaaaaaaaaaaaa"), MCHANGER_OK, "evict");
+    ASSERT_EQ(mchanger_cache_count(cache), 0, "evicted");
+    snprintf(path, sizeof(path), "%s/aaaaaaaaaaaaaaaa.iso", dir);
+    ASSERT(access(path, F_OK) != 0, "image file removed");
+    mchanger_cache_close(cache);
+
+    ASSERT_EQ(mchanger_cache_lookup(NULL, "aa", NULL, 0), MCHANGER_ERR_INVALID, "lookup NULL");
+    ASSERT_EQ(mchanger_fetch_image(NULL, NULL, 1, 1, image, sizeof(image)), MCHANGER_ERR_INVALID, "fetch NULL");
+
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    system(cmd);
+    PASS();
+}
+
+static int noop_job(const MChangerJobDisc *disc, void *context) {
+    (void)disc;
+    (void)context;
+    return 0;
+}
+
+TEST(job_queue_orders_by_arrival_until_a_disc_is_loaded) {
+    MChangerQueueOptions options = { .max_batch = 2, .max_wait_secs = 60 };
+    MChangerJobQueue *queue = mchanger_queue_create(&options);
+    ASSERT_NOT_NULL(queue, "create");
+    ASSERT_EQ(mchanger_queue_next_slot(queue), 0, "empty queue has no next slot");
+
+    ASSERT_EQ(mchanger_queue_submit(queue, 5, noop_job, NULL), MCHANGER_OK, "submit");
+    ASSERT_EQ(mchanger_queue_submit(queue, 3, noop_job, NULL), MCHANGER_OK, "submit");
+    ASSERT_EQ(mchanger_queue_submit(queue, 5, noop_job, NULL), MCHANGER_OK, "submit");
+    ASSERT_EQ(mchanger_queue_submit(queue, 0, noop_job, NULL), MCHANGER_ERR_INVALID, "slot 0");
+    ASSERT_EQ(mchanger_queue_submit(queue, 1, NULL, NULL), MCHANGER_ERR_INVALID, "no job function");
+
+    ASSERT_EQ(mchanger_queue_pending(queue), 3, "three pending");
+    ASSERT_EQ(mchanger_queue_next_slot(queue), 5, "oldest job's disc goes first");
+
+    MChangerQueueStats stats;
+    mchanger_queue_get_stats(queue, &stats);
+    ASSERT_EQ(stats.submitted, 3, "submitted count");
+    ASSERT_EQ(stats.served, 0, "nothing served yet");
+    ASSERT_EQ(mchanger_queue_run(queue, NULL, 1, false), MCHANGER_ERR_INVALID, "run needs a changer");
+
+    mchanger_queue_destroy(queue);
+    mchanger_queue_destroy(NULL);
+    PASS();
+}
+
+TEST(job_queue_serves_urgent_classes_first) {
+    MChangerJobQueue *queue = mchanger_queue_create(NULL);
+    ASSERT_NOT_NULL(queue, "create");
+
+    ASSERT_EQ(mchanger_queue_submit(queue, 5, noop_job, NULL), MCHANGER_OK, "batch job");
+    ASSERT_EQ(mchanger_queue_submit_ex(queue, 8, MCHANGER_PRIORITY_BACKGROUND, 0, noop_job, NULL),
+              MCHANGER_OK, "background job");
+    ASSERT_EQ(mchanger_queue_next_slot(queue), 5, "batch goes ahead of background");
+
+    ASSERT_EQ(mchanger_queue_submit_ex(queue, 7, MCHANGER_PRIORITY_INTERACTIVE, 0, noop_job, NULL),
+              MCHANGER_OK, "interactive job");
+    ASSERT_EQ(mchanger_queue_next_slot(queue), 7, "interactive jumps the queue");
+    ASSERT(!mchanger_queue_should_yield(queue), "nothing running to yield");
+
+    /* A deadline inside the aging window counts as interactive, earliest first */
+    ASSERT_EQ(mchanger_queue_submit_ex(queue, 9, MCHANGER_PRIORITY_BACKGROUND, 30, noop_job, NULL),
+              MCHANGER_OK, "job with a deadline");
+    ASSERT_EQ(mchanger_queue_next_slot(queue), 9, "nearest deadline goes first");
+
+    ASSERT_EQ(mchanger_queue_submit_ex(queue, 1, 3, 0, noop_job, NULL), MCHANGER_ERR_INVALID, "bad priority");
+    ASSERT_EQ(mchanger_queue_submit_ex(queue, 1, MCHANGER_PRIORITY_BATCH, -1, noop_job, NULL),
+              MCHANGER_ERR_INVALID, "negative deadline");
+    ASSERT_EQ(mchanger_queue_pending(queue), 4, "four pending");
+
+    mchanger_queue_destroy(queue);
+    PASS();
+}
+
+static bool write_text(const char *path, const char *text) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return false;
+    fputs(text, fp);
+    return fclose(fp) == 0;
+}
+
+/* What a saved inventory says an element holds */
+static bool inventory_holds(const char *path, const char *kind, unsigned addr, bool *full, unsigned *source) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return false;
+    char line[256], k[16];
+    unsigned a, f, src;
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || sscanf(line, "%15s %u %u %u", k, &a, &f, &src) != 4) continue;
+        if (strcmp(k, kind) == 0 && a == addr) {
+            *full = f != 0;
+            *source = src;
+            found = true;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+/* Six slots (0x1000-0x1005), two drives, one I/E port. Drive 1 holds slot 5's disc. */
+#define PLAN_INVENTORY "# mchanger inventory v1\n" \
+    "transport\t1\t0\t0\n" \
+    "slot\t4096\t1\t0\nslot\t4097\t1\t0\nslot\t4098\t1\t0\n" \
+    "slot\t4099\t0\t0\nslot\t4100\t0\t0\nslot\t4101\t0\t0\n" \
+    "drive\t512\t1\t4100\ndrive\t513\t0\t0\n" \
+    "ie\t256\t0\t0\n"
+
+TEST(plan_batch_checks_moves_and_tracks_layout) {
+    char dir[] = "/tmp/mchanger_plan_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir), "mkdtemp");
+    char inventory[512], ops[512], result[512], motion[512];
+    snprintf(inventory, sizeof(inventory), "%s/inventory.tsv", dir);
+    snprintf(ops, sizeof(ops), "%s/ops.txt", dir);
+    snprintf(result, sizeof(result), "%s/result.tsv", dir);
+    snprintf(motion, sizeof(motion), "%s/motion.tsv", dir);
+    ASSERT(write_text(inventory, PLAN_INVENTORY), "write inventory");
+    ASSERT(write_text(ops,
+                      "load --slot 1 --drive 2\n"
+                      "load --slot 2 --drive 1   # slot 5's disc goes home first\n"
+                      "unload --slot 3 --drive 2\n"
+                      "move --source 0x1005 --dest 0x1002\n"
+                      "\n"
+                      "retrieve --slot 3\n"
+                      "insert --slot 4\n"
+                      "load --slot 9\n"), "write ops");
+
+    MChangerPlanOptions options = { .motion_path = motion, .save_path = result };
+    MChangerPlanResult plan;
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan");
+    ASSERT_EQ(plan.operations, 7, "blank lines are not operations");
+    ASSERT_EQ(plan.illegal, 3, "full slot, empty source and bad slot are refused");
+    ASSERT_EQ(plan.moves, 5, "legal operations' moves");
+    ASSERT(!plan.estimated, "no motion log, no estimate");
+    ASSERT_EQ(plan.robot_ms, 0, "no estimate");
+
+    bool full;
+    unsigned source;
+    static const struct { unsigned addr; bool full; } slots[] = {
+        { 0x1000, false }, { 0x1001, false }, { 0x1002, false },
+        { 0x1003, true }, { 0x1004, true }, { 0x1005, false },
+    };
+    for (size_t i = 0; i < 6; i++) {
+        ASSERT(inventory_holds(result, "slot", slots[i].addr, &full, &source), "slot saved");
+        ASSERT_EQ(full, slots[i].full, "slot occupancy after the plan");
+    }
+    ASSERT(inventory_holds(result, "drive", 0x200, &full, &source), "drive 1 saved");
+    ASSERT(full && source == 0x1001, "drive 1 holds slot 2's disc");
+    ASSERT(inventory_holds(result, "drive", 0x201, &full, &source), "drive 2 saved");
+    ASSERT(full && source == 0x1000, "drive 2 holds slot 1's disc");
+    ASSERT(inventory_holds(inventory, "drive", 0x200, &full, &source) && source == 0x1004,
+           "snapshot itself is left alone");
+
+    /* Planning again from the result: slot 2's disc is already in drive 1 */
+    ASSERT(write_text(ops, "load --slot 2 --drive 1\nunload --slot 2 --drive 1\nfrobnicate\n"), "write ops");
+    options.save_path = NULL;
+    ASSERT_EQ(mchanger_plan_batch(result, ops, &options, &plan), MCHANGER_OK, "plan from result");
+    ASSERT_EQ(plan.operations, 3, "three operations");
+    ASSERT_EQ(plan.illegal, 1, "unknown operation");
+    ASSERT_EQ(plan.moves, 1, "a loaded disc is not loaded again");
+
+    ASSERT_EQ(mchanger_plan_batch(ops, ops, &options, &plan), MCHANGER_ERR_INVALID, "not an inventory");
+    ASSERT_EQ(mchanger_plan_batch(motion, ops, &options, &plan), MCHANGER_ERR_NOT_FOUND, "no inventory");
+    ASSERT_EQ(mchanger_plan_batch(inventory, NULL, &options, &plan), MCHANGER_ERR_INVALID, "no ops");
+
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    system(cmd);
+    PASS();
+}
+
+/* Eight slots on a carousel, nearest the drives at slot 1. Drive 1 holds slot 2's disc. */
+#define RING_INVENTORY "# mchanger inventory v1\n" \
+    "transport\t1\t0\t0\n" \
+    "slot\t4096\t1\t0\nslot\t4097\t0\t0\nslot\t4098\t0\t0\nslot\t4099\t1\t0\n" \
+    "slot\t4100\t1\t0\nslot\t4101\t0\t0\nslot\t4102\t0\t0\nslot\t4103\t0\t0\n" \
+    "drive\t512\t1\t4097\ndrive\t513\t0\t0\n" \
+    "ie\t256\t0\t0\n"
+
+TEST(placement_and_rebalance_plan_by_distance) {
+    char dir[] = "/tmp/mchanger_plan_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir), "mkdtemp");
+    char inventory[512], ops[512], result[512], motion[512], catalog_path[512];
+    snprintf(inventory, sizeof(inventory), "%s/inventory.tsv", dir);
+    snprintf(ops, sizeof(ops), "%s/ops.txt", dir);
+    snprintf(result, sizeof(result), "%s/result.tsv", dir);
+    snprintf(motion, sizeof(motion), "%s/motion.tsv", dir);
+    snprintf(catalog_path, sizeof(catalog_path), "%s/catalog.tsv", dir);
+    ASSERT(write_text(inventory, RING_INVENTORY), "write inventory");
+
+    /* Hot goes nearest (slot 8 wraps around to sit next to slot 1), cold farthest,
+       ties to the lower slot; slot 2 belongs to the loaded disc */
+    ASSERT(write_text(ops, "insert --slot auto --hot\ninsert --slot auto\ninsert --slot auto\n"), "write ops");
+    MChangerPlanOptions options = { .near_slot = 1, .ring = true, .motion_path = motion, .save_path = result };
+    MChangerPlanResult plan;
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan inserts");
+    ASSERT_EQ(plan.illegal, 0, "inserts are legal");
+    ASSERT_EQ(plan.moves, 3, "one move per insert");
+    bool full;
+    unsigned source;
+    static const bool after_inserts[8] = { true, false, true, true, true, true, false, true };
+    for (unsigned i = 0; i < 8; i++) {
+        ASSERT(inventory_holds(result, "slot", 0x1000 + i, &full, &source), "slot saved");
+        ASSERT_EQ(full, after_inserts[i], "inserted discs land by distance");
+    }
+
+    /* On a straight magazine the hot disc goes to slot 3 instead */
+    ASSERT(write_text(ops, "insert --slot auto --hot\n"), "write ops");
+    options.ring = false;
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan straight");
+    ASSERT(inventory_holds(result, "slot", 0x1002, &full, &source) && full, "nearest free slot on a line");
+    options.ring = true;
+
+    /* Rebalance: slot 5's disc is hottest, so slot 1's cold disc moves to the
+       farthest free slot (6) to make way; slot 4's goes to slot 8 */
+    ASSERT(write_text(ops, "rebalance\n"), "write ops");
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan without catalog");
+    ASSERT_EQ(plan.illegal, 1, "rebalance needs a catalog");
+
+    MChangerCatalog *catalog = mchanger_catalog_open(catalog_path);
+    ASSERT_NOT_NULL(catalog, "open catalog");
+    MChangerCatalogEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    static const struct { int slot; uint32_t loads; } heat[] = { { 1, 0 }, { 4, 3 }, { 5, 10 } };
+    for (size_t i = 0; i < 3; i++) {
+        entry.slot = heat[i].slot;
+        entry.loads = heat[i].loads;
+        snprintf(entry.fingerprint, sizeof(entry.fingerprint), "%016zx", i + 1);
+        ASSERT_EQ(mchanger_catalog_record(catalog, &entry), MCHANGER_OK, "record");
+    }
+    options.catalog = catalog;
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan rebalance");
+    ASSERT_EQ(plan.illegal, 0, "rebalance is legal");
+    ASSERT_EQ(plan.moves, 3, "make way, then two hot discs");
+    static const bool after_rebalance[8] = { true, false, false, false, false, true, false, true };
+    for (unsigned i = 0; i < 8; i++) {
+        ASSERT(inventory_holds(result, "slot", 0x1000 + i, &full, &source), "slot saved");
+        ASSERT_EQ(full, after_rebalance[i], "hot discs move toward the drives");
+    }
+    ASSERT(inventory_holds(result, "slot", 0x1000, &full, &source) && source == 0x1004, "slot 5's disc in slot 1");
+
+    ASSERT(write_text(ops, "rebalance --moves 2\n"), "write ops");
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan short rebalance");
+    ASSERT_EQ(plan.moves, 2, "move budget is kept");
+    mchanger_catalog_close(catalog);
 
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    system(cmd);
+    PASS();
+}
+
+TEST(motion_model_estimates_plan_time) {
+    char dir[] = "/tmp/mchanger_plan_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir), "mkdtemp");
+    char inventory[512], ops[512], motion[512];
+    snprintf(inventory, sizeof(inventory), "%s/inventory.tsv", dir);
+    snprintf(ops, sizeof(ops), "%s/ops.txt", dir);
+    snprintf(motion, sizeof(motion), "%s/motion.tsv", dir);
+    ASSERT(write_text(inventory, PLAN_INVENTORY), "write inventory");
+
+    /* Loads take 2000 ms + 500 ms per slot from slot 1, unloads 1500 ms + 200 ms */
+    ASSERT(write_text(motion,
+                      "# mchanger motion v1\n"
+                      "1\t4096\t513\t2000\n1\t4098\t513\t3000\n1\t4100\t513\t4000\n"
+                      "1\t513\t4096\t1500\n1\t513\t4100\t2300\n"), "write motion log");
+
+    MChangerPlanOptions options = { .near_slot = 1, .motion_path = motion };
+    MChangerPlanResult plan;
+    ASSERT(write_text(ops, "load --slot 2 --drive 2\n"), "write ops");
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan load");
+    ASSERT(plan.estimated, "loads have been timed");
+    ASSERT_EQ(plan.robot_ms, 2500, "load estimate follows the fitted line");
+
+    /* Drive 1's disc goes home to slot 5 first; a kind never timed (export)
+       costs the average of every logged move */
+    ASSERT(write_text(ops, "load --slot 2 --drive 2\nload --slot 3 --drive 1\nretrieve --slot 1\n"), "write ops");
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan batch");
+    ASSERT_EQ(plan.moves, 4, "four moves");
+    ASSERT(plan.estimated, "every move estimated");
+    ASSERT_EQ(plan.robot_ms, 2500 + 2300 + 3000 + 2560, "per-kind lines plus the fallback");
+
+    ASSERT_EQ(unlink(motion), 0, "remove motion log");
+    ASSERT(write_text(ops, "load --slot 2 --drive 2\n"), "write ops");
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan without a log");
+    ASSERT(!plan.estimated, "nothing logged, no estimate");
+
+    uint32_t ms = 7;
+    ASSERT_EQ(mchanger_estimate_move_ms(NULL, 0, 0, 0, &ms), MCHANGER_ERR_INVALID, "estimate NULL");
+    ASSERT_EQ(ms, 0, "estimate cleared");
+
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    system(cmd);
+    PASS();
+}
+
+TEST(idle_return_sends_discs_to_free_home_slots) {
+    char dir[] = "/tmp/mchanger_plan_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir), "mkdtemp");
+    char inventory[512], ops[512], result[512], motion[512];
+    snprintf(inventory, sizeof(inventory), "%s/inventory.tsv", dir);
+    snprintf(ops, sizeof(ops), "%s/ops.txt", dir);
+    snprintf(result, sizeof(result), "%s/result.tsv", dir);
+    snprintf(motion, sizeof(motion), "%s/motion.tsv", dir);
+
+    /* Four loaded drives: home slot 2 is free, home slot 3 has been refilled,
+       one source is unknown and one disc came in through the I/E port */
+    ASSERT(write_text(inventory,
+                      "# mchanger inventory v1\n"
+                      "transport\t1\t0\t0\n"
+                      "slot\t4096\t1\t0\nslot\t4097\t0\t0\nslot\t4098\t1\t0\nslot\t4099\t0\t0\n"
+                      "drive\t512\t1\t4097\ndrive\t513\t1\t4098\ndrive\t514\t1\t0\ndrive\t515\t1\t256\n"
+                      "ie\t256\t0\t0\n"), "write inventory");
+    ASSERT(write_text(ops, "return\n"), "write ops");
+
+    MChangerPlanOptions options = { .motion_path = motion, .save_path = result };
+    MChangerPlanResult plan;
+    ASSERT_EQ(mchanger_plan_batch(inventory, ops, &options, &plan), MCHANGER_OK, "plan return");
+    ASSERT_EQ(plan.illegal, 0, "discs that can't go home are left, not refused");
+    ASSERT_EQ(plan.moves, 1, "only the disc with a free home slot goes back");
+
+    bool full;
+    unsigned source;
+    ASSERT(inventory_holds(result, "drive", 0x200, &full, &source) && !full, "drive 1 emptied");
+    ASSERT(inventory_holds(result, "slot", 0x1001, &full, &source) && full && source == 0x200,
+           "disc back in slot 2");
+    static const unsigned kept[] = { 0x201, 0x202, 0x203 };
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT(inventory_holds(result, "drive", kept[i], &full, &source) && full, "other drives keep their discs");
+    }
+
+    ASSERT_EQ(mchanger_plan_batch(result, ops, &options, &plan), MCHANGER_OK, "plan return again");
+    ASSERT_EQ(plan.moves, 0, "nothing left to send home");
+
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    system(cmd);
+    PASS();
+}
+
+/* Every index maps to an address that maps back to it */
+static bool element_list_round_trips(const ElementList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (element_list_index(list, element_addr(list, i)) != (int)i + 1) return false;
+    }
+    return true;
+}
+
+TEST(element_lists_map_addresses_and_indexes) {
+    ElementList contiguous = {0}, gapped = {0}, single = {0}, unordered = {0}, empty = {0};
+    for (uint16_t a = 0x1000; a < 0x1000 + 500; a++) ASSERT(element_list_push(&contiguous, a), "push slot");
+    static const uint16_t gapped_addrs[] = { 0x100, 0x101, 0x102, 0x200, 0x201, 0x300 };
+    for (size_t i = 0; i < 6; i++) ASSERT(element_list_push(&gapped, gapped_addrs[i]), "push gapped");
+    ASSERT(element_list_push(&single, 0x0001), "push transport");
+    static const uint16_t unordered_addrs[] = { 0x300, 0x301, 0x100, 0x101 };
+    for (size_t i = 0; i < 4; i++) ASSERT(element_list_push(&unordered, unordered_addrs[i]), "push unordered");
+
+    ASSERT(contiguous.run_count == 1 && contiguous.count == 500, "contiguous list is one run");
+    ASSERT_EQ(element_addr(&contiguous, 0), 0x1000, "first slot");
+    ASSERT_EQ(element_addr(&contiguous, 499), 0x1000 + 499, "last slot");
+    ASSERT_EQ(element_list_index(&contiguous, 0x1000 + 250), 251, "slot 251");
+    ASSERT(element_list_round_trips(&contiguous), "contiguous round trip");
+
+    ASSERT(gapped.run_count == 3 && gapped.count == 6 && !gapped.unordered, "a run per gap");
+    for (size_t i = 0; i < 6; i++) ASSERT_EQ(element_addr(&gapped, i), gapped_addrs[i], "gapped addresses");
+    ASSERT(element_list_round_trips(&gapped), "gapped round trip");
+    ASSERT_EQ(element_list_index(&gapped, 0x0FF), 0, "below the first run");
+    ASSERT_EQ(element_list_index(&gapped, 0x103), 0, "in a gap");
+    ASSERT_EQ(element_list_index(&gapped, 0x301), 0, "past the last run");
+
+    ASSERT(single.run_count == 1 && single.count == 1, "singleton");
+    ASSERT_EQ(element_addr(&single, 0), 0x0001, "singleton address");
+    ASSERT_EQ(element_list_index(&single, 0x0001), 1, "singleton index");
+    ASSERT_EQ(element_list_index(&single, 0x0002), 0, "not in the singleton");
+
+    ASSERT(unordered.unordered, "runs out of address order noticed");
+    ASSERT(element_list_round_trips(&unordered), "unordered round trip");
+    ASSERT_EQ(element_list_index(&unordered, 0x101), 4, "found by scan");
+
+    ASSERT_EQ(element_addr(&empty, 0), 0, "empty list has no address");
+    ASSERT_EQ(element_list_index(&empty, 0x1000), 0, "empty list has no index");
+
+    element_list_free(&contiguous);
+    element_list_free(&gapped);
+    element_list_free(&single);
+    element_list_free(&unordered);
+    PASS();
+}
+
+TEST(parse_slot_list_ranges_and_errors) {
+    int *slots = NULL;
+    size_t n = 0;
+    ASSERT(parse_slot_list("10-50,77", 100, &slots, &n), "ranges and single slots");
+    ASSERT_EQ(n, 42, "41 slots from 10-50 plus 77");
+    ASSERT(slots[0] == 10 && slots[40] == 50 && slots[41] == 77, "sorted");
+    free(slots);
+
+    ASSERT(parse_slot_list("5-8,1-6,6", 10, &slots, &n), "overlapping ranges");
+    ASSERT_EQ(n, 8, "overlaps counted once");
+    for (size_t i = 0; i < n; i++) ASSERT_EQ(slots[i], (int)i + 1, "slots 1-8 in order");
+    free(slots);
+
+    ASSERT(!parse_slot_list("5-3", 10, &slots, &n), "reversed range");
+    ASSERT(!parse_slot_list("0", 10, &slots, &n), "slot 0");
+    ASSERT(!parse_slot_list("1,2,", 10, &slots, &n), "trailing comma");
+    ASSERT(!parse_slot_list("11", 10, &slots, &n), "slot past the last");
+    ASSERT(!parse_slot_list("8-12", 10, &slots, &n), "range past the last slot");
+    ASSERT(!parse_slot_list("", 10, &slots, &n), "empty list");
+    ASSERT(!parse_slot_list("3,x", 10, &slots, &n), "junk");
+    ASSERT(slots == NULL && n == 0, "nothing returned on failure");
     PASS();
 }
 
@@ -125,6 +740,695 @@ TEST(api_invalid_slot_returns_invalid) {
     PASS();
 }
 
+/*
+ * =============================================================================
+ * Fake Changer Tests (no hardware required)
+ *
+ * A SCSITask device that answers from memory, so the library's command paths
+ * run without a changer. Descriptors follow SMC-3: 12 bytes, no volume tags.
+ * =============================================================================
+ */
+
+#define FAKE_TRANSPORT 0x0001
+#define FAKE_FIRST_IE 0x0100
+#define FAKE_FIRST_DRIVE 0x0200
+#define FAKE_FIRST_SLOT 0x1000
+#define FAKE_MAX_ELEMENTS 1200
+
+/* What the next MOVE MEDIUM does after reporting success */
+typedef enum {
+    FAKE_MOVE_OK = 0,
+    FAKE_MOVE_MISS,             /* the robot never picks the disc */
+    FAKE_MOVE_IN_ROBOT,         /* the disc stays in the robot */
+    FAKE_MOVE_JAM,              /* the disc stays in the robot, which then refuses to move */
+    FAKE_MOVE_NOT_SEATED,       /* the disc lands in the destination with an exception */
+    FAKE_MOVE_NO_STATUS         /* the disc moves, then status reads fail */
+} FakeMove;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t type;               /* SMC element type code */
+    bool full;
+    bool except;
+    uint16_t source;            /* 0 when unknown */
+} FakeElement;
+
+static struct {
+    pthread_mutex_t lock;
+    FakeElement elements[FAKE_MAX_ELEMENTS];
+    size_t count;
+    size_t page_size;           /* descriptors per READ ELEMENT STATUS, 0 for all */
+    bool no_curdata;            /* reject CURDATA as an invalid CDB field */
+    bool jammed;
+    bool no_status;
+    int res_delay_ms;
+    FakeMove next_move;
+    int moves;                  /* MOVE MEDIUM commands received */
+    int prevent;                /* last PREVENT ALLOW MEDIUM REMOVAL setting */
+} fake = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+typedef struct {
+    SCSITaskInterface *vtable;
+    uint8_t cdb[16];
+    uint8_t *buffer;
+    uint64_t length;
+} FakeTask;
+
+static void fake_add(uint8_t type, uint16_t first, size_t n) {
+    for (size_t i = 0; i < n && fake.count < FAKE_MAX_ELEMENTS; i++) {
+        fake.elements[fake.count++] = (FakeElement){ .addr = (uint16_t)(first + i), .type = type };
+    }
+}
+
+/* One transport, then I/E ports, drives and slots at the FAKE_FIRST_* addresses */
+static void fake_reset(size_t slots, size_t drives, size_t ies) {
+    pthread_mutex_lock(&fake.lock);
+    fake.count = 0;
+    fake.page_size = 0;
+    fake.no_curdata = fake.jammed = fake.no_status = false;
+    fake.res_delay_ms = 0;
+    fake.next_move = FAKE_MOVE_OK;
+    fake.moves = 0;
+    fake.prevent = 0;
+    fake_add(1, FAKE_TRANSPORT, 1);
+    fake_add(3, FAKE_FIRST_IE, ies);
+    fake_add(4, FAKE_FIRST_DRIVE, drives);
+    fake_add(2, FAKE_FIRST_SLOT, slots);
+    pthread_mutex_unlock(&fake.lock);
+}
+
+static FakeElement *fake_find(uint16_t addr) {
+    for (size_t i = 0; i < fake.count; i++) {
+        if (fake.elements[i].addr == addr) return &fake.elements[i];
+    }
+    return NULL;
+}
+
+static void fake_set(uint16_t addr, bool full, uint16_t source) {
+    pthread_mutex_lock(&fake.lock);
+    FakeElement *e = fake_find(addr);
+    if (e) {
+        e->full = full;
+        e->source = source;
+    }
+    pthread_mutex_unlock(&fake.lock);
+}
+
+static bool fake_full(uint16_t addr) {
+    pthread_mutex_lock(&fake.lock);
+    FakeElement *e = fake_find(addr);
+    bool full = e && e->full;
+    pthread_mutex_unlock(&fake.lock);
+    return full;
+}
+
+static void fake_check_condition(SCSI_Sense_Data *sense, SCSITaskStatus *status, uint8_t key, uint8_t asc,
+                                 uint8_t ascq) {
+    *status = kSCSITaskStatus_CHECK_CONDITION;
+    sense->SENSE_KEY = key;
+    sense->ADDITIONAL_SENSE_CODE = asc;
+    sense->ADDITIONAL_SENSE_CODE_QUALIFIER = ascq;
+}
+
+/* READ ELEMENT STATUS: element type pages from start, in type order */
+static uint64_t fake_read_element_status(const uint8_t *cdb, uint8_t *buf, uint64_t len) {
+    uint8_t type = cdb[1] & 0x0F;
+    uint16_t start = (uint16_t)((cdb[2] << 8) | cdb[3]);
+    size_t want = (size_t)((cdb[4] << 8) | cdb[5]);
+    if (fake.page_size && want > fake.page_size) want = fake.page_size;
+
+    size_t cap = 8 + 4 * 8 + fake.count * 12;
+    uint8_t *out = calloc(1, cap);
+    if (!out) return 0;
+    size_t offset = 8, total = 0;
+    uint16_t first = 0xFFFF;
+    for (uint8_t t = 1; t <= 4; t++) {
+        if (type && t != type) continue;
+        size_t header = offset, n = 0;
+        offset += 8;
+        for (size_t i = 0; i < fake.count && total < want; i++) {
+            const FakeElement *e = &fake.elements[i];
+            if (e->type != t || e->addr < start) continue;
+            uint8_t *d = out + offset;
+            d[0] = e->addr >> 8;
+            d[1] = e->addr & 0xFF;
+            d[2] = (e->full ? 0x01 : 0) | (e->except ? 0x04 : 0) | 0x08;
+            if (e->source) {
+                d[9] = 0x80;
+                d[10] = e->source >> 8;
+                d[11] = e->source & 0xFF;
+            }
+            if (e->addr < first) first = e->addr;
+            offset += 12;
+            n++;
+            total++;
+        }
+        if (n == 0) {
+            offset = header;
+            continue;
+        }
+        uint32_t page_bytes = (uint32_t)(n * 12);
+        out[header] = t;
+        out[header + 3] = 12;
+        out[header + 5] = (page_bytes >> 16) & 0xFF;
+        out[header + 6] = (page_bytes >> 8) & 0xFF;
+        out[header + 7] = page_bytes & 0xFF;
+    }
+    uint32_t report_bytes = (uint32_t)(offset - 8);
+    out[0] = first >> 8;
+    out[1] = first & 0xFF;
+    out[2] = (total >> 8) & 0xFF;
+    out[3] = total & 0xFF;
+    out[5] = (report_bytes >> 16) & 0xFF;
+    out[6] = (report_bytes >> 8) & 0xFF;
+    out[7] = report_bytes & 0xFF;
+
+    uint32_t alloc = ((uint32_t)(cdb[6] & ~0x03u) << 16) | (cdb[7] << 8) | cdb[8];
+    uint64_t n = offset < alloc ? offset : alloc;
+    if (n > len) n = len;
+    memcpy(buf, out, (size_t)n);
+    free(out);
+    return n;
+}
+
+/* MODE SENSE(10), element address assignment page */
+static uint64_t fake_mode_sense(uint8_t *buf, uint64_t len) {
+    uint8_t page[28] = {0};
+    page[8] = 0x1D;
+    page[9] = 18;
+    uint8_t *p = page + 10;
+    static const uint8_t types[4] = { 1, 2, 3, 4 };
+    for (size_t k = 0; k < 4; k++) {
+        uint16_t first = 0, n = 0;
+        for (size_t i = 0; i < fake.count; i++) {
+            if (fake.elements[i].type != types[k]) continue;
+            if (n++ == 0) first = fake.elements[i].addr;
+        }
+        uint8_t *f = p + k * 4;
+        f[0] = first >> 8;
+        f[1] = first & 0xFF;
+        f[2] = n >> 8;
+        f[3] = n & 0xFF;
+    }
+    page[1] = sizeof(page) - 2;
+    uint64_t n = len < sizeof(page) ? len : sizeof(page);
+    memcpy(buf, page, (size_t)n);
+    return n;
+}
+
+static void fake_move_medium(const uint8_t *cdb, SCSI_Sense_Data *sense, SCSITaskStatus *status) {
+    fake.moves++;
+    uint16_t transport = (uint16_t)((cdb[2] << 8) | cdb[3]);
+    FakeElement *robot = fake_find(transport);
+    FakeElement *src = fake_find((uint16_t)((cdb[4] << 8) | cdb[5]));
+    FakeElement *dst = fake_find((uint16_t)((cdb[6] << 8) | cdb[7]));
+    if (!robot || !src || !dst || !src->full || (dst->full && dst != src)) {
+        fake_check_condition(sense, status, kSENSE_KEY_ILLEGAL_REQUEST, 0x3B, 0x0E);
+        return;
+    }
+    if (fake.jammed) {
+        fake_check_condition(sense, status, kSENSE_KEY_HARDWARE_ERROR, 0x15, 0x01);
+        return;
+    }
+    FakeMove outcome = fake.next_move;
+    fake.next_move = FAKE_MOVE_OK;
+    switch (outcome) {
+    case FAKE_MOVE_MISS:
+        return;
+    case FAKE_MOVE_IN_ROBOT:
+    case FAKE_MOVE_JAM:
+        src->full = false;
+        robot->full = true;
+        robot->source = src->addr;
+        fake.jammed = outcome == FAKE_MOVE_JAM;
+        return;
+    default:
+        break;
+    }
+    dst->source = src == robot ? robot->source : src->addr;
+    src->full = false;
+    src->source = 0;
+    dst->full = true;
+    dst->except = outcome == FAKE_MOVE_NOT_SEATED;
+    fake.no_status = outcome == FAKE_MOVE_NO_STATUS;
+}
+
+static IOReturn fake_execute(void *self, SCSI_Sense_Data *sense, SCSITaskStatus *status, UInt64 *transferred) {
+    FakeTask *task = self;
+    const uint8_t *cdb = task->cdb;
+    *status = kSCSITaskStatus_GOOD;
+    *transferred = 0;
+
+    if (cdb[0] == 0xB8 && fake.res_delay_ms > 0) usleep((useconds_t)fake.res_delay_ms * 1000);
+    pthread_mutex_lock(&fake.lock);
+    switch (cdb[0]) {
+    case 0xB8: /* READ ELEMENT STATUS */
+        if (fake.no_status) {
+            fake_check_condition(sense, status, kSENSE_KEY_HARDWARE_ERROR, 0x40, 0x00);
+        } else if (fake.no_curdata && (cdb[6] & 0x02)) {
+            fake_check_condition(sense, status, kSENSE_KEY_ILLEGAL_REQUEST, 0x24, 0x00);
+        } else {
+            *transferred = fake_read_element_status(cdb, task->buffer, task->length);
+        }
+        break;
+    case 0x5A: /* MODE SENSE(10) */
+        *transferred = fake_mode_sense(task->buffer, task->length);
+        break;
+    case 0xA5: /* MOVE MEDIUM */
+        fake_move_medium(cdb, sense, status);
+        break;
+    case 0x1E: /* PREVENT ALLOW MEDIUM REMOVAL */
+        fake.prevent = cdb[4] & 0x03;
+        break;
+    default:
+        break;
+    }
+    pthread_mutex_unlock(&fake.lock);
+    return kIOReturnSuccess;
+}
+
+static IOReturn fake_set_attribute(void *self, SCSITaskAttribute attribute) {
+    (void)self;
+    (void)attribute;
+    return kIOReturnSuccess;
+}
+
+static IOReturn fake_set_cdb(void *self, UInt8 *cdb, UInt8 size) {
+    FakeTask *task = self;
+    memcpy(task->cdb, cdb, size < sizeof(task->cdb) ? size : sizeof(task->cdb));
+    return kIOReturnSuccess;
+}
+
+static IOReturn fake_set_buffers(void *self, SCSITaskSGElement *list, UInt8 entries, UInt64 count,
+                                 UInt8 direction) {
+    FakeTask *task = self;
+    (void)direction;
+    task->buffer = entries ? (uint8_t *)(uintptr_t)list[0].address : NULL;
+    task->length = entries ? count : 0;
+    return kIOReturnSuccess;
+}
+
+static IOReturn fake_set_timeout(void *self, UInt32 ms) {
+    (void)self;
+    (void)ms;
+    return kIOReturnSuccess;
+}
+
+static ULONG fake_task_release(void *self) {
+    free(self);
+    return 0;
+}
+
+static SCSITaskInterface fake_task_vtable = {
+    .Release = fake_task_release,
+    .SetTaskAttribute = fake_set_attribute,
+    .SetCommandDescriptorBlock = fake_set_cdb,
+    .SetScatterGatherEntries = fake_set_buffers,
+    .SetTimeoutDuration = fake_set_timeout,
+    .ExecuteTaskSync = fake_execute,
+};
+
+static SCSITaskInterface **fake_create_task(void *self) {
+    (void)self;
+    FakeTask *task = calloc(1, sizeof(FakeTask));
+    if (!task) return NULL;
+    task->vtable = &fake_task_vtable;
+    return &task->vtable;
+}
+
+static ULONG fake_device_release(void *self) {
+    (void)self;
+    return 0;
+}
+
+static SCSITaskDeviceInterface fake_device_vtable = {
+    .Release = fake_device_release,
+    .CreateSCSITask = fake_create_task,
+};
+static SCSITaskDeviceInterface *fake_device = &fake_device_vtable;
+
+/* A handle on the fake changer, as mchanger_open() would return one */
+static MChangerHandle *fake_open(void) {
+    ChangerHandle internal = {0};
+    internal.backend = BACKEND_SCSITASK;
+    internal.scsi_device = &fake_device;
+    internal.quiet = true;
+    return handle_create(internal);
+}
+
+TEST(storage_map_reads_pages_in_order) {
+    uint16_t start, count;
+    storage_page_span(0x1028, 0x1064, 40, 0, &start, &count);
+    ASSERT(start == 0x1028 && count == 40, "first page after the probe");
+    storage_page_span(0x1028, 0x1064, 40, 1, &start, &count);
+    ASSERT(start == 0x1050 && count == 20, "last page cut at the end");
+    storage_page_span(0xFFD8, 0x10000, 40, 0, &start, &count);
+    ASSERT(start == 0xFFD8 && count == 40, "page ending at the top of the address space");
+
+    /* 300 slots 40 to a page: more pages than workers, so buffers are reused */
+    fake_reset(300, 1, 1);
+    fake.page_size = 40;
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+    ElementMap map = {0};
+    ASSERT_EQ(fetch_element_map(&changer->internal, &map), 0, "map read");
+    ASSERT_EQ(map.slots.count, 300, "every slot");
+    bool in_order = true;
+    for (size_t i = 0; i < map.slots.count; i++) in_order &= element_addr(&map.slots, i) == FAKE_FIRST_SLOT + i;
+    ASSERT(in_order, "slots in address order");
+    element_map_free(&map);
+    mchanger_close(changer);
+    PASS();
+}
+
+TEST(legacy_status_falls_back_without_curdata) {
+    ASSERT_EQ(status_mode_flags(MCHANGER_STATUS_CACHED, false), RES_MEMORY, "legacy CACHED may fall back");
+    ASSERT_EQ(status_mode_flags(MCHANGER_STATUS_CACHED, true), RES_CURDATA, "_ex CACHED stays strict");
+    ASSERT_EQ(status_mode_flags(MCHANGER_STATUS_VERIFIED, false), 0, "legacy VERIFIED");
+    ASSERT_EQ(status_mode_flags(MCHANGER_STATUS_VERIFIED, true), 0, "_ex VERIFIED");
+
+    fake_reset(4, 1, 0);
+    fake.no_curdata = true;
+    fake_set(FAKE_FIRST_SLOT + 1, true, 0);
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+
+    /* The second read comes after the changer has been marked as lacking CURDATA */
+    MChangerElementStatus status;
+    for (int pass = 0; pass < 2; pass++) {
+        ASSERT_EQ(mchanger_get_slot_status(changer, 2, &status), MCHANGER_OK, "legacy slot status");
+        ASSERT(status.full, "slot 2 is full");
+    }
+    ASSERT(changer->internal.curdata_unsupported, "CURDATA marked unsupported");
+    ASSERT_EQ(mchanger_get_drive_status(changer, 1, &status), MCHANGER_OK, "legacy drive status");
+    ASSERT(!status.full, "drive 1 is empty");
+
+    uint16_t addrs[2] = { FAKE_FIRST_SLOT, FAKE_FIRST_SLOT + 1 };
+    MChangerElementStatus slots[2];
+    ASSERT_EQ(mchanger_get_bulk_status(changer, addrs, 2, FAKE_FIRST_DRIVE, &status, slots, NULL),
+              MCHANGER_OK, "legacy bulk status");
+    ASSERT(!slots[0].full && slots[1].full, "bulk status of both slots");
+
+    ASSERT_EQ(mchanger_get_slot_status_ex(changer, 2, MCHANGER_STATUS_CACHED, &status), MCHANGER_ERR_SCSI,
+              "strict CACHED fails without CURDATA");
+    ASSERT_EQ(mchanger_get_bulk_status_ex(changer, addrs, 2, 0, MCHANGER_STATUS_CACHED, NULL, slots, NULL),
+              MCHANGER_ERR_SCSI, "strict bulk CACHED fails without CURDATA");
+    ASSERT_EQ(mchanger_get_slot_status_ex(changer, 2, MCHANGER_STATUS_VERIFIED, &status), MCHANGER_OK,
+              "VERIFIED never needs CURDATA");
+
+    mchanger_close(changer);
+    PASS();
+}
+
+TEST(watch_diff_reports_changes_since_the_last_poll) {
+    Watch w;
+    memset(&w, 0, sizeof(w));
+    for (uint16_t i = 0; i < 3; i++) element_list_push(&w.map.slots, FAKE_FIRST_SLOT + i);
+    for (int k = 0; k < INVENTORY_KINDS; k++) {
+        w.states[k] = calloc(3, sizeof(ElementStatus));
+        w.fresh[k] = calloc(3, sizeof(ElementStatus));
+        ASSERT(w.states[k] && w.fresh[k], "allocate states");
+    }
+    ChangerHandle handle = {0};
+
+    /* First poll: only exceptions already present are reported */
+    w.fresh[1][1].full = true;
+    w.fresh[1][2].except = true;
+    watch_diff(&handle, &w, 1);
+    ASSERT_EQ(w.count, 1, "one event before priming");
+    ASSERT_EQ(w.events[0].type, MCHANGER_EVENT_EXCEPTION, "exception reported");
+    ASSERT_EQ(w.events[0].kind, MCHANGER_ELEMENT_SLOT, "on a slot");
+    ASSERT_EQ(w.events[0].index, 3, "slot 3");
+    ASSERT_EQ(w.events[0].address, FAKE_FIRST_SLOT + 2, "slot 3's address");
+    ASSERT(w.states[1][1].full && w.states[1][2].except, "fresh reads kept as the last seen");
+
+    /* Later polls report each change once */
+    w.primed = true;
+    w.count = 0;
+    memcpy(w.fresh[1], w.states[1], 3 * sizeof(ElementStatus));
+    w.fresh[1][0] = (ElementStatus){ .full = true, .valid_src = true, .src_addr = FAKE_FIRST_DRIVE };
+    w.fresh[1][1].full = false;
+    w.fresh[1][2].except = false;
+    watch_diff(&handle, &w, 1);
+    ASSERT_EQ(w.count, 3, "three events");
+    ASSERT(w.events[0].type == MCHANGER_EVENT_FILLED && w.events[0].index == 1, "slot 1 filled");
+    ASSERT_EQ(w.events[0].source_addr, FAKE_FIRST_DRIVE, "from the drive");
+    ASSERT(w.events[1].type == MCHANGER_EVENT_EMPTIED && w.events[1].index == 2, "slot 2 emptied");
+    ASSERT(w.events[2].type == MCHANGER_EVENT_EXCEPTION_CLEARED && w.events[2].index == 3,
+           "slot 3 exception cleared");
+
+    w.count = 0;
+    memcpy(w.fresh[1], w.states[1], 3 * sizeof(ElementStatus));
+    watch_diff(&handle, &w, 1);
+    ASSERT_EQ(w.count, 0, "nothing changed, nothing reported");
+    watch_free(&w);
+
+    /* A changer without CURDATA is still watched */
+    fake_reset(2, 1, 1);
+    fake.no_curdata = true;
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+    MChangerWatch *watch = mchanger_watch_open(changer);
+    ASSERT_NOT_NULL(watch, "watch without CURDATA");
+    MChangerEvent events[4];
+    size_t count = 1;
+    ASSERT_EQ(mchanger_watch_poll(watch, events, 4, &count), MCHANGER_OK, "first poll");
+    ASSERT_EQ(count, 0, "first poll primes");
+    fake_set(FAKE_FIRST_IE, true, 0);
+    ASSERT_EQ(mchanger_watch_poll(watch, events, 4, &count), MCHANGER_OK, "second poll");
+    ASSERT(count == 1 && events[0].type == MCHANGER_EVENT_FILLED && events[0].kind == MCHANGER_ELEMENT_IE,
+           "disc put in the I/E port");
+    mchanger_watch_close(watch);
+    mchanger_close(changer);
+    PASS();
+}
+
+TEST(door_locks_nest_and_release) {
+    fake_reset(4, 1, 0);
+    fake_set(FAKE_FIRST_SLOT, true, 0);
+    fake_set(FAKE_FIRST_SLOT + 1, true, 0);
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+    ChangerHandle *handle = &changer->internal;
+
+    door_lock(handle);
+    door_lock(handle);
+    ASSERT(handle->door_locks == 2 && fake.prevent == 1, "nested locks, one PREVENT");
+    ASSERT(g_door_holder == handle, "a second Ctrl-C would unlock this handle");
+    door_unlock(handle);
+    ASSERT(handle->door_locks == 1 && fake.prevent == 1, "still locked by the outer batch");
+    door_unlock(handle);
+    ASSERT(handle->door_locks == 0 && fake.prevent == 0, "unlocked by the last release");
+    ASSERT(g_door_holder == NULL, "nothing left for Ctrl-C to unlock");
+    door_unlock(handle);
+    ASSERT_EQ(handle->door_locks, 0, "an extra release does not go negative");
+
+    /* An API lock nests with the lock a batch takes */
+    ASSERT_EQ(mchanger_set_door_lock(changer, true), MCHANGER_OK, "lock through the API");
+    size_t made = 0;
+    ASSERT_EQ(mchanger_calibrate(changer, 4, &made), MCHANGER_OK, "calibrate");
+    ASSERT(made > 0, "calibration moved discs");
+    ASSERT(handle->door_locks == 1 && fake.prevent == 1, "calibration released only its own lock");
+    ASSERT_EQ(mchanger_set_door_lock(changer, false), MCHANGER_OK, "unlock through the API");
+    ASSERT(handle->door_locks == 0 && fake.prevent == 0, "door open again");
+    ASSERT_EQ(mchanger_set_door_lock(changer, false), MCHANGER_ERR_INVALID, "nothing left to unlock");
+
+    mchanger_close(changer);
+    ASSERT(g_door_holder == NULL, "closed handle forgotten");
+    PASS();
+}
+
+TEST(check_move_classifies_each_outcome) {
+    const uint16_t robot = FAKE_TRANSPORT, s1 = FAKE_FIRST_SLOT, s2 = s1 + 1, s3 = s1 + 2;
+    fake_reset(4, 1, 0);
+    fake_set(s1, true, 0);
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+    ChangerHandle *handle = &changer->internal;
+
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s1, s2), MCHANGER_OK, "clean move");
+    ASSERT(fake.moves == 1 && fake_full(s2), "confirmed without a retry");
+
+    fake.next_move = FAKE_MOVE_MISS;
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s2, s1), MCHANGER_OK, "missed pick");
+    ASSERT(fake.moves == 3 && fake_full(s1) && !fake_full(s2), "retried once and confirmed");
+
+    fake.next_move = FAKE_MOVE_IN_ROBOT;
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s1, s2), MCHANGER_ERR_SCSI, "disc left in the robot");
+    ASSERT(fake_full(s1) && !fake_full(robot), "returned to the source");
+
+    fake.next_move = FAKE_MOVE_NOT_SEATED;
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s1, s2), MCHANGER_ERR_STRANDED, "half-seated");
+
+    fake_reset(4, 1, 0);
+    fake_set(s1, true, 0);
+    fake.next_move = FAKE_MOVE_JAM;
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s1, s2), MCHANGER_ERR_STRANDED, "jammed in the robot");
+
+    fake_reset(4, 1, 0);
+    fake_set(s1, true, 0);
+    fake.next_move = FAKE_MOVE_NO_STATUS;
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s1, s2), MCHANGER_OK, "unverified move taken as made");
+
+    /* check_move() on its own, after a MOVE MEDIUM the device reported made */
+    uint8_t cdb[12] = { 0xA5 };
+    cdb[3] = robot & 0xFF;
+    cdb[4] = s1 >> 8;
+    cdb[5] = s1 & 0xFF;
+    cdb[6] = s2 >> 8;
+    cdb[7] = s2 & 0xFF;
+
+    fake_reset(4, 1, 0);
+    fake_set(s1, true, 0);
+    fake.next_move = FAKE_MOVE_MISS;
+    ASSERT_EQ(check_move(handle, cdb, robot, s1, s2), MOVE_MISSED, "missed twice");
+    ASSERT_EQ(fake.moves, 1, "only one retry");
+
+    fake_reset(4, 1, 0);
+    fake_set(s1, true, 0);
+    fake_set(s2, true, s3);
+    ASSERT_EQ(check_move(handle, cdb, robot, s1, s2), MOVE_MISSED, "destination filled from elsewhere");
+    ASSERT_EQ(fake.moves, 0, "no retry into a full destination");
+
+    fake_reset(4, 1, 0);
+    fake_set(s2, true, s1);
+    ASSERT_EQ(check_move(handle, cdb, robot, s1, s2), MOVE_CONFIRMED, "disc in the destination");
+    ASSERT_EQ(fake.moves, 0, "nothing to recover");
+
+    mchanger_close(changer);
+    PASS();
+}
+
+TEST(prefetch_wait_and_partial_status) {
+    fake_reset(4, 1, 1);
+    fake_set(FAKE_FIRST_SLOT, true, 0);
+    fake.res_delay_ms = 200;
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+    MChangerBoardSnapshot *snap = malloc(sizeof(*snap));
+    ASSERT_NOT_NULL(snap, "allocate snapshot");
+
+    ASSERT_EQ(mchanger_prefetch_wait(changer, 1), MCHANGER_ERR_BUSY, "timed out");
+    ASSERT_EQ(mchanger_get_prefetched_status(changer, snap), MCHANGER_ERR_NOT_FOUND, "no map yet");
+    ASSERT_EQ(snap->count, 0, "nothing to show");
+
+    for (int i = 0; i < 5000 && mchanger_prefetch_state(changer) == MCHANGER_PREFETCH_MAP; i++) usleep(1000);
+    ASSERT_EQ(mchanger_prefetch_state(changer), MCHANGER_PREFETCH_STATUS, "map read, status pending");
+    ASSERT_EQ(mchanger_get_prefetched_status(changer, snap), MCHANGER_ERR_BUSY, "partial");
+    ASSERT(snap->count == 7 && snap->total == 7, "every address from the map");
+    bool any_full = false;
+    for (size_t i = 0; i < snap->count; i++) any_full |= snap->elements[i].full;
+    ASSERT(!any_full, "every element empty until its status is read");
+
+    ASSERT_EQ(mchanger_prefetch_wait(changer, -1), MCHANGER_OK, "waited out");
+    ASSERT_EQ(mchanger_get_prefetched_status(changer, snap), MCHANGER_OK, "complete");
+    ASSERT(snap->count == 7 && snap->elements[3].address == FAKE_FIRST_SLOT && snap->elements[3].full,
+           "status filled in");
+
+    mchanger_close(changer);
+    free(snap);
+    PASS();
+}
+
+TEST(board_round_trips_through_shared_memory) {
+    char name[64];
+    snprintf(name, sizeof(name), "/mchanger.test.%d", (int)getpid());
+    fake_reset(4, 1, 1);
+    fake_set(FAKE_FIRST_SLOT, true, 0);
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+    ASSERT_EQ(mchanger_publish_board(changer, name), MCHANGER_OK, "publish");
+    MChangerBoard *board = mchanger_board_attach(name);
+    ASSERT_NOT_NULL(board, "attach");
+    MChangerBoardSnapshot *snap = malloc(sizeof(*snap));
+    ASSERT_NOT_NULL(snap, "allocate snapshot");
+
+    ASSERT_EQ(mchanger_board_read(board, snap), MCHANGER_OK, "read");
+    ASSERT(snap->count == 7 && snap->total == 7, "every element on the board");
+    ASSERT_EQ(snap->owner_pid, (int)getpid(), "published by this process");
+    ASSERT(snap->elements[0].kind == MCHANGER_ELEMENT_TRANSPORT && snap->elements[1].kind == MCHANGER_ELEMENT_DRIVE &&
+           snap->elements[2].kind == MCHANGER_ELEMENT_IE && snap->elements[3].kind == MCHANGER_ELEMENT_SLOT,
+           "slots listed last");
+    ASSERT(snap->elements[3].address == FAKE_FIRST_SLOT && snap->elements[3].full, "full slot");
+    uint64_t generation = snap->generation;
+
+    /* A move reaches readers without another publish */
+    ASSERT_EQ(mchanger_move_medium(changer, FAKE_TRANSPORT, FAKE_FIRST_SLOT, FAKE_FIRST_SLOT + 2), MCHANGER_OK,
+              "move");
+    ASSERT_EQ(mchanger_board_read(board, snap), MCHANGER_OK, "read after the move");
+    ASSERT_EQ(snap->generation, generation + 1, "move counted");
+    ASSERT(!snap->elements[3].full, "source emptied");
+    ASSERT(snap->elements[5].full && snap->elements[5].source_addr == FAKE_FIRST_SLOT, "destination filled");
+    mchanger_board_detach(board);
+    mchanger_close(changer);
+    ASSERT(mchanger_board_attach(name) == NULL, "closing the owner removes the board");
+
+    /* A library larger than the board loses its highest slots, and says so */
+    fake_reset(1100, 1, 1);
+    changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open large fake changer");
+    ASSERT_EQ(mchanger_publish_board(changer, name), MCHANGER_OK, "publish large");
+    board = mchanger_board_attach(name);
+    ASSERT_NOT_NULL(board, "attach large");
+    ASSERT_EQ(mchanger_board_read(board, snap), MCHANGER_OK, "read large");
+    ASSERT_EQ(snap->count, MCHANGER_BOARD_MAX_ELEMENTS, "board full");
+    ASSERT_EQ(snap->total, 1103, "every element counted");
+    ASSERT(snap->elements[1].kind == MCHANGER_ELEMENT_DRIVE && snap->elements[2].kind == MCHANGER_ELEMENT_IE,
+           "drive and I/E port kept");
+    mchanger_board_detach(board);
+    mchanger_close(changer);
+    free(snap);
+    PASS();
+}
+
+TEST(compare_and_move_conflicts_only_on_its_elements) {
+    fake_reset(6, 1, 0);
+    fake_set(FAKE_FIRST_SLOT, true, 0);
+    fake_set(FAKE_FIRST_SLOT + 1, true, 0);
+    MChangerHandle *changer = fake_open();
+    ASSERT_NOT_NULL(changer, "open fake changer");
+    const uint16_t robot = FAKE_TRANSPORT, s1 = FAKE_FIRST_SLOT, s2 = s1 + 1, s3 = s1 + 2, s4 = s1 + 3;
+
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s1, s3, NULL), MCHANGER_OK, "unchecked move");
+    MChangerMoveCheck check = { .generation = mchanger_get_generation(changer) };
+    ASSERT_EQ(check.generation, 1, "one move made");
+
+    /* A move between two other elements leaves the plan standing */
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s2, s4), MCHANGER_OK, "unrelated move");
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s3, s1, &check), MCHANGER_OK,
+              "no conflict from an unrelated move");
+    ASSERT(fake_full(s1) && !fake_full(s3), "moved back");
+
+    /* A move through the source since the plan is a conflict, even if it was undone */
+    check.generation = mchanger_get_generation(changer);
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s1, s3), MCHANGER_OK, "move out");
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s3, s1), MCHANGER_OK, "move back");
+    int moves = fake.moves;
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s1, s2, &check), MCHANGER_ERR_CONFLICT,
+              "source moved since the plan");
+    ASSERT_EQ(fake.moves, moves, "nothing moved on a conflict");
+
+    /* The elements themselves must still allow the move */
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s2, s3, NULL), MCHANGER_ERR_CONFLICT, "source empty");
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s1, s4, NULL), MCHANGER_ERR_CONFLICT, "destination full");
+
+    /* And the disc in the source must have come from where the caller thinks */
+    check = (MChangerMoveCheck){ .generation = mchanger_get_generation(changer), .origin = s2 };
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s1, s2, &check), MCHANGER_ERR_CONFLICT, "wrong origin");
+    check.origin = s3;
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s1, s2, &check), MCHANGER_OK, "origin matches");
+
+    /* Without per-element records, any move since the plan conflicts */
+    check = (MChangerMoveCheck){ .generation = mchanger_get_generation(changer) };
+    ASSERT_EQ(mchanger_move_medium(changer, robot, s4, s3), MCHANGER_OK, "unrelated move");
+    changer->internal.moves_untracked = true;
+    ASSERT_EQ(mchanger_compare_and_move(changer, robot, s2, s1, &check), MCHANGER_ERR_CONFLICT,
+              "untracked moves fall back to the handle's count");
+
+    mchanger_close(changer);
+    PASS();
+}
+
 /*
  * =============================================================================
  * Hardware Tests (require connected changer)
@@ -208,6 +1512,39 @@ TEST(get_drive_status) {
     PASS();
 }
 
+TEST(cached_and_verified_status_agree) {
+    if (!g_has_hardware) SKIP("no hardware");
+
+    MChangerElementStatus cached = {0}, verified = {0};
+    int rc = mchanger_get_slot_status_ex(g_changer, 1, MCHANGER_STATUS_CACHED, &cached);
+    ASSERT_EQ(rc, MCHANGER_OK, "cached read should succeed");
+    rc = mchanger_get_slot_status_ex(g_changer, 1, MCHANGER_STATUS_VERIFIED, &verified);
+    ASSERT_EQ(rc, MCHANGER_OK, "verified read should succeed");
+    ASSERT_EQ(cached.address, verified.address, "same element address");
+    ASSERT_EQ(cached.full, verified.full, "idle changer should report the same fullness");
+
+    PASS();
+}
+
+TEST(identify_disc_is_stable) {
+    if (!g_has_hardware) SKIP("no hardware");
+
+    MChangerElementStatus drive_st = {0};
+    ASSERT_EQ(mchanger_get_drive_status(g_changer, 1, &drive_st), MCHANGER_OK, "should get drive status");
+    if (!drive_st.full) SKIP("drive empty");
+
+    MChangerDiscId first, second;
+    int rc = mchanger_identify_disc(g_changer, 1, 30, &first);
+    if (rc == MCHANGER_ERR_NOT_FOUND) SKIP("drive not visible to IOKit");
+    ASSERT_EQ(rc, MCHANGER_OK, "identify should succeed");
+    ASSERT(strlen(first.fingerprint) == 16, "fingerprint is 16 hex digits");
+    ASSERT(first.track_count > 0, "at least one track");
+    ASSERT_EQ(mchanger_identify_disc(g_changer, 1, 30, &second), MCHANGER_OK, "identify again");
+    ASSERT(strcmp(first.fingerprint, second.fingerprint) == 0, "same disc, same fingerprint");
+
+    PASS();
+}
+
 TEST(load_same_slot_is_noop) {
     if (!g_has_hardware) SKIP("no hardware");
 
@@ -245,6 +1582,90 @@ TEST(load_same_slot_is_noop) {
     PASS();
 }
 
+static void *try_reserve(void *arg) {
+    uint16_t *addrs = arg;
+    static int rc;
+    rc = mchanger_reserve_elements(g_changer, addrs, 2, false);
+    if (rc == MCHANGER_OK) mchanger_release_elements(g_changer, addrs, 2);
+    return &rc;
+}
+
+TEST(reservations_conflict_only_on_shared_elements) {
+    if (!g_has_hardware) SKIP("no hardware");
+
+    MChangerElementMap map = {0};
+    ASSERT_EQ(mchanger_get_element_map(g_changer, &map), MCHANGER_OK, "should get map");
+    if (map.slot_count < 3 || map.drive_count < 1) {
+        mchanger_free_element_map(&map);
+        SKIP("need three slots and a drive");
+    }
+    uint16_t mine[2] = { map.drive_addrs[0], map.slot_addrs[0] };
+    uint16_t shared[2] = { map.slot_addrs[1], map.slot_addrs[0] };
+    uint16_t disjoint[2] = { map.slot_addrs[1], map.slot_addrs[2] };
+    mchanger_free_element_map(&map);
+
+    ASSERT_EQ(mchanger_reserve_elements(g_changer, mine, 2, false), MCHANGER_OK, "reserve");
+    ASSERT_EQ(mchanger_reserve_elements(g_changer, mine, 1, false), MCHANGER_OK, "reservations nest");
+    mchanger_release_elements(g_changer, mine, 1);
+
+    pthread_t thread;
+    void *result;
+    pthread_create(&thread, NULL, try_reserve, shared);
+    pthread_join(thread, &result);
+    int shared_rc = *(int *)result;
+    pthread_create(&thread, NULL, try_reserve, disjoint);
+    pthread_join(thread, &result);
+    int disjoint_rc = *(int *)result;
+    mchanger_release_elements(g_changer, mine, 2);
+
+    ASSERT_EQ(shared_rc, MCHANGER_ERR_BUSY, "another thread waits for a shared slot");
+    ASSERT_EQ(disjoint_rc, MCHANGER_OK, "disjoint slots are free");
+    pthread_create(&thread, NULL, try_reserve, shared);
+    pthread_join(thread, &result);
+    ASSERT_EQ(*(int *)result, MCHANGER_OK, "free once released");
+    PASS();
+}
+
+TEST(load_slot_auto_hits_loaded_disc) {
+    if (!g_has_hardware) SKIP("no hardware");
+
+    MChangerElementStatus drive_st = {0};
+    int rc = mchanger_get_drive_status(g_changer, 1, &drive_st);
+    ASSERT_EQ(rc, MCHANGER_OK, "should get drive status");
+    if (!drive_st.full || !drive_st.valid_source) {
+        SKIP("drive empty or no source info");
+    }
+
+    MChangerElementMap map = {0};
+    rc = mchanger_get_element_map(g_changer, &map);
+    ASSERT_EQ(rc, MCHANGER_OK, "should get map");
+    int source_slot = 0;
+    for (size_t i = 0; i < map.slot_count; i++) {
+        if (map.slot_addrs[i] == drive_st.source_addr) {
+            source_slot = (int)(i + 1);
+            break;
+        }
+    }
+    mchanger_free_element_map(&map);
+    if (source_slot == 0) {
+        SKIP("couldn't find source slot");
+    }
+
+    /* The loaded disc is a hit: same drive, no move */
+    ASSERT_EQ(mchanger_set_residency_policy(g_changer, MCHANGER_RESIDENCY_ARC), MCHANGER_OK, "set policy");
+    int drive = 0;
+    rc = mchanger_load_slot_auto(g_changer, source_slot, &drive);
+    ASSERT_EQ(rc, MCHANGER_OK, "auto load of loaded disc should succeed");
+    ASSERT_EQ(drive, 1, "should report the drive holding the disc");
+
+    MChangerResidencyStats stats;
+    mchanger_get_residency_stats(g_changer, &stats);
+    ASSERT_EQ(stats.hits, 1, "one hit");
+    ASSERT_EQ(stats.misses, 0, "no misses");
+
+    PASS();
+}
+
 /*
  * =============================================================================
  * Main
@@ -255,6 +1676,14 @@ int main(int argc, char **argv) {
     (void)argc;
     (void)argv;
 
+    /* Moves against the fake changer must not reach the user's motion log */
+    char motion[] = "/tmp/mchanger_motion_XXXXXX";
+    int motion_fd = mkstemp(motion);
+    if (motion_fd >= 0) {
+        close(motion_fd);
+        setenv("MCHANGER_MOTION", motion, 1);
+    }
+
     printf("mchanger library tests\n");
     printf("==========================\n\n");
 
@@ -287,8 +1716,30 @@ int main(int argc, char **argv) {
     RUN_TEST(close_null_safe);
     RUN_TEST(free_element_map_null_safe);
     RUN_TEST(api_null_changer_returns_invalid);
+    RUN_TEST(catalog_round_trip);
+    RUN_TEST(file_index_finds_files_by_name);
+    RUN_TEST(image_cache_lookup_and_evict);
+    RUN_TEST(job_queue_orders_by_arrival_until_a_disc_is_loaded);
+    RUN_TEST(job_queue_serves_urgent_classes_first);
+    RUN_TEST(plan_batch_checks_moves_and_tracks_layout);
+    RUN_TEST(placement_and_rebalance_plan_by_distance);
+    RUN_TEST(motion_model_estimates_plan_time);
+    RUN_TEST(idle_return_sends_discs_to_free_home_slots);
+    RUN_TEST(element_lists_map_addresses_and_indexes);
+    RUN_TEST(parse_slot_list_ranges_and_errors);
     RUN_TEST(api_invalid_slot_returns_invalid);
 
+    /* Fake changer tests */
+    printf("\nFake changer tests:\n");
+    RUN_TEST(storage_map_reads_pages_in_order);
+    RUN_TEST(legacy_status_falls_back_without_curdata);
+    RUN_TEST(watch_diff_reports_changes_since_the_last_poll);
+    RUN_TEST(door_locks_nest_and_release);
+    RUN_TEST(compare_and_move_conflicts_only_on_its_elements);
+    RUN_TEST(check_move_classifies_each_outcome);
+    RUN_TEST(prefetch_wait_and_partial_status);
+    RUN_TEST(board_round_trips_through_shared_memory);
+
     /* Hardware tests */
     printf("\nHardware tests:\n");
     RUN_TEST(open_and_close);
@@ -297,13 +1748,19 @@ int main(int argc, char **argv) {
     RUN_TEST(get_element_map);
     RUN_TEST(get_slot_status);
     RUN_TEST(get_drive_status);
+    RUN_TEST(cached_and_verified_status_agree);
+    RUN_TEST(identify_disc_is_stable);
     RUN_TEST(load_same_slot_is_noop);
+    RUN_TEST(load_slot_auto_hits_loaded_disc);
+    RUN_TEST(reservations_conflict_only_on_shared_elements);
 
     /* Cleanup */
     if (g_changer) {
         mchanger_close(g_changer);
     }
 
+    if (motion_fd >= 0) unlink(motion);
+
     /* Summary */
     printf("\n==========================\n");
     printf("Tests: %d | Passed: %d | Failed: %d | Skipped: %d\n",